@@ -0,0 +1,547 @@
+/*
+CPU core microbenchmarks
+
+usage: bench [--csv out.csv] [--baseline old.csv] [--tolerance percent] [--reps n] [--ticks n] [--trace file]
+
+Every workload fills the 64KB address space with a repeating instruction
+stream and lets PC wrap around, so gbcpu::tick() runs without any jumps.
+Streams only use implemented opcodes and every store writes back the value
+already at its address, so the code never modifies itself.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_TSC 1
+#else
+#define HAS_TSC 0
+#endif
+
+#include "../cpu.h"
+#include "../trace.h"
+#include "../apu.h"
+#include "../gameboy.h"
+#include "../runahead.h"
+#include "../link.h"
+#include "../lockstep.h"
+
+#define STACK_PAD 16 //NOPs kept at the top of memory for the stack workload
+#define T_CYCLES_PER_M_CYCLE 4
+#define GB_CLOCK_MHZ 4.194304
+
+struct instruction {
+	uint8_t bytes[3];
+	uint8_t length;
+	uint8_t cycles; //machine cycles spent in gbcpu::tick()
+};
+
+struct workload {
+	const char* name;
+	std::vector<instruction> stream;
+	bool shuffle; //pick instructions at random instead of in order
+	uint64_t frames; //0 for the fixed tick count
+	traceRing* tracer; //NULL unless the run is traced
+};
+
+struct result {
+	std::string name;
+	uint64_t ticks;
+	uint64_t instructions;
+	double seconds;
+	double emulatedMHz;
+	double nsPerInstruction;
+	double cyclesPerHostCycle;
+};
+
+static uint64_t hostCycles() {
+#if HAS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* small deterministic PRNG so runs are comparable */
+static uint32_t xorshift(uint32_t& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static std::vector<instruction> aluStream() {
+	std::vector<instruction> s;
+	s.push_back({ { 0x3E, 0x5A }, 2, 2 }); //LD A, d8
+	s.push_back({ { 0x06, 0x13 }, 2, 2 }); //LD B, d8
+	s.push_back({ { 0x0E, 0xC4 }, 2, 2 }); //LD C, d8
+	for (uint8_t op = 0x80; op < 0xC0; op++) {
+		if (op % 8 != 0x6) {
+			s.push_back({ { op }, 1, 1 }); //ADD/ADC/SUB/SBC/AND/XOR/OR/CP r
+		}
+	}
+	return s;
+}
+
+static std::vector<instruction> loadStoreStream() {
+	std::vector<instruction> s;
+	s.push_back({ { 0x21, 0xF0, 0xFF }, 3, 3 }); //LD HL, 0xFFF0
+	s.push_back({ { 0x01, 0xF1, 0xFF }, 3, 3 }); //LD BC, 0xFFF1
+	s.push_back({ { 0x7E }, 1, 2 }); //LD A, (HL)
+	s.push_back({ { 0x77 }, 1, 2 }); //LD (HL), A
+	s.push_back({ { 0x46 }, 1, 2 }); //LD B, (HL)
+	s.push_back({ { 0x70 }, 1, 2 }); //LD (HL), B
+	s.push_back({ { 0x01, 0xF1, 0xFF }, 3, 3 }); //LD BC, 0xFFF1
+	s.push_back({ { 0x0A }, 1, 2 }); //LD A, (BC)
+	s.push_back({ { 0x02 }, 1, 2 }); //LD (BC), A
+	s.push_back({ { 0xFA, 0xF2, 0xFF }, 3, 4 }); //LD A, (0xFFF2)
+	s.push_back({ { 0xEA, 0xF2, 0xFF }, 3, 4 }); //LD (0xFFF2), A
+	s.push_back({ { 0xF0, 0xF3 }, 2, 3 }); //LDH A, (0xF3)
+	s.push_back({ { 0xE0, 0xF3 }, 2, 3 }); //LDH (0xF3), A
+	s.push_back({ { 0x0E, 0xF4 }, 2, 2 }); //LD C, d8
+	s.push_back({ { 0xF2 }, 1, 2 }); //LD A, (C)
+	s.push_back({ { 0xE2 }, 1, 2 }); //LD (C), A
+	s.push_back({ { 0x36, 0x00 }, 2, 3 }); //LD (HL), d8 (top of memory is all NOPs)
+	return s;
+}
+
+static std::vector<instruction> stackStream() {
+	/* all registers stay zero and SP wraps into the NOP pad, so pushes never change memory */
+	std::vector<instruction> s;
+	s.push_back({ { 0x31, 0x00, 0x00 }, 3, 3 }); //LD SP, 0x0000
+	s.push_back({ { 0xC5 }, 1, 4 }); //PUSH BC
+	s.push_back({ { 0xD5 }, 1, 4 }); //PUSH DE
+	s.push_back({ { 0xD1 }, 1, 3 }); //POP DE
+	s.push_back({ { 0xE1 }, 1, 3 }); //POP HL
+	s.push_back({ { 0xE5 }, 1, 4 }); //PUSH HL
+	s.push_back({ { 0xF5 }, 1, 4 }); //PUSH AF
+	s.push_back({ { 0xC1 }, 1, 3 }); //POP BC
+	s.push_back({ { 0xF1 }, 1, 3 }); //POP AF
+	s.push_back({ { 0xF9 }, 1, 2 }); //LD SP, HL
+	s.push_back({ { 0xF8, 0x00 }, 2, 3 }); //LD HL, SP+0
+	return s;
+}
+
+static std::vector<instruction> mixedStream() {
+	/*
+	shuffled picks of ALU ops and loads defeat the host branch predictor,
+	stores are left out because H and L hold arbitrary values here
+	*/
+	std::vector<instruction> s = aluStream();
+	s.push_back({ { 0x21, 0xF0, 0xFF }, 3, 3 }); //LD HL, d16
+	s.push_back({ { 0x11, 0x34, 0x12 }, 3, 3 }); //LD DE, d16
+	s.push_back({ { 0x0A }, 1, 2 }); //LD A, (BC)
+	s.push_back({ { 0x1A }, 1, 2 }); //LD A, (DE)
+	s.push_back({ { 0x2A }, 1, 2 }); //LD A, (HL+)
+	s.push_back({ { 0x3A }, 1, 2 }); //LD A, (HL-)
+	s.push_back({ { 0xFA, 0x00, 0x80 }, 3, 4 }); //LD A, (d16)
+	s.push_back({ { 0xF0, 0x44 }, 2, 3 }); //LDH A, (d8)
+	s.push_back({ { 0xF2 }, 1, 2 }); //LD A, (C)
+	for (uint8_t op = 0x46; op < 0x80; op += 8) {
+		if (op != 0x76) {
+			s.push_back({ { op }, 1, 2 }); //LD r, (HL)
+		}
+	}
+	for (uint8_t op = 0x40; op < 0x80; op++) {
+		if ((op < 0x70 || op >= 0x78) && (op % 8 != 0x6)) {
+			s.push_back({ { op }, 1, 1 }); //LD r, r
+		}
+	}
+	return s;
+}
+
+/* lays the stream out over the whole address space and returns the machine cycles of one pass */
+static uint64_t fillMemory(uint8_t* memory, const workload& w, uint64_t& instructions) {
+	uint32_t rng = 0x9E3779B9;
+	uint32_t addr = 0;
+	uint64_t cycles = 0;
+	size_t next = 0;
+
+	instructions = 0;
+	memset(memory, 0, MEMORY_SIZE);
+
+	while (true) {
+		const instruction& in = w.shuffle ? w.stream[xorshift(rng) % w.stream.size()] : w.stream[next];
+		if (addr + in.length > MEMORY_SIZE - STACK_PAD) {
+			break;
+		}
+		memcpy(&memory[addr], in.bytes, in.length);
+		addr += in.length;
+		cycles += in.cycles;
+		instructions++;
+		next = (next + 1) % w.stream.size();
+	}
+
+	/* pad the rest with NOPs */
+	cycles += MEMORY_SIZE - addr;
+	instructions += MEMORY_SIZE - addr;
+	return cycles;
+}
+
+static result runWorkload(uint8_t* memory, const workload& w, uint64_t ticks, unsigned int reps) {
+	uint64_t instructionsPerPass;
+	uint64_t cyclesPerPass = fillMemory(memory, w, instructionsPerPass);
+
+	/* check the cycle table against the core: one pass plus the first fetch lands PC on 1 */
+	{
+		gbcpu gb(memory);
+		for (uint64_t i = 0; i < cyclesPerPass + 1; i++) {
+			gb.tick();
+		}
+		if (cpuView(gb).getPC() != 1) {
+			std::cout << "WARNING: cycle table for " << w.name << " disagrees with the core" << std::endl;
+		}
+		fillMemory(memory, w, instructionsPerPass);
+	}
+
+	if (w.frames != 0) {
+		ticks = w.frames * CYCLES_PER_FRAME;
+	}
+
+	result best = { w.name, ticks, 0, 1e30, 0, 0, 0 };
+	uint64_t bestHost = 0;
+
+	for (unsigned int r = 0; r < reps; r++) {
+		gbcpu gb(memory);
+		gb.setTracer(w.tracer, false);
+
+		auto start = std::chrono::steady_clock::now();
+		uint64_t hostStart = hostCycles();
+		for (uint64_t i = 0; i < ticks; i++) {
+			gb.tick();
+		}
+		uint64_t hostEnd = hostCycles();
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		if (seconds < best.seconds) {
+			best.seconds = seconds;
+			bestHost = hostEnd - hostStart;
+		}
+	}
+
+	best.instructions = ticks * instructionsPerPass / cyclesPerPass;
+	best.emulatedMHz = ticks * T_CYCLES_PER_M_CYCLE / best.seconds / 1e6;
+	best.nsPerInstruction = best.seconds * 1e9 / best.instructions;
+	best.cyclesPerHostCycle = bestHost ? static_cast<double>(ticks * T_CYCLES_PER_M_CYCLE) / bestHost : 0;
+	return best;
+}
+
+/* all four channels playing, reported as a share of the 16.74ms frame budget */
+static double apuFrameShare(unsigned int reps) {
+	const uint8_t writes[][2] = {
+		{ 0x26, 0x80 }, { 0x24, 0x77 }, { 0x25, 0xFF },
+		{ 0x10, 0x17 }, { 0x11, 0x80 }, { 0x12, 0xF3 }, { 0x13, 0x83 }, { 0x14, 0x87 }, //square with sweep
+		{ 0x16, 0x40 }, { 0x17, 0xF0 }, { 0x18, 0x00 }, { 0x19, 0x86 }, //square
+		{ 0x1A, 0x80 }, { 0x1C, 0x20 }, { 0x1D, 0x00 }, { 0x1E, 0x86 }, //wave
+		{ 0x21, 0xF0 }, { 0x22, 0x11 }, { 0x23, 0x80 } //noise
+	};
+	const unsigned int frames = 600;
+	double best = 1e30;
+
+	for (unsigned int r = 0; r < reps; r++) {
+		uint8_t* memory = new uint8_t[MEMORY_SIZE];
+		memset(memory, 0, MEMORY_SIZE);
+		for (int i = 0; i < 16; i++) {
+			memory[0xFF30 + i] = static_cast<uint8_t>(i * 17);
+		}
+
+		audioRing ring(4096);
+		apu sound(memory, &ring);
+		int16_t drain[4096 * AUDIO_CHANNELS];
+
+		auto start = std::chrono::steady_clock::now();
+		for (auto& w : writes) {
+			memory[0xFF00 | w[0]] = w[1];
+			sound.ioWrite(0xFF00 | w[0], w[1], 0);
+		}
+		for (unsigned int f = 1; f <= frames; f++) {
+			sound.endFrame(static_cast<uint64_t>(f) * CYCLES_PER_FRAME);
+			ring.read(drain, 4096);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (seconds < best) {
+			best = seconds;
+		}
+		delete[] memory;
+	}
+
+	return 100.0 * (best / frames) / (1.0 / 59.73);
+}
+
+/* state save and load cost on the frame workload and how many frames ahead fit in the budget */
+static void runAheadCost(unsigned int reps) {
+	const unsigned int frames = 600;
+	workload w = { "runahead", mixedStream(), true, 0, NULL };
+	int16_t drain[AUDIO_BUFFER_FRAMES * AUDIO_CHANNELS];
+	double save = 1e30;
+	double load = 1e30;
+	double frame = 1e30;
+
+	for (unsigned int r = 0; r < reps; r++) {
+		gameboy gb;
+		uint64_t instructions;
+		fillMemory(gb.getMemory(), w, instructions);
+
+		runAhead ahead(gb, 1);
+		for (unsigned int f = 0; f < frames; f++) {
+			ahead.runFrame();
+			gb.getAudio().read(drain, AUDIO_BUFFER_FRAMES);
+		}
+
+		if (ahead.getSaveMicros() + ahead.getLoadMicros() < save + load) {
+			save = ahead.getSaveMicros();
+			load = ahead.getLoadMicros();
+		}
+		if (ahead.getRealMicros() < frame) {
+			frame = ahead.getRealMicros();
+		}
+	}
+
+	double budget = 1e6 / 59.7275;
+	int fit = static_cast<int>((budget - frame - save - load) / frame);
+	if (fit > RUNAHEAD_MAX_FRAMES) {
+		fit = RUNAHEAD_MAX_FRAMES;
+	}
+	printf("runahead   save %.1fus, load %.1fus per host frame, %d frames ahead fit in the budget\n", save, load, fit);
+}
+
+/* a linked pair against two unlinked consoles on two threads, as a share of their speed */
+static double linkShare(unsigned int reps) {
+	const uint32_t frames = 600;
+	workload w = { "link", mixedStream(), true, 0, NULL };
+	double unlinked = 1e30;
+	double linked = 1e30;
+
+	for (unsigned int r = 0; r < reps; r++) {
+		gameboy a;
+		gameboy b;
+		uint64_t instructions;
+		fillMemory(a.getMemory(), w, instructions);
+		fillMemory(b.getMemory(), w, instructions);
+
+		auto start = std::chrono::steady_clock::now();
+		std::thread other([&b]() {
+			for (uint32_t f = 0; f < frames; f++) {
+				b.runFrame();
+			}
+		});
+		for (uint32_t f = 0; f < frames; f++) {
+			a.runFrame();
+		}
+		other.join();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds < unlinked) {
+			unlinked = seconds;
+		}
+
+		linkCable cable(a, b);
+		start = std::chrono::steady_clock::now();
+		cable.runFrames(frames);
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds < linked) {
+			linked = seconds;
+		}
+	}
+
+	return 100.0 * unlinked / linked;
+}
+
+/* LOCKSTEP_LANES copies of a workload in the lockstep engine against the same CPUs run one after another */
+static void lockstepShare(const workload& w, unsigned int reps) {
+	const uint64_t cycles = 2000000;
+	uint8_t* memory[LOCKSTEP_LANES];
+	gbcpu* cpus[LOCKSTEP_LANES];
+	double independent = 1e30;
+	double together = 1e30;
+	double utilisation = 0;
+	double share = 0;
+
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		uint64_t instructions;
+		memory[l] = new uint8_t[MEMORY_SIZE];
+		fillMemory(memory[l], w, instructions);
+	}
+
+	for (unsigned int r = 0; r < reps; r++) {
+		for (int l = 0; l < LOCKSTEP_LANES; l++) {
+			cpus[l] = new gbcpu(memory[l]);
+		}
+		auto start = std::chrono::steady_clock::now();
+		for (int l = 0; l < LOCKSTEP_LANES; l++) {
+			cpus[l]->run(cycles);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds < independent) {
+			independent = seconds;
+		}
+		for (int l = 0; l < LOCKSTEP_LANES; l++) {
+			delete cpus[l];
+			cpus[l] = new gbcpu(memory[l]);
+		}
+
+		lockstep engine(cpus, memory, LOCKSTEP_LANES);
+		start = std::chrono::steady_clock::now();
+		engine.run(cycles);
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds < together) {
+			together = seconds;
+		}
+		utilisation = engine.getUtilisation();
+		share = engine.getVectorShare();
+		for (int l = 0; l < LOCKSTEP_LANES; l++) {
+			delete cpus[l];
+		}
+	}
+
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		delete[] memory[l];
+	}
+	printf("lockstep   %-10s %5.2fx independent CPUs, %.1f%% lane utilisation, %.1f%% vectorised\n", w.name,
+		independent / together, 100.0 * utilisation, 100.0 * share);
+}
+
+static void writeCSV(std::ostream& out, const std::vector<result>& results) {
+	out << "workload,ticks,instructions,seconds,emulated_mhz,ns_per_instruction,cycles_per_host_cycle" << std::endl;
+	for (const result& r : results) {
+		out << r.name << "," << r.ticks << "," << r.instructions << "," << r.seconds << "," << r.emulatedMHz << ","
+			<< r.nsPerInstruction << "," << r.cyclesPerHostCycle << std::endl;
+	}
+}
+
+static std::vector<result> readCSV(const char* filename) {
+	std::vector<result> results;
+	std::ifstream inp(filename);
+	if (!inp) {
+		std::cout << "ERROR: failed to open baseline " << filename << std::endl;
+		return results;
+	}
+
+	std::string line;
+	std::getline(inp, line); //header
+	while (std::getline(inp, line)) {
+		std::stringstream ss(line);
+		std::string field[7];
+		for (int i = 0; i < 7; i++) {
+			std::getline(ss, field[i], ',');
+		}
+		if (field[0].empty()) {
+			continue;
+		}
+
+		result r;
+		r.name = field[0];
+		r.ticks = std::strtoull(field[1].c_str(), NULL, 10);
+		r.instructions = std::strtoull(field[2].c_str(), NULL, 10);
+		r.seconds = std::atof(field[3].c_str());
+		r.emulatedMHz = std::atof(field[4].c_str());
+		r.nsPerInstruction = std::atof(field[5].c_str());
+		r.cyclesPerHostCycle = std::atof(field[6].c_str());
+		results.push_back(r);
+	}
+	return results;
+}
+
+int main(int argc, char** argv) {
+	const char* csvFile = NULL;
+	const char* baselineFile = NULL;
+	const char* traceFile = NULL;
+	double tolerance = 10.0; //percent
+	unsigned int reps = 5;
+	uint64_t ticks = 20000000;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--csv" && i + 1 < argc) {
+			csvFile = argv[++i];
+		}
+		else if (arg == "--baseline" && i + 1 < argc) {
+			baselineFile = argv[++i];
+		}
+		else if (arg == "--tolerance" && i + 1 < argc) {
+			tolerance = std::atof(argv[++i]);
+		}
+		else if (arg == "--reps" && i + 1 < argc) {
+			reps = std::atoi(argv[++i]);
+		}
+		else if (arg == "--ticks" && i + 1 < argc) {
+			ticks = std::strtoull(argv[++i], NULL, 10);
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			traceFile = argv[++i];
+		}
+		else {
+			std::cout << "usage: " << argv[0] << " [--csv out.csv] [--baseline old.csv] [--tolerance percent] [--reps n] [--ticks n] [--trace file]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<workload> workloads;
+	workloads.push_back({ "alu", aluStream(), false, 0, NULL });
+	workloads.push_back({ "loadstore", loadStoreStream(), false, 0, NULL });
+	workloads.push_back({ "stack", stackStream(), false, 0, NULL });
+	workloads.push_back({ "branchy", mixedStream(), true, 0, NULL });
+	workloads.push_back({ "frame", mixedStream(), true, 600, NULL }); //10 seconds of emulated time
+
+	traceRecorder recorder;
+	if (traceFile && recorder.open(traceFile)) {
+		workloads.push_back({ "frametrace", mixedStream(), true, 600, recorder.openRing() });
+	}
+
+	uint8_t* memory = new uint8_t[MEMORY_SIZE];
+	std::vector<result> results;
+
+	for (const workload& w : workloads) {
+		results.push_back(runWorkload(memory, w, ticks, reps));
+	}
+	delete[] memory;
+	recorder.close();
+
+	printf("%-10s %10s %10s %12s %10s\n", "workload", "MHz", "ns/instr", "cyc/host cyc", "realtime");
+	for (const result& r : results) {
+		printf("%-10s %10.2f %10.2f %12.4f %9.1fx\n", r.name.c_str(), r.emulatedMHz, r.nsPerInstruction,
+			r.cyclesPerHostCycle, r.emulatedMHz / GB_CLOCK_MHZ);
+	}
+
+	printf("apu        %9.2f%% of the frame budget\n", apuFrameShare(reps));
+	runAheadCost(reps);
+	printf("link       %9.2f%% of the speed of two unlinked consoles\n", linkShare(reps));
+	lockstepShare(workloads[0], reps);
+	lockstepShare(workloads[3], reps);
+
+	if (csvFile) {
+		std::ofstream out(csvFile);
+		writeCSV(out, results);
+	}
+
+	int status = 0;
+	if (baselineFile) {
+		std::vector<result> baseline = readCSV(baselineFile);
+		for (const result& r : results) {
+			for (const result& b : baseline) {
+				if (b.name != r.name || b.nsPerInstruction <= 0) {
+					continue;
+				}
+				double change = 100.0 * (r.nsPerInstruction - b.nsPerInstruction) / b.nsPerInstruction;
+				printf("%-10s %+7.1f%% ns/instr vs baseline%s\n", r.name.c_str(), change, (change > tolerance) ? "  REGRESSION" : "");
+				if (change > tolerance) {
+					status = 2;
+				}
+			}
+		}
+	}
+
+	return status;
+}
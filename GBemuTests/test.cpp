@@ -1,17 +1,49 @@
 #include "pch.h"
 
 #include "../cpu.h"
-
-cpuDebugger* runAndDebug(uint8_t* memory, uint64_t cycles) {
-	gbcpu* gb = new gbcpu(memory);
-	
-	for (uint64_t i = 0; i < cycles;  i++) {
-		gb->tick();
-	}
-	
-	cpuDebugger* debugger = new cpuDebugger(*gb);
-	delete gb;
-	return debugger;
+#include "../trace.h"
+#include "../gameboy.h"
+#include "../pacing.h"
+#include "../runahead.h"
+#include "../netplay.h"
+#include "../link.h"
+#include "../ppu.h"
+#include "../gbenv.h"
+#include "../lockstep.h"
+#include "../frameshare.h"
+#include "../recorder.h"
+#include "../movie.h"
+#include "../conformance.h"
+#include "../romtest.h"
+#include "../golden.h"
+#include "../screen.h"
+#include "../utils.h"
+#include "../profiler.h"
+#include "../cdl.h"
+#include "../probe.h"
+
+#include <thread>
+#include <fstream>
+#include <sstream>
+
+/* cpuDebugger keeps a pointer to its target, so the CPU lives as long as the debugger */
+struct heldCPU {
+	gbcpu cpu;
+	heldCPU(uint8_t* memory) : cpu(memory) {}
+};
+
+class debugRun : private heldCPU, public cpuDebugger {
+	public:
+		debugRun(uint8_t* memory, uint64_t cycles) : heldCPU(memory), cpuDebugger(this->cpu) {
+			for (uint64_t i = 0; i < cycles; i++) {
+				this->cpu.tick();
+			}
+			this->refresh();
+		}
+};
+
+debugRun* runAndDebug(uint8_t* memory, uint64_t cycles) {
+	return new debugRun(memory, cycles);
 }
 
 TEST(CPUDebugger, getAllRegisters) {
@@ -53,7 +85,7 @@ all values past array[1] will be initialized to 0 automatically
 
 TEST(NOP, PCvalue) { //0x00
 	uint8_t memory[4] = { 0 };
-	cpuDebugger* results = runAndDebug(memory, 3);
+	debugRun* results = runAndDebug(memory, 3);
 
 	EXPECT_EQ(results->PC, 3);
 	delete results;
@@ -61,7 +93,7 @@ TEST(NOP, PCvalue) { //0x00
 
 TEST(LD_BC_d16, Load_0xFFFF) { //0x01
 	uint8_t memory[5] = { 0x01, 0xFF, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 4);
+	debugRun* results = runAndDebug(memory, 4);
 
 	EXPECT_EQ(results->BC.full, 0xFFFF);
 	delete results;
@@ -69,7 +101,7 @@ TEST(LD_BC_d16, Load_0xFFFF) { //0x01
 
 TEST(LD_BC_ptr_A, Load_255) { //0x02
 	uint8_t memory[1024] = { 0x06, 0x01, 0x0E, 0xFF, 0x3E, 0xFF, 0x02 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x1FF], 0xFF);
 	delete results;
@@ -77,7 +109,7 @@ TEST(LD_BC_ptr_A, Load_255) { //0x02
 
 TEST(LD_B_d8, Load_255) { //0x06
 	uint8_t memory[2] = { 0x06, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 3);
+	debugRun* results = runAndDebug(memory, 3);
 
 	EXPECT_EQ(results->BC.half[1], 0xFF);
 	delete results;
@@ -85,7 +117,7 @@ TEST(LD_B_d8, Load_255) { //0x06
 
 TEST(LD_a16_ptr_SP, Load_0xFFFF_to_0x1A0_LSB) { //0x08
 	uint8_t memory[512] = { 0x31, 0xFF, 0xFF, 0x08, 0xA0, 0x01 };
-	cpuDebugger* results = runAndDebug(memory, 30);
+	debugRun* results = runAndDebug(memory, 30);
 
 	EXPECT_EQ(memory[0x1A0], 0xFF);
 	delete results;
@@ -93,7 +125,7 @@ TEST(LD_a16_ptr_SP, Load_0xFFFF_to_0x1A0_LSB) { //0x08
 
 TEST(LD_a16_ptr_SP, Load_0xFFFF_to_0x1A0_MSB) { //0x08
 	uint8_t memory[512] = { 0x31, 0xFF, 0xFF, 0x08, 0xA0, 0x01 };
-	cpuDebugger* results = runAndDebug(memory, 30);
+	debugRun* results = runAndDebug(memory, 30);
 
 	EXPECT_EQ(memory[0x1A1], 0xFF);
 	delete results;
@@ -102,14 +134,14 @@ TEST(LD_a16_ptr_SP, Load_0xFFFF_to_0x1A0_MSB) { //0x08
 TEST(LD_A_BC_ptr, Load_255) { //0x0A
 	uint8_t memory[1024] = { 0x06, 0x01, 0x0E, 0xFF, 0x0A };
 	memory[0x01FF] = 0xFF;
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->AF.half[1], 0xFF);
 }
 
 TEST(LC_C_d8, Load_255) { //0x0E
 	uint8_t memory[2] = { 0x0E, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 3);
+	debugRun* results = runAndDebug(memory, 3);
 
 	EXPECT_EQ(results->BC.half[0], 0xFF);
 	delete results;
@@ -117,7 +149,7 @@ TEST(LC_C_d8, Load_255) { //0x0E
 
 TEST(LD_DE_d16, Load_0xFFFF) { //0x11
 	uint8_t memory[5] = { 0x11, 0xFF, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 4);
+	debugRun* results = runAndDebug(memory, 4);
 
 	EXPECT_EQ(results->DE.full, 0xFFFF);
 	delete results;
@@ -125,7 +157,7 @@ TEST(LD_DE_d16, Load_0xFFFF) { //0x11
 
 TEST(LD_DE_ptr_A, Load_255) { //0x12
 	uint8_t memory[1024] = { 0x16, 0x01, 0x1E, 0xFF, 0x3E, 0xFF, 0x12 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x1FF], 0xFF);
 	delete results;
@@ -133,7 +165,7 @@ TEST(LD_DE_ptr_A, Load_255) { //0x12
 
 TEST(LD_D_d8, Load_255) { //0x16
 	uint8_t memory[2] = { 0x16, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 3);
+	debugRun* results = runAndDebug(memory, 3);
 
 	EXPECT_EQ(results->DE.half[1], 0xFF);
 	delete results;
@@ -142,14 +174,14 @@ TEST(LD_D_d8, Load_255) { //0x16
 TEST(LD_A_DE_ptr, Load_255) { //0x1A
 	uint8_t memory[1024] = { 0x16, 0x01, 0x1E, 0xFF, 0x1A };
 	memory[0x01FF] = 0xFF;
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->AF.half[1], 0xFF);
 }
 
 TEST(LD_E_d8, Load_255) { //0x1E
 	uint8_t memory[2] = { 0x1E, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 3);
+	debugRun* results = runAndDebug(memory, 3);
 
 	EXPECT_EQ(results->DE.half[0], 0xFF);
 	delete results;
@@ -157,7 +189,7 @@ TEST(LD_E_d8, Load_255) { //0x1E
 
 TEST(LD_HL_d16, Load_0xFFFF) { //0x21
 	uint8_t memory[5] = { 0x21, 0xFF, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 4);
+	debugRun* results = runAndDebug(memory, 4);
 
 	EXPECT_EQ(results->HL.full, 0xFFFF);
 	delete results;
@@ -165,7 +197,7 @@ TEST(LD_HL_d16, Load_0xFFFF) { //0x21
 
 TEST(LD_HL_inc_ptr_A, Load_to_255_check_registers) { //0x22
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x3E, 0xA0, 0x22 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xA000000000000100);
 	delete results;
@@ -173,7 +205,7 @@ TEST(LD_HL_inc_ptr_A, Load_to_255_check_registers) { //0x22
 
 TEST(LD_HL_inc_ptr_A, Load_to_255_check_memory) { //0x22
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x3E, 0xA0, 0x22 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[255], 0xA0);
 	delete results;
@@ -181,7 +213,7 @@ TEST(LD_HL_inc_ptr_A, Load_to_255_check_memory) { //0x22
 
 TEST(LD_H_d8, Load_255) { //0x26
 	uint8_t memory[2] = { 0x26, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 3);
+	debugRun* results = runAndDebug(memory, 3);
 
 	EXPECT_EQ(results->HL.half[1], 0xFF);
 	delete results;
@@ -190,7 +222,7 @@ TEST(LD_H_d8, Load_255) { //0x26
 TEST(LD_A_HL_inc_ptr, Load_from_0xFF_check_registers) { //0x2A
 	uint8_t memory[300] = {0x2E, 0xFF, 0x2A};
 	memory[255] = 0xA0;
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xA000000000000100);
 	delete results;
@@ -198,7 +230,7 @@ TEST(LD_A_HL_inc_ptr, Load_from_0xFF_check_registers) { //0x2A
 
 TEST(LD_L_d8, Load_255) { //0x2E
 	uint8_t memory[2] = { 0x2E, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 3);
+	debugRun* results = runAndDebug(memory, 3);
 
 	EXPECT_EQ(results->HL.half[0], 0xFF);
 	delete results;
@@ -206,7 +238,7 @@ TEST(LD_L_d8, Load_255) { //0x2E
 
 TEST(LD_SP_d16, Load_0xFFFF) { //0x31
 	uint8_t memory[5] = { 0x31, 0xFF, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 4);
+	debugRun* results = runAndDebug(memory, 4);
 
 	EXPECT_EQ(results->SP, 0xFFFF);
 	delete results;
@@ -214,7 +246,7 @@ TEST(LD_SP_d16, Load_0xFFFF) { //0x31
 
 TEST(LD_HL_dec_ptr_A, Load_to_255_check_registers) { //0x32
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x3E, 0xA0, 0x32 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xA0000000000000FE);
 	delete results;
@@ -222,7 +254,7 @@ TEST(LD_HL_dec_ptr_A, Load_to_255_check_registers) { //0x32
 
 TEST(LD_HL_dec_ptr_A, Load_to_255_check_memory) { //0x32
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x3E, 0xA0, 0x32 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[255], 0xA0);
 	delete results;
@@ -230,7 +262,7 @@ TEST(LD_HL_dec_ptr_A, Load_to_255_check_memory) { //0x32
 
 TEST(LD_HL_ptr_d8, LOAD_255) { //0x36
 	uint8_t memory[1024] = { 0x26, 0x01, 0x2E, 0xA0, 0x36, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 30);
+	debugRun* results = runAndDebug(memory, 30);
 
 	EXPECT_EQ(memory[0x01A0], 0xFF);
 	delete results;
@@ -239,7 +271,7 @@ TEST(LD_HL_ptr_d8, LOAD_255) { //0x36
 TEST(LD_A_HL_dec_ptr, Load_from_0xFF_check_registers) { //0x3A
 	uint8_t memory[300] = { 0x2E, 0xFF, 0x3A };
 	memory[255] = 0xA0;
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xA0000000000000FE);
 	delete results;
@@ -247,7 +279,7 @@ TEST(LD_A_HL_dec_ptr, Load_from_0xFF_check_registers) { //0x3A
 
 TEST(LD_A_d8, Load_255) { //0x3E
 	uint8_t memory[2] = { 0x3E, 0xFF };
-	cpuDebugger* results = runAndDebug(memory, 3);
+	debugRun* results = runAndDebug(memory, 3);
 
 	EXPECT_EQ(results->AF.half[1], 0xFF);
 	delete results;
@@ -255,7 +287,7 @@ TEST(LD_A_d8, Load_255) { //0x3E
 
 TEST(LD_x_B, LOAD_255) {
 	uint8_t memory[] = { 0x06, 0xFF, 0x40, 0x50, 0x60, 0x48, 0x58, 0x68, 0x78 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xFF00FFFFFFFFFFFF);
 	delete results;
@@ -263,7 +295,7 @@ TEST(LD_x_B, LOAD_255) {
 
 TEST(LD_x_C, LOAD_255) {
 	uint8_t memory[] = { 0x0E, 0xFF, 0x41, 0x51, 0x61, 0x49, 0x59, 0x69, 0x79 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xFF00FFFFFFFFFFFF);
 	delete results;
@@ -271,7 +303,7 @@ TEST(LD_x_C, LOAD_255) {
 
 TEST(LD_x_D, LOAD_255) {
 	uint8_t memory[] = { 0x16, 0xFF, 0x42, 0x52, 0x62, 0x4A, 0x5A, 0x6A, 0x7A };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xFF00FFFFFFFFFFFF);
 	delete results;
@@ -279,7 +311,7 @@ TEST(LD_x_D, LOAD_255) {
 
 TEST(LD_x_E, LOAD_255) {
 	uint8_t memory[] = { 0x1E, 0xFF, 0x43, 0x53, 0x63, 0x4B, 0x5B, 0x6B, 0x7B };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xFF00FFFFFFFFFFFF);
 	delete results;
@@ -287,7 +319,7 @@ TEST(LD_x_E, LOAD_255) {
 
 TEST(LD_x_H, LOAD_255) {
 	uint8_t memory[] = { 0x26, 0xFF, 0x44, 0x54, 0x64, 0x4C, 0x5C, 0x6C, 0x7C };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xFF00FFFFFFFFFFFF);
 	delete results;
@@ -295,7 +327,7 @@ TEST(LD_x_H, LOAD_255) {
 
 TEST(LD_x_L, LOAD_255) {
 	uint8_t memory[] = { 0x2E, 0xFF, 0x45, 0x55, 0x65, 0x4D, 0x5D, 0x6D, 0x7D };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xFF00FFFFFFFFFFFF);
 	delete results;
@@ -303,7 +335,7 @@ TEST(LD_x_L, LOAD_255) {
 
 TEST(LD_x_A, LOAD_255) {
 	uint8_t memory[] = { 0x3E, 0xFF, 0x47, 0x57, 0x67, 0x4F, 0x5F, 0x6F, 0x7F };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xFF00FFFFFFFFFFFF);
 	delete results;
@@ -312,7 +344,7 @@ TEST(LD_x_A, LOAD_255) {
 TEST(LD_x_HL_ptr, LOAD_FROM_ADDR_255) {
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x46, 0x56, 0x4E, 0x5E, 0x7E };
 	memory[255] = 0x40;
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(results->getAllRegisters(), 0x40004040404000FF);
 	delete results;
@@ -320,7 +352,7 @@ TEST(LD_x_HL_ptr, LOAD_FROM_ADDR_255) {
 
 TEST(LD_HL_ptr_B, LOAD_64) { //0x70
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x06, 0x40, 0x70};
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[255], 0x40);
 	delete results;
@@ -328,7 +360,7 @@ TEST(LD_HL_ptr_B, LOAD_64) { //0x70
 
 TEST(LD_HL_ptr_C, LOAD_64) { //0x71
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x0E, 0x40, 0x71 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[255], 0x40);
 	delete results;
@@ -336,7 +368,7 @@ TEST(LD_HL_ptr_C, LOAD_64) { //0x71
 
 TEST(LD_HL_ptr_D, LOAD_64) { //0x72
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x16, 0x40, 0x72 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[255], 0x40);
 	delete results;
@@ -344,7 +376,7 @@ TEST(LD_HL_ptr_D, LOAD_64) { //0x72
 
 TEST(LD_HL_ptr_E, LOAD_64) { //0x73
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x1E, 0x40, 0x73 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[255], 0x40);
 	delete results;
@@ -352,7 +384,7 @@ TEST(LD_HL_ptr_E, LOAD_64) { //0x73
 
 TEST(LD_HL_ptr_H, LOAD_64) { //0x74
 	uint8_t memory[65536] = { 0x2E, 0xFF, 0x26, 0x40, 0x74 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[0x40FF], 0x40);
 	delete results;
@@ -360,7 +392,7 @@ TEST(LD_HL_ptr_H, LOAD_64) { //0x74
 
 TEST(LD_HL_ptr_L, LOAD_64) { //0x75
 	uint8_t memory[65536] = { 0x2E, 0xFF, 0x26, 0x40, 0x75 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[0x40FF], 0xFF);
 	delete results;
@@ -368,7 +400,7 @@ TEST(LD_HL_ptr_L, LOAD_64) { //0x75
 
 TEST(LD_HL_ptr_A, LOAD_64) { //0x77
 	uint8_t memory[256] = { 0x2E, 0xFF, 0x3E, 0x40, 0x77 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[255], 0x40);
 	delete results;
@@ -376,7 +408,7 @@ TEST(LD_HL_ptr_A, LOAD_64) { //0x77
 
 TEST(POP_BC, check_registers_are_same) { //0xC1
 	uint8_t memory[256] = { 0x31, 0x80, 0x00, 0x01, 0xB0, 0xA0, 0xC5, 0x01, 0x00, 0x00, 0xC1 };
-	cpuDebugger* results = runAndDebug(memory, 30);
+	debugRun* results = runAndDebug(memory, 30);
 
 	EXPECT_EQ(results->getAllRegisters(), 0x0000A0B000000000);
 	delete results;
@@ -384,7 +416,7 @@ TEST(POP_BC, check_registers_are_same) { //0xC1
 
 TEST(PUSH_BC, Push_to_0x40_check_MSB) { //0xC5
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0x01, 0xC0, 0xB0, 0xC5 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x3F], 0xB0);
 	delete results;
@@ -392,7 +424,7 @@ TEST(PUSH_BC, Push_to_0x40_check_MSB) { //0xC5
 
 TEST(PUSH_BC, Push_to_0x40_check_LSB) { //0xC5
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0x01, 0xC0, 0xB0, 0xC5 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x3E], 0xC0);
 	delete results;
@@ -400,7 +432,7 @@ TEST(PUSH_BC, Push_to_0x40_check_LSB) { //0xC5
 
 TEST(POP_DE, check_registers_are_same) { //0xD1
 	uint8_t memory[256] = { 0x31, 0x80, 0x00, 0x11, 0xB0, 0xA0, 0xD5, 0x11, 0x00, 0x00, 0xD1 };
-	cpuDebugger* results = runAndDebug(memory, 30);
+	debugRun* results = runAndDebug(memory, 30);
 
 	EXPECT_EQ(results->getAllRegisters(), 0x00000000A0B00000);
 	delete results;
@@ -408,7 +440,7 @@ TEST(POP_DE, check_registers_are_same) { //0xD1
 
 TEST(PUSH_DE, Push_to_0x40_check_MSB) { //0xD5
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0x11, 0xC0, 0xB0, 0xD5 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x3F], 0xB0);
 	delete results;
@@ -416,7 +448,7 @@ TEST(PUSH_DE, Push_to_0x40_check_MSB) { //0xD5
 
 TEST(PUSH_DE, Push_to_0x40_check_LSB) { //0xD5
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0x11, 0xC0, 0xB0, 0xD5 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x3E], 0xC0);
 	delete results;
@@ -424,7 +456,7 @@ TEST(PUSH_DE, Push_to_0x40_check_LSB) { //0xD5
 
 TEST(LDH_n_ptr_A, Load_to_0xFFFF) { //0xE0
 	uint8_t memory[65536] = {0x3E, 0xA0, 0xE0, 0xFF};
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[0xFFFF], 0xA0);
 	delete results;
@@ -432,7 +464,7 @@ TEST(LDH_n_ptr_A, Load_to_0xFFFF) { //0xE0
 
 TEST(POP_HL, check_registers_are_same) { //0xE1
 	uint8_t memory[256] = { 0x31, 0x80, 0x00, 0x21, 0xB0, 0xA0, 0xE5, 0x21, 0x00, 0x00, 0xE1 };
-	cpuDebugger* results = runAndDebug(memory, 30);
+	debugRun* results = runAndDebug(memory, 30);
 
 	EXPECT_EQ(results->getAllRegisters(), 0x000000000000A0B0);
 	delete results;
@@ -440,7 +472,7 @@ TEST(POP_HL, check_registers_are_same) { //0xE1
 
 TEST(LD_C_ptr_A, Load_to_0xFFFF) { //0xE2
 	uint8_t memory[65536] = { 0x3E, 0xA0, 0x0E, 0xFF, 0xE2};
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[0xFFFF], 0xA0);
 	delete results;
@@ -448,7 +480,7 @@ TEST(LD_C_ptr_A, Load_to_0xFFFF) { //0xE2
 
 TEST(PUSH_HL, Push_to_0x40_check_MSB) { //0xE5
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0x21, 0xC0, 0xB0, 0xE5 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x3F], 0xB0);
 	delete results;
@@ -456,7 +488,7 @@ TEST(PUSH_HL, Push_to_0x40_check_MSB) { //0xE5
 
 TEST(PUSH_HL, Push_to_0x40_check_LSB) { //0xE5
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0x21, 0xC0, 0xB0, 0xE5 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x3E], 0xC0);
 	delete results;
@@ -464,7 +496,7 @@ TEST(PUSH_HL, Push_to_0x40_check_LSB) { //0xE5
 
 TEST(LD_nn_ptr_A, Load_255) { //0xEA
 	uint8_t memory[1024] = { 0x3E, 0xFF, 0xEA, 0xFF, 0x01 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(memory[0x1FF], 0xFF);
 	delete results;
@@ -473,7 +505,7 @@ TEST(LD_nn_ptr_A, Load_255) { //0xEA
 TEST(LDH_A_n_ptr, Load_from_0xFFFF) { //0xF0
 	uint8_t memory[65536] = {0xF0, 0xFF};
 	memory[65535] = 0xA0;
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->AF.half[1], 0xA0);
 	delete results;
@@ -481,7 +513,7 @@ TEST(LDH_A_n_ptr, Load_from_0xFFFF) { //0xF0
 
 TEST(POP_AF, check_registers_are_same) { //0xF1
 	uint8_t memory[256] = { 0x31, 0x80, 0x00, 0x3E, 0xA0, 0xF5, 0x3E, 0x00, 0xF1 };
-	cpuDebugger* results = runAndDebug(memory, 30);
+	debugRun* results = runAndDebug(memory, 30);
 
 	EXPECT_EQ(results->getAllRegisters(), 0xA000000000000000);
 	delete results;
@@ -490,7 +522,7 @@ TEST(POP_AF, check_registers_are_same) { //0xF1
 TEST(LD_A_C_ptr, Load_from_0xFFFF) { //0xF2
 	uint8_t memory[65536] = { 0x0E, 0xFF, 0xF2 };
 	memory[65535] = 0xA0;
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->AF.half[1], 0xA0);
 	delete results;
@@ -498,7 +530,7 @@ TEST(LD_A_C_ptr, Load_from_0xFFFF) { //0xF2
 
 TEST(PUSH_AF, Push_to_0x40_check_MSB) { //0xF5
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0x3E, 0xB0, 0xF5 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x3F], 0xB0);
 	delete results;
@@ -506,7 +538,7 @@ TEST(PUSH_AF, Push_to_0x40_check_MSB) { //0xF5
 
 TEST(PUSH_AF, Push_to_0x40_check_LSB) { //0xF5
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0x3E, 0xB0, 0xF5 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(memory[0x3E], 0x00);
 	delete results;
@@ -514,7 +546,7 @@ TEST(PUSH_AF, Push_to_0x40_check_LSB) { //0xF5
 
 TEST(LD_HL_SP_plus_r8, Test_plus_1) { //0xF8
 	uint8_t memory[128] = { 0x31, 0x40, 0x00, 0xF8, 0x01 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(results->HL.full, 0x41);
 	delete results;
@@ -522,7 +554,7 @@ TEST(LD_HL_SP_plus_r8, Test_plus_1) { //0xF8
 
 TEST(LD_HL_SP_plus_r8, Test_minus_128) { //0xF8
 	uint8_t memory[128] = { 0x31, 0xFF, 0x00, 0xF8, 0x80 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(results->HL.full, 0x7F);
 	delete results;
@@ -530,7 +562,7 @@ TEST(LD_HL_SP_plus_r8, Test_minus_128) { //0xF8
 
 TEST(LD_HL_SP_plus_r8, Test_half_carry) { //0xF8
 	uint8_t memory[128] = { 0x31, 0x08, 0x00, 0xF8, 0x08 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(results->AF.half[0], 0b00100000);
 	delete results;
@@ -538,7 +570,7 @@ TEST(LD_HL_SP_plus_r8, Test_half_carry) { //0xF8
 
 TEST(LD_HL_SP_plus_r8, Test_full_carry) { //0xF8
 	uint8_t memory[128] = { 0x31, 0x80, 0x00, 0xF8, 0x80 };
-	cpuDebugger* results = runAndDebug(memory, 20);
+	debugRun* results = runAndDebug(memory, 20);
 
 	EXPECT_EQ(results->AF.half[0], 0b00010000);
 	delete results;
@@ -546,7 +578,7 @@ TEST(LD_HL_SP_plus_r8, Test_full_carry) { //0xF8
 
 TEST(LD_SP_HL, Load_FFA0) { //0xF9
 	uint8_t memory[10] = { 0x21, 0xA0, 0xFF, 0xF9 };
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->SP, 0xFFA0);
 	delete results;
@@ -555,8 +587,1356 @@ TEST(LD_SP_HL, Load_FFA0) { //0xF9
 TEST(LD_A_nn_ptr, Load_255) { //0xFA
 	uint8_t memory[1024] = { 0xFA, 0xFF, 0x01};
 	memory[0x1FF] = 0xFF;
-	cpuDebugger* results = runAndDebug(memory, 10);
+	debugRun* results = runAndDebug(memory, 10);
 
 	EXPECT_EQ(results->AF.half[1], 0xFF);
 	delete results;
-}
\ No newline at end of file
+}
+
+TEST(Profiler, opcodeFamily) {
+	EXPECT_EQ(opcodeFamily(0x00), FAMILY_NOP);
+	EXPECT_EQ(opcodeFamily(0x41), FAMILY_LD_R_R);
+	EXPECT_EQ(opcodeFamily(0x3E), FAMILY_LD_R_N);
+	EXPECT_EQ(opcodeFamily(0x2A), FAMILY_LD_R_HL);
+	EXPECT_EQ(opcodeFamily(0x77), FAMILY_LD_HL_R);
+	EXPECT_EQ(opcodeFamily(0xF5), FAMILY_PUSH);
+	EXPECT_EQ(opcodeFamily(0xCB), FAMILY_CB);
+	EXPECT_EQ(opcodeFamily(0x76), FAMILY_OTHER);
+}
+
+#ifdef GBCPU_PROFILE
+TEST(Profiler, countsExecutionsAndCycles) {
+	uint8_t memory[16] = { 0x06, 0xFF, 0x41, 0x41 }; //LD B, d8 then LD B, C twice, then NOPs
+	debugRun* results = runAndDebug(memory, 8);
+
+	EXPECT_EQ(results->getOpcodeCount(0x06), 1);
+	EXPECT_EQ(results->getOpcodeCycles(0x06), 2);
+	EXPECT_EQ(results->getOpcodeCount(0x41), 2);
+	EXPECT_EQ(results->getFamilyCount(FAMILY_LD_R_R), 2);
+	EXPECT_EQ(results->getFamilyCycles(FAMILY_LD_R_R), 2);
+	delete results;
+}
+
+TEST(Profiler, countsCBPrefix) {
+	uint8_t memory[16] = { 0xCB, 0x37 };
+	debugRun* results = runAndDebug(memory, 2);
+
+	EXPECT_EQ(results->getOpcodeCount(0xCB), 1);
+	EXPECT_EQ(results->getCBCount(0x37), 1);
+	EXPECT_EQ(results->getFamilyCount(FAMILY_CB), 1);
+	delete results;
+}
+#endif
+
+TEST(Trace, compressRoundTrip) {
+	traceRecord records[64] = {};
+	for (int i = 0; i < 64; i++) {
+		records[i].PC = static_cast<uint16_t>(i * 3);
+		records[i].AF = 0x01B0;
+		records[i].cycle = i * 2;
+	}
+
+	uint8_t* packed = new uint8_t[traceCompressBound(64)];
+	size_t size = traceCompress(records, 64, packed);
+	traceRecord unpacked[64];
+
+	EXPECT_LT(size, sizeof(records) / 4);
+	EXPECT_TRUE(traceDecompress(packed, size, unpacked, 64));
+	EXPECT_EQ(memcmp(records, unpacked, sizeof(records)), 0);
+	delete[] packed;
+}
+
+TEST(Trace, recordsInstructionsAndWrites) {
+	uint8_t memory[16] = { 0x21, 0x0C, 0x00, 0x3E, 0x42, 0x77 }; //LD HL, 0x0C / LD A, 0x42 / LD (HL), A
+	traceRecorder recorder;
+	ASSERT_TRUE(recorder.open("trace_test.gbt"));
+
+	gbcpu gb(memory);
+	gb.setTracer(recorder.openRing(), true);
+	for (int i = 0; i < 7; i++) {
+		gb.tick();
+	}
+	recorder.close();
+
+	traceReader reader;
+	ASSERT_TRUE(reader.open("trace_test.gbt"));
+	traceRecord record;
+	uint32_t ring;
+	bool sawWrite = false;
+	int instructions = 0;
+	while (reader.next(record, ring)) {
+		if (record.type == TRACE_EXEC) {
+			instructions++;
+		}
+		if (record.type == TRACE_WRITE) {
+			EXPECT_EQ(record.data, 0x42);
+			sawWrite = true;
+		}
+	}
+	EXPECT_EQ(instructions, 3);
+	EXPECT_TRUE(sawWrite);
+	remove("trace_test.gbt");
+}
+
+TEST(CPUView, readsLiveRegisters) {
+	uint8_t memory[16] = { 0x21, 0x34, 0x12, 0x3E, 0x42 }; //LD HL, 0x1234 then LD A, 0x42
+	gbcpu gb(memory);
+	cpuView view(gb);
+
+	for (int i = 0; i < 4; i++) {
+		gb.tick();
+	}
+	EXPECT_EQ(view.getHL(), 0x1234);
+	EXPECT_EQ(view.getOpcode(), 0x3E); //fetched, not yet executed
+
+	gb.tick();
+	gb.tick();
+	EXPECT_EQ(view.getAF() >> 8, 0x42);
+	EXPECT_EQ(view.getTotalCycles(), 6);
+	EXPECT_EQ(view.readMemory(1), 0x34);
+}
+
+TEST(CPUView, pollFromAnotherThread) {
+	uint8_t memory[16] = { 0x21, 0x34, 0x12 };
+	gbcpu gb(memory);
+	cpuView view(gb);
+	cpuSnapshot snapshot;
+
+	EXPECT_FALSE(view.poll(snapshot));
+
+	for (int i = 0; i < 4; i++) {
+		gb.tick();
+	}
+	view.publish();
+
+	bool published = false;
+	std::thread reader([&]() {
+		published = view.poll(snapshot);
+	});
+	reader.join();
+
+	EXPECT_TRUE(published);
+	EXPECT_EQ(snapshot.HL.full, 0x1234);
+	EXPECT_EQ(snapshot.totalCycles, 4);
+	EXPECT_EQ(snapshot.epoch, 1);
+}
+
+TEST(Breakpoints, stopsAtExecutionBreakpoint) {
+	uint8_t memory[16] = { 0x06, 0x01, 0x0E, 0x02, 0x16, 0x03 }; //LD B, 1 / LD C, 2 / LD D, 3
+	gbcpu gb(memory);
+	cpuDebugger debugger(gb);
+	debugger.setBreakpoint(0x0004);
+
+	gb.run(100);
+	debugger.refresh();
+
+	EXPECT_EQ(debugger.getBreakReason(), BREAK_EXEC);
+	EXPECT_EQ(debugger.getBreakAddress(), 0x0004);
+	EXPECT_EQ(debugger.BC.full, 0x0102);
+	EXPECT_EQ(debugger.DE.half[1], 0x00); //LD D, 3 has not run yet
+}
+
+TEST(Breakpoints, stopsAtWriteWatchpoint) {
+	uint8_t memory[64] = { 0x21, 0x30, 0x00, 0x3E, 0x42, 0x77, 0x06, 0x07 }; //LD HL, 0x30 / LD A, 0x42 / LD (HL), A / LD B, 7
+	gbcpu gb(memory);
+	cpuDebugger debugger(gb);
+	debugger.setWatchpoint(0x0031, WATCH_WRITE); //same page, not hit
+	debugger.setWatchpoint(0x0030, WATCH_READ); //wrong mode, not hit
+	EXPECT_EQ(gb.run(7), 7);
+	EXPECT_EQ(debugger.getBreakReason(), BREAK_NONE);
+
+	gbcpu gb2(memory);
+	cpuDebugger debugger2(gb2);
+	debugger2.setWatchpoint(0x0030, WATCH_WRITE);
+	gb2.run(100);
+
+	EXPECT_EQ(debugger2.getBreakReason(), BREAK_WRITE);
+	EXPECT_EQ(debugger2.getBreakAddress(), 0x0030);
+	EXPECT_EQ(memory[0x30], 0x42);
+}
+
+TEST(Breakpoints, frameStopsOnSerialWindowBoundary) {
+	gameboy gb; //all NOPs, one instruction per cycle
+	cpuDebugger debugger(gb.getCPU());
+	debugger.setBreakpoint(0x03FF);
+
+	uint64_t ran = gb.runFrame();
+	EXPECT_EQ(ran % SERIAL_WINDOW, 0u); //the hit is on the last cycle of a window
+	EXPECT_LT(ran, CYCLES_PER_FRAME);
+	EXPECT_EQ(debugger.getBreakReason(), BREAK_EXEC);
+	EXPECT_EQ(debugger.getBreakAddress(), 0x03FF);
+}
+
+TEST(Breakpoints, profilerSamplesDoNotHideHits) {
+	gameboy gb;
+	guestProfiler profiler(4); //a sample window ends every 3 to 6 cycles
+	gb.setProfiler(&profiler);
+	cpuDebugger debugger(gb.getCPU());
+	for (uint16_t address = 0x0100; address < 0x0140; address++) {
+		debugger.setBreakpoint(address);
+	}
+
+	/* one NOP per cycle, so every hit lands somewhere in or at the end of a window */
+	for (uint16_t address = 0x0100; address < 0x0140; address++) {
+		gb.runFrame();
+		EXPECT_EQ(debugger.getBreakReason(), BREAK_EXEC);
+		EXPECT_EQ(debugger.getBreakAddress(), address);
+	}
+	EXPECT_GT(profiler.getSamples(), 0u);
+	gb.setProfiler(NULL);
+}
+
+TEST(APU, squareChannelProducesSamples) {
+	/* LD A, n / LDH (n), A pairs that power on the APU and trigger channel 1 at ~1kHz */
+	const uint8_t writes[][2] = { { 0x26, 0x80 }, { 0x24, 0x77 }, { 0x25, 0xFF }, { 0x11, 0x80 }, { 0x12, 0xF0 }, { 0x13, 0x83 }, { 0x14, 0x87 } };
+	gameboy gb;
+	uint8_t* memory = gb.getMemory();
+	int pc = 0;
+	for (auto& w : writes) {
+		memory[pc++] = 0x3E;
+		memory[pc++] = w[1];
+		memory[pc++] = 0xE0;
+		memory[pc++] = w[0];
+	}
+
+	gb.runFrame();
+	gb.runFrame();
+
+	int16_t samples[2048 * AUDIO_CHANNELS];
+	uint32_t count = gb.getAudio().read(samples, 2048);
+	int16_t peak = 0;
+	for (uint32_t i = 0; i < count * AUDIO_CHANNELS; i++) {
+		if (samples[i] > peak) {
+			peak = samples[i];
+		}
+	}
+
+	EXPECT_NEAR(count, 2.0 * APU_SAMPLE_RATE * CYCLES_PER_FRAME * 4 / APU_CLOCK, 2);
+	EXPECT_GT(peak, 1000);
+	EXPECT_EQ(memory[0xFF26] & 0x80, 0x80);
+}
+
+TEST(APU, statusRegisterShowsActiveChannels) {
+	uint8_t memory[0x10000] = { 0 };
+	apu sound(memory, NULL);
+	ioBus io;
+	io.attach(APU_FIRST, APU_LAST, &sound);
+
+	memory[0xFF26] = 0x80;
+	io.write(0xFF26, 0x80, 0);
+	memory[0xFF17] = 0xF0;
+	io.write(0xFF17, 0xF0, 0);
+	memory[0xFF19] = 0x80;
+	io.write(0xFF19, 0x80, 0);
+
+	EXPECT_EQ(io.read(0xFF26, memory[0xFF26], 0), 0xF2);
+}
+
+TEST(Audio, wavWriterHeader) {
+	int16_t frames[10 * AUDIO_CHANNELS] = { 0 };
+	wavWriter wav;
+	ASSERT_TRUE(wav.open("wav_test.wav", APU_SAMPLE_RATE));
+	wav.write(frames, 10);
+	wav.close();
+
+	FILE* f = fopen("wav_test.wav", "rb");
+	ASSERT_TRUE(f != NULL);
+	uint8_t header[44];
+	EXPECT_EQ(fread(header, 1, 44, f), 44);
+	fseek(f, 0, SEEK_END);
+	EXPECT_EQ(ftell(f), 44 + 10 * AUDIO_CHANNELS * 2);
+	fclose(f);
+
+	EXPECT_EQ(memcmp(header, "RIFF", 4), 0);
+	EXPECT_EQ(header[40] | (header[41] << 8), 10 * AUDIO_CHANNELS * 2); //data size
+	remove("wav_test.wav");
+}
+
+TEST(Pacing, resamplerFollowsRatio) {
+	int16_t in[800 * AUDIO_CHANNELS];
+	int16_t out[(800 * 2 + 2) * AUDIO_CHANNELS];
+	for (int i = 0; i < 800 * AUDIO_CHANNELS; i++) {
+		in[i] = 1000;
+	}
+
+	resampler r;
+	uint32_t total = 0;
+	for (int frame = 0; frame < 10; frame++) {
+		total += r.process(in, 800, 1.005, out);
+	}
+	EXPECT_NEAR(total, 8040, 1);
+	EXPECT_EQ(out[0], 1000); //settled on the constant input
+}
+
+TEST(Pacing, rateAdjustTracksDeviceFill) {
+	audioRing ring(DEVICE_BUFFER_FRAMES);
+	framePacer pacer(PACE_AUDIO, 1.0, &ring);
+	pacer.setRefreshRate(GB_FRAME_RATE); //one emulated frame per real one, the fill alone decides
+	EXPECT_DOUBLE_EQ(pacer.rateAdjust(), 1.0 + DRC_MAX_DELTA); //empty, produce more
+
+	int16_t frames[DEVICE_BUFFER_FRAMES * AUDIO_CHANNELS] = { 0 };
+	ring.write(frames, DEVICE_BUFFER_FRAMES / 4);
+	EXPECT_DOUBLE_EQ(pacer.rateAdjust(), 1.0);
+
+	ring.write(frames, DEVICE_BUFFER_FRAMES / 4);
+	EXPECT_DOUBLE_EQ(pacer.rateAdjust(), 1.0 - DRC_MAX_DELTA);
+
+	pacer.setRefreshRate(60.0); //the nominal ratio takes back the faster refresh
+	EXPECT_DOUBLE_EQ(pacer.rateAdjust(), GB_FRAME_RATE / 60.0 * (1.0 - DRC_MAX_DELTA));
+
+	framePacer timer(PACE_TIMER, 1.0, &ring);
+	EXPECT_DOUBLE_EQ(timer.rateAdjust(), 1.0);
+}
+
+TEST(Pacing, deviceFillSettlesAt60Hz) {
+	audioRing ring(DEVICE_BUFFER_FRAMES);
+	framePacer pacer(PACE_AUDIO, 1.0, &ring);
+	pacer.setRefreshRate(60.0);
+	resampler r;
+
+	/* two minutes of one emulated frame per vsync, the device plays 800 frames in each */
+	std::vector<int16_t> in(1024 * AUDIO_CHANNELS, 0);
+	std::vector<int16_t> out((1024 * 2 + 2) * AUDIO_CHANNELS);
+	std::vector<int16_t> played(APU_SAMPLE_RATE / 60 * AUDIO_CHANNELS);
+	double owed = 0;
+	uint32_t fullest = 0;
+	for (int vsync = 0; vsync < 60 * 120; vsync++) {
+		owed += APU_SAMPLE_RATE / GB_FRAME_RATE;
+		uint32_t count = static_cast<uint32_t>(owed);
+		owed -= count;
+		ring.write(out.data(), r.process(in.data(), count, pacer.rateAdjust(), out.data()));
+		fullest = std::max(fullest, ring.available());
+		ring.read(played.data(), APU_SAMPLE_RATE / 60);
+	}
+
+	EXPECT_LT(fullest, DEVICE_BUFFER_FRAMES * 3 / 4u); //the backstop never has to wait
+	EXPECT_NEAR(ring.available(), DEVICE_BUFFER_FRAMES / 4, DEVICE_BUFFER_FRAMES / 16); //just before the next write
+}
+
+TEST(RunAhead, restoresStateAndKeepsAudio) {
+	const uint8_t writes[][2] = { { 0x26, 0x80 }, { 0x24, 0x77 }, { 0x25, 0xFF }, { 0x11, 0x80 }, { 0x12, 0xF0 }, { 0x13, 0x83 }, { 0x14, 0x87 } };
+	gameboy plain;
+	gameboy ahead;
+	for (gameboy* gb : { &plain, &ahead }) {
+		uint8_t* memory = gb->getMemory();
+		int pc = 0;
+		for (auto& w : writes) {
+			memory[pc++] = 0x3E;
+			memory[pc++] = w[1];
+			memory[pc++] = 0xE0;
+			memory[pc++] = w[0];
+		}
+	}
+
+	runAhead runner(ahead, 2);
+	for (int i = 0; i < 5; i++) {
+		plain.runFrame();
+		runner.runFrame();
+	}
+
+	/* only the real frames are heard */
+	int16_t a[4096 * AUDIO_CHANNELS];
+	int16_t b[4096 * AUDIO_CHANNELS];
+	uint32_t countA = plain.getAudio().read(a, 4096);
+	uint32_t countB = ahead.getAudio().read(b, 4096);
+	ASSERT_EQ(countA, countB);
+	EXPECT_EQ(memcmp(a, b, countA * AUDIO_CHANNELS * sizeof(int16_t)), 0);
+
+	/* the machine shows the frame two ahead */
+	plain.runFrame();
+	plain.runFrame();
+	cpuView viewA(plain.getCPU());
+	cpuView viewB(ahead.getCPU());
+	EXPECT_EQ(viewA.getTotalCycles(), viewB.getTotalCycles());
+	EXPECT_EQ(viewA.getPC(), viewB.getPC());
+	EXPECT_EQ(viewA.getAF(), viewB.getAF());
+	EXPECT_EQ(memcmp(plain.getMemory(), ahead.getMemory(), MEMORY_SIZE), 0);
+	EXPECT_EQ(plain.getFrame(), ahead.getFrame());
+}
+
+TEST(Joypad, latchesButtonsAtRead) {
+	/* select the d-pad, read JOYP into B, read it again into C */
+	const uint8_t program[] = { 0x3E, 0x20, 0xE0, 0x00, 0xF0, 0x00, 0x47, 0xF0, 0x00, 0x4F };
+	gameboy gb;
+	memcpy(gb.getMemory(), program, sizeof(program));
+	cpuView view(gb.getCPU());
+
+	while (view.getPC() < 8) {
+		gb.getCPU().tick();
+	}
+	gb.getJoypad().press(BUTTON_RIGHT);
+	gb.getJoypad().press(BUTTON_START); //not selected
+	while (view.getPC() < 12) {
+		gb.getCPU().tick();
+	}
+
+	EXPECT_EQ(view.getBC(), 0xEFEE); //B before the press, C after
+	gb.getJoypad().release(BUTTON_RIGHT);
+	EXPECT_EQ(gb.getJoypad().getButtons(), 1 << BUTTON_START);
+}
+
+/* presses A at the first poll, like a key that went down while the frame ran */
+class countingPoller : public inputPoller {
+	public:
+		joypad* pad;
+		uint32_t polls;
+
+		void poll() {
+			if (this->polls++ == 0) {
+				this->pad->press(BUTTON_A);
+			}
+		}
+};
+
+TEST(Joypad, pollsHostInputDuringFrame) {
+	/* select the buttons, then read JOYP back to back into B and C */
+	const uint8_t program[] = { 0x3E, 0x10, 0xE0, 0x00, 0xF0, 0x00, 0x47, 0xF0, 0x00, 0x4F };
+	gameboy gb;
+	memcpy(gb.getMemory(), program, sizeof(program));
+	countingPoller poller;
+	poller.pad = &gb.getJoypad();
+	poller.polls = 0;
+	gb.getJoypad().setPoller(&poller);
+	cpuView view(gb.getCPU());
+
+	while (view.getPC() < 12) {
+		gb.getCPU().tick();
+	}
+	EXPECT_EQ(view.getBC(), 0xDEDE); //the press is seen by the read that polled
+	EXPECT_EQ(poller.polls, 1u); //the second read was too soon to poll again
+
+	gb.getJoypad().setPoller(NULL);
+}
+
+/* stores both JOYP halves to 0xC000 onwards, over and over */
+static void loadJoypadProgram(gameboy& gb) {
+	const uint8_t block[] = { 0x3E, 0x20, 0xE0, 0x00, 0xF0, 0x00, 0x22, 0x3E, 0x10, 0xE0, 0x00, 0xF0, 0x00, 0x22 };
+	uint8_t* memory = gb.getMemory();
+	memory[0] = 0x21;
+	memory[1] = 0x00;
+	memory[2] = 0xC0;
+	for (int pc = 3; pc + sizeof(block) <= ROM_SIZE; pc += sizeof(block)) {
+		memcpy(&memory[pc], block, sizeof(block));
+	}
+}
+
+static uint8_t netplayInput(int player, uint32_t frame) {
+	return static_cast<uint8_t>(((frame / 5) * 37 + player * 101) ^ (frame / 11));
+}
+
+TEST(Netplay, peersMatchReferenceAfterRollbacks) {
+	const uint32_t frames = 120;
+	gameboy reference[2];
+	gameboy peerA[2];
+	gameboy peerB[2];
+	for (int i = 0; i < 2; i++) {
+		loadJoypadProgram(reference[i]);
+		loadJoypadProgram(peerA[i]);
+		loadJoypadProgram(peerB[i]);
+	}
+
+	for (uint32_t f = 0; f < frames; f++) {
+		reference[0].getJoypad().setButtons(netplayInput(0, f));
+		reference[1].getJoypad().setButtons(netplayInput(1, f));
+		reference[0].runFrame();
+		reference[1].runFrame();
+	}
+
+	rollbackSession a(peerA[0], peerA[1], 0);
+	rollbackSession b(peerB[0], peerB[1], 1);
+	ASSERT_TRUE(a.connect(47845, "127.0.0.1", 47846));
+	ASSERT_TRUE(b.connect(47846, "127.0.0.1", 47845));
+	a.setLoss(0.1);
+
+	/* b runs at half the speed of a, so a keeps predicting and rolling back */
+	for (int i = 0; i < 10000; i++) {
+		if (a.getFrame() < frames) {
+			a.step(netplayInput(0, a.getFrame()));
+		}
+		else {
+			a.poll();
+		}
+		if (i % 2 == 0 && b.getFrame() < frames) {
+			b.step(netplayInput(1, b.getFrame()));
+		}
+		else {
+			b.poll();
+		}
+
+		if (a.getFrame() == frames && b.getFrame() == frames && a.isSynced() && b.isSynced()) {
+			break;
+		}
+	}
+
+	ASSERT_TRUE(a.isSynced());
+	ASSERT_TRUE(b.isSynced());
+	EXPECT_GT(a.getRollbacks(), 0);
+	for (int i = 0; i < 2; i++) {
+		EXPECT_EQ(peerA[i].stateHash(), reference[i].stateHash());
+		EXPECT_EQ(peerB[i].stateHash(), reference[i].stateHash());
+	}
+	EXPECT_NE(reference[0].stateHash(), reference[1].stateHash()); //the inputs made a difference
+}
+
+/* LD A, data / LDH (SB), A / LD A, control / LDH (SC), A */
+static void loadSerialProgram(gameboy& gb, uint8_t data, uint8_t control) {
+	const uint8_t program[] = { 0x3E, data, 0xE0, 0x01, 0x3E, control, 0xE0, 0x02 };
+	memcpy(gb.getMemory(), program, sizeof(program));
+}
+
+TEST(Serial, unlinkedTransferShiftsInFF) {
+	gameboy gb;
+	loadSerialProgram(gb, 0x42, 0x81);
+	gb.runFrame();
+
+	EXPECT_EQ(gb.getMemory()[SB], 0xFF);
+	EXPECT_EQ(gb.getMemory()[SC] & 0x80, 0);
+	EXPECT_EQ(gb.getMemory()[IF_REGISTER] & SERIAL_INTERRUPT, SERIAL_INTERRUPT);
+}
+
+TEST(Serial, linkedConsolesSwapBytes) {
+	gameboy master;
+	gameboy slave;
+	loadSerialProgram(master, 0x42, 0x81); //internal clock
+	loadSerialProgram(slave, 0x99, 0x80); //waits for the master's clock
+
+	linkCable cable(master, slave);
+	cable.runFrames(2);
+
+	EXPECT_EQ(master.getMemory()[SB], 0x99);
+	EXPECT_EQ(slave.getMemory()[SB], 0x42);
+	EXPECT_EQ(master.getMemory()[SC] & 0x80, 0);
+	EXPECT_EQ(slave.getMemory()[SC] & 0x80, 0);
+	EXPECT_EQ(slave.getMemory()[IF_REGISTER] & SERIAL_INTERRUPT, SERIAL_INTERRUPT);
+	EXPECT_EQ(master.getCycles(), slave.getCycles());
+}
+
+/* sends the pressed directions over and over, the bytes received are stored from 0xC000 */
+static void loadLinkProgram(gameboy& gb, uint8_t control) {
+	const uint8_t start[] = { 0x3E, 0x20, 0xE0, 0x00, 0xF0, 0x00, 0xE0, 0x01, 0x3E, control, 0xE0, 0x02 }; //JOYP = 0x20 / SB = JOYP / SC = control
+	const uint8_t store[] = { 0xF0, 0x01, 0x22 }; //LDH A, (SB) / LD (HL+), A
+	const int block = sizeof(start) + SERIAL_TRANSFER_CYCLES + 16 + sizeof(store); //NOPs until the transfer is done
+	uint8_t* memory = gb.getMemory();
+	memory[0] = 0x21;
+	memory[1] = 0x00;
+	memory[2] = 0xC0;
+	for (int pc = 3; pc + block <= ROM_SIZE; pc += block) {
+		memcpy(&memory[pc], start, sizeof(start));
+		memcpy(&memory[pc + block - sizeof(store)], store, sizeof(store));
+	}
+}
+
+static uint8_t linkInput(int player, uint32_t frame) {
+	return static_cast<uint8_t>((frame + 1) * (player + 3));
+}
+
+TEST(Netplay, linkTransfersSurviveRollback) {
+	const uint32_t frames = 4;
+	gameboy reference[2];
+	gameboy peerA[2];
+	gameboy peerB[2];
+	for (int i = 0; i < 2; i++) {
+		loadLinkProgram(reference[i], (i == 0) ? 0x81 : 0x80);
+		loadLinkProgram(peerA[i], (i == 0) ? 0x81 : 0x80);
+		loadLinkProgram(peerB[i], (i == 0) ? 0x81 : 0x80);
+	}
+
+	linkCable cable(reference[0], reference[1]);
+	for (uint32_t f = 0; f < frames; f++) {
+		reference[0].getJoypad().setButtons(linkInput(0, f));
+		reference[1].getJoypad().setButtons(linkInput(1, f));
+		cable.stepFrame();
+	}
+
+	/* the first player clocks the transfers and gets the second one's directions */
+	const uint8_t* received = &reference[0].getMemory()[0xC000];
+	EXPECT_NE(received[0], 0xFF);
+	EXPECT_NE(received[0], received[20]); //frame 0 and frame 1 input
+
+	rollbackSession a(peerA[0], peerA[1], 0);
+	rollbackSession b(peerB[0], peerB[1], 1);
+	ASSERT_TRUE(a.connect(47847, "127.0.0.1", 47848));
+	ASSERT_TRUE(b.connect(47848, "127.0.0.1", 47847));
+
+	/* b only steps every third turn, a resimulates the transfers it ran with predicted input */
+	for (int i = 0; i < 10000; i++) {
+		if (a.getFrame() < frames) {
+			a.step(linkInput(0, a.getFrame()));
+		}
+		else {
+			a.poll();
+		}
+		if (i % 3 == 0 && b.getFrame() < frames) {
+			b.step(linkInput(1, b.getFrame()));
+		}
+		else {
+			b.poll();
+		}
+
+		if (a.getFrame() == frames && b.getFrame() == frames && a.isSynced() && b.isSynced()) {
+			break;
+		}
+	}
+
+	ASSERT_TRUE(a.isSynced());
+	ASSERT_TRUE(b.isSynced());
+	EXPECT_GT(a.getRollbacks(), 0);
+	for (int i = 0; i < 2; i++) {
+		EXPECT_EQ(memcmp(&peerA[i].getMemory()[0xC000], &reference[i].getMemory()[0xC000], 32), 0);
+		EXPECT_EQ(peerA[i].stateHash(), reference[i].stateHash());
+		EXPECT_EQ(peerB[i].stateHash(), reference[i].stateHash());
+	}
+}
+
+TEST(PPU, drawsBackgroundTile) {
+	/* LCDC = 0x91, BGP = 0xE4 */
+	const uint8_t program[] = { 0x3E, 0x91, 0xE0, 0x40, 0x3E, 0xE4, 0xE0, 0x47 };
+	gameboy gb;
+	uint8_t* memory = gb.getMemory();
+	memcpy(memory, program, sizeof(program));
+	for (int row = 0; row < 8; row++) {
+		memory[0x8010 + row * 2] = 0xF0; //tile 1, left half colour 1
+	}
+	memory[0x9800] = 0x01;
+
+	gb.runFrame();
+	gb.runFrame();
+
+	const uint8_t* frame = gb.getFramebuffer();
+	EXPECT_EQ(frame[0], 1);
+	EXPECT_EQ(frame[7 * SCREEN_WIDTH + 3], 1);
+	EXPECT_EQ(frame[4], 0);
+	EXPECT_EQ(frame[8 * SCREEN_WIDTH], 0); //tile 0 below
+	EXPECT_EQ(memory[IF_REGISTER] & VBLANK_INTERRUPT, VBLANK_INTERRUPT);
+}
+
+TEST(PPU, skippedFramesKeepTimingAndInterrupts) {
+	const uint8_t program[] = { 0x3E, 0x91, 0xE0, 0x40, 0x3E, 0xE4, 0xE0, 0x47 };
+	gameboy drawn;
+	gameboy skipped;
+	for (gameboy* gb : { &drawn, &skipped }) {
+		memcpy(gb->getMemory(), program, sizeof(program));
+		gb->getMemory()[0x8010] = 0xF0;
+		gb->getMemory()[0x9800] = 0x01;
+	}
+
+	skipped.setRender(false);
+	drawn.runFrame();
+	skipped.runFrame();
+	drawn.runFrame();
+	skipped.runFrame();
+
+	EXPECT_EQ(skipped.stateHash(), drawn.stateHash());
+	EXPECT_EQ(skipped.getMemory()[IF_REGISTER] & VBLANK_INTERRUPT, VBLANK_INTERRUPT);
+	EXPECT_EQ(drawn.getFramebuffer()[0], 1);
+	EXPECT_EQ(skipped.getFramebuffer()[0], 0); //never drawn
+
+	skipped.setRender(true);
+	skipped.runFrame();
+	EXPECT_EQ(skipped.getFramebuffer()[0], 1);
+}
+
+TEST(Batch, stepsConsolesWithTheirOwnInputs) {
+	gameboy program;
+	loadJoypadProgram(program);
+	gbBatch* batch = gbBatchCreate(3, program.getMemory(), ROM_SIZE, 2);
+	ASSERT_NE(batch, nullptr);
+
+	const uint8_t inputs[] = { 0, 1 << BUTTON_RIGHT, 1 << BUTTON_A };
+	gbBatchStep(batch, inputs, 2);
+
+	/* the first store holds the d-pad, the second the buttons */
+	gbView dpad = gbBatchMemoryView(batch, 0xC000);
+	gbView buttons = gbBatchMemoryView(batch, 0xC001);
+	ASSERT_EQ(dpad.count, 3u);
+	EXPECT_NE(dpad.base[0], dpad.base[dpad.stride]);
+	EXPECT_EQ(dpad.base[0], dpad.base[2 * dpad.stride]);
+	EXPECT_EQ(buttons.base[0], buttons.base[buttons.stride]);
+	EXPECT_NE(buttons.base[0], buttons.base[2 * buttons.stride]);
+
+	gbBatchReset(batch, 1);
+	EXPECT_EQ(dpad.base[dpad.stride], 0);
+	EXPECT_EQ(dpad.base[0], dpad.base[2 * dpad.stride]);
+	EXPECT_NE(gbBatchFramebuffers(batch), nullptr);
+	gbBatchDestroy(batch);
+}
+
+TEST(Batch, workersMatchSingleThreadFrameByFrame) {
+	gameboy program;
+	loadJoypadProgram(program);
+	gbBatch* pooled = gbBatchCreate(7, program.getMemory(), ROM_SIZE, 4);
+	gbBatch* single = gbBatchCreate(7, program.getMemory(), ROM_SIZE, 1);
+	ASSERT_NE(pooled, nullptr);
+	ASSERT_NE(single, nullptr);
+
+	/* one frame per call, the same workers serve every step */
+	uint8_t inputs[7];
+	for (uint32_t f = 0; f < 60; f++) {
+		for (uint32_t i = 0; i < 7; i++) {
+			inputs[i] = netplayInput(i, f);
+		}
+		gbBatchStep(pooled, inputs, 1);
+		gbBatchStep(single, inputs, 1);
+	}
+
+	gbView a = gbBatchMemoryView(pooled, 0);
+	gbView b = gbBatchMemoryView(single, 0);
+	EXPECT_EQ(memcmp(a.base, b.base, a.stride * a.count), 0);
+	EXPECT_EQ(memcmp(gbBatchFramebuffers(pooled), gbBatchFramebuffers(single), static_cast<size_t>(FRAMEBUFFER_SIZE) * 7), 0);
+	gbBatchDestroy(pooled);
+	gbBatchDestroy(single);
+}
+
+/* random implemented opcodes without stores, a few bytes differ per lane so lanes drift apart and back */
+static void fillLockstepProgram(uint8_t* memory, uint32_t lane) {
+	const uint8_t others[] = { 0x00, 0x06, 0x0E, 0x16, 0x1E, 0x26, 0x2E, 0x3E, 0x0A, 0x1A, 0x2A, 0x3A,
+		0x01, 0x11, 0x21, 0x31, 0xF0, 0xF2, 0xFA, 0xF8, 0xF9, 0xC1, 0xD1, 0xE1, 0xF1 };
+	uint32_t rng = 12345;
+	for (uint32_t i = 0; i < MEMORY_SIZE; i++) {
+		rng = rng * 1103515245 + 12345;
+		uint8_t pick = static_cast<uint8_t>(rng >> 24);
+		uint8_t op = static_cast<uint8_t>(0x40 + (pick & 0x7F)); //LD r,r and ALU
+		if (pick >= 192 || (op >= 0x70 && op < 0x78)) {
+			op = others[pick % sizeof(others)];
+		}
+		memory[i] = op;
+	}
+	for (uint32_t i = 97; i < MEMORY_SIZE; i += 97) {
+		memory[i] = static_cast<uint8_t>(0x80 | ((lane * 7 + i) & 0x3F));
+	}
+	for (uint32_t i = 251; i < MEMORY_SIZE; i += 251) {
+		memory[i] = (lane & 1) ? 0x3E : 0x00; //LD A, d8 in odd lanes shifts their PC
+	}
+}
+
+TEST(Lockstep, matchesIndependentCPUs) {
+	const uint32_t lanes = 8;
+	uint8_t* memory[lanes];
+	uint8_t* reference[lanes];
+	gbcpu* cpus[lanes];
+	gbcpu* alone[lanes];
+	for (uint32_t l = 0; l < lanes; l++) {
+		memory[l] = new uint8_t[MEMORY_SIZE];
+		reference[l] = new uint8_t[MEMORY_SIZE];
+		fillLockstepProgram(memory[l], l);
+		memcpy(reference[l], memory[l], MEMORY_SIZE);
+		cpus[l] = new gbcpu(memory[l]);
+		alone[l] = new gbcpu(reference[l]);
+	}
+
+	/* short, uneven runs stop lanes in the middle of instructions and catch flags before they are overwritten */
+	lockstep engine(cpus, memory, lanes);
+	uint32_t mismatches = 0;
+	for (int r = 0; r < 2000; r++) {
+		uint64_t cycles = (r * 37) % 23 + 1;
+		engine.run(cycles);
+		for (uint32_t l = 0; l < lanes; l++) {
+			alone[l]->run(cycles);
+			cpuDebugger a(*cpus[l]);
+			cpuDebugger b(*alone[l]);
+			cpuView viewA(*cpus[l]);
+			cpuView viewB(*alone[l]);
+			mismatches += (a.getAllRegisters() != b.getAllRegisters()) || (a.getBothPointers() != b.getBothPointers()) ||
+				(viewA.getTotalCycles() != viewB.getTotalCycles()) || (viewA.getCycle() != viewB.getCycle());
+		}
+	}
+
+	EXPECT_EQ(mismatches, 0u);
+	for (uint32_t l = 0; l < lanes; l++) {
+		EXPECT_EQ(memcmp(memory[l], reference[l], MEMORY_SIZE), 0);
+	}
+	EXPECT_GT(engine.getVectorSteps(), 0u);
+	EXPECT_GT(engine.getScalarInstructions(), 0u);
+	EXPECT_LE(engine.getUtilisation(), 0.5); //8 of 16 lanes
+
+	for (uint32_t l = 0; l < lanes; l++) {
+		delete cpus[l];
+		delete alone[l];
+		delete[] memory[l];
+		delete[] reference[l];
+	}
+}
+
+TEST(FrameExport, readerSeesNewestFrame) {
+	frameExport exporter;
+	ASSERT_TRUE(exporter.open("/gbemu-test-frames"));
+	frameReader reader;
+	ASSERT_TRUE(reader.open("/gbemu-test-frames"));
+
+	uint64_t frame;
+	uint8_t buttons;
+	std::vector<uint8_t> rgb(EXPORT_PIXELS);
+	EXPECT_FALSE(reader.read(frame, buttons, rgb.data()));
+
+	/* more frames than slots, nobody reads in between and the writer does not care */
+	std::vector<uint8_t> image(EXPORT_PIXELS);
+	for (uint64_t f = 1; f <= EXPORT_SLOTS * 2 + 1; f++) {
+		memset(image.data(), static_cast<int>(f), EXPORT_PIXELS);
+		exporter.publish(f, static_cast<uint8_t>(1 << (f % 8)), image.data());
+	}
+
+	ASSERT_TRUE(reader.read(frame, buttons, rgb.data()));
+	EXPECT_EQ(frame, EXPORT_SLOTS * 2 + 1u);
+	EXPECT_EQ(buttons, 1 << ((EXPORT_SLOTS * 2 + 1) % 8));
+	EXPECT_EQ(rgb, image);
+	EXPECT_EQ(reader.getPublished(), EXPORT_SLOTS * 2 + 1u);
+
+	/* a second instance must not take the name over from a live one */
+	frameExport second;
+	EXPECT_FALSE(second.open("/gbemu-test-frames"));
+	EXPECT_EQ(reader.getPublished(), EXPORT_SLOTS * 2 + 1u);
+	EXPECT_TRUE(second.open("/gbemu-test-frames", true));
+}
+
+TEST(Recorder, writesEveryFrameFromPooledBuffers) {
+	const uint32_t frames = RECORD_POOL_SIZE * 3;
+	uint8_t pixels[FRAMEBUFFER_SIZE];
+	int16_t samples[800 * AUDIO_CHANNELS] = { 0 };
+	recorder rec;
+	ASSERT_TRUE(rec.open("record_test.y4m", "record_test.wav", APU_SAMPLE_RATE));
+
+	/* more frames than buffers, the writer recycles them as it goes */
+	recordBuffer* first = NULL;
+	bool recycled = false;
+	for (uint32_t f = 0; f < frames; f++) {
+		memset(pixels, f & 3, sizeof(pixels));
+		recordBuffer* buffer = rec.acquire(true);
+		if (!first) {
+			first = buffer;
+		}
+		recycled |= (f > 0 && buffer == first);
+
+		buffer->frame = f;
+		memcpy(buffer->pixels, pixels, FRAMEBUFFER_SIZE);
+		memcpy(buffer->samples, samples, sizeof(samples));
+		buffer->sampleCount = 800;
+		rec.submit(buffer);
+	}
+	EXPECT_EQ(rec.getRecorded(), frames);
+	rec.close();
+	EXPECT_TRUE(recycled);
+
+	FILE* f = fopen("record_test.y4m", "rb");
+	ASSERT_TRUE(f != NULL);
+	char header[128] = { 0 };
+	ASSERT_TRUE(fgets(header, sizeof(header), f) != NULL);
+	long headerSize = ftell(f);
+	fseek(f, 0, SEEK_END);
+	long frameSize = 6 + FRAMEBUFFER_SIZE + FRAMEBUFFER_SIZE / 2;
+	EXPECT_EQ(ftell(f), headerSize + frames * frameSize);
+
+	/* the last frame used shade (frames - 1) & 3 */
+	uint8_t luma = 0;
+	fseek(f, headerSize + (frames - 1) * frameSize + 6, SEEK_SET);
+	EXPECT_EQ(fread(&luma, 1, 1, f), 1u);
+	EXPECT_EQ(luma, 255 - 85 * ((frames - 1) & 3));
+	fclose(f);
+	EXPECT_EQ(memcmp(header, "YUV4MPEG2 W160 H144", 19), 0);
+
+	f = fopen("record_test.wav", "rb");
+	ASSERT_TRUE(f != NULL);
+	fseek(f, 0, SEEK_END);
+	EXPECT_EQ(ftell(f), 44 + frames * 800 * AUDIO_CHANNELS * 2);
+	fclose(f);
+	remove("record_test.y4m");
+	remove("record_test.wav");
+}
+
+TEST(Movie, seeksFromNearestKeyframe) {
+	const uint32_t frames = 1000;
+	const uint32_t more = 200;
+	gameboy recording;
+	gameboy reference;
+	loadJoypadProgram(recording);
+	loadJoypadProgram(reference);
+
+	movieWriter writer;
+	ASSERT_TRUE(writer.create("movie_test.gbm", recording, 100));
+	uint64_t at537 = 0;
+	for (uint32_t f = 0; f < frames; f++) {
+		if (f == 537) {
+			at537 = reference.stateHash();
+		}
+		writer.record(recording, netplayInput(0, f));
+		recording.runFrame();
+		reference.getJoypad().setButtons(netplayInput(0, f));
+		reference.runFrame();
+	}
+
+	/* not closed yet, the reader has to walk the chunks */
+	{
+		movieReader live;
+		ASSERT_TRUE(live.open("movie_test.gbm"));
+		EXPECT_EQ(live.getFrames(), 960u); //inputs are flushed every MOVIE_FLUSH_FRAMES
+		EXPECT_EQ(live.getKeyframes(), 10u);
+	}
+	writer.close();
+
+	movieReader reader;
+	ASSERT_TRUE(reader.open("movie_test.gbm"));
+	EXPECT_EQ(reader.getFrames(), frames);
+	EXPECT_EQ(reader.getKeyframes(), 10u);
+	EXPECT_EQ(reader.getInput(537), netplayInput(0, 537));
+
+	gameboy player; //no program, the keyframe brings the memory along
+	EXPECT_EQ(reader.seek(player, 537), 37u);
+	EXPECT_EQ(player.stateHash(), at537);
+	reader.close();
+
+	/* carry on recording where the movie ended */
+	gameboy appending;
+	ASSERT_TRUE(writer.append("movie_test.gbm", appending));
+	EXPECT_EQ(appending.stateHash(), reference.stateHash());
+	uint64_t at1150 = 0;
+	for (uint32_t f = frames; f < frames + more; f++) {
+		if (f == 1150) {
+			at1150 = reference.stateHash();
+		}
+		writer.record(appending, netplayInput(0, f));
+		appending.runFrame();
+		reference.getJoypad().setButtons(netplayInput(0, f));
+		reference.runFrame();
+	}
+	writer.close();
+
+	ASSERT_TRUE(reader.open("movie_test.gbm"));
+	EXPECT_EQ(reader.getFrames(), frames + more);
+	EXPECT_EQ(reader.getKeyframes(), 12u);
+	EXPECT_EQ(reader.seek(player, 1150), 50u);
+	EXPECT_EQ(player.stateHash(), at1150);
+	reader.close();
+	remove("movie_test.gbm");
+}
+
+TEST(Conformance, runsStreamedVectors) {
+	/* NOP, LD B,C, LD A,(HL), LD (HL),A, an ADD A,B with a wrong result and CB (skipped) */
+	const char* vectors =
+		"[{\"name\": \"00 0000\", \"initial\": {\"pc\": 257, \"sp\": 0, \"a\": 1, \"b\": 2, \"c\": 3, \"d\": 4, \"e\": 5, \"f\": 0, \"h\": 6, \"l\": 7,\n"
+		"  \"ime\": 0, \"ram\": [[256, 0], [257, 65]]}, \"final\": {\"pc\": 258, \"sp\": 0, \"a\": 1, \"b\": 2, \"c\": 3, \"d\": 4, \"e\": 5,\n"
+		"  \"f\": 0, \"h\": 6, \"l\": 7, \"ram\": [[256, 0], [257, 65]]}, \"cycles\": [[257, 65, \"r-m\"]]},\n"
+		" {\"name\": \"41 0000\", \"initial\": {\"pc\": 4097, \"sp\": 65534, \"a\": 0, \"b\": 18, \"c\": 52, \"d\": 0, \"e\": 0, \"f\": 176, \"h\": 0, \"l\": 0,\n"
+		"  \"ram\": [[4096, 65], [4097, 0]]}, \"final\": {\"pc\": 4098, \"sp\": 65534, \"a\": 0, \"b\": 52, \"c\": 52, \"d\": 0, \"e\": 0, \"f\": 176,\n"
+		"  \"h\": 0, \"l\": 0, \"ram\": [[4096, 65], [4097, 0]]}, \"cycles\": [[4097, 0, \"r-m\"]]},\n"
+		" {\"name\": \"7E 0000\", \"initial\": {\"pc\": 513, \"sp\": 0, \"a\": 0, \"b\": 0, \"c\": 0, \"d\": 0, \"e\": 0, \"f\": 0, \"h\": 192, \"l\": 0,\n"
+		"  \"ram\": [[512, 126], [513, 0], [49152, 90]]}, \"final\": {\"pc\": 514, \"sp\": 0, \"a\": 90, \"b\": 0, \"c\": 0, \"d\": 0, \"e\": 0,\n"
+		"  \"f\": 0, \"h\": 192, \"l\": 0, \"ram\": [[512, 126], [513, 0], [49152, 90]]}, \"cycles\": [[49152, 90, \"r-m\"], [513, 0, \"r-m\"]]},\n"
+		" {\"name\": \"77 0000\", \"initial\": {\"pc\": 769, \"sp\": 0, \"a\": 171, \"b\": 0, \"c\": 0, \"d\": 0, \"e\": 0, \"f\": 0, \"h\": 192, \"l\": 16,\n"
+		"  \"ram\": [[768, 119], [769, 0]]}, \"final\": {\"pc\": 770, \"sp\": 0, \"a\": 171, \"b\": 0, \"c\": 0, \"d\": 0, \"e\": 0,\n"
+		"  \"f\": 0, \"h\": 192, \"l\": 16, \"ram\": [[768, 119], [769, 0], [49168, 171]]}, \"cycles\": [[49168, 171, \"-wm\"], [769, 0, \"r-m\"]]},\n"
+		" {\"name\": \"80 0000\", \"initial\": {\"pc\": 1025, \"sp\": 0, \"a\": 1, \"b\": 2, \"c\": 0, \"d\": 0, \"e\": 0, \"f\": 0, \"h\": 0, \"l\": 0,\n"
+		"  \"ram\": [[1024, 128], [1025, 0]]}, \"final\": {\"pc\": 1026, \"sp\": 0, \"a\": 4, \"b\": 2, \"c\": 0, \"d\": 0, \"e\": 0,\n"
+		"  \"f\": 0, \"h\": 0, \"l\": 0, \"ram\": [[1024, 128], [1025, 0]]}, \"cycles\": [[1025, 0, \"r-m\"]]},\n"
+		" {\"name\": \"CB 0000\", \"initial\": {\"pc\": 1281, \"sp\": 0, \"a\": 0, \"b\": 0, \"c\": 0, \"d\": 0, \"e\": 0, \"f\": 0, \"h\": 0, \"l\": 0,\n"
+		"  \"ram\": [[1280, 203], [1281, 0]]}, \"final\": {\"pc\": 1283, \"sp\": 0, \"a\": 0, \"b\": 0, \"c\": 0, \"d\": 0, \"e\": 0,\n"
+		"  \"f\": 0, \"h\": 0, \"l\": 0, \"ram\": [[1280, 203], [1281, 0]]}, \"cycles\": [[1281, 0, \"r-m\"], null]}]\n";
+
+	std::vector<std::string> files;
+	for (int i = 0; i < 3; i++) {
+		files.push_back("conformance_test" + std::to_string(i) + ".json");
+		FILE* f = fopen(files.back().c_str(), "wb");
+		ASSERT_TRUE(f != NULL);
+		fputs(vectors, f);
+		fclose(f);
+	}
+
+	conformanceRunner runner(2);
+	conformanceResult result = runner.run(files);
+	EXPECT_EQ(result.badFiles, 0u);
+	EXPECT_EQ(result.passed, 4u * 3);
+	EXPECT_EQ(result.failed, 1u * 3);
+	EXPECT_EQ(result.skipped, 1u * 3);
+	EXPECT_EQ(result.opcodeFailed[0x80], 3u);
+	EXPECT_EQ(result.opcodePassed[0x7E], 3u);
+	ASSERT_EQ(result.failures.size(), 3u);
+	EXPECT_NE(result.failures[0].find("AF 0300, expected 0400"), std::string::npos);
+
+	/* a single case, streamed from the same file */
+	conformanceParser parser;
+	conformanceCase test;
+	ASSERT_TRUE(parser.open(files[0].c_str()));
+	ASSERT_TRUE(parser.next(test));
+	ASSERT_TRUE(parser.next(test));
+	EXPECT_STREQ(test.name, "41 0000");
+	EXPECT_EQ(runner.runCase(test), 1);
+	test.cycles[0].type = BUS_IDLE;
+	test.cycleCount = 2; //too long, LD B,C has fetched the next opcode by then
+	EXPECT_EQ(runner.runCase(test), 0);
+	EXPECT_STREQ(runner.getFailure(), "took 1 cycles, expected 2");
+	parser.close();
+
+	for (const std::string& file : files) {
+		remove(file.c_str());
+	}
+}
+
+/* prints text through the serial port, waiting out each transfer with NOPs */
+static std::vector<uint8_t> serialROM(const char* text) {
+	std::vector<uint8_t> rom(ROM_SIZE, 0x00);
+	size_t pc = 0;
+	for (const char* c = text; *c; c++) {
+		const uint8_t send[] = { 0x3E, static_cast<uint8_t>(*c), 0xE0, 0x01, 0x3E, 0x81, 0xE0, 0x02 };
+		memcpy(&rom[pc], send, sizeof(send));
+		pc += sizeof(send) + SERIAL_TRANSFER_CYCLES;
+	}
+	return rom;
+}
+
+TEST(ROMTest, spinLoopIsNotStuck) {
+	/*
+	gbcpu has no jumps yet, so take the state a wait loop such as LD A, (HL) /
+	JR -3 would show at every frame boundary: about to run the same load again
+	*/
+	uint8_t memory[16] = { 0x7E, 0x7E, 0xD3 }; //LD A, (HL) twice, then an opcode that does not exist
+	gbcpu cpu(memory);
+	cpuState spin;
+	cpu.tick();
+	cpu.saveState(spin);
+	ASSERT_EQ(spin.cycle, NEW_CYCLE);
+	ASSERT_EQ(spin.PC, 1);
+	EXPECT_FALSE(romTestStuck(spin)); //however often a frame ends here
+
+	cpuState stuck;
+	for (int i = 0; i < 4; i++) {
+		cpu.tick();
+	}
+	cpu.saveState(stuck);
+	EXPECT_EQ(stuck.opcode, 0xD3);
+	EXPECT_TRUE(romTestStuck(stuck));
+}
+
+TEST(ROMTest, stopsOnVerdicts) {
+	std::vector<std::vector<uint8_t>> images;
+	images.push_back(serialROM("cpu_instrs\n\nPassed\n"));
+	images.push_back(serialROM("01-special\n\nFailed #3\n"));
+
+	/* LD B,3 LD C,5 LD D,8 LD E,13 LD H,21 LD L,34, then NOPs */
+	std::vector<uint8_t> fib(ROM_SIZE, 0x00);
+	const uint8_t loads[] = { 0x06, 3, 0x0E, 5, 0x16, 8, 0x1E, 13, 0x26, 21, 0x2E, 34 };
+	memcpy(fib.data(), loads, sizeof(loads));
+	images.push_back(fib);
+
+	/* JP, which gbcpu does not implement */
+	std::vector<uint8_t> jump(ROM_SIZE, 0x00);
+	jump[0x100] = 0xC3;
+	images.push_back(jump);
+
+	std::vector<std::string> roms;
+	for (size_t i = 0; i < images.size(); i++) {
+		roms.push_back("romtest_" + std::to_string(i) + ".gb");
+		FILE* f = fopen(roms.back().c_str(), "wb");
+		ASSERT_TRUE(f != NULL);
+		fwrite(images[i].data(), 1, images[i].size(), f);
+		fclose(f);
+	}
+	roms.push_back("romtest_missing.gb");
+
+	romTestRunner runner(3, 600);
+	std::vector<romTestResult> results = runner.run(roms);
+	ASSERT_EQ(results.size(), roms.size());
+
+	EXPECT_EQ(results[0].status, ROMTEST_PASSED);
+	EXPECT_EQ(results[0].output, "cpu_instrs\n\nPassed\n");
+	EXPECT_LT(results[0].frames, 30u); //stopped early, not at the limit
+
+	EXPECT_EQ(results[1].status, ROMTEST_FAILED);
+	EXPECT_EQ(results[1].output, "01-special\n\nFailed #3\n"); //the tail frames catch the text after "Failed"
+
+	EXPECT_EQ(results[2].status, ROMTEST_PASSED);
+	EXPECT_EQ(results[2].frames, 1u + ROMTEST_TAIL_FRAMES);
+
+	EXPECT_EQ(results[3].status, ROMTEST_STUCK);
+	EXPECT_EQ(results[3].opcode, 0xC3);
+	EXPECT_EQ(results[3].PC, 0x100);
+	EXPECT_EQ(results[3].frames, 1u); //no second frame needed to tell
+
+	EXPECT_EQ(results[4].status, ROMTEST_ERROR);
+	for (size_t i = 0; i < images.size(); i++) {
+		remove(roms[i].c_str());
+	}
+}
+
+TEST(Golden, hashFastMatchesXXH64) {
+	EXPECT_EQ(hashFast("", 0), 0xEF46DB3751D8E999ULL);
+	EXPECT_EQ(hashFast("abc", 3), 0x44BC2CF5AD770999ULL);
+	EXPECT_EQ(hashFast("Nobody inspects the spammish repetition", 39), 0xFBCEA83C8A378BF1ULL);
+}
+
+TEST(Golden, flagsChangedFramesOnly) {
+	/* turns the LCD on, then keeps copying the d-pad bits of JOYP into BGP */
+	gameboy recording;
+	uint8_t* memory = recording.getMemory();
+	const uint8_t start[] = { 0x3E, 0x91, 0xE0, 0x40 };
+	const uint8_t block[] = { 0x3E, 0x20, 0xE0, 0x00, 0xF0, 0x00, 0xE0, 0x47 };
+	memcpy(memory, start, sizeof(start));
+	for (size_t pc = sizeof(start); pc + sizeof(block) <= ROM_SIZE; pc += sizeof(block)) {
+		memcpy(&memory[pc], block, sizeof(block));
+	}
+	for (int i = 0; i < 16; i += 2) { //tile 0 uses all four colors, the keyframe carries it along
+		memory[0x8000 + i] = 0x5A;
+		memory[0x8000 + i + 1] = 0x4C;
+	}
+
+	movieWriter writer;
+	ASSERT_TRUE(writer.create("golden_test.gbm", recording, 8));
+	std::vector<uint64_t> reference;
+	for (uint32_t f = 0; f < 40; f++) {
+		writer.record(recording, 1 << (f % 4));
+		recording.runFrame();
+		reference.push_back(frameHash(recording.getFramebuffer()));
+	}
+	writer.close();
+	EXPECT_NE(reference[0], reference[1]); //the palette follows the buttons
+
+	FILE* f = fopen("golden_test.golden", "w");
+	ASSERT_TRUE(f != NULL);
+	fputs("# written by the test\nmovie golden_test.gbm\n1 -\n2 -\n30 -\n", f);
+	fclose(f);
+
+	/* bless, then check against what was blessed */
+	goldenTest test;
+	ASSERT_TRUE(test.load("golden_test.golden"));
+	EXPECT_EQ(test.run(NULL), 3u);
+	ASSERT_TRUE(test.save());
+	ASSERT_TRUE(test.load("golden_test.golden"));
+	EXPECT_EQ(test.run("."), 0u);
+	EXPECT_EQ(test.getFrame(0).expected, reference[1]);
+	EXPECT_EQ(test.getFrame(2).expected, reference[30]);
+
+	/* a wrong hash costs a PNG of that frame only */
+	f = fopen("golden_test.golden", "w");
+	fprintf(f, "movie golden_test.gbm\n1 %016llx\n30 %016llx\n", (unsigned long long)reference[1], (unsigned long long)(reference[30] ^ 1));
+	fclose(f);
+	ASSERT_TRUE(test.load("golden_test.golden"));
+	EXPECT_EQ(test.run("."), 1u);
+	EXPECT_EQ(test.getFrame(1).actual, reference[30]);
+
+	FILE* png = fopen("golden_test_30.png", "rb");
+	ASSERT_TRUE(png != NULL);
+	uint8_t signature[8] = { 0 };
+	EXPECT_EQ(fread(signature, 1, 8, png), 8u);
+	fclose(png);
+	EXPECT_EQ(signature[1], 'P');
+	EXPECT_EQ(fopen("golden_test_1.png", "rb"), (FILE*)NULL);
+
+	remove("golden_test_30.png");
+	remove("golden_test.golden");
+	remove("golden_test.gbm");
+}
+
+TEST(Profiler, foldsShadowCallStacks) {
+	FILE* f = fopen("profiler_test.sym", "w");
+	ASSERT_TRUE(f != NULL);
+	fputs("; RGBDS symbols\n00:0150 Main\n00:0200 Helper\n00:0210 Helper.loop\n", f);
+	fclose(f);
+
+	guestProfiler profiler;
+	ASSERT_TRUE(profiler.loadSymbols("profiler_test.sym"));
+	EXPECT_EQ(profiler.getSymbols(), 2u); //local labels are left out
+
+	profiler.onFetch(0x0150, 0xFFFE, 0x00);
+	profiler.sample(0x0151, 100); //PC is one past the fetched opcode
+	profiler.onFetch(0x0155, 0xFFFE, 0xCD); //CALL Helper
+	profiler.onFetch(0x0200, 0xFFFC, 0x00);
+	profiler.sample(0x0213, 200);
+	profiler.onFetch(0x0205, 0xFFFC, 0xDC); //CALL C, not taken
+	profiler.onFetch(0x0208, 0xFFFC, 0xFF); //RST 38
+	profiler.onFetch(0x0038, 0xFFFA, 0x00);
+	EXPECT_EQ(profiler.getDepth(), 2u);
+	profiler.sample(0x0039, 300);
+	profiler.onFetch(0x0039, 0xFFFA, 0xC9); //RET
+	profiler.onFetch(0x0209, 0xFFFC, 0xC9); //RET
+	profiler.onFetch(0x0158, 0xFFFE, 0x00);
+	EXPECT_EQ(profiler.getDepth(), 0u);
+	profiler.sample(0x0159, 400);
+	profiler.endFrame(0x0159, 450);
+
+	ASSERT_TRUE(profiler.writeFolded("profiler_test.folded"));
+	std::ifstream in("profiler_test.folded");
+	std::stringstream folded;
+	folded << in.rdbuf();
+	EXPECT_EQ(folded.str(), "Main 2\nMain;Helper 1\nMain;Helper;$00:0000 1\n");
+	EXPECT_EQ(profiler.getFrames(), 1u);
+	in.close();
+	remove("profiler_test.sym");
+	remove("profiler_test.folded");
+}
+
+TEST(Profiler, samplingLeavesEmulationAlone) {
+	gameboy plain;
+	gameboy profiled;
+	loadJoypadProgram(plain);
+	loadJoypadProgram(profiled);
+
+	guestProfiler profiler(500);
+	profiled.setProfiler(&profiler);
+	for (int f = 0; f < 10; f++) {
+		plain.runFrame();
+		profiled.runFrame();
+	}
+
+	EXPECT_EQ(plain.stateHash(), profiled.stateHash());
+	EXPECT_EQ(profiler.getFrames(), 10u);
+	EXPECT_GT(profiler.getSamples(), 10u * CYCLES_PER_FRAME / 1000);
+	EXPECT_LT(profiler.getSamples(), 10u * CYCLES_PER_FRAME / 250);
+
+	/* a loaded state moves SP and PC under the shadow stack */
+	gameboyState* state = new gameboyState;
+	profiled.saveState(*state);
+	profiled.loadState(*state);
+	EXPECT_EQ(profiler.getDepth(), 0u);
+	profiler.onFetch(0x0150, 0xFFFE, 0xCD);
+	profiler.onFetch(0x0200, 0xFFFC, 0x00);
+	EXPECT_EQ(profiler.getDepth(), 1u);
+	profiled.loadState(*state);
+	EXPECT_EQ(profiler.getDepth(), 0u);
+	delete state;
+	profiled.setProfiler(NULL);
+}
+
+TEST(CodeDataLog, marksCodeDataAndWrites) {
+	std::vector<uint8_t> memory(MEMORY_SIZE, 0);
+	const uint8_t program[] = { 0xFA, 0x50, 0x01, 0xEA, 0x00, 0xC0 }; //LD A, (0x0150) / LD (0xC000), A
+	memcpy(memory.data(), program, sizeof(program));
+	memory[0x0150] = 0x42;
+
+	codeDataLog cdl;
+	gbcpu cpu(memory.data());
+	cpu.setCodeDataLog(&cdl);
+	for (int i = 0; i < 10; i++) {
+		cpu.tick();
+	}
+	cpu.setCodeDataLog(NULL);
+	cpu.tick();
+
+	for (uint16_t address = 0; address < 7; address++) {
+		EXPECT_EQ(cdl.get(address), CDL_CODE) << address; //operands are code, nothing was jumped to
+	}
+	EXPECT_EQ(cdl.get(0x0150), CDL_DATA);
+	EXPECT_EQ(cdl.get(0xC000), CDL_WRITTEN);
+	EXPECT_EQ(cdl.get(0x0008), 0); //fetched after the log was taken off
+	EXPECT_EQ(memory[0xC000], 0x42);
+}
+
+TEST(CodeDataLog, flagsJumpTargetsAndMerges) {
+	codeDataLog cdl;
+	cdl.onFetch(0x0100, 0x00); //NOP
+	cdl.onFetch(0x0101, 0xC3); //JP 0x0150
+	cdl.onFetch(0x0150, 0xCD); //CALL 0x0200
+	cdl.onFetch(0x0200, 0xC9); //RET
+	cdl.onFetch(0x0153, 0x00); //returned to
+	cdl.onFetch(0x0154, 0x00);
+
+	EXPECT_EQ(cdl.get(0x0101), CDL_CODE);
+	EXPECT_EQ(cdl.get(0x0150), CDL_CODE | CDL_JUMP_TARGET);
+	EXPECT_EQ(cdl.get(0x0200), CDL_CODE | CDL_JUMP_TARGET | CDL_SUB_ENTRY);
+	EXPECT_EQ(cdl.get(0x0153), CDL_CODE | CDL_JUMP_TARGET);
+	EXPECT_EQ(cdl.get(0x0154), CDL_CODE);
+
+	cdl.restored(); //as after a loaded state
+	cdl.onFetch(0x0300, 0x00);
+	EXPECT_EQ(cdl.get(0x0300), CDL_CODE);
+
+	cdl.onRead(0xC000, 0x0155);
+	ASSERT_TRUE(cdl.save("cdl_test.cdl"));
+	FILE* f = fopen("cdl_test.cdl", "rb");
+	ASSERT_TRUE(f != NULL);
+	fseek(f, 0, SEEK_END);
+	EXPECT_EQ(ftell(f), ROM_SIZE); //the cartridge area only
+	fclose(f);
+
+	codeDataLog merged;
+	merged.onFetch(0x4000, 0x00);
+	ASSERT_TRUE(merged.load("cdl_test.cdl"));
+	EXPECT_EQ(merged.get(0x0200), CDL_CODE | CDL_JUMP_TARGET | CDL_SUB_ENTRY);
+	EXPECT_EQ(merged.get(0x4000), CDL_CODE);
+	EXPECT_EQ(merged.get(0xC000), 0);
+	EXPECT_EQ(merged.count(CDL_CODE, 0, ROM_SIZE), 8u);
+	remove("cdl_test.cdl");
+}
+
+TEST(Probe, dumpsChromeTraceEvents) {
+	{
+		PROBE("skipped"); //probes are off
+	}
+
+	probeEnable(true);
+	uint64_t since = probeNow();
+	{
+		scopedProbe phase("first");
+		phase.next("second");
+	}
+	std::thread worker([]() {
+		probeThreadName("worker");
+		gameboy gb;
+		gb.setAudioOutput(false);
+		gb.runFrame();
+	});
+	worker.join();
+	probeEnable(false);
+
+	ASSERT_TRUE(probeDump("probe_test.json", since));
+	std::ifstream in("probe_test.json");
+	std::stringstream json;
+	json << in.rdbuf();
+	std::string text = json.str();
+	in.close();
+	remove("probe_test.json");
+
+	EXPECT_EQ(text.find("skipped"), std::string::npos);
+	EXPECT_NE(text.find("{\"name\":\"first\",\"ph\":\"X\""), std::string::npos);
+	EXPECT_NE(text.find("{\"name\":\"second\",\"ph\":\"X\""), std::string::npos);
+	EXPECT_NE(text.find("\"args\":{\"name\":\"worker\"}"), std::string::npos);
+	EXPECT_NE(text.find("{\"name\":\"cpu\""), std::string::npos);
+	EXPECT_NE(text.find("{\"name\":\"ppu\""), std::string::npos);
+	EXPECT_EQ(text.substr(text.size() - 4), "\n]}\n");
+}
+
+TEST(Pacing, frameStatsPercentilesAndSpeed) {
+	frameStats stats;
+	uint64_t now = 1000000000;
+	uint64_t cycles = 0;
+	stats.endFrame(now, 0, cycles);
+
+	/* 99 frames of 10ms and one of 40ms, running at half speed */
+	for (uint64_t frame = 1; frame <= 100; frame++) {
+		now += (frame == 50) ? 40000000 : 10000000;
+		cycles += CYCLES_PER_FRAME / 2;
+		stats.endFrame(now, frame, cycles);
+	}
+
+	EXPECT_EQ(stats.getVersion(), 2u); //after 0.5s and after 1s
+	EXPECT_FLOAT_EQ(stats.getPercentile(0), 10.0f);
+	EXPECT_FLOAT_EQ(stats.getPercentile(1), 10.0f);
+	EXPECT_FLOAT_EQ(stats.getPercentile(3), 40.0f);
+	EXPECT_NEAR(stats.getFPS(), 100.0, 1.0);
+	EXPECT_NEAR(stats.getSpeed(), 100.0 / 2 / GB_FRAME_RATE, 0.01);
+	EXPECT_EQ(stats.getHead(), 0u); //not wrapped yet
+	EXPECT_FLOAT_EQ(stats.getHistory()[49], 40.0f);
+}
+
+TEST(Screen, frameDiffReportsChangedLineRanges) {
+	std::vector<uint8_t> shades(FRAMEBUFFER_SIZE, 0);
+	frameDiff diff;
+	ASSERT_EQ(diff.update(shades.data()), 1u); //everything is new at first
+	EXPECT_EQ(diff.getRange(0).first, 0u);
+	EXPECT_EQ(diff.getRange(0).count, static_cast<uint32_t>(SCREEN_HEIGHT));
+
+	EXPECT_EQ(diff.update(shades.data()), 0u);
+
+	shades[10 * SCREEN_WIDTH + 5] = 3;
+	shades[11 * SCREEN_WIDTH] = 2;
+	shades[143 * SCREEN_WIDTH + 159] = 1;
+	ASSERT_EQ(diff.update(shades.data()), 2u);
+	EXPECT_EQ(diff.getRange(0).first, 10u);
+	EXPECT_EQ(diff.getRange(0).count, 2u);
+	EXPECT_EQ(diff.getRange(1).first, 143u);
+	EXPECT_EQ(diff.getRange(1).count, 1u);
+
+	diff.invalidate();
+	EXPECT_EQ(diff.update(shades.data()), 1u);
+
+	screen display;
+	shadeLines(&display, shades.data(), 10, 2);
+	EXPECT_EQ(display.square[10][5].r, colors[0].r);
+	EXPECT_EQ(display.square[11][0].r, colors[1].r);
+}
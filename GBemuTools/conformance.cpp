@@ -0,0 +1,73 @@
+/*
+runs single instruction JSON test vectors against gbcpu
+
+usage: conformance dir|file.json... [--threads n] [--all]
+
+directories are searched for .json files, one file per opcode. --all
+also runs the opcodes gbcpu does not implement yet instead of skipping them
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <cstdio>
+
+#include "../conformance.h"
+
+int main(int argc, char** argv) {
+	std::vector<std::string> files;
+	unsigned int threads = std::thread::hardware_concurrency();
+	bool all = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc) {
+			threads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--all") {
+			all = true;
+		}
+		else if (std::filesystem::is_directory(arg)) {
+			for (const auto& entry : std::filesystem::directory_iterator(arg)) {
+				if (entry.path().extension() == ".json") {
+					files.push_back(entry.path().string());
+				}
+			}
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+	if (files.empty()) {
+		std::cout << "usage: conformance dir|file.json... [--threads n] [--all]" << std::endl;
+		return 1;
+	}
+	std::sort(files.begin(), files.end());
+
+	conformanceRunner runner(threads);
+	runner.setIncludeAll(all);
+	auto start = std::chrono::steady_clock::now();
+	conformanceResult result = runner.run(files);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (int op = 0; op < 256; op++) {
+		if (result.opcodeFailed[op] > 0) {
+			printf("%02X: %llu of %llu failed\n", op, (unsigned long long)result.opcodeFailed[op],
+				(unsigned long long)(result.opcodeFailed[op] + result.opcodePassed[op]));
+		}
+	}
+	for (const std::string& failure : result.failures) {
+		std::cout << failure << std::endl;
+	}
+
+	uint64_t cases = result.passed + result.failed + result.skipped;
+	printf("%llu passed, %llu failed, %llu skipped in %zu files (%u bad) with %u threads\n", (unsigned long long)result.passed,
+		(unsigned long long)result.failed, (unsigned long long)result.skipped, files.size(), result.badFiles, threads);
+	printf("%.2f s, %.0f cases/s\n", seconds, cases / seconds);
+	return (result.failed > 0 || result.badFiles > 0) ? 1 : 0;
+}
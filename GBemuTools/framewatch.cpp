@@ -0,0 +1,73 @@
+/*
+follows the frames a running GBemu --export publishes
+
+usage: framewatch [name] [--count n] [--ppm out.ppm]
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#include "../frameshare.h"
+#include "../utils.h"
+
+int main(int argc, char** argv) {
+	const char* name = EXPORT_NAME;
+	const char* ppmFile = NULL;
+	uint64_t count = 60;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--count" && i + 1 < argc) {
+			count = std::strtoull(argv[++i], NULL, 10);
+		}
+		else if (arg == "--ppm" && i + 1 < argc) {
+			ppmFile = argv[++i];
+		}
+		else {
+			name = argv[i];
+		}
+	}
+
+	frameReader reader;
+	if (!reader.open(name)) {
+		return 1;
+	}
+
+	uint8_t* rgb = new uint8_t[EXPORT_PIXELS];
+	uint64_t last = 0;
+	uint64_t seen = 0;
+	uint64_t skipped = 0;
+
+	/* polls, a reader has no way to wake the emulator or be woken by it */
+	while (seen < count) {
+		uint64_t frame;
+		uint8_t buttons;
+		if (!reader.read(frame, buttons, rgb) || (seen > 0 && frame == last)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			continue;
+		}
+
+		if (seen > 0 && frame > last + 1) {
+			skipped += frame - last - 1;
+		}
+		printf("frame %llu buttons %02X hash %016llx\n", (unsigned long long)frame, buttons,
+			(unsigned long long)hashBytes(rgb, EXPORT_PIXELS));
+		last = frame;
+		seen++;
+	}
+	printf("%llu frames, %llu skipped\n", (unsigned long long)seen, (unsigned long long)skipped);
+
+	if (ppmFile) {
+		std::ofstream out(ppmFile, std::ios::binary);
+		out << "P6\n" << SCREEN_WIDTH << " " << SCREEN_HEIGHT << "\n255\n";
+		out.write(reinterpret_cast<const char*>(rgb), EXPORT_PIXELS);
+	}
+
+	delete[] rgb;
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+checks movies against their golden frame hashes, without a window
+
+usage: golden file.golden... [--update] [--png dir] [--threads n]
+
+mismatching frames are saved as PNGs in dir (the current one by default).
+--update blesses what the build draws now as the new golden hashes
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#include "../golden.h"
+
+int main(int argc, char** argv) {
+	std::vector<std::string> files;
+	const char* pngDir = ".";
+	unsigned int threads = std::thread::hardware_concurrency();
+	bool update = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--update") {
+			update = true;
+		}
+		else if (arg == "--png" && i + 1 < argc) {
+			pngDir = argv[++i];
+		}
+		else if (arg == "--threads" && i + 1 < argc) {
+			threads = std::atoi(argv[++i]);
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+	if (files.empty()) {
+		std::cout << "usage: golden file.golden... [--update] [--png dir] [--threads n]" << std::endl;
+		return 1;
+	}
+	if (threads == 0) {
+		threads = 1;
+	}
+
+	std::vector<goldenTest> tests(files.size());
+	std::vector<uint32_t> mismatches(files.size(), 0);
+	std::vector<bool> loaded(files.size(), false);
+	std::atomic<size_t> next(0);
+	auto start = std::chrono::steady_clock::now();
+
+	/* one golden file at a time per thread */
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threads && t < files.size(); t++) {
+		workers.push_back(std::thread([&]() {
+			for (size_t i = next++; i < files.size(); i = next++) {
+				loaded[i] = tests[i].load(files[i].c_str());
+				if (loaded[i]) {
+					mismatches[i] = tests[i].run(update ? NULL : pngDir);
+				}
+			}
+		}));
+	}
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t checked = 0;
+	uint32_t failed = 0;
+	for (size_t i = 0; i < tests.size(); i++) {
+		if (!loaded[i]) {
+			failed++;
+			continue;
+		}
+		checked += tests[i].getFrames();
+
+		if (update) {
+			tests[i].save();
+			printf("updated %s, %zu frames\n", files[i].c_str(), tests[i].getFrames());
+			continue;
+		}
+		if (mismatches[i] == 0) {
+			printf("ok       %s, %zu frames\n", files[i].c_str(), tests[i].getFrames());
+			continue;
+		}
+
+		failed++;
+		printf("FAILED   %s, %u of %zu frames\n", files[i].c_str(), mismatches[i], tests[i].getFrames());
+		for (size_t j = 0; j < tests[i].getFrames(); j++) {
+			const goldenFrame& frame = tests[i].getFrame(j);
+			if (frame.actual != frame.expected) {
+				printf("    frame %llu: %016llx, expected %016llx\n", (unsigned long long)frame.frame, (unsigned long long)frame.actual,
+					(unsigned long long)frame.expected);
+			}
+		}
+	}
+
+	printf("%llu frames checked in %.2fs (%.0f per second)\n", (unsigned long long)checked, seconds, checked / seconds);
+	return (failed > 0 && !update) ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+/*
+runs a ROM without a window
+
+usage: headless rom.gb [--frames n] [--wav out.wav] [--y4m out.y4m] [--profile out.folded] [--sym rom.sym] [--interval n] [--cdl out.cdl]
+
+--profile samples the guest PC every n machine cycles (about), writes flame graph
+stacks and prints where each frame's cycles went. Symbols come from --sym,
+or rom.sym next to the ROM
+
+--cdl adds the bytes run, read and written to a code/data log of the
+cartridge area, see cdl.h. Run it with several inputs to grow coverage
+*/
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+
+#include "../gameboy.h"
+#include "../recorder.h"
+#include "../profiler.h"
+#include "../cdl.h"
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cout << "usage: " << argv[0] << " rom.gb [--frames n] [--wav out.wav] [--y4m out.y4m] [--profile out.folded] [--sym rom.sym] [--interval n] [--cdl out.cdl]" << std::endl;
+		return 1;
+	}
+
+	uint64_t frames = 600;
+	const char* wavFile = NULL;
+	const char* videoFile = NULL;
+	const char* profileFile = NULL;
+	const char* cdlFile = NULL;
+	std::string symbolFile;
+	uint64_t interval = PROFILE_INTERVAL;
+
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc) {
+			frames = std::strtoull(argv[++i], NULL, 10);
+		}
+		else if (arg == "--wav" && i + 1 < argc) {
+			wavFile = argv[++i];
+		}
+		else if (arg == "--y4m" && i + 1 < argc) {
+			videoFile = argv[++i];
+		}
+		else if (arg == "--profile" && i + 1 < argc) {
+			profileFile = argv[++i];
+		}
+		else if (arg == "--sym" && i + 1 < argc) {
+			symbolFile = argv[++i];
+		}
+		else if (arg == "--interval" && i + 1 < argc) {
+			interval = std::strtoull(argv[++i], NULL, 10);
+		}
+		else if (arg == "--cdl" && i + 1 < argc) {
+			cdlFile = argv[++i];
+		}
+	}
+
+	gameboy gb;
+	if (!gb.loadROM(argv[1])) {
+		return 1;
+	}
+
+	wavWriter wav;
+	if (wavFile && !wav.open(wavFile, APU_SAMPLE_RATE)) {
+		return 1;
+	}
+
+	recorder video;
+	if (videoFile && !video.open(videoFile, NULL, APU_SAMPLE_RATE)) {
+		return 1;
+	}
+
+	guestProfiler profiler(interval);
+	if (profileFile) {
+		if (symbolFile.empty()) {
+			std::string rom = argv[1];
+			symbolFile = rom.substr(0, rom.find_last_of('.')) + ".sym";
+			std::ifstream exists(symbolFile);
+			if (!exists) {
+				symbolFile.clear(); //addresses only
+			}
+		}
+		if (!symbolFile.empty() && !profiler.loadSymbols(symbolFile.c_str())) {
+			return 1;
+		}
+		gb.setProfiler(&profiler);
+	}
+
+	codeDataLog cdl;
+	if (cdlFile) {
+		std::ifstream exists(cdlFile);
+		if (exists && !cdl.load(cdlFile)) {
+			return 1;
+		}
+		gb.setCodeDataLog(&cdl);
+	}
+
+	int16_t samples[1024 * AUDIO_CHANNELS];
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t f = 0; f < frames; f++) {
+		/* the PPU draws straight into a pooled buffer, the writer thread gets the pointer. Unthrottled, so wait for the disk */
+		recordBuffer* buffer = video.acquire(true);
+		gb.setFramebuffer(buffer ? buffer->pixels : NULL);
+		gb.runFrame();
+		if (buffer) {
+			buffer->frame = gb.getFrame();
+			video.submit(buffer);
+		}
+
+		/* drain every frame so the ring never fills up */
+		uint32_t count;
+		while ((count = gb.getAudio().read(samples, 1024)) > 0) {
+			wav.write(samples, count);
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << frames << " frames in " << seconds << "s (" << frames / seconds << " fps)" << std::endl;
+
+	if (video.isOpen()) {
+		std::cout << video.getRecorded() << " frames recorded, " << video.getDropped() << " dropped" << std::endl;
+	}
+	if (profileFile) {
+		gb.setProfiler(NULL);
+		profiler.report(20);
+		profiler.writeFolded(profileFile);
+	}
+	if (cdlFile) {
+		gb.setCodeDataLog(NULL);
+		std::cout << cdl.count(CDL_CODE, 0, ROM_SIZE) << " ROM bytes run, " << cdl.count(CDL_DATA, 0, ROM_SIZE) << " read as data" << std::endl;
+		cdl.save(cdlFile);
+	}
+	gb.setFramebuffer(NULL);
+	video.close();
+	wav.close();
+	return 0;
+}
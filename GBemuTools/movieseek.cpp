@@ -0,0 +1,36 @@
+/*
+seeks a movie recorded with GBemu --movie and reports what it cost
+
+usage: movieseek movie.gbm frame
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#include "../movie.h"
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cout << "usage: movieseek movie.gbm frame" << std::endl;
+		return 1;
+	}
+
+	movieReader reader;
+	if (!reader.open(argv[1])) {
+		return 1;
+	}
+	uint64_t frame = std::strtoull(argv[2], NULL, 10);
+
+	gameboy gb;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t replayed = reader.seek(gb, frame);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%llu frames, %zu keyframes every %u frames\n", (unsigned long long)reader.getFrames(), reader.getKeyframes(),
+		reader.getInterval());
+	printf("seek to %llu: %llu frames replayed in %.2f ms\n", (unsigned long long)frame, (unsigned long long)replayed, ms);
+	printf("state hash %016llx\n", (unsigned long long)gb.stateHash());
+	return 0;
+}
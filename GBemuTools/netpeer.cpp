@@ -0,0 +1,172 @@
+/*
+rollback netplay peer with scripted input
+
+usage:
+netpeer rom.gb --player 0|1 [--port n] [--peer host:port] [--frames n] [--loss percent] [--speed n]
+netpeer rom.gb --reference [--frames n]
+
+both players run the same ROM on both consoles and press buttons from a
+script, so two peers started on one machine must end with the same state
+hash as a --reference run that plays both scripts without the network:
+
+netpeer rom.gb --player 0 & netpeer rom.gb --player 1 & netpeer rom.gb --reference
+*/
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+
+#include "../gameboy.h"
+#include "../netplay.h"
+#include "../pacing.h"
+#include "../utils.h"
+
+#define DEFAULT_PORT 7845 //player 0, player 1 uses the next one
+#define TIMEOUT_SECONDS 10
+
+/* a new random button combination every 12 frames */
+static uint8_t scriptInput(uint8_t player, uint32_t frame) {
+	uint32_t x = (frame / 12) * 2654435761u + player * 40503u;
+	x ^= x >> 15;
+	x *= 2246822519u;
+	x ^= x >> 13;
+	return static_cast<uint8_t>(x);
+}
+
+static uint64_t pairHash(gameboy* consoles) {
+	uint64_t second = consoles[1].stateHash();
+	return hashBytes(&second, sizeof(second), consoles[0].stateHash());
+}
+
+static void drainAudio(gameboy& gb) {
+	int16_t samples[1024 * AUDIO_CHANNELS];
+	while (gb.getAudio().read(samples, 1024) > 0) {
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cout << "usage: " << argv[0] << " rom.gb --player 0|1 [--port n] [--peer host:port] [--frames n] [--loss percent] [--speed n]" << std::endl;
+		std::cout << "       " << argv[0] << " rom.gb --reference [--frames n]" << std::endl;
+		return 1;
+	}
+
+	int player = -1;
+	bool reference = false;
+	uint32_t frames = 600;
+	int port = -1;
+	std::string peerHost = "127.0.0.1";
+	int peerPort = -1;
+	double loss = 0;
+	double speed = 1.0;
+
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--player" && i + 1 < argc) {
+			player = std::atoi(argv[++i]) & 1;
+		}
+		else if (arg == "--reference") {
+			reference = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::atoi(argv[++i]);
+		}
+		else if (arg == "--port" && i + 1 < argc) {
+			port = std::atoi(argv[++i]);
+		}
+		else if (arg == "--peer" && i + 1 < argc) {
+			std::string peer = argv[++i];
+			size_t colon = peer.rfind(':');
+			peerHost = peer.substr(0, colon);
+			if (colon != std::string::npos) {
+				peerPort = std::atoi(peer.c_str() + colon + 1);
+			}
+		}
+		else if (arg == "--loss" && i + 1 < argc) {
+			loss = std::atof(argv[++i]) / 100.0;
+		}
+		else if (arg == "--speed" && i + 1 < argc) {
+			speed = std::atof(argv[++i]);
+		}
+	}
+
+	gameboy consoles[2];
+	for (gameboy& gb : consoles) {
+		if (!gb.loadROM(argv[1])) {
+			return 1;
+		}
+	}
+
+	if (reference) {
+		linkCable cable(consoles[0], consoles[1]); //the session links them the same way
+		for (uint32_t f = 0; f < frames; f++) {
+			for (int p = 0; p < 2; p++) {
+				consoles[p].getJoypad().setButtons(scriptInput(p, f));
+			}
+			cable.stepFrame();
+			drainAudio(consoles[0]);
+			drainAudio(consoles[1]);
+		}
+		printf("reference frame %u hash %016llx\n", frames, (unsigned long long)pairHash(consoles));
+		return 0;
+	}
+
+	if (player < 0) {
+		std::cout << "ERROR: --player or --reference is required" << std::endl;
+		return 1;
+	}
+	if (port < 0) {
+		port = DEFAULT_PORT + player;
+	}
+	if (peerPort < 0) {
+		peerPort = DEFAULT_PORT + (player ^ 1);
+	}
+
+	rollbackSession session(consoles[0], consoles[1], static_cast<uint8_t>(player));
+	if (!session.connect(static_cast<uint16_t>(port), peerHost.c_str(), static_cast<uint16_t>(peerPort))) {
+		return 1;
+	}
+	session.setLoss(loss);
+
+	framePacer pacer((speed > 0) ? PACE_TIMER : PACE_UNTHROTTLED, speed, NULL);
+	auto lastProgress = std::chrono::steady_clock::now();
+	uint64_t lastProgressMark = 0;
+
+	/* finished once every frame is confirmed and the peer has all of our inputs */
+	while (session.getFrame() < frames || !session.isSynced() || session.getAcked() < frames) {
+		if (session.getFrame() < frames && session.step(scriptInput(static_cast<uint8_t>(player), session.getFrame()))) {
+			pacer.endFrame();
+		}
+		else {
+			session.poll();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		drainAudio(consoles[0]);
+		drainAudio(consoles[1]);
+
+		uint64_t progressMark = static_cast<uint64_t>(session.getFrame()) + session.getConfirmed() + session.getAcked();
+		if (progressMark != lastProgressMark) {
+			lastProgressMark = progressMark;
+			lastProgress = std::chrono::steady_clock::now();
+		}
+		else if (std::chrono::steady_clock::now() - lastProgress > std::chrono::seconds(TIMEOUT_SECONDS)) {
+			std::cout << "ERROR: no answer from the peer at frame " << session.getFrame() << std::endl;
+			return 2;
+		}
+	}
+
+	/* keep acknowledging for a moment in case our last packets to the peer were lost */
+	auto linger = std::chrono::steady_clock::now() + std::chrono::milliseconds(250);
+	while (std::chrono::steady_clock::now() < linger) {
+		session.poll();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	printf("player %d frame %u hash %016llx rollbacks %llu resimulated %llu stalls %llu\n", player, frames,
+		(unsigned long long)pairHash(consoles),
+		(unsigned long long)session.getRollbacks(), (unsigned long long)session.getResimulated(), (unsigned long long)session.getStalls());
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*
+runs test ROMs (blargg, mooneye, ...) across all cores and reports their verdicts
+
+usage: romtest dir|rom.gb... [--threads n] [--frames n] [--verbose]
+
+directories are searched for .gb files. --verbose prints each ROM's serial output
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <cstdio>
+
+#include "../romtest.h"
+
+int main(int argc, char** argv) {
+	std::vector<std::string> roms;
+	unsigned int threads = std::thread::hardware_concurrency();
+	uint64_t frames = ROMTEST_FRAMES;
+	bool verbose = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc) {
+			threads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::strtoull(argv[++i], NULL, 10);
+		}
+		else if (arg == "--verbose") {
+			verbose = true;
+		}
+		else if (std::filesystem::is_directory(arg)) {
+			for (const auto& entry : std::filesystem::recursive_directory_iterator(arg)) {
+				if (entry.path().extension() == ".gb") {
+					roms.push_back(entry.path().string());
+				}
+			}
+		}
+		else {
+			roms.push_back(arg);
+		}
+	}
+	if (roms.empty()) {
+		std::cout << "usage: romtest dir|rom.gb... [--threads n] [--frames n] [--verbose]" << std::endl;
+		return 1;
+	}
+	std::sort(roms.begin(), roms.end());
+
+	romTestRunner runner(threads, frames);
+	auto start = std::chrono::steady_clock::now();
+	std::vector<romTestResult> results = runner.run(roms);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	int counts[ROMTEST_ERROR + 1] = { 0 };
+	for (const romTestResult& result : results) {
+		counts[result.status]++;
+		printf("%-8s %6llu frames %7.2fs  %s", romTestStatusName(result.status), (unsigned long long)result.frames, result.seconds,
+			result.rom.c_str());
+		if (result.status == ROMTEST_STUCK) {
+			printf("  (opcode %02X at %04X)", result.opcode, result.PC);
+		}
+		printf("\n");
+		if (verbose && !result.output.empty()) {
+			std::cout << result.output << std::endl;
+		}
+	}
+
+	printf("%d passed, %d failed, %d timed out, %d stuck, %d errors in %.2fs with %u threads\n", counts[ROMTEST_PASSED],
+		counts[ROMTEST_FAILED], counts[ROMTEST_TIMEOUT], counts[ROMTEST_STUCK], counts[ROMTEST_ERROR], seconds, threads);
+	return (counts[ROMTEST_PASSED] == static_cast<int>(results.size())) ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+/*
+trace file viewer
+
+usage:
+tracetool text trace.gbt [--ring n]
+tracetool diff a.gbt b.gbt [--ring n] [--context n]
+
+diff compares the records of one ring in order and stops at the first
+difference, printing the records leading up to it from both files
+*/
+
+#include <iostream>
+#include <string>
+#include <deque>
+#include <cstdlib>
+
+#include "../trace.h"
+
+static void printRecord(const traceRecord& r, const char* prefix) {
+	switch (r.type) {
+	case TRACE_EXEC:
+		printf("%s%12llu  %04X  %02X  AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X\n", prefix, (unsigned long long)r.cycle,
+			r.PC, r.opcode, r.AF, r.BC, r.DE, r.HL, r.SP);
+		break;
+	case TRACE_READ:
+		printf("%s%12llu  %04X  %02X  read  (%04X) -> %02X\n", prefix, (unsigned long long)r.cycle, r.PC, r.opcode, r.address, r.data);
+		break;
+	case TRACE_WRITE:
+		printf("%s%12llu  %04X  %02X  write (%04X) <- %02X\n", prefix, (unsigned long long)r.cycle, r.PC, r.opcode, r.address, r.data);
+		break;
+	default:
+		printf("%s%12llu  unknown record type %d\n", prefix, (unsigned long long)r.cycle, r.type);
+		break;
+	}
+}
+
+static bool sameRecord(const traceRecord& a, const traceRecord& b) {
+	return a.type == b.type && a.opcode == b.opcode && a.PC == b.PC && a.AF == b.AF && a.BC == b.BC && a.DE == b.DE &&
+		a.HL == b.HL && a.SP == b.SP && a.address == b.address && a.data == b.data && a.cycle == b.cycle;
+}
+
+/* next record belonging to the selected ring */
+static bool nextInRing(traceReader& reader, uint32_t ring, traceRecord& record) {
+	uint32_t id;
+	while (reader.next(record, id)) {
+		if (id == ring) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int text(const char* filename, uint32_t ring) {
+	traceReader reader;
+	if (!reader.open(filename)) {
+		return 1;
+	}
+
+	traceRecord record;
+	while (nextInRing(reader, ring, record)) {
+		printRecord(record, "");
+	}
+	return 0;
+}
+
+static int diff(const char* fileA, const char* fileB, uint32_t ring, unsigned int context) {
+	traceReader a;
+	traceReader b;
+	if (!a.open(fileA) || !b.open(fileB)) {
+		return 1;
+	}
+
+	std::deque<traceRecord> history;
+	traceRecord ra;
+	traceRecord rb;
+	uint64_t index = 0;
+
+	while (true) {
+		bool hasA = nextInRing(a, ring, ra);
+		bool hasB = nextInRing(b, ring, rb);
+
+		if (!hasA && !hasB) {
+			printf("traces are identical (%llu records)\n", (unsigned long long)index);
+			return 0;
+		}
+
+		if (hasA && hasB && sameRecord(ra, rb)) {
+			history.push_back(ra);
+			if (history.size() > context) {
+				history.pop_front();
+			}
+			index++;
+			continue;
+		}
+
+		printf("traces differ at record %llu\n", (unsigned long long)index);
+		for (const traceRecord& r : history) {
+			printRecord(r, "  ");
+		}
+		if (hasA) {
+			printRecord(ra, "< ");
+		}
+		else {
+			printf("< end of trace\n");
+		}
+		if (hasB) {
+			printRecord(rb, "> ");
+		}
+		else {
+			printf("> end of trace\n");
+		}
+		return 2;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cout << "usage: " << argv[0] << " text trace.gbt [--ring n]" << std::endl;
+		std::cout << "       " << argv[0] << " diff a.gbt b.gbt [--ring n] [--context n]" << std::endl;
+		return 1;
+	}
+
+	std::string mode = argv[1];
+	uint32_t ring = 0;
+	unsigned int context = 8;
+
+	int first = (mode == "diff") ? 4 : 3;
+	for (int i = first; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--ring" && i + 1 < argc) {
+			ring = std::atoi(argv[++i]);
+		}
+		else if (arg == "--context" && i + 1 < argc) {
+			context = std::atoi(argv[++i]);
+		}
+	}
+
+	if (mode == "text") {
+		return text(argv[2], ring);
+	}
+	if (mode == "diff" && argc >= 4) {
+		return diff(argv[2], argv[3], ring, context);
+	}
+
+	std::cout << "ERROR: unknown mode " << mode << std::endl;
+	return 1;
+}
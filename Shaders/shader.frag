@@ -1,11 +0,0 @@
-#version 330 core
-out vec4 FragColor;
-in vec3 vertexColor;
-in vec2 TexCoord;
-
-uniform sampler2D tex;
-
-void main()
-{
-   FragColor = texture(tex, TexCoord);
-}
\ No newline at end of file
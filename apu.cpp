@@ -0,0 +1,550 @@
+#include "apu.h"
+
+#include <cmath>
+#include <cstring>
+
+#define NR10 0xFF10
+#define NR30 0xFF1A
+#define NR32 0xFF1C
+#define NR43 0xFF22
+#define NR50 0xFF24
+#define NR51 0xFF25
+#define NR52 0xFF26
+#define WAVE_RAM 0xFF30
+
+static const double PI = 3.14159265358979323846;
+
+/* bits OR'd into register reads, unused and write-only bits read back as 1 */
+static const uint8_t readMask[0x20] = {
+	0x80, 0x3F, 0x00, 0xFF, 0xBF, //NR10-NR14
+	0xFF, 0x3F, 0x00, 0xFF, 0xBF, //NR20-NR24
+	0x7F, 0xFF, 0x9F, 0xFF, 0xBF, //NR30-NR34
+	0xFF, 0xFF, 0x00, 0x00, 0xBF, //NR40-NR44
+	0x00, 0x00, 0x70, //NR50-NR52
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static const uint8_t dutyTable[4] = { 0x01, 0x81, 0x87, 0x7E }; //12.5%, 25%, 50%, 75%
+static const uint8_t noiseDivisor[8] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+
+/* windowed sinc rows, one per sub-sample phase */
+static const int16_t* blipKernel() {
+	static int16_t kernel[BLIP_PHASES][BLIP_TAPS];
+	static bool built = false;
+
+	if (!built) {
+		for (int p = 0; p < BLIP_PHASES; p++) {
+			double frac = static_cast<double>(p) / BLIP_PHASES;
+			double row[BLIP_TAPS];
+			double sum = 0;
+
+			for (int k = 0; k < BLIP_TAPS; k++) {
+				double x = k - BLIP_TAPS / 2 - frac;
+				double sinc = (x == 0) ? 1.0 : sin(PI * 0.9 * x) / (PI * 0.9 * x); //cutoff just below Nyquist
+				double window = 0.42 + 0.5 * cos(2 * PI * x / BLIP_TAPS) + 0.08 * cos(4 * PI * x / BLIP_TAPS);
+				row[k] = sinc * window;
+				sum += row[k];
+			}
+
+			/* every row must sum to exactly 1 << 15 or steps leave a DC error behind */
+			int total = 0;
+			for (int k = 0; k < BLIP_TAPS; k++) {
+				kernel[p][k] = static_cast<int16_t>(lround(row[k] / sum * (1 << BLIP_KERNEL_BITS)));
+				total += kernel[p][k];
+			}
+			kernel[p][BLIP_TAPS / 2] += static_cast<int16_t>((1 << BLIP_KERNEL_BITS) - total);
+		}
+		built = true;
+	}
+
+	return &kernel[0][0];
+}
+
+blipBuffer::blipBuffer(uint32_t clockRate, uint32_t sampleRate, uint32_t maxSamples) {
+	this->size = maxSamples + BLIP_TAPS;
+	this->buffer = new int32_t[this->size];
+	memset(this->buffer, 0, this->size * sizeof(int32_t));
+
+	this->factor = (static_cast<uint64_t>(sampleRate) << 32) / clockRate;
+	this->offset = 0;
+	this->integrator = 0;
+	blipKernel();
+}
+
+blipBuffer::~blipBuffer() {
+	delete[] this->buffer;
+}
+
+void blipBuffer::addDelta(uint32_t time, int32_t delta) {
+	static const int16_t* kernel = blipKernel();
+
+	uint64_t pos = this->offset + time * this->factor;
+	uint32_t index = static_cast<uint32_t>(pos >> 32);
+	uint32_t phase = static_cast<uint32_t>(pos >> (32 - 5)) & (BLIP_PHASES - 1);
+
+	if (index + BLIP_TAPS > this->size) {
+		return; //endFrame() was not called often enough
+	}
+
+	const int16_t* row = &kernel[phase * BLIP_TAPS];
+	int32_t* out = &this->buffer[index];
+	for (int k = 0; k < BLIP_TAPS; k++) {
+		out[k] += delta * row[k];
+	}
+}
+
+void blipBuffer::endFrame(uint32_t duration) {
+	this->offset += duration * this->factor;
+}
+
+uint32_t blipBuffer::samplesAvailable() {
+	uint32_t available = static_cast<uint32_t>(this->offset >> 32);
+	return (available > this->size - BLIP_TAPS) ? this->size - BLIP_TAPS : available;
+}
+
+uint32_t blipBuffer::readSamples(int16_t* out, uint32_t count, uint32_t stride) {
+	uint32_t available = this->samplesAvailable();
+	if (count > available) {
+		count = available;
+	}
+
+	int64_t sum = this->integrator;
+	for (uint32_t i = 0; i < count; i++) {
+		sum += this->buffer[i];
+		int64_t sample = sum >> BLIP_KERNEL_BITS;
+		if (sample > 32767) {
+			sample = 32767;
+		}
+		else if (sample < -32768) {
+			sample = -32768;
+		}
+		out[i * stride] = static_cast<int16_t>(sample);
+
+		sum -= sum >> 12; //leaky integrator, removes DC below a few Hz
+	}
+	this->integrator = sum;
+
+	/* keep the kernel tails that reach past the samples just read */
+	uint32_t remaining = this->size - count;
+	memmove(this->buffer, &this->buffer[count], remaining * sizeof(int32_t));
+	memset(&this->buffer[remaining], 0, count * sizeof(int32_t));
+	this->offset -= static_cast<uint64_t>(count) << 32;
+
+	return count;
+}
+
+void blipBuffer::saveState(blipState& state) {
+	state.offset = this->offset;
+	state.integrator = this->integrator;
+	memcpy(state.tail, this->buffer, sizeof(state.tail));
+}
+
+void blipBuffer::loadState(const blipState& state) {
+	this->offset = state.offset;
+	this->integrator = state.integrator;
+	memcpy(this->buffer, state.tail, sizeof(state.tail)); //readSamples() left the rest zeroed
+}
+
+apu::apu(uint8_t* memory, audioRing* output) {
+	this->memory = memory;
+	this->output = output;
+	this->left = new blipBuffer(APU_CLOCK, APU_SAMPLE_RATE, APU_SAMPLE_RATE / 10);
+	this->right = new blipBuffer(APU_CLOCK, APU_SAMPLE_RATE, APU_SAMPLE_RATE / 10);
+	this->mixBuffer = new int16_t[(APU_SAMPLE_RATE / 10) * AUDIO_CHANNELS];
+
+	memset(this->ch, 0, sizeof(this->ch));
+	this->sweepShadow = 0;
+	this->sweepTimer = 0;
+	this->sweepEnabled = false;
+
+	this->power = (memory[NR52] & 0x80) != 0;
+	this->sequencerStep = 0;
+	this->sequencerTimer = APU_SEQUENCER_PERIOD;
+	this->now = 0;
+	this->frameStart = 0;
+	this->dropped = 0;
+}
+
+apu::~apu() {
+	delete this->left;
+	delete this->right;
+	delete[] this->mixBuffer;
+}
+
+uint64_t apu::getDroppedFrames() {
+	return this->dropped;
+}
+
+void apu::setOutput(audioRing* output) {
+	this->output = output;
+}
+
+void apu::saveState(apuState& state) {
+	memcpy(state.ch, this->ch, sizeof(state.ch));
+	state.sweepShadow = this->sweepShadow;
+	state.sweepTimer = this->sweepTimer;
+	state.sweepEnabled = this->sweepEnabled;
+
+	state.power = this->power;
+	state.sequencerStep = this->sequencerStep;
+	state.sequencerTimer = this->sequencerTimer;
+	state.now = this->now;
+	state.frameStart = this->frameStart;
+
+	this->left->saveState(state.left);
+	this->right->saveState(state.right);
+}
+
+void apu::loadState(const apuState& state) {
+	memcpy(this->ch, state.ch, sizeof(this->ch));
+	this->sweepShadow = state.sweepShadow;
+	this->sweepTimer = state.sweepTimer;
+	this->sweepEnabled = state.sweepEnabled;
+
+	this->power = state.power;
+	this->sequencerStep = state.sequencerStep;
+	this->sequencerTimer = state.sequencerTimer;
+	this->now = state.now;
+	this->frameStart = state.frameStart;
+
+	this->left->loadState(state.left);
+	this->right->loadState(state.right);
+}
+
+uint32_t apu::period(int c) {
+	switch (c) {
+	case 0:
+	case 1:
+		return (2048 - this->ch[c].frequency) * 4;
+	case 2:
+		return (2048 - this->ch[c].frequency) * 2;
+	default:
+		return static_cast<uint32_t>(noiseDivisor[this->memory[NR43] & 0x07]) << (this->memory[NR43] >> 4);
+	}
+}
+
+uint8_t apu::level(int c) {
+	const apuChannel& channel = this->ch[c];
+
+	switch (c) {
+	case 0:
+	case 1:
+		return ((dutyTable[this->memory[APU_FIRST + 5 * c + 1] >> 6] >> channel.position) & 1) ? channel.volume : 0;
+	case 2: {
+		static const uint8_t shift[4] = { 4, 0, 1, 2 }; //mute, 100%, 50%, 25%
+		uint8_t sample = this->memory[WAVE_RAM + channel.position / 2];
+		sample = (channel.position & 1) ? (sample & 0x0F) : (sample >> 4);
+		return sample >> shift[(this->memory[NR32] >> 5) & 0x03];
+	}
+	default:
+		return (channel.lfsr & 1) ? 0 : channel.volume;
+	}
+}
+
+void apu::updateLevel(int c, uint64_t time) {
+	apuChannel& channel = this->ch[c];
+	int32_t lvl = (channel.enabled && channel.dac) ? this->level(c) : 0;
+	uint8_t panning = this->memory[NR51];
+	uint8_t master = this->memory[NR50];
+
+	int32_t amp[2];
+	amp[0] = ((panning >> (4 + c)) & 1) ? lvl * (((master >> 4) & 0x07) + 1) * APU_SCALE : 0;
+	amp[1] = ((panning >> c) & 1) ? lvl * ((master & 0x07) + 1) * APU_SCALE : 0;
+
+	uint32_t offset = static_cast<uint32_t>(time - this->frameStart);
+	if (amp[0] != channel.amp[0]) {
+		this->left->addDelta(offset, amp[0] - channel.amp[0]);
+		channel.amp[0] = amp[0];
+	}
+	if (amp[1] != channel.amp[1]) {
+		this->right->addDelta(offset, amp[1] - channel.amp[1]);
+		channel.amp[1] = amp[1];
+	}
+}
+
+uint16_t apu::sweepCalc() {
+	uint8_t nr10 = this->memory[NR10];
+	uint16_t change = this->sweepShadow >> (nr10 & 0x07);
+	uint16_t frequency = (nr10 & 0x08) ? this->sweepShadow - change : this->sweepShadow + change;
+
+	if (frequency > 2047) {
+		this->ch[0].enabled = false;
+	}
+	return frequency;
+}
+
+void apu::trigger(int c) {
+	apuChannel& channel = this->ch[c];
+	uint8_t envelope = this->memory[APU_FIRST + 5 * c + 2];
+
+	channel.enabled = channel.dac;
+	if (channel.length == 0) {
+		channel.length = (c == 2) ? 256 : 64;
+	}
+	channel.timer = this->period(c);
+
+	if (c != 2) {
+		channel.volume = envelope >> 4;
+		channel.envelopeUp = (envelope & 0x08) != 0;
+		channel.envelopePeriod = envelope & 0x07;
+		channel.envelopeTimer = channel.envelopePeriod;
+	}
+	else {
+		channel.position = 0;
+	}
+
+	if (c == 3) {
+		channel.lfsr = 0x7FFF;
+	}
+
+	if (c == 0) {
+		uint8_t nr10 = this->memory[NR10];
+		this->sweepShadow = channel.frequency;
+		this->sweepTimer = ((nr10 >> 4) & 0x07) ? ((nr10 >> 4) & 0x07) : 8;
+		this->sweepEnabled = (nr10 & 0x77) != 0;
+		if (nr10 & 0x07) {
+			this->sweepCalc();
+		}
+	}
+}
+
+void apu::runChannels(uint64_t end) {
+	for (int c = 0; c < 4; c++) {
+		apuChannel& channel = this->ch[c];
+		if (!channel.enabled) {
+			continue;
+		}
+
+		uint32_t step = this->period(c);
+		uint64_t t = this->now + channel.timer;
+
+		while (t < end) {
+			switch (c) {
+			case 0:
+			case 1:
+				channel.position = (channel.position + 1) & 0x07;
+				break;
+			case 2:
+				channel.position = (channel.position + 1) & 0x1F;
+				break;
+			case 3: {
+				uint16_t bit = (channel.lfsr ^ (channel.lfsr >> 1)) & 1;
+				channel.lfsr = (channel.lfsr >> 1) | (bit << 14);
+				if (this->memory[NR43] & 0x08) { //7 bit mode
+					channel.lfsr = (channel.lfsr & ~0x40) | (bit << 6);
+				}
+				break;
+			}
+			}
+
+			this->updateLevel(c, t);
+			t += step;
+		}
+
+		channel.timer = static_cast<uint32_t>(t - end);
+	}
+}
+
+void apu::clockSequencer() {
+	uint8_t step = this->sequencerStep;
+
+	/* length counters at 256Hz */
+	if ((step & 1) == 0) {
+		for (int c = 0; c < 4; c++) {
+			apuChannel& channel = this->ch[c];
+			if (channel.lengthEnable && channel.length > 0) {
+				channel.length--;
+				if (channel.length == 0) {
+					channel.enabled = false;
+					this->updateLevel(c, this->now);
+				}
+			}
+		}
+	}
+
+	/* frequency sweep at 128Hz */
+	if (step == 2 || step == 6) {
+		uint8_t nr10 = this->memory[NR10];
+		if (this->sweepTimer > 0) {
+			this->sweepTimer--;
+		}
+		if (this->sweepTimer == 0) {
+			uint8_t sweepPeriod = (nr10 >> 4) & 0x07;
+			this->sweepTimer = sweepPeriod ? sweepPeriod : 8;
+
+			if (this->sweepEnabled && sweepPeriod) {
+				uint16_t frequency = this->sweepCalc();
+				if (frequency <= 2047 && (nr10 & 0x07)) {
+					this->sweepShadow = frequency;
+					this->ch[0].frequency = frequency;
+					this->memory[0xFF13] = static_cast<uint8_t>(frequency);
+					this->memory[0xFF14] = (this->memory[0xFF14] & 0xF8) | ((frequency >> 8) & 0x07);
+					this->sweepCalc();
+				}
+				this->updateLevel(0, this->now);
+			}
+		}
+	}
+
+	/* volume envelopes at 64Hz */
+	if (step == 7) {
+		for (int c = 0; c < 4; c++) {
+			apuChannel& channel = this->ch[c];
+			if (c == 2 || channel.envelopePeriod == 0) {
+				continue;
+			}
+			if (--channel.envelopeTimer == 0) {
+				channel.envelopeTimer = channel.envelopePeriod;
+				if (channel.envelopeUp && channel.volume < 15) {
+					channel.volume++;
+				}
+				else if (!channel.envelopeUp && channel.volume > 0) {
+					channel.volume--;
+				}
+				this->updateLevel(c, this->now);
+			}
+		}
+	}
+
+	this->sequencerStep = (step + 1) & 0x07;
+}
+
+void apu::runTo(uint64_t time) {
+	if (time <= this->now) {
+		return;
+	}
+	if (!this->power) {
+		this->now = time;
+		return;
+	}
+
+	/* channels run freely between frame sequencer steps */
+	while (this->now + this->sequencerTimer <= time) {
+		uint64_t step = this->now + this->sequencerTimer;
+		this->runChannels(step);
+		this->now = step;
+		this->clockSequencer();
+		this->sequencerTimer = APU_SEQUENCER_PERIOD;
+	}
+
+	this->runChannels(time);
+	this->sequencerTimer -= static_cast<uint32_t>(time - this->now);
+	this->now = time;
+}
+
+uint8_t apu::ioRead(uint16_t address, uint8_t val, uint64_t cycle) {
+	if (address >= WAVE_RAM) {
+		return val;
+	}
+
+	if (address == NR52) {
+		this->runTo(cycle * 4); //length counters may have switched channels off
+		uint8_t status = this->power ? 0x80 : 0x00;
+		for (int c = 0; c < 4; c++) {
+			if (this->ch[c].enabled) {
+				status |= 1 << c;
+			}
+		}
+		return status | readMask[address - APU_FIRST];
+	}
+
+	return val | readMask[address - APU_FIRST];
+}
+
+void apu::ioWrite(uint16_t address, uint8_t val, uint64_t cycle) {
+	this->runTo(cycle * 4);
+
+	if (address >= WAVE_RAM) {
+		return; //wave RAM is read straight from memory
+	}
+
+	if (address == NR52) {
+		bool on = (val & 0x80) != 0;
+		if (!on && this->power) {
+			/* powering off clears every register */
+			memset(&this->memory[APU_FIRST], 0, NR52 - APU_FIRST);
+			for (int c = 0; c < 4; c++) {
+				int32_t amp[2] = { this->ch[c].amp[0], this->ch[c].amp[1] };
+				memset(&this->ch[c], 0, sizeof(apuChannel));
+				this->ch[c].amp[0] = amp[0];
+				this->ch[c].amp[1] = amp[1];
+				this->updateLevel(c, this->now);
+			}
+		}
+		else if (on && !this->power) {
+			this->sequencerStep = 0;
+			this->sequencerTimer = APU_SEQUENCER_PERIOD;
+		}
+		this->power = on;
+		return;
+	}
+
+	if (!this->power) {
+		this->memory[address] = 0; //registers ignore writes while powered off
+		return;
+	}
+
+	if (address == NR50 || address == NR51) {
+		for (int c = 0; c < 4; c++) {
+			this->updateLevel(c, this->now);
+		}
+		return;
+	}
+	if (address > NR52) {
+		return;
+	}
+
+	int c = (address - APU_FIRST) / 5;
+	apuChannel& channel = this->ch[c];
+
+	switch ((address - APU_FIRST) % 5) {
+	case 0: //NR10 and NR30
+		if (c == 2) {
+			channel.dac = (val & 0x80) != 0;
+			if (!channel.dac) {
+				channel.enabled = false;
+			}
+		}
+		break;
+	case 1: //length
+		channel.length = (c == 2) ? 256 - val : 64 - (val & 0x3F);
+		break;
+	case 2: //envelope, or the output level of the wave channel
+		if (c != 2) {
+			channel.dac = (val & 0xF8) != 0;
+			if (!channel.dac) {
+				channel.enabled = false;
+			}
+		}
+		break;
+	case 3: //frequency LSB
+		channel.frequency = (channel.frequency & 0x0700) | val;
+		break;
+	case 4: //frequency MSB, length enable and trigger
+		channel.frequency = (channel.frequency & 0x00FF) | ((val & 0x07) << 8);
+		channel.lengthEnable = (val & 0x40) != 0;
+		if (val & 0x80) {
+			this->trigger(c);
+		}
+		break;
+	}
+
+	this->updateLevel(c, this->now);
+}
+
+void apu::endFrame(uint64_t cycle) {
+	this->runTo(cycle * 4);
+
+	uint32_t duration = static_cast<uint32_t>(this->now - this->frameStart);
+	this->left->endFrame(duration);
+	this->right->endFrame(duration);
+	this->frameStart = this->now;
+
+	uint32_t count = this->left->samplesAvailable();
+	this->left->readSamples(this->mixBuffer, count, AUDIO_CHANNELS);
+	this->right->readSamples(this->mixBuffer + 1, count, AUDIO_CHANNELS);
+
+	if (this->output) {
+		this->dropped += count - this->output->write(this->mixBuffer, count);
+	}
+}
@@ -0,0 +1,142 @@
+#ifndef __APU_H__
+#define __APU_H__
+
+#include <cstdint>
+
+#include "io.h"
+#include "audio.h"
+
+#define APU_CLOCK 4194304 //T-cycles per second
+#define APU_SAMPLE_RATE 48000
+#define APU_FIRST 0xFF10
+#define APU_LAST 0xFF3F
+#define APU_SEQUENCER_PERIOD 8192 //T-cycles between frame sequencer steps (512Hz)
+#define APU_SCALE 8 //4 channels * 15 * master volume 8 * 8 stays inside int16
+
+#define BLIP_PHASES 32 //sub-sample positions of the step kernel
+#define BLIP_TAPS 16
+#define BLIP_KERNEL_BITS 15 //each kernel row sums to 1 << 15
+
+/*
+band-limited step synthesis
+
+channels add a delta whenever their output level changes instead of
+producing one value per cycle, every delta is spread over BLIP_TAPS output
+samples with a windowed sinc and readSamples() integrates them again
+*/
+/* pending kernel tails, only complete right after the samples of a frame were read */
+struct blipState {
+	uint64_t offset;
+	int64_t integrator;
+	int32_t tail[BLIP_TAPS];
+};
+
+class blipBuffer {
+	private:
+		int32_t* buffer;
+		uint32_t size; //samples, including room for the kernel tail
+		uint64_t factor; //output samples per clock, 32.32 fixed point
+		uint64_t offset; //output position of the frame start, 32.32 fixed point
+		int64_t integrator;
+
+	public:
+		blipBuffer(uint32_t clockRate, uint32_t sampleRate, uint32_t maxSamples);
+		~blipBuffer();
+		blipBuffer(const blipBuffer&) = delete;
+		blipBuffer& operator=(const blipBuffer&) = delete;
+
+		void addDelta(uint32_t time, int32_t delta); //time in clocks since the frame start
+		void endFrame(uint32_t duration); //makes the samples of duration clocks readable
+		uint32_t samplesAvailable();
+		uint32_t readSamples(int16_t* out, uint32_t count, uint32_t stride);
+		void saveState(blipState& state);
+		void loadState(const blipState& state);
+};
+
+struct apuChannel {
+	bool enabled;
+	bool dac;
+	uint16_t frequency;
+	uint32_t timer; //T-cycles until the next waveform step
+	uint8_t position; //duty step or wave sample index
+	uint16_t length;
+	bool lengthEnable;
+	uint8_t volume;
+	uint8_t envelopePeriod;
+	uint8_t envelopeTimer;
+	bool envelopeUp;
+	uint16_t lfsr; //noise channel
+	int32_t amp[2]; //last level sent to the left and right buffers
+};
+
+/* channel and sequencer state, registers are part of the saved memory */
+struct apuState {
+	apuChannel ch[4];
+	uint16_t sweepShadow;
+	uint8_t sweepTimer;
+	bool sweepEnabled;
+
+	bool power;
+	uint8_t sequencerStep;
+	uint32_t sequencerTimer;
+	uint64_t now;
+	uint64_t frameStart;
+
+	blipState left;
+	blipState right;
+};
+
+/*
+two square channels, wave and noise
+
+nothing runs per cycle: the APU catches up to the CPU when one of its
+registers is written and at endFrame(), which the frame loop calls once
+per scanline or frame to hand finished samples to the output ring
+*/
+class apu : public ioDevice {
+	private:
+		uint8_t* memory; //registers live in 0xFF10-0xFF3F
+		audioRing* output;
+		blipBuffer* left;
+		blipBuffer* right;
+		int16_t* mixBuffer;
+
+		apuChannel ch[4];
+		uint16_t sweepShadow;
+		uint8_t sweepTimer;
+		bool sweepEnabled;
+
+		bool power;
+		uint8_t sequencerStep;
+		uint32_t sequencerTimer;
+		uint64_t now; //T-cycles emulated so far
+		uint64_t frameStart; //T-cycle the blip buffers' frame starts at
+		uint64_t dropped; //frames the output ring had no room for
+
+		void runTo(uint64_t time);
+		void runChannels(uint64_t end);
+		void clockSequencer();
+		void trigger(int c);
+		uint32_t period(int c);
+		uint8_t level(int c);
+		void updateLevel(int c, uint64_t time);
+		uint16_t sweepCalc();
+
+	public:
+		apu(uint8_t* memory, audioRing* output);
+		~apu();
+		apu(const apu&) = delete;
+		apu& operator=(const apu&) = delete;
+
+		uint8_t ioRead(uint16_t address, uint8_t val, uint64_t cycle);
+		void ioWrite(uint16_t address, uint8_t val, uint64_t cycle);
+		void endFrame(uint64_t cycle); //cycle in gbcpu machine cycles
+		uint64_t getDroppedFrames();
+		void setOutput(audioRing* output); //NULL discards the samples of the following frames
+
+		/* only between frames, after endFrame() */
+		void saveState(apuState& state);
+		void loadState(const apuState& state);
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "audio.h"
+
+#include <iostream>
+#include <cstring>
+
+audioRing::audioRing(uint32_t capacity) {
+	/* round up to a power of 2 so indices can be masked */
+	this->capacity = 1;
+	while (this->capacity < capacity) {
+		this->capacity <<= 1;
+	}
+
+	this->samples = new int16_t[this->capacity * AUDIO_CHANNELS];
+	this->head = 0;
+	this->tail = 0;
+}
+
+audioRing::~audioRing() {
+	delete[] this->samples;
+}
+
+uint32_t audioRing::write(const int16_t* frames, uint32_t count) {
+	uint64_t h = this->head.load(std::memory_order_relaxed);
+	uint64_t t = this->tail.load(std::memory_order_acquire);
+	uint32_t space = this->capacity - static_cast<uint32_t>(h - t);
+	if (count > space) {
+		count = space;
+	}
+
+	/* at most two copies, before and after the wrap */
+	uint32_t start = static_cast<uint32_t>(h & (this->capacity - 1));
+	uint32_t first = (count < this->capacity - start) ? count : this->capacity - start;
+	memcpy(&this->samples[start * AUDIO_CHANNELS], frames, first * AUDIO_CHANNELS * sizeof(int16_t));
+	memcpy(this->samples, &frames[first * AUDIO_CHANNELS], (count - first) * AUDIO_CHANNELS * sizeof(int16_t));
+
+	this->head.store(h + count, std::memory_order_release);
+	return count;
+}
+
+uint32_t audioRing::read(int16_t* frames, uint32_t count) {
+	uint64_t t = this->tail.load(std::memory_order_relaxed);
+	uint64_t h = this->head.load(std::memory_order_acquire);
+	uint32_t waiting = static_cast<uint32_t>(h - t);
+	if (count > waiting) {
+		count = waiting;
+	}
+
+	uint32_t start = static_cast<uint32_t>(t & (this->capacity - 1));
+	uint32_t first = (count < this->capacity - start) ? count : this->capacity - start;
+	memcpy(frames, &this->samples[start * AUDIO_CHANNELS], first * AUDIO_CHANNELS * sizeof(int16_t));
+	memcpy(&frames[first * AUDIO_CHANNELS], this->samples, (count - first) * AUDIO_CHANNELS * sizeof(int16_t));
+
+	this->tail.store(t + count, std::memory_order_release);
+	return count;
+}
+
+uint32_t audioRing::available() {
+	return static_cast<uint32_t>(this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire));
+}
+
+uint32_t audioRing::getCapacity() {
+	return this->capacity;
+}
+
+/* little endian helpers for the RIFF header */
+static void put16(uint8_t* p, uint16_t v) {
+	p[0] = static_cast<uint8_t>(v);
+	p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+	put16(p, static_cast<uint16_t>(v));
+	put16(p + 2, static_cast<uint16_t>(v >> 16));
+}
+
+static void wavHeader(uint8_t* header, uint32_t sampleRate, uint32_t dataBytes) {
+	memcpy(header, "RIFF", 4);
+	put32(header + 4, 36 + dataBytes);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	put32(header + 16, 16); //PCM format chunk size
+	put16(header + 20, 1); //PCM
+	put16(header + 22, AUDIO_CHANNELS);
+	put32(header + 24, sampleRate);
+	put32(header + 28, sampleRate * AUDIO_CHANNELS * sizeof(int16_t)); //byte rate
+	put16(header + 32, AUDIO_CHANNELS * sizeof(int16_t)); //block align
+	put16(header + 34, 16); //bits per sample
+	memcpy(header + 36, "data", 4);
+	put32(header + 40, dataBytes);
+}
+
+wavWriter::wavWriter() {
+	this->file = NULL;
+	this->dataBytes = 0;
+	this->sampleRate = 0;
+}
+
+wavWriter::~wavWriter() {
+	this->close();
+}
+
+bool wavWriter::open(const char* filename, uint32_t sampleRate) {
+	this->close();
+
+	this->file = fopen(filename, "wb");
+	if (!this->file) {
+		std::cout << "ERROR: failed to open WAV file " << filename << std::endl;
+		return false;
+	}
+
+	uint8_t header[44];
+	this->sampleRate = sampleRate;
+	this->dataBytes = 0;
+	wavHeader(header, sampleRate, 0);
+	fwrite(header, sizeof(header), 1, this->file);
+	return true;
+}
+
+void wavWriter::write(const int16_t* frames, uint32_t count) {
+	if (!this->file) {
+		return;
+	}
+
+	/* samples are written in host order, WAV is little endian like every platform we build for */
+	fwrite(frames, AUDIO_CHANNELS * sizeof(int16_t), count, this->file);
+	this->dataBytes += count * AUDIO_CHANNELS * sizeof(int16_t);
+}
+
+void wavWriter::close() {
+	if (!this->file) {
+		return;
+	}
+
+	uint8_t header[44];
+	wavHeader(header, this->sampleRate, this->dataBytes);
+	fseek(this->file, 0, SEEK_SET);
+	fwrite(header, sizeof(header), 1, this->file);
+	fclose(this->file);
+	this->file = NULL;
+}
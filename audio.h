@@ -0,0 +1,45 @@
+#ifndef __AUDIO_H__
+#define __AUDIO_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+
+#define AUDIO_CHANNELS 2 //samples are interleaved left/right
+
+/* single producer, single consumer ring of stereo int16 frames */
+class audioRing {
+	private:
+		int16_t* samples;
+		uint32_t capacity; //frames, power of 2
+
+		alignas(64) std::atomic<uint64_t> head; //written by the emulator
+		alignas(64) std::atomic<uint64_t> tail; //written by the consumer
+
+	public:
+		audioRing(uint32_t capacity);
+		~audioRing();
+		audioRing(const audioRing&) = delete;
+		audioRing& operator=(const audioRing&) = delete;
+
+		uint32_t write(const int16_t* frames, uint32_t count); //returns frames written, never blocks
+		uint32_t read(int16_t* frames, uint32_t count); //returns frames read, never blocks
+		uint32_t available(); //frames waiting to be read
+		uint32_t getCapacity();
+};
+
+class wavWriter {
+	private:
+		FILE* file;
+		uint32_t dataBytes;
+		uint32_t sampleRate;
+
+	public:
+		wavWriter();
+		~wavWriter();
+		bool open(const char* filename, uint32_t sampleRate);
+		void write(const int16_t* frames, uint32_t count);
+		void close(); //patches the header sizes
+};
+
+#endif
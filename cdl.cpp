@@ -0,0 +1,81 @@
+#include "cdl.h"
+#include "gameboy.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+codeDataLog::codeDataLog() {
+	this->clear();
+}
+
+void codeDataLog::clear() {
+	memset(this->flags, 0, sizeof(this->flags));
+	this->lastPC = 0;
+	this->lastOpcode = 0;
+	this->started = false;
+}
+
+void codeDataLog::onFetch(uint16_t PC, uint8_t opcode) {
+	uint8_t mark = CDL_CODE;
+	if (this->started && PC != static_cast<uint16_t>(this->lastPC + instructionLength(this->lastOpcode))) {
+		mark |= CDL_JUMP_TARGET;
+		if (isCallOpcode(this->lastOpcode)) {
+			mark |= CDL_SUB_ENTRY;
+		}
+	}
+	this->flags[PC] |= mark;
+
+	this->lastPC = PC;
+	this->lastOpcode = opcode;
+	this->started = true;
+}
+
+void codeDataLog::restored() {
+	this->started = false;
+}
+
+uint8_t codeDataLog::get(uint16_t address) {
+	return this->flags[address];
+}
+
+uint32_t codeDataLog::count(uint8_t flag, uint32_t first, uint32_t last) {
+	uint32_t n = 0;
+	for (uint32_t i = first; i < last && i < CDL_SIZE; i++) {
+		n += (this->flags[i] & flag) ? 1 : 0;
+	}
+	return n;
+}
+
+bool codeDataLog::save(const char* filename, bool wholeMap) {
+	FILE* f = fopen(filename, "wb");
+	if (!f) {
+		std::cout << "ERROR: failed to create " << filename << std::endl;
+		return false;
+	}
+	size_t size = wholeMap ? CDL_SIZE : ROM_SIZE;
+	bool ok = fwrite(this->flags, 1, size, f) == size;
+	fclose(f);
+	return ok;
+}
+
+bool codeDataLog::load(const char* filename) {
+	FILE* f = fopen(filename, "rb");
+	if (!f) {
+		std::cout << "ERROR: failed to open " << filename << std::endl;
+		return false;
+	}
+
+	uint8_t saved[CDL_SIZE];
+	size_t size = fread(saved, 1, CDL_SIZE, f);
+	fclose(f);
+	if (size != ROM_SIZE && size != CDL_SIZE) {
+		std::cout << "ERROR: " << filename << " is not a code/data log" << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < size; i++) {
+		this->flags[i] |= saved[i];
+	}
+	return true;
+}
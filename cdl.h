@@ -0,0 +1,48 @@
+#ifndef __CDL_H__
+#define __CDL_H__
+
+#include <cstdint>
+
+/* flags per byte, the low four as in the FCEUX/Mesen .cdl files */
+#define CDL_CODE 0x01 //executed, opcode or operand
+#define CDL_DATA 0x02 //read as data
+#define CDL_JUMP_TARGET 0x04 //reached other than by running into it
+#define CDL_SUB_ENTRY 0x08 //reached by a CALL or RST
+#define CDL_WRITTEN 0x10 //only in the full map, ROM is never written
+
+#define CDL_SIZE 0x10000 //the whole address space, there is no banking
+
+/*
+code/data log, filled in by gbcpu while it is attached
+
+fetches and bus accesses go through gbcpu's hook paths, which are only
+taken while a tracer, breakpoint, profiler or this log is attached, so a
+detached log costs nothing. Operands are read at PC and count as code
+*/
+class codeDataLog {
+	private:
+		uint8_t flags[CDL_SIZE];
+		uint16_t lastPC; //of the previous opcode fetch
+		uint8_t lastOpcode;
+		bool started;
+
+	public:
+		codeDataLog();
+		void clear();
+
+		void onFetch(uint16_t PC, uint8_t opcode);
+		void restored(); //PC jumped with a loaded state, that is not a jump target
+		void onRead(uint16_t address, uint16_t PC) {
+			this->flags[address] |= (address == PC) ? CDL_CODE : CDL_DATA;
+		}
+		void onWrite(uint16_t address) {
+			this->flags[address] |= CDL_WRITTEN;
+		}
+
+		uint8_t get(uint16_t address);
+		uint32_t count(uint8_t flag, uint32_t first, uint32_t last); //bytes in [first, last) with the flag
+		bool save(const char* filename, bool wholeMap = false); //the cartridge area only, unless wholeMap
+		bool load(const char* filename); //merges a saved log into this one
+};
+
+#endif
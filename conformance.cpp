@@ -0,0 +1,649 @@
+#include "conformance.h"
+
+#include <iostream>
+#include <cstring>
+#include <thread>
+
+jsonStream::jsonStream() {
+	this->file = NULL;
+	this->buffer = new char[JSON_BUFFER_SIZE];
+	this->pos = 0;
+	this->length = 0;
+}
+
+jsonStream::~jsonStream() {
+	this->close();
+	delete[] this->buffer;
+}
+
+bool jsonStream::open(const char* filename) {
+	this->close();
+	this->file = fopen(filename, "rb");
+	return this->file != NULL;
+}
+
+void jsonStream::close() {
+	if (this->file) {
+		fclose(this->file);
+		this->file = NULL;
+	}
+	this->pos = 0;
+	this->length = 0;
+}
+
+bool jsonStream::refill() {
+	if (!this->file) {
+		return false;
+	}
+	this->length = fread(this->buffer, 1, JSON_BUFFER_SIZE, this->file);
+	this->pos = 0;
+	return this->length > 0;
+}
+
+int jsonStream::peek() {
+	if (this->pos == this->length && !this->refill()) {
+		return EOF;
+	}
+	return static_cast<unsigned char>(this->buffer[this->pos]);
+}
+
+void jsonStream::skipSpace() {
+	int c = this->peek();
+	while (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+		this->pos++;
+		c = this->peek();
+	}
+}
+
+bool jsonStream::consume(char c) {
+	this->skipSpace();
+	if (this->peek() != static_cast<unsigned char>(c)) {
+		return false;
+	}
+	this->pos++;
+	return true;
+}
+
+bool jsonStream::readString(char* out, size_t size) {
+	if (!this->consume('"')) {
+		return false;
+	}
+
+	size_t n = 0;
+	while (true) {
+		int c = this->peek();
+		if (c == EOF) {
+			return false;
+		}
+		this->pos++;
+		if (c == '"') {
+			break;
+		}
+		if (c == '\\') { //the escaped character is kept as is, names never need more
+			c = this->peek();
+			if (c == EOF) {
+				return false;
+			}
+			this->pos++;
+		}
+		if (out && n + 1 < size) {
+			out[n++] = static_cast<char>(c);
+		}
+	}
+	if (out && size > 0) {
+		out[n] = '\0';
+	}
+	return true;
+}
+
+bool jsonStream::readNumber(int64_t& n) {
+	this->skipSpace();
+	bool negative = this->peek() == '-';
+	if (negative) {
+		this->pos++;
+	}
+
+	int c = this->peek();
+	if (c < '0' || c > '9') {
+		return false;
+	}
+	n = 0;
+	while (c >= '0' && c <= '9') {
+		n = n * 10 + (c - '0');
+		this->pos++;
+		c = this->peek();
+	}
+
+	/* fractions and exponents are dropped */
+	while (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-' || (c >= '0' && c <= '9')) {
+		this->pos++;
+		c = this->peek();
+	}
+	if (negative) {
+		n = -n;
+	}
+	return true;
+}
+
+bool jsonStream::readNull() {
+	this->skipSpace();
+	for (const char* word = "null"; *word; word++) {
+		if (this->peek() != *word) {
+			return false;
+		}
+		this->pos++;
+	}
+	return true;
+}
+
+bool jsonStream::skipValue() {
+	this->skipSpace();
+	int c = this->peek();
+	int64_t number;
+
+	if (c == '"') {
+		return this->readString(NULL, 0);
+	}
+	if (c == '-' || (c >= '0' && c <= '9')) {
+		return this->readNumber(number);
+	}
+	if (c == '[' || c == '{') {
+		char close = (c == '[') ? ']' : '}';
+		this->pos++;
+		if (this->consume(close)) {
+			return true;
+		}
+		do {
+			if (close == '}' && (!this->readString(NULL, 0) || !this->consume(':'))) {
+				return false;
+			}
+			if (!this->skipValue()) {
+				return false;
+			}
+		} while (this->consume(','));
+		return this->consume(close);
+	}
+
+	/* true, false and null */
+	if (c < 'a' || c > 'z') {
+		return false;
+	}
+	while (c >= 'a' && c <= 'z') {
+		this->pos++;
+		c = this->peek();
+	}
+	return true;
+}
+
+bool jsonStream::atEnd() {
+	this->skipSpace();
+	return this->peek() == EOF;
+}
+
+conformanceParser::conformanceParser() {
+	this->started = false;
+	this->broken = false;
+}
+
+bool conformanceParser::open(const char* filename) {
+	this->started = false;
+	this->broken = false;
+	if (!this->json.open(filename)) {
+		std::cout << "ERROR: failed to open test file " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void conformanceParser::close() {
+	this->json.close();
+}
+
+bool conformanceParser::failed() {
+	return this->broken;
+}
+
+bool conformanceParser::readRam(conformanceState& state) {
+	state.ramCount = 0;
+	if (!this->json.consume('[')) {
+		return false;
+	}
+	if (this->json.consume(']')) {
+		return true;
+	}
+
+	do {
+		int64_t address;
+		int64_t value;
+		if (!this->json.consume('[') || !this->json.readNumber(address) || !this->json.consume(',') ||
+			!this->json.readNumber(value) || !this->json.consume(']')) {
+			return false;
+		}
+		if (state.ramCount == CONFORMANCE_MAX_RAM) {
+			return false;
+		}
+		state.address[state.ramCount] = static_cast<uint16_t>(address);
+		state.value[state.ramCount] = static_cast<uint8_t>(value);
+		state.ramCount++;
+	} while (this->json.consume(','));
+	return this->json.consume(']');
+}
+
+bool conformanceParser::readState(conformanceState& state) {
+	registerPair AF = {};
+	registerPair BC = {};
+	registerPair DE = {};
+	registerPair HL = {};
+	char key[8];
+
+	state.SP = 0;
+	state.PC = 0;
+	state.ramCount = 0;
+	if (!this->json.consume('{')) {
+		return false;
+	}
+	if (!this->json.consume('}')) {
+		do {
+			if (!this->json.readString(key, sizeof(key)) || !this->json.consume(':')) {
+				return false;
+			}
+			if (strcmp(key, "ram") == 0) {
+				if (!this->readRam(state)) {
+					return false;
+				}
+				continue;
+			}
+
+			/* registers by name, anything else is skipped */
+			uint8_t* half = NULL;
+			uint16_t* full = NULL;
+			if (key[0] != '\0' && key[1] == '\0') {
+				switch (key[0]) {
+				case 'a': half = &AF.half[1]; break;
+				case 'f': half = &AF.half[0]; break;
+				case 'b': half = &BC.half[1]; break;
+				case 'c': half = &BC.half[0]; break;
+				case 'd': half = &DE.half[1]; break;
+				case 'e': half = &DE.half[0]; break;
+				case 'h': half = &HL.half[1]; break;
+				case 'l': half = &HL.half[0]; break;
+				}
+			}
+			else if (strcmp(key, "pc") == 0) {
+				full = &state.PC;
+			}
+			else if (strcmp(key, "sp") == 0) {
+				full = &state.SP;
+			}
+
+			int64_t value;
+			if (half || full) {
+				if (!this->json.readNumber(value)) {
+					return false;
+				}
+				if (half) {
+					*half = static_cast<uint8_t>(value);
+				}
+				else {
+					*full = static_cast<uint16_t>(value);
+				}
+			}
+			else if (!this->json.skipValue()) {
+				return false;
+			}
+		} while (this->json.consume(','));
+		if (!this->json.consume('}')) {
+			return false;
+		}
+	}
+
+	state.AF = AF.full;
+	state.BC = BC.full;
+	state.DE = DE.full;
+	state.HL = HL.full;
+	return true;
+}
+
+bool conformanceParser::readCycles(conformanceCase& test) {
+	test.cycleCount = 0;
+	if (!this->json.consume('[')) {
+		return false;
+	}
+	if (this->json.consume(']')) {
+		return true;
+	}
+
+	do {
+		if (test.cycleCount == CONFORMANCE_MAX_CYCLES) {
+			return false;
+		}
+		conformanceCycle& cycle = test.cycles[test.cycleCount++];
+		cycle.type = BUS_IDLE;
+		cycle.address = 0;
+		cycle.value = 0;
+		if (this->json.readNull()) {
+			continue;
+		}
+
+		/* [address, value, pins], pins are "r-m"/"-wm"/"---" or "read"/"write" */
+		int64_t address = 0;
+		int64_t value = 0;
+		char pins[8];
+		if (!this->json.consume('[')) {
+			return false;
+		}
+		if (!this->json.readNull() && !this->json.readNumber(address)) {
+			return false;
+		}
+		if (!this->json.consume(',') || (!this->json.readNull() && !this->json.readNumber(value))) {
+			return false;
+		}
+		if (!this->json.consume(',') || !this->json.readString(pins, sizeof(pins)) || !this->json.consume(']')) {
+			return false;
+		}
+
+		if (pins[0] == 'r') {
+			cycle.type = BUS_READ;
+		}
+		else if (pins[0] == 'w' || pins[1] == 'w') {
+			cycle.type = BUS_WRITE;
+		}
+		cycle.address = static_cast<uint16_t>(address);
+		cycle.value = static_cast<uint8_t>(value);
+	} while (this->json.consume(','));
+	return this->json.consume(']');
+}
+
+bool conformanceParser::next(conformanceCase& test) {
+	if (this->broken) {
+		return false;
+	}
+
+	/* the file is one array, cases are taken from it one at a time */
+	if (!this->started) {
+		this->started = true;
+		if (!this->json.consume('[')) {
+			this->broken = true;
+			return false;
+		}
+		if (this->json.consume(']')) {
+			return false;
+		}
+	}
+	else if (!this->json.consume(',')) {
+		this->broken = !this->json.consume(']') || !this->json.atEnd();
+		return false;
+	}
+
+	char key[16];
+	test.name[0] = '\0';
+	test.cycleCount = 0;
+	bool ok = this->json.consume('{');
+	while (ok) {
+		ok = this->json.readString(key, sizeof(key)) && this->json.consume(':');
+		if (!ok) {
+			break;
+		}
+
+		if (strcmp(key, "name") == 0) {
+			ok = this->json.readString(test.name, sizeof(test.name));
+		}
+		else if (strcmp(key, "initial") == 0) {
+			ok = this->readState(test.initial);
+		}
+		else if (strcmp(key, "final") == 0) {
+			ok = this->readState(test.final);
+		}
+		else if (strcmp(key, "cycles") == 0) {
+			ok = this->readCycles(test);
+		}
+		else {
+			ok = this->json.skipValue();
+		}
+
+		if (ok && !this->json.consume(',')) {
+			ok = this->json.consume('}');
+			break;
+		}
+	}
+
+	this->broken = !ok;
+	return ok;
+}
+
+conformanceResult::conformanceResult() {
+	this->passed = 0;
+	this->failed = 0;
+	this->skipped = 0;
+	this->badFiles = 0;
+	memset(this->opcodePassed, 0, sizeof(this->opcodePassed));
+	memset(this->opcodeFailed, 0, sizeof(this->opcodeFailed));
+}
+
+void conformanceResult::merge(const conformanceResult& other) {
+	this->passed += other.passed;
+	this->failed += other.failed;
+	this->skipped += other.skipped;
+	this->badFiles += other.badFiles;
+	for (int i = 0; i < 256; i++) {
+		this->opcodePassed[i] += other.opcodePassed[i];
+		this->opcodeFailed[i] += other.opcodeFailed[i];
+	}
+	for (size_t i = 0; i < other.failures.size() && this->failures.size() < CONFORMANCE_MAX_REPORTS; i++) {
+		this->failures.push_back(other.failures[i]);
+	}
+}
+
+conformanceRunner::conformanceRunner(unsigned int threads) {
+	if (threads == 0) {
+		threads = 1;
+	}
+	this->includeAll = false;
+
+	for (unsigned int i = 0; i < threads; i++) {
+		conformanceWorker* worker = new conformanceWorker;
+		worker->memory = new uint8_t[0x10000](); //the whole address space, plain memory without IO
+		worker->cpu = new gbcpu(worker->memory);
+		worker->ring = new traceRing(i);
+		worker->cpu->setTracer(worker->ring, true);
+		worker->failure[0] = '\0';
+		this->workers.push_back(worker);
+	}
+}
+
+conformanceRunner::~conformanceRunner() {
+	for (conformanceWorker* worker : this->workers) {
+		delete worker->cpu;
+		delete worker->ring;
+		delete[] worker->memory;
+		delete worker;
+	}
+}
+
+void conformanceRunner::setIncludeAll(bool all) {
+	this->includeAll = all;
+}
+
+int conformanceRunner::check(conformanceWorker* worker, const conformanceCase& test) {
+	uint8_t* memory = worker->memory;
+	char* failure = worker->failure;
+	const size_t size = sizeof(worker->failure);
+	failure[0] = '\0';
+
+	for (uint32_t i = 0; i < test.initial.ramCount; i++) {
+		memory[test.initial.address[i]] = test.initial.value[i];
+	}
+
+	/* the opcode at PC - 1 is already fetched */
+	cpuState state = {};
+	state.AF.full = test.initial.AF;
+	state.BC.full = test.initial.BC;
+	state.DE.full = test.initial.DE;
+	state.HL.full = test.initial.HL;
+	state.SP = test.initial.SP;
+	state.PC = test.initial.PC;
+	state.opcode = memory[static_cast<uint16_t>(test.initial.PC - 1)];
+	worker->opcode = state.opcode;
+	state.nibble[0] = state.opcode & 0x0F;
+	state.nibble[1] = (state.opcode >> 4) & 0x0F;
+	state.cycle = NEW_CYCLE;
+	state.totalCycles = 0;
+
+	int outcome = 1;
+	uint8_t family = opcodeFamily(state.opcode);
+	if (!this->includeAll && (family == FAMILY_OTHER || family == FAMILY_CB)) {
+		outcome = -1;
+	}
+	else {
+		worker->cpu->loadState(state);
+		for (uint32_t i = 0; i < test.cycleCount; i++) {
+			worker->cpu->tick();
+		}
+	}
+
+	/* the ring holds this case's bus cycles, tagged with the cycle they happened in */
+	uint8_t seen[CONFORMANCE_MAX_CYCLES] = { 0 };
+	uint16_t written[CONFORMANCE_MAX_CYCLES];
+	uint32_t writes = 0;
+	uint64_t fetched = 0;
+	traceRecord record;
+	while (worker->ring->pop(record)) {
+		if (record.type == TRACE_EXEC) {
+			if (fetched == 0) {
+				fetched = record.cycle;
+			}
+			continue;
+		}
+
+		uint64_t index = record.cycle - 1;
+		uint8_t type = (record.type == TRACE_READ) ? BUS_READ : BUS_WRITE;
+		if (record.type == TRACE_WRITE && writes < CONFORMANCE_MAX_CYCLES) {
+			written[writes++] = record.address; //may lie outside the case's ram
+		}
+		if (outcome != 1) {
+			continue;
+		}
+		if (index >= test.cycleCount || test.cycles[index].type != type || test.cycles[index].address != record.address ||
+			test.cycles[index].value != record.data) {
+			snprintf(failure, size, "cycle %llu: unexpected %s %04X = %02X", (unsigned long long)index,
+				(type == BUS_READ) ? "read" : "write", record.address, record.data);
+			outcome = 0;
+		}
+		else {
+			seen[index] = 1;
+		}
+	}
+
+	if (outcome == 1 && fetched != test.cycleCount) {
+		if (fetched == 0) {
+			snprintf(failure, size, "next opcode not fetched after %u cycles", test.cycleCount);
+		}
+		else {
+			snprintf(failure, size, "took %llu cycles, expected %u", (unsigned long long)fetched, test.cycleCount);
+		}
+		outcome = 0;
+	}
+
+	/* the last cycle is the opcode fetch, it never shows up on gbcpu's bus */
+	for (uint32_t i = 0; outcome == 1 && i + 1 < test.cycleCount; i++) {
+		if (test.cycles[i].type != BUS_IDLE && !seen[i]) {
+			snprintf(failure, size, "cycle %u: missing %s %04X = %02X", i, (test.cycles[i].type == BUS_READ) ? "read" : "write",
+				test.cycles[i].address, test.cycles[i].value);
+			outcome = 0;
+		}
+	}
+
+	if (outcome == 1) {
+		worker->cpu->saveState(state);
+		const char* names[6] = { "AF", "BC", "DE", "HL", "SP", "PC" };
+		uint16_t got[6] = { state.AF.full, state.BC.full, state.DE.full, state.HL.full, state.SP, state.PC };
+		uint16_t want[6] = { test.final.AF, test.final.BC, test.final.DE, test.final.HL, test.final.SP, test.final.PC };
+		for (int i = 0; i < 6; i++) {
+			if (got[i] != want[i]) {
+				snprintf(failure, size, "%s %04X, expected %04X", names[i], got[i], want[i]);
+				outcome = 0;
+				break;
+			}
+		}
+	}
+	for (uint32_t i = 0; outcome == 1 && i < test.final.ramCount; i++) {
+		if (memory[test.final.address[i]] != test.final.value[i]) {
+			snprintf(failure, size, "memory %04X = %02X, expected %02X", test.final.address[i], memory[test.final.address[i]],
+				test.final.value[i]);
+			outcome = 0;
+		}
+	}
+
+	/* leave the memory zeroed for the next case */
+	for (uint32_t i = 0; i < test.initial.ramCount; i++) {
+		memory[test.initial.address[i]] = 0;
+	}
+	for (uint32_t i = 0; i < test.final.ramCount; i++) {
+		memory[test.final.address[i]] = 0;
+	}
+	for (uint32_t i = 0; i < writes; i++) {
+		memory[written[i]] = 0;
+	}
+	return outcome;
+}
+
+int conformanceRunner::runCase(const conformanceCase& test) {
+	return this->check(this->workers[0], test);
+}
+
+const char* conformanceRunner::getFailure() {
+	return this->workers[0]->failure;
+}
+
+void conformanceRunner::runFiles(conformanceWorker* worker, const std::vector<std::string>* files, std::atomic<size_t>* next,
+	conformanceResult* result) {
+	conformanceParser parser;
+
+	for (size_t i = (*next)++; i < files->size(); i = (*next)++) {
+		const char* filename = (*files)[i].c_str();
+		if (!parser.open(filename)) {
+			result->badFiles++;
+			continue;
+		}
+
+		while (parser.next(worker->test)) {
+			int outcome = this->check(worker, worker->test);
+			if (outcome < 0) {
+				result->skipped++;
+			}
+			else if (outcome > 0) {
+				result->passed++;
+				result->opcodePassed[worker->opcode]++;
+			}
+			else {
+				result->failed++;
+				result->opcodeFailed[worker->opcode]++;
+				if (result->failures.size() < CONFORMANCE_MAX_REPORTS) {
+					result->failures.push_back(std::string(filename) + " \"" + worker->test.name + "\": " + worker->failure);
+				}
+			}
+		}
+		if (parser.failed()) {
+			std::cout << "ERROR: bad test case in " << filename << " after " << worker->test.name << std::endl;
+			result->badFiles++;
+		}
+		parser.close();
+	}
+}
+
+conformanceResult conformanceRunner::run(const std::vector<std::string>& files) {
+	std::vector<conformanceResult> results(this->workers.size());
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
+
+	for (size_t i = 0; i < this->workers.size(); i++) {
+		threads.push_back(std::thread(&conformanceRunner::runFiles, this, this->workers[i], &files, &next, &results[i]));
+	}
+
+	conformanceResult total;
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+		total.merge(results[i]);
+	}
+	return total;
+}
@@ -0,0 +1,162 @@
+#ifndef __CONFORMANCE_H__
+#define __CONFORMANCE_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <atomic>
+#include <vector>
+
+#include "cpu.h"
+#include "trace.h"
+
+#define CONFORMANCE_MAX_RAM 32 //bytes set or checked by one case
+#define CONFORMANCE_MAX_CYCLES 8 //machine cycles, the longest instruction takes 6
+#define CONFORMANCE_NAME_SIZE 32
+#define CONFORMANCE_MAX_REPORTS 20 //failures kept per run
+#define JSON_BUFFER_SIZE 65536
+
+#define BUS_IDLE 0
+#define BUS_READ 1
+#define BUS_WRITE 2
+
+/*
+single instruction test vectors, one JSON file per opcode, as in
+
+	[{"name": "41 0000",
+	  "initial": {"pc": 257, "sp": 0, "a": 0, "b": 18, "c": 52, ... "ram": [[256, 65], [257, 0]]},
+	  "final": {...},
+	  "cycles": [[257, 0, "r-m"]]}, ...]
+
+the opcode at pc - 1 has already been fetched, as it is when gbcpu
+starts an instruction. Every case ends with the fetch of the next opcode,
+which gbcpu does without a bus read, so that last cycle is only checked
+for its timing. Other keys (ime, ie, ...) are ignored
+*/
+struct conformanceState {
+	uint16_t AF;
+	uint16_t BC;
+	uint16_t DE;
+	uint16_t HL;
+	uint16_t SP;
+	uint16_t PC;
+
+	uint32_t ramCount;
+	uint16_t address[CONFORMANCE_MAX_RAM];
+	uint8_t value[CONFORMANCE_MAX_RAM];
+};
+
+struct conformanceCycle {
+	uint8_t type; //BUS_*
+	uint8_t value;
+	uint16_t address;
+};
+
+struct conformanceCase {
+	char name[CONFORMANCE_NAME_SIZE];
+	conformanceState initial;
+	conformanceState final;
+	uint32_t cycleCount;
+	conformanceCycle cycles[CONFORMANCE_MAX_CYCLES];
+};
+
+/* pull parser over a buffered file, only ever holds one buffer of text */
+class jsonStream {
+	private:
+		FILE* file;
+		char* buffer;
+		size_t pos;
+		size_t length;
+
+		bool refill();
+		int peek(); //EOF at the end
+		void skipSpace();
+
+	public:
+		jsonStream();
+		~jsonStream();
+		jsonStream(const jsonStream&) = delete;
+		jsonStream& operator=(const jsonStream&) = delete;
+
+		bool open(const char* filename);
+		void close();
+
+		bool consume(char c); //skips whitespace, then takes c if it is next
+		bool readString(char* out, size_t size); //truncates to size - 1
+		bool readNumber(int64_t& n); //integer part only
+		bool readNull();
+		bool skipValue();
+		bool atEnd();
+};
+
+/* reads conformanceCases from one file without building a document */
+class conformanceParser {
+	private:
+		jsonStream json;
+		bool started;
+		bool broken;
+
+		bool readState(conformanceState& state);
+		bool readRam(conformanceState& state);
+		bool readCycles(conformanceCase& test);
+
+	public:
+		conformanceParser();
+		bool open(const char* filename);
+		void close();
+		bool next(conformanceCase& test); //false at the end of the file or on bad input
+		bool failed(); //true when next() stopped on bad input
+};
+
+struct conformanceResult {
+	uint64_t passed;
+	uint64_t failed;
+	uint64_t skipped; //opcodes gbcpu does not implement yet
+	uint32_t badFiles;
+	uint64_t opcodePassed[256];
+	uint64_t opcodeFailed[256];
+	std::vector<std::string> failures; //the first CONFORMANCE_MAX_REPORTS
+
+	conformanceResult();
+	void merge(const conformanceResult& other);
+};
+
+/* everything one thread needs, allocated once and reused for every case */
+struct conformanceWorker {
+	uint8_t* memory;
+	gbcpu* cpu;
+	traceRing* ring; //bus reads and writes of the case being run
+	conformanceCase test;
+	uint8_t opcode; //of the last case
+	char failure[256];
+};
+
+/*
+runs test vector files across threads
+
+files are handed out one at a time, each thread parses its own file and
+runs the cases on its own CPU, so nothing is shared until the results are
+merged at the end
+*/
+class conformanceRunner {
+	private:
+		std::vector<conformanceWorker*> workers;
+		bool includeAll;
+
+		int check(conformanceWorker* worker, const conformanceCase& test); //1 passed, 0 failed, -1 skipped
+		void runFiles(conformanceWorker* worker, const std::vector<std::string>* files, std::atomic<size_t>* next, conformanceResult* result);
+
+	public:
+		conformanceRunner(unsigned int threads);
+		~conformanceRunner();
+		conformanceRunner(const conformanceRunner&) = delete;
+		conformanceRunner& operator=(const conformanceRunner&) = delete;
+
+		void setIncludeAll(bool all); //also run opcodes gbcpu does not implement, they then fail
+		int runCase(const conformanceCase& test); //on the first thread's CPU, same as check()
+		const char* getFailure(); //why the last runCase() failed
+		conformanceResult run(const std::vector<std::string>& files);
+};
+
+#endif
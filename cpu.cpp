@@ -1,16 +1,253 @@
 #include "cpu.h"
 #include "utils.h"
+#include "trace.h"
+#include "io.h"
+#include "profiler.h"
+#include "cdl.h"
 
 #include <iostream>
+#include <cstring>
 
-cpuDebugger::cpuDebugger(gbcpu target) {
-	this->AF = target.AF;
-	this->BC = target.BC;
-	this->DE = target.DE;
-	this->HL = target.HL;
+uint8_t opcodeFamily(uint8_t opcode) {
+	uint8_t nibble[2];
+	nibble[0] = opcode & 0x0F; //LSN
+	nibble[1] = (opcode >> 4) & 0x0F; //MSN
+
+	/* same decoding as gbcpu::tick() */
+	if (opcode == 0x00) {
+		return FAMILY_NOP;
+	}
+	if (opcode == 0xCB) {
+		return FAMILY_CB;
+	}
+	if (((nibble[1] >= 0x4 && nibble[1] <= 0x6) || (nibble[1] == 0x7 && nibble[0] >= 0x8)) && (nibble[0] % 0x8 != 0x6)) {
+		return FAMILY_LD_R_R;
+	}
+	if ((nibble[0] % 8 == 0x6) && (nibble[1] <= 0x3) && (opcode != 0x36)) {
+		return FAMILY_LD_R_N;
+	}
+	if (((nibble[1] >= 0x4 && nibble[1] <= 0x7) && (nibble[0] % 8 == 0x6) && (opcode != 0x76)) || (opcode == 0x2A) || (opcode == 0x3A)) {
+		return FAMILY_LD_R_HL;
+	}
+	if ((nibble[1] == 0x7 && nibble[0] <= 0x7 && opcode != 0x76) || (opcode == 0x22) || (opcode == 0x32)) {
+		return FAMILY_LD_HL_R;
+	}
+	if (opcode == 0x36) {
+		return FAMILY_LD_HL_N;
+	}
+
+	switch (opcode) {
+	case 0x0A:
+	case 0x1A:
+	case 0x02:
+	case 0x12:
+		return FAMILY_LD_A_RR;
+	case 0xFA:
+	case 0xEA:
+		return FAMILY_LD_A_NN;
+	case 0xF2:
+	case 0xE2:
+	case 0xF0:
+	case 0xE0:
+		return FAMILY_LDH;
+	case 0x08:
+	case 0xF9:
+	case 0xF8:
+		return FAMILY_LD_SP;
+	}
+
+	if ((nibble[0] == 0x1) && (nibble[1] <= 0x3)) {
+		return FAMILY_LD_RR_NN;
+	}
+	if ((nibble[1] >= 0xC) && (nibble[0] == 0x5)) {
+		return FAMILY_PUSH;
+	}
+	if ((nibble[1] >= 0xC) && (nibble[0] == 0x1)) {
+		return FAMILY_POP;
+	}
+	if ((nibble[1] >= 0x8) && (nibble[1] <= 0xB) && (nibble[1] % 8 != 0x6)) {
+		return FAMILY_ALU;
+	}
+
+	return FAMILY_OTHER;
+}
+
+uint8_t instructionLength(uint8_t opcode) {
+	switch (opcode) {
+	case 0x01: //LD rr, nn
+	case 0x11:
+	case 0x21:
+	case 0x31:
+	case 0x08: //LD (nn), SP
+	case 0xC2: //JP
+	case 0xC3:
+	case 0xCA:
+	case 0xD2:
+	case 0xDA:
+	case 0xC4: //CALL
+	case 0xCC:
+	case 0xCD:
+	case 0xD4:
+	case 0xDC:
+	case 0xEA: //LD (nn), A
+	case 0xFA: //LD A, (nn)
+		return 3;
+	case 0x10: //STOP
+	case 0x18: //JR
+	case 0x20:
+	case 0x28:
+	case 0x30:
+	case 0x38:
+	case 0xE0: //LDH
+	case 0xF0:
+	case 0xE8: //ADD SP, e
+	case 0xF8: //LD HL, SP+e
+	case 0xCB:
+		return 2;
+	}
+
+	/* LD r, n and ALU A, n */
+	if ((opcode & 0xC7) == 0x06 || (opcode & 0xC7) == 0xC6) {
+		return 2;
+	}
+	return 1;
+}
+
+bool isCallOpcode(uint8_t opcode) {
+	switch (opcode) {
+	case 0xCD: //CALL nn
+	case 0xC4: //CALL NZ/Z/NC/C, nn
+	case 0xCC:
+	case 0xD4:
+	case 0xDC:
+		return true;
+	}
+	return (opcode & 0xC7) == 0xC7; //RST
+}
+
+const char* familyName(uint8_t family) {
+	static const char* names[NUM_FAMILIES] = {
+		"NOP", "LD r,r", "LD r,n", "LD r,(HL)", "LD (HL),r", "LD (HL),n", "LD A,(rr)", "LD A,(nn)",
+		"LDH", "LD rr,nn", "LD SP", "PUSH", "POP", "ALU", "CB", "other"
+	};
+
+	if (family >= NUM_FAMILIES) {
+		return "invalid";
+	}
+	return names[family];
+}
+
+cpuDebugger::cpuDebugger(gbcpu& target) {
+	this->target = &target;
+	this->points = NULL;
+	this->refresh();
+}
+
+cpuDebugger::~cpuDebugger() {
+	if (this->points) {
+		this->target->debug = NULL;
+		this->target->updateHooks();
+		delete this->points;
+	}
+}
+
+void cpuDebugger::refresh() {
+	this->AF = this->target->AF;
+	this->BC = this->target->BC;
+	this->DE = this->target->DE;
+	this->HL = this->target->HL;
 	
-	this->SP = target.SP;
-	this->PC = target.PC;
+	this->SP = this->target->SP;
+	this->PC = this->target->PC;
+
+#ifdef GBCPU_PROFILE
+	this->profile = this->target->profile;
+#endif
+}
+
+debugPoints* cpuDebugger::attach() {
+	if (!this->points) {
+		this->points = new debugPoints;
+		memset(this->points, 0, sizeof(debugPoints));
+		this->target->debug = this->points;
+	}
+	return this->points;
+}
+
+void cpuDebugger::setBreakpoint(uint16_t address) {
+	debugPoints* p = this->attach();
+	if (!getBit(p->breakMap[address >> 3], address & 7)) {
+		p->breakMap[address >> 3] = static_cast<uint8_t>(setBit(p->breakMap[address >> 3], address & 7, 1));
+		p->breakCount++;
+	}
+	this->target->updateHooks();
+}
+
+void cpuDebugger::clearBreakpoint(uint16_t address) {
+	debugPoints* p = this->attach();
+	if (getBit(p->breakMap[address >> 3], address & 7)) {
+		p->breakMap[address >> 3] = static_cast<uint8_t>(setBit(p->breakMap[address >> 3], address & 7, 0));
+		p->breakCount--;
+	}
+	this->target->updateHooks();
+}
+
+void cpuDebugger::setWatchpoint(uint16_t address, uint8_t mode) {
+	debugPoints* p = this->attach();
+	uint8_t* maps[2] = { p->readMap, p->writeMap };
+
+	for (int i = 0; i < 2; i++) {
+		if ((mode & (1 << i)) && !getBit(maps[i][address >> 3], address & 7)) {
+			maps[i][address >> 3] = static_cast<uint8_t>(setBit(maps[i][address >> 3], address & 7, 1));
+			p->watchCount++;
+		}
+	}
+	p->pageFlags[address >> 8] |= mode & (WATCH_READ | WATCH_WRITE);
+	this->target->updateHooks();
+}
+
+void cpuDebugger::clearWatchpoint(uint16_t address, uint8_t mode) {
+	debugPoints* p = this->attach();
+	uint8_t* maps[2] = { p->readMap, p->writeMap };
+
+	for (int i = 0; i < 2; i++) {
+		if ((mode & (1 << i)) && getBit(maps[i][address >> 3], address & 7)) {
+			maps[i][address >> 3] = static_cast<uint8_t>(setBit(maps[i][address >> 3], address & 7, 0));
+			p->watchCount--;
+		}
+	}
+
+	/* recompute the page flags from the 32 bitmap bytes covering the page */
+	uint8_t flags = 0;
+	for (int i = 0; i < 32; i++) {
+		if (p->readMap[(address >> 8) * 32 + i]) {
+			flags |= WATCH_READ;
+		}
+		if (p->writeMap[(address >> 8) * 32 + i]) {
+			flags |= WATCH_WRITE;
+		}
+	}
+	p->pageFlags[address >> 8] = flags;
+	this->target->updateHooks();
+}
+
+void cpuDebugger::clearAll() {
+	if (this->points) {
+		memset(this->points, 0, sizeof(debugPoints));
+		this->target->updateHooks();
+	}
+}
+
+uint8_t cpuDebugger::getBreakReason() {
+	return this->points ? this->points->reason : BREAK_NONE;
+}
+
+uint16_t cpuDebugger::getBreakAddress() {
+	return this->points ? this->points->address : 0;
+}
+
+uint16_t cpuDebugger::getBreakPC() {
+	return this->points ? this->points->PC : 0;
 }
 
 uint64_t cpuDebugger::getAllRegisters() {
@@ -21,6 +258,186 @@ uint32_t cpuDebugger::getBothPointers() {
 	return (static_cast<uint32_t>(this->SP) << 16) | static_cast<uint32_t>(this->PC);
 }
 
+#ifdef GBCPU_PROFILE
+uint64_t cpuDebugger::getOpcodeCount(uint8_t opcode) {
+	return this->profile.count[opcode];
+}
+
+uint64_t cpuDebugger::getOpcodeCycles(uint8_t opcode) {
+	return this->profile.cycles[opcode];
+}
+
+uint64_t cpuDebugger::getCBCount(uint8_t opcode) {
+	return this->profile.cbCount[opcode];
+}
+
+uint64_t cpuDebugger::getCBCycles(uint8_t opcode) {
+	return this->profile.cbCycles[opcode];
+}
+
+uint64_t cpuDebugger::getFamilyCount(uint8_t family) {
+	/* families are summed here so the CPU only has to count opcodes */
+	uint64_t total = 0;
+	for (unsigned int i = 0; i < 256; i++) {
+		if (opcodeFamily(static_cast<uint8_t>(i)) == family) {
+			total += this->profile.count[i];
+		}
+	}
+	return total;
+}
+
+uint64_t cpuDebugger::getFamilyCycles(uint8_t family) {
+	uint64_t total = 0;
+	for (unsigned int i = 0; i < 256; i++) {
+		if (opcodeFamily(static_cast<uint8_t>(i)) == family) {
+			total += this->profile.cycles[i];
+		}
+	}
+	return total;
+}
+
+void cpuDebugger::profileDump(unsigned int top) {
+	uint64_t totalCycles = 0;
+	for (unsigned int i = 0; i < 256; i++) {
+		totalCycles += this->profile.cycles[i];
+	}
+	if (totalCycles == 0) {
+		totalCycles = 1;
+	}
+
+	printf("%-10s %12s %12s %6s\n", "family", "count", "cycles", "%cyc");
+	for (uint8_t f = 0; f < NUM_FAMILIES; f++) {
+		uint64_t cycles = this->getFamilyCycles(f);
+		if (cycles == 0) {
+			continue;
+		}
+		printf("%-10s %12llu %12llu %5.1f%%\n", familyName(f), (unsigned long long)this->getFamilyCount(f),
+			(unsigned long long)cycles, 100.0 * cycles / totalCycles);
+	}
+	printf("\n");
+
+	/* selection of the heaviest opcodes by cycle count, CB opcodes are listed as 0x1xx */
+	bool listed[512] = { false };
+	printf("%-6s %12s %12s %6s\n", "opcode", "count", "cycles", "%cyc");
+	for (unsigned int n = 0; n < top; n++) {
+		int best = -1;
+		uint64_t bestCycles = 0;
+		for (int i = 0; i < 512; i++) {
+			uint64_t cycles = (i < 256) ? this->profile.cycles[i] : this->profile.cbCycles[i - 256];
+			if (!listed[i] && cycles > bestCycles) {
+				best = i;
+				bestCycles = cycles;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+		listed[best] = true;
+
+		uint64_t count = (best < 256) ? this->profile.count[best] : this->profile.cbCount[best - 256];
+		printf("0x%03X  %12llu %12llu %5.1f%%\n", best, (unsigned long long)count, (unsigned long long)bestCycles,
+			100.0 * bestCycles / totalCycles);
+	}
+	printf("\n");
+}
+#endif
+
+cpuView::cpuView(const gbcpu& target) {
+	this->target = &target;
+	this->sequence = 0;
+	for (int i = 0; i < 3; i++) {
+		this->words[i] = 0;
+	}
+}
+
+uint16_t cpuView::getAF() const {
+	return this->target->AF.full;
+}
+
+uint16_t cpuView::getBC() const {
+	return this->target->BC.full;
+}
+
+uint16_t cpuView::getDE() const {
+	return this->target->DE.full;
+}
+
+uint16_t cpuView::getHL() const {
+	return this->target->HL.full;
+}
+
+uint16_t cpuView::getSP() const {
+	return this->target->SP;
+}
+
+uint16_t cpuView::getPC() const {
+	return this->target->PC;
+}
+
+uint8_t cpuView::getFlag(uint8_t flag) const {
+	return getBit(this->target->AF.half[0], flag);
+}
+
+uint8_t cpuView::getOpcode() const {
+	return this->target->opcode;
+}
+
+uint8_t cpuView::getCycle() const {
+	return this->target->cycle;
+}
+
+uint64_t cpuView::getTotalCycles() const {
+	return this->target->totalCycles;
+}
+
+uint8_t cpuView::readMemory(uint16_t address) const {
+	return this->target->memory[address];
+}
+
+void cpuView::publish() {
+	const gbcpu* cpu = this->target;
+	uint32_t seq = this->sequence.load(std::memory_order_relaxed);
+
+	this->sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	this->words[0].store((static_cast<uint64_t>(cpu->AF.full)) | (static_cast<uint64_t>(cpu->BC.full) << 16) |
+		(static_cast<uint64_t>(cpu->DE.full) << 32) | (static_cast<uint64_t>(cpu->HL.full) << 48), std::memory_order_relaxed);
+	this->words[1].store((static_cast<uint64_t>(cpu->SP)) | (static_cast<uint64_t>(cpu->PC) << 16) |
+		(static_cast<uint64_t>(cpu->opcode) << 32) | (static_cast<uint64_t>(cpu->cycle) << 40), std::memory_order_relaxed);
+	this->words[2].store(cpu->totalCycles, std::memory_order_relaxed);
+
+	this->sequence.store(seq + 2, std::memory_order_release);
+}
+
+bool cpuView::poll(cpuSnapshot& snapshot) const {
+	uint32_t before;
+	uint32_t after;
+	uint64_t w[3];
+
+	do {
+		before = this->sequence.load(std::memory_order_acquire);
+		for (int i = 0; i < 3; i++) {
+			w[i] = this->words[i].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = this->sequence.load(std::memory_order_relaxed);
+	} while ((before & 1) || before != after); //a publish happened in between
+
+	snapshot.AF.full = static_cast<uint16_t>(w[0]);
+	snapshot.BC.full = static_cast<uint16_t>(w[0] >> 16);
+	snapshot.DE.full = static_cast<uint16_t>(w[0] >> 32);
+	snapshot.HL.full = static_cast<uint16_t>(w[0] >> 48);
+	snapshot.SP = static_cast<uint16_t>(w[1]);
+	snapshot.PC = static_cast<uint16_t>(w[1] >> 16);
+	snapshot.opcode = static_cast<uint8_t>(w[1] >> 32);
+	snapshot.cycle = static_cast<uint8_t>(w[1] >> 40);
+	snapshot.totalCycles = w[2];
+	snapshot.epoch = before / 2;
+
+	return before != 0;
+}
+
 gbcpu::gbcpu(uint8_t* memory) {
 	this->AF.full = 0;
 	this->BC.full = 0;
@@ -31,10 +448,38 @@ gbcpu::gbcpu(uint8_t* memory) {
 	this->PC = 0;
 
 	this->memory = memory;
+	this->io = NULL;
 
 	this->opcode = 0;
 	this->cycle = 0;
+	this->totalCycles = 0;
+
+	this->nibble[0] = 0;
+	this->nibble[1] = 0;
+	this->src = NULL;
+	this->dest = NULL;
+	this->immediate = 0;
+	this->immediate16.full = 0;
+
+	this->tracer = NULL;
+	this->busTracer = NULL;
+	this->debug = NULL;
+	this->hit = false;
+	this->profiler = NULL;
+	this->cdl = NULL;
+	this->updateHooks();
+
+#ifdef GBCPU_PROFILE
+	this->resetProfile();
+#endif
+}
+
+#ifdef GBCPU_PROFILE
+void gbcpu::resetProfile() {
+	memset(&this->profile, 0, sizeof(this->profile));
+	this->profileCB = 0;
 }
+#endif
 
 void gbcpu::registerDump() {
 	printf("A: %d F: %d\n", AF.half[1], AF.half[0]);
@@ -46,6 +491,160 @@ void gbcpu::registerDump() {
 	printf("Opcode: %d, Cycle: %d\n\n", opcode, cycle);
 }
 
+void gbcpu::setTracer(traceRing* ring, bool bus) {
+	this->tracer = ring;
+	this->busTracer = bus ? ring : NULL;
+	this->updateHooks();
+}
+
+void gbcpu::setIO(ioBus* io) {
+	this->io = io;
+}
+
+void gbcpu::setProfiler(guestProfiler* profiler) {
+	this->profiler = profiler;
+	this->updateHooks();
+}
+
+void gbcpu::setCodeDataLog(codeDataLog* cdl) {
+	this->cdl = cdl;
+	this->updateHooks();
+}
+
+void gbcpu::saveState(cpuState& state) {
+	state.AF = this->AF;
+	state.BC = this->BC;
+	state.DE = this->DE;
+	state.HL = this->HL;
+	state.SP = this->SP;
+	state.PC = this->PC;
+
+	state.opcode = this->opcode;
+	state.cycle = this->cycle;
+	state.totalCycles = this->totalCycles;
+
+	state.nibble[0] = this->nibble[0];
+	state.nibble[1] = this->nibble[1];
+	state.immediate = this->immediate;
+	state.immediate16 = this->immediate16;
+}
+
+void gbcpu::loadState(const cpuState& state) {
+	if (this->profiler) {
+		this->profiler->restored();
+	}
+	if (this->cdl) {
+		this->cdl->restored();
+	}
+
+	this->AF = state.AF;
+	this->BC = state.BC;
+	this->DE = state.DE;
+	this->HL = state.HL;
+	this->SP = state.SP;
+	this->PC = state.PC;
+
+	this->opcode = state.opcode;
+	this->cycle = state.cycle;
+	this->totalCycles = state.totalCycles;
+
+	this->nibble[0] = state.nibble[0];
+	this->nibble[1] = state.nibble[1];
+	this->immediate = state.immediate;
+	this->immediate16 = state.immediate16;
+}
+
+void gbcpu::updateHooks() {
+	this->fetchHooks = (this->tracer != NULL) || (this->debug && this->debug->breakCount > 0) || (this->profiler != NULL) || (this->cdl != NULL);
+	this->busHooks = (this->busTracer != NULL) || (this->debug && this->debug->watchCount > 0) || (this->cdl != NULL);
+}
+
+/* called before PC moves past the opcode */
+NOINLINE void gbcpu::fetchHook() {
+	if (this->tracer) {
+		traceRecord record = {};
+		record.type = TRACE_EXEC;
+		record.opcode = this->opcode;
+		record.PC = this->PC;
+		record.AF = this->AF.full;
+		record.BC = this->BC.full;
+		record.DE = this->DE.full;
+		record.HL = this->HL.full;
+		record.SP = this->SP;
+		record.cycle = this->totalCycles;
+		this->tracer->push(record);
+	}
+
+	if (this->profiler) {
+		this->profiler->onFetch(this->PC, this->SP, this->opcode);
+	}
+
+	if (this->cdl) {
+		this->cdl->onFetch(this->PC, this->opcode);
+	}
+
+	if (this->debug && getBit(this->debug->breakMap[this->PC >> 3], this->PC & 7)) {
+		this->debug->reason = BREAK_EXEC;
+		this->debug->address = this->PC;
+		this->debug->PC = this->PC;
+	}
+}
+
+NOINLINE void gbcpu::busHook(uint8_t type, uint16_t address, uint8_t val) {
+	if (this->busTracer) {
+		traceRecord record = {};
+		record.type = type;
+		record.opcode = this->opcode;
+		record.PC = this->PC;
+		record.address = address;
+		record.data = val;
+		record.cycle = this->totalCycles;
+		this->busTracer->push(record);
+	}
+
+	if (this->cdl) {
+		if (type == TRACE_READ) {
+			this->cdl->onRead(address, this->PC);
+		}
+		else {
+			this->cdl->onWrite(address);
+		}
+	}
+
+	if (this->debug) {
+		uint8_t mode = (type == TRACE_READ) ? WATCH_READ : WATCH_WRITE;
+		if (this->debug->pageFlags[address >> 8] & mode) {
+			const uint8_t* map = (mode == WATCH_READ) ? this->debug->readMap : this->debug->writeMap;
+			if (getBit(map[address >> 3], address & 7)) {
+				this->debug->reason = (mode == WATCH_READ) ? BREAK_READ : BREAK_WRITE;
+				this->debug->address = address;
+				this->debug->PC = this->PC;
+			}
+		}
+	}
+}
+
+inline uint8_t gbcpu::read(uint16_t address) {
+	uint8_t val = this->memory[address];
+	if ((address & 0xFF80) == IO_FIRST && this->io) {
+		val = this->io->read(address, val, this->totalCycles);
+	}
+	if (this->busHooks) {
+		this->busHook(TRACE_READ, address, val);
+	}
+	return val;
+}
+
+inline void gbcpu::write(uint16_t address, uint8_t val) {
+	if (this->busHooks) {
+		this->busHook(TRACE_WRITE, address, val);
+	}
+	this->memory[address] = val;
+	if ((address & 0xFF80) == IO_FIRST && this->io) {
+		this->io->write(address, val, this->totalCycles);
+	}
+}
+
 uint8_t gbcpu::getFlag(uint8_t flag) {
 	return getBit(this->AF.half[0], flag);
 }
@@ -163,13 +762,43 @@ void gbcpu::ALU(uint8_t operation, uint8_t r2) {
 	}
 }
 
+uint64_t gbcpu::run(uint64_t cycles) {
+	if (!this->debug) {
+		for (uint64_t i = 0; i < cycles; i++) {
+			this->tick();
+		}
+		return cycles;
+	}
+
+	this->debug->reason = BREAK_NONE;
+	for (uint64_t i = 0; i < cycles; i++) {
+		this->tick();
+		if (this->debug->reason != BREAK_NONE) {
+			this->hit = true;
+			return i + 1;
+		}
+	}
+	return cycles;
+}
+
+bool gbcpu::stopped() {
+	bool hit = this->hit;
+	this->hit = false;
+	return hit;
+}
+
 void gbcpu::tick() {
-	static uint8_t nibble[2];
+	totalCycles++;
 
-	static uint8_t* src;
-	static uint8_t* dest;
-	static uint8_t immediate;
-	static registerPair immediate16;
+#ifdef GBCPU_PROFILE
+	/* every machine cycle is charged to the instruction in flight */
+	if (opcode == 0xCB) {
+		profile.cbCycles[profileCB]++;
+	}
+	else {
+		profile.cycles[opcode]++;
+	}
+#endif
 	
 	/* NOP [1 cycle] */
 	if (opcode == 0x00) {
@@ -252,7 +881,7 @@ void gbcpu::tick() {
 	if ((nibble[0] % 8 == 0x6) && (nibble[1] <= 0x3) && (opcode != 0x36)) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate = memory[PC];
+			immediate = read(PC);
 			PC++;
 			cycle = 1;
 			break;
@@ -300,33 +929,33 @@ void gbcpu::tick() {
 		case NEW_CYCLE:
 			switch (opcode) {
 			case 0x2A: //increment
-				this->AF.half[1] = this->memory[this->HL.full];
+				this->AF.half[1] = this->read(this->HL.full);
 				this->HL.full++;
 				break;
 			case 0x3A: //decrement
-				this->AF.half[1] = this->memory[this->HL.full];
+				this->AF.half[1] = this->read(this->HL.full);
 				this->HL.full--;
 				break;
 			case 0x46:
-				this->BC.half[1] = this->memory[this->HL.full];
+				this->BC.half[1] = this->read(this->HL.full);
 				break;
 			case 0x4E:
-				this->BC.half[0] = this->memory[this->HL.full];
+				this->BC.half[0] = this->read(this->HL.full);
 				break;
 			case 0x56:
-				this->DE.half[1] = this->memory[this->HL.full];
+				this->DE.half[1] = this->read(this->HL.full);
 				break;
 			case 0x5E:
-				this->DE.half[0] = this->memory[this->HL.full];
+				this->DE.half[0] = this->read(this->HL.full);
 				break;
 			case 0x66:
-				this->HL.half[1] = this->memory[this->HL.full];
+				this->HL.half[1] = this->read(this->HL.full);
 				break;
 			case 0x6E:
-				this->HL.half[0] = this->memory[this->HL.full];
+				this->HL.half[0] = this->read(this->HL.full);
 				break;
 			case 0x7E:
-				this->AF.half[1] = this->memory[this->HL.full];
+				this->AF.half[1] = this->read(this->HL.full);
 				break;
 			}
 			cycle = 1;
@@ -343,33 +972,33 @@ void gbcpu::tick() {
 		case NEW_CYCLE:
 			switch (opcode) {
 			case 0x22: //increment
-				this->memory[this->HL.full] = this->AF.half[1];
+				this->write(this->HL.full, this->AF.half[1]);
 				this->HL.full++;
 				break;
 			case 0x32: //decrement
-				this->memory[this->HL.full] = this->AF.half[1];
+				this->write(this->HL.full, this->AF.half[1]);
 				this->HL.full--;
 				break;
 			case 0x70:
-				this->memory[this->HL.full] = this->BC.half[1];
+				this->write(this->HL.full, this->BC.half[1]);
 				break;
 			case 0x71:
-				this->memory[this->HL.full] = this->BC.half[0];
+				this->write(this->HL.full, this->BC.half[0]);
 				break;
 			case 0x72:
-				this->memory[this->HL.full] = this->DE.half[1];
+				this->write(this->HL.full, this->DE.half[1]);
 				break;
 			case 0x73:
-				this->memory[this->HL.full] = this->DE.half[0];
+				this->write(this->HL.full, this->DE.half[0]);
 				break;
 			case 0x74:
-				this->memory[this->HL.full] = this->HL.half[1];
+				this->write(this->HL.full, this->HL.half[1]);
 				break;
 			case 0x75:
-				this->memory[this->HL.full] = this->HL.half[0];
+				this->write(this->HL.full, this->HL.half[0]);
 				break;
 			case 0x77:
-				this->memory[this->HL.full] = this->AF.half[1];
+				this->write(this->HL.full, this->AF.half[1]);
 				break;
 			}
 			cycle = 1;
@@ -384,12 +1013,12 @@ void gbcpu::tick() {
 	if (opcode == 0x36) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate = memory[PC];
+			immediate = read(PC);
 			PC++;
 			cycle = 2;
 			break;
 		case 1:
-			this->memory[this->HL.full] = immediate;
+			this->write(this->HL.full, immediate);
 			break;
 		case 0:
 			//do nothing
@@ -401,7 +1030,7 @@ void gbcpu::tick() {
 	if (opcode == 0x0A) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			this->AF.half[1] = this->memory[this->BC.full];
+			this->AF.half[1] = this->read(this->BC.full);
 			cycle = 1;
 			break;
 		case 0:
@@ -414,7 +1043,7 @@ void gbcpu::tick() {
 	if (opcode == 0x1A) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			this->AF.half[1] = this->memory[this->DE.full];
+			this->AF.half[1] = this->read(this->DE.full);
 			cycle = 1;
 			break;
 		case 0:
@@ -427,7 +1056,7 @@ void gbcpu::tick() {
 	if (opcode == 0x02) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			this->memory[this->BC.full] = this->AF.half[1];
+			this->write(this->BC.full, this->AF.half[1]);
 			cycle = 1;
 			break;
 		case 0:
@@ -440,7 +1069,7 @@ void gbcpu::tick() {
 	if (opcode == 0x12) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			this->memory[this->DE.full] = this->AF.half[1];
+			this->write(this->DE.full, this->AF.half[1]);
 			cycle = 1;
 			break;
 		case 0:
@@ -453,16 +1082,16 @@ void gbcpu::tick() {
 	if (opcode == 0xFA) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate16.half[0] = this->memory[PC]; //LSB
+			immediate16.half[0] = this->read(PC); //LSB
 			PC++;
 			cycle = 3;
 			break;
 		case 2:
-			immediate16.half[1] = this->memory[PC]; //MSB
+			immediate16.half[1] = this->read(PC); //MSB
 			PC++;
 			break;
 		case 1:
-			this->AF.half[1] = this->memory[immediate16.full];
+			this->AF.half[1] = this->read(immediate16.full);
 			break;
 		case 0:
 			//do nothing
@@ -474,16 +1103,16 @@ void gbcpu::tick() {
 	if (opcode == 0xEA) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate16.half[0] = this->memory[PC]; //LSB
+			immediate16.half[0] = this->read(PC); //LSB
 			PC++;
 			cycle = 3;
 			break;
 		case 2:
-			immediate16.half[1] = this->memory[PC]; //MSB
+			immediate16.half[1] = this->read(PC); //MSB
 			PC++;
 			break;
 		case 1:
-			this->memory[immediate16.full] = this->AF.half[1];
+			this->write(immediate16.full, this->AF.half[1]);
 			break;
 		case 0:
 			//do nothing
@@ -495,7 +1124,7 @@ void gbcpu::tick() {
 	if (opcode == 0xF2) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			this->AF.half[1] = this->memory[0xFF00 | (static_cast<uint16_t>(this->BC.half[0]) & 0x00FF)];
+			this->AF.half[1] = this->read(0xFF00 | (static_cast<uint16_t>(this->BC.half[0]) & 0x00FF));
 			cycle = 1;
 			break;
 		case 0:
@@ -508,7 +1137,7 @@ void gbcpu::tick() {
 	if (opcode == 0xE2) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			this->memory[0xFF00 | (static_cast<uint16_t>(this->BC.half[0]) & 0x00FF)] = this->AF.half[1];
+			this->write(0xFF00 | (static_cast<uint16_t>(this->BC.half[0]) & 0x00FF), this->AF.half[1]);
 			cycle = 1;
 			break;
 		case 0:
@@ -521,12 +1150,12 @@ void gbcpu::tick() {
 	if (opcode == 0xF0) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate = this->memory[PC];
+			immediate = this->read(PC);
 			PC++;
 			cycle = 2;
 			break;
 		case 1:
-			this->AF.half[1] = this->memory[0xFF00 | (static_cast<uint16_t>(immediate) & 0x00FF)];
+			this->AF.half[1] = this->read(0xFF00 | (static_cast<uint16_t>(immediate) & 0x00FF));
 			break;
 		case 0:
 			//do nothing
@@ -538,12 +1167,12 @@ void gbcpu::tick() {
 	if (opcode == 0xE0) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate = this->memory[PC];
+			immediate = this->read(PC);
 			PC++;
 			cycle = 2;
 			break;
 		case 1:
-			this->memory[0xFF00 | (static_cast<uint16_t>(immediate) & 0x00FF)] = this->AF.half[1];
+			this->write(0xFF00 | (static_cast<uint16_t>(immediate) & 0x00FF), this->AF.half[1]);
 			break;
 		case 0:
 			//do nothing
@@ -555,12 +1184,12 @@ void gbcpu::tick() {
 	if ((nibble[0] == 0x1) && (nibble[1] <= 0x3)) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate16.half[0] = this->memory[PC]; //LSB
+			immediate16.half[0] = this->read(PC); //LSB
 			PC++;
 			cycle = 2;
 			break;
 		case 1:
-			immediate16.half[1] = this->memory[PC]; //MSB
+			immediate16.half[1] = this->read(PC); //MSB
 			PC++;
 			break;
 		case 0:
@@ -586,19 +1215,19 @@ void gbcpu::tick() {
 	if (opcode == 0x08) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate16.half[0] = this->memory[PC]; //LSB
+			immediate16.half[0] = this->read(PC); //LSB
 			PC++;
 			cycle = 4;
 			break;
 		case 3:
-			immediate16.half[1] = this->memory[PC]; //MSB
+			immediate16.half[1] = this->read(PC); //MSB
 			PC++;
 			break;
 		case 2:
-			this->memory[immediate16.full] = static_cast<uint8_t>(this->SP & 0x00FF); //LSB
+			this->write(immediate16.full, static_cast<uint8_t>(this->SP & 0x00FF)); //LSB
 			break;
 		case 1:
-			this->memory[immediate16.full + 1] = static_cast<uint8_t>((this->SP >> 8) & 0x00FF); //MSB
+			this->write(immediate16.full + 1, static_cast<uint8_t>((this->SP >> 8) & 0x00FF)); //MSB
 			break;
 		case 0:
 			//do nothing
@@ -629,16 +1258,16 @@ void gbcpu::tick() {
 		case 2:
 			switch (opcode) {
 			case 0xC5:
-				memory[this->SP] = this->BC.half[1];
+				write(this->SP, this->BC.half[1]);
 				break;
 			case 0xD5:
-				memory[this->SP] = this->DE.half[1];
+				write(this->SP, this->DE.half[1]);
 				break;
 			case 0xE5:
-				memory[this->SP] = this->HL.half[1];
+				write(this->SP, this->HL.half[1]);
 				break;
 			case 0xF5:
-				memory[this->SP] = this->AF.half[1];
+				write(this->SP, this->AF.half[1]);
 				break;
 			}
 			this->SP--;
@@ -646,16 +1275,16 @@ void gbcpu::tick() {
 		case 1:
 			switch (opcode) {
 			case 0xC5:
-				memory[this->SP] = this->BC.half[0];
+				write(this->SP, this->BC.half[0]);
 				break;
 			case 0xD5:
-				memory[this->SP] = this->DE.half[0];
+				write(this->SP, this->DE.half[0]);
 				break;
 			case 0xE5:
-				memory[this->SP] = this->HL.half[0];
+				write(this->SP, this->HL.half[0]);
 				break;
 			case 0xF5:
-				memory[this->SP] = this->AF.half[0];
+				write(this->SP, this->AF.half[0]);
 				break;
 			}
 			break;
@@ -671,16 +1300,16 @@ void gbcpu::tick() {
 		case NEW_CYCLE:
 			switch (opcode) {
 			case 0xC1:
-				this->BC.half[0] = this->memory[SP];
+				this->BC.half[0] = this->read(SP);
 				break;
 			case 0xD1:
-				this->DE.half[0] = this->memory[SP];
+				this->DE.half[0] = this->read(SP);
 				break;
 			case 0xE1:
-				this->HL.half[0] = this->memory[SP];
+				this->HL.half[0] = this->read(SP);
 				break;
 			case 0xF1:
-				this->AF.half[0] = this->memory[SP];
+				this->AF.half[0] = this->read(SP);
 				break;
 			}
 			this->SP++;
@@ -689,16 +1318,16 @@ void gbcpu::tick() {
 		case 1:
 			switch (opcode) {
 			case 0xC1:
-				this->BC.half[1] = this->memory[SP];
+				this->BC.half[1] = this->read(SP);
 				break;
 			case 0xD1:
-				this->DE.half[1] = this->memory[SP];
+				this->DE.half[1] = this->read(SP);
 				break;
 			case 0xE1:
-				this->HL.half[1] = this->memory[SP];
+				this->HL.half[1] = this->read(SP);
 				break;
 			case 0xF1:
-				this->AF.half[1] = this->memory[SP];
+				this->AF.half[1] = this->read(SP);
 				break;
 			}
 			this->SP++;
@@ -713,7 +1342,7 @@ void gbcpu::tick() {
 	if (opcode == 0xF8) {
 		switch (cycle) {
 		case NEW_CYCLE:
-			immediate = this->memory[PC];
+			immediate = this->read(PC);
 			PC++;
 			cycle = 2;
 			break;
@@ -777,10 +1406,21 @@ void gbcpu::tick() {
 	/* fetch (happens same cycle as prev. instruction) */
 	if (cycle == 0) {
 		opcode = memory[PC];
+		if (fetchHooks) {
+			this->fetchHook();
+		}
 		nibble[0] = opcode & 0x0F; //LSN
 		nibble[1] = (opcode >> 4) & 0x0F; //MSN
 		PC++;
 		cycle = NEW_CYCLE; //denotes new cycle
+
+#ifdef GBCPU_PROFILE
+		profile.count[opcode]++;
+		if (opcode == 0xCB) {
+			profileCB = memory[PC];
+			profile.cbCount[profileCB]++;
+		}
+#endif
 	}
 
 	if (cycle != 0 && cycle != NEW_CYCLE) { //underflow protection
@@ -2,6 +2,7 @@
 #define __CPU_H__
 
 #include <cstdint>
+#include <atomic>
 
 #define Z_FLAG 7 //zero flag
 #define S_FLAG 6 //subtract flag
@@ -13,12 +14,73 @@
 
 #define NEW_CYCLE 255
 
+/* why gbcpu::run() stopped early */
+#define BREAK_NONE 0
+#define BREAK_EXEC 1 //breakpoint, the instruction at PC-1 is fetched but not executed
+#define BREAK_READ 2 //read watchpoint, the access has completed
+#define BREAK_WRITE 3 //write watchpoint, the access has completed
+
+#define WATCH_READ 1
+#define WATCH_WRITE 2
+
+/* instruction families used by the profiler */
+#define FAMILY_NOP 0
+#define FAMILY_LD_R_R 1 //LD r, r
+#define FAMILY_LD_R_N 2 //LD r, n
+#define FAMILY_LD_R_HL 3 //LD r, (HL) and LD A, (HL+/-)
+#define FAMILY_LD_HL_R 4 //LD (HL), r and LD (HL+/-), A
+#define FAMILY_LD_HL_N 5 //LD (HL), n
+#define FAMILY_LD_A_RR 6 //LD A, (BC/DE) and LD (BC/DE), A
+#define FAMILY_LD_A_NN 7 //LD A, (nn) and LD (nn), A
+#define FAMILY_LDH 8 //LDH and LD (C)
+#define FAMILY_LD_RR_NN 9 //LD rr, nn
+#define FAMILY_LD_SP 10 //LD (nn), SP / LD SP, HL / LD HL, SP+s8
+#define FAMILY_PUSH 11
+#define FAMILY_POP 12
+#define FAMILY_ALU 13
+#define FAMILY_CB 14
+#define FAMILY_OTHER 15 //not implemented yet
+#define NUM_FAMILIES 16
+
 union registerPair {
 	uint16_t full;
 	uint8_t half[2];
 };
 
 class gbcpu;
+class traceRing;
+class guestProfiler;
+class codeDataLog;
+class ioBus;
+
+#ifdef GBCPU_PROFILE
+struct opcodeProfile {
+	uint64_t count[256]; //executions per opcode
+	uint64_t cycles[256]; //machine cycles per opcode
+	uint64_t cbCount[256]; //same for CB-prefixed opcodes
+	uint64_t cbCycles[256];
+};
+#endif
+
+/* bitmaps behind cpuDebugger's breakpoints and watchpoints */
+struct debugPoints {
+	uint8_t breakMap[0x2000]; //one bit per address
+	uint8_t readMap[0x2000];
+	uint8_t writeMap[0x2000];
+	uint8_t pageFlags[256]; //WATCH_READ/WATCH_WRITE when anything in the 256 byte page is watched
+	uint32_t breakCount;
+	uint32_t watchCount;
+
+	/* last hit */
+	uint8_t reason;
+	uint16_t address;
+	uint16_t PC;
+};
+
+uint8_t opcodeFamily(uint8_t opcode);
+uint8_t instructionLength(uint8_t opcode); //bytes, including the operands
+bool isCallOpcode(uint8_t opcode); //CALL or RST, taken or not
+const char* familyName(uint8_t family);
 
 class cpuDebugger {
 	public: 
@@ -30,14 +92,123 @@ class cpuDebugger {
 		uint16_t SP;
 		uint16_t PC;
 
+#ifdef GBCPU_PROFILE
+		opcodeProfile profile;
+#endif
+
+	private:
+		gbcpu* target;
+		debugPoints* points; //allocated by the first breakpoint or watchpoint
+
+		debugPoints* attach();
+
 	public:
-		cpuDebugger(gbcpu target);
+		/* target must outlive the debugger once breakpoints or watchpoints are set */
+		cpuDebugger(gbcpu& target);
+		~cpuDebugger();
+		cpuDebugger(const cpuDebugger&) = delete;
+		cpuDebugger& operator=(const cpuDebugger&) = delete;
+
+		void refresh(); //copy the registers from the target again
 		uint64_t getAllRegisters();
 		uint32_t getBothPointers();
+
+		void setBreakpoint(uint16_t address);
+		void clearBreakpoint(uint16_t address);
+		void setWatchpoint(uint16_t address, uint8_t mode); //WATCH_READ and/or WATCH_WRITE
+		void clearWatchpoint(uint16_t address, uint8_t mode);
+		void clearAll();
+		uint8_t getBreakReason();
+		uint16_t getBreakAddress(); //breakpoint or watched address of the last hit
+		uint16_t getBreakPC(); //PC when the last hit happened
+
+#ifdef GBCPU_PROFILE
+		uint64_t getOpcodeCount(uint8_t opcode);
+		uint64_t getOpcodeCycles(uint8_t opcode);
+		uint64_t getCBCount(uint8_t opcode);
+		uint64_t getCBCycles(uint8_t opcode);
+		uint64_t getFamilyCount(uint8_t family);
+		uint64_t getFamilyCycles(uint8_t family);
+		void profileDump(unsigned int top);
+#endif
+};
+
+/* registers as published by cpuView::publish() */
+struct cpuSnapshot {
+	registerPair AF;
+	registerPair BC;
+	registerPair DE;
+	registerPair HL;
+
+	uint16_t SP;
+	uint16_t PC;
+
+	uint8_t opcode;
+	uint8_t cycle;
+	uint64_t totalCycles;
+	uint32_t epoch; //number of publishes up to this one
+};
+
+/*
+everything gbcpu::loadState() needs to resume exactly where saveState()
+was called, even in the middle of an instruction. src and dest are left
+out, tick() sets them in the same cycle it uses them, so a state holds
+no pointers and loads into any CPU, or from a file
+*/
+struct cpuState {
+	registerPair AF;
+	registerPair BC;
+	registerPair DE;
+	registerPair HL;
+
+	uint16_t SP;
+	uint16_t PC;
+
+	uint8_t opcode;
+	uint8_t cycle;
+	uint64_t totalCycles;
+
+	uint8_t nibble[2];
+	uint8_t immediate;
+	registerPair immediate16;
+};
+
+/*
+read-only, non-owning view of a live CPU
+
+the getters read the CPU directly and must be used from the thread that
+runs it, other threads poll() what that thread last published
+*/
+class cpuView {
+	private:
+		const gbcpu* target;
+
+		/* seqlock, odd while a publish is in progress */
+		std::atomic<uint32_t> sequence;
+		std::atomic<uint64_t> words[3];
+
+	public:
+		cpuView(const gbcpu& target);
+		uint16_t getAF() const;
+		uint16_t getBC() const;
+		uint16_t getDE() const;
+		uint16_t getHL() const;
+		uint16_t getSP() const;
+		uint16_t getPC() const;
+		uint8_t getFlag(uint8_t flag) const;
+		uint8_t getOpcode() const;
+		uint8_t getCycle() const;
+		uint64_t getTotalCycles() const;
+		uint8_t readMemory(uint16_t address) const; //no bus side effects
+
+		void publish(); //CPU thread only, e.g. once per frame
+		bool poll(cpuSnapshot& snapshot) const; //any thread, false until the first publish
 };
 
 class gbcpu {
 	friend class cpuDebugger;
+	friend class cpuView;
+	friend class lockstep;
 
 	private:
 		/* registers */
@@ -50,19 +221,69 @@ class gbcpu {
 		uint16_t PC;
 
 		uint8_t* memory;
+		ioBus* io; //hardware registers, NULL for plain memory
 
 		/* execution variables */
 		uint8_t opcode;
 		uint8_t cycle;
+		uint64_t totalCycles; //machine cycles since power on
+
+		/* decode state of the instruction in flight */
+		uint8_t nibble[2];
+		uint8_t* src;
+		uint8_t* dest;
+		uint8_t immediate;
+		registerPair immediate16;
+
+		/* tracing, NULL when off */
+		traceRing* tracer;
+		traceRing* busTracer;
+
+		/* breakpoints and watchpoints, NULL when off */
+		debugPoints* debug;
+		bool hit; //run() stopped early, kept until stopped() reads it
+
+		/* call stack tracking for the guest profiler, NULL when off */
+		guestProfiler* profiler;
+
+		/* code/data log, NULL when off */
+		codeDataLog* cdl;
+
+		/* fast path checks, only true while tracing, debugging, profiling or logging */
+		bool fetchHooks;
+		bool busHooks;
+
+#ifdef GBCPU_PROFILE
+		opcodeProfile profile;
+		uint8_t profileCB; //operand of the CB opcode being executed
+#endif
 
 		uint8_t getFlag(uint8_t flag);
 		void setFlag(uint8_t flag, uint8_t val);
 		void ALU(uint8_t operation, uint8_t r2);
 
+		uint8_t read(uint16_t address);
+		void write(uint16_t address, uint8_t val);
+		void fetchHook();
+		void busHook(uint8_t type, uint16_t address, uint8_t val);
+		void updateHooks();
+
 	public:
 		gbcpu(uint8_t* memory);
 		void tick(); //one machine cycle
+		uint64_t run(uint64_t cycles); //ticks until cycles have passed or a breakpoint/watchpoint hits
+		bool stopped(); //true once after run() stopped on a hit, even one on its last cycle
 		void registerDump();
+		void setTracer(traceRing* ring, bool bus); //ring is NULL to stop tracing
+		void setIO(ioBus* io);
+		void setProfiler(guestProfiler* profiler); //NULL to stop
+		void setCodeDataLog(codeDataLog* cdl); //NULL to stop
+		void saveState(cpuState& state); //registers and execution state, not memory
+		void loadState(const cpuState& state);
+
+#ifdef GBCPU_PROFILE
+		void resetProfile();
+#endif
 };
 
 #endif
\ No newline at end of file
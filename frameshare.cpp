@@ -0,0 +1,267 @@
+#include "frameshare.h"
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+sharedMapping::sharedMapping() {
+#ifdef _WIN32
+	this->handle = NULL;
+#else
+	this->handle = -1;
+	this->name[0] = '\0';
+	this->owner = false;
+#endif
+	this->data = NULL;
+	this->size = 0;
+}
+
+sharedMapping::~sharedMapping() {
+	this->close();
+}
+
+bool sharedMapping::create(const char* name, size_t size, bool replace) {
+	this->close();
+
+#ifdef _WIN32
+	const char* local = (name[0] == '/') ? name + 1 : name; //backslashes and a leading slash are not allowed
+	this->handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+		static_cast<DWORD>(size), local);
+	if (!this->handle) {
+		std::cout << "ERROR: failed to create shared memory " << name << std::endl;
+		return false;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS && !replace) { //a running instance still owns it, windows drops stale ones by itself
+		std::cout << "ERROR: shared memory " << name << " is in use by another instance" << std::endl;
+		CloseHandle(this->handle);
+		this->handle = NULL;
+		return false;
+	}
+	this->data = MapViewOfFile(this->handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+	this->handle = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (this->handle < 0 && errno == EEXIST) {
+		if (!replace) { //may belong to a running instance and its readers
+			std::cout << "ERROR: shared memory " << name << " already exists, replace it only if it was left behind by a crashed run" << std::endl;
+			return false;
+		}
+		shm_unlink(name);
+		this->handle = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	}
+	if (this->handle < 0) {
+		std::cout << "ERROR: failed to create shared memory " << name << std::endl;
+		return false;
+	}
+	strncpy(this->name, name, sizeof(this->name) - 1);
+	this->name[sizeof(this->name) - 1] = '\0';
+	this->owner = true;
+
+	if (ftruncate(this->handle, static_cast<off_t>(size)) != 0) {
+		std::cout << "ERROR: failed to size shared memory " << name << std::endl;
+		this->close();
+		return false;
+	}
+	this->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->handle, 0);
+	if (this->data == MAP_FAILED) {
+		this->data = NULL;
+	}
+#endif
+
+	if (!this->data) {
+		std::cout << "ERROR: failed to map shared memory " << name << std::endl;
+		this->close();
+		return false;
+	}
+	this->size = size;
+	memset(this->data, 0, size);
+	return true;
+}
+
+bool sharedMapping::open(const char* name, size_t size) {
+	this->close();
+
+#ifdef _WIN32
+	const char* local = (name[0] == '/') ? name + 1 : name;
+	this->handle = OpenFileMappingA(FILE_MAP_READ, FALSE, local);
+	if (!this->handle) {
+		std::cout << "ERROR: no shared memory named " << name << std::endl;
+		return false;
+	}
+	this->data = MapViewOfFile(this->handle, FILE_MAP_READ, 0, 0, size);
+#else
+	this->handle = shm_open(name, O_RDONLY, 0);
+	if (this->handle < 0) {
+		std::cout << "ERROR: no shared memory named " << name << std::endl;
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(this->handle, &info) != 0 || static_cast<size_t>(info.st_size) < size) {
+		std::cout << "ERROR: shared memory " << name << " is too small" << std::endl;
+		this->close();
+		return false;
+	}
+	this->data = mmap(NULL, size, PROT_READ, MAP_SHARED, this->handle, 0);
+	if (this->data == MAP_FAILED) {
+		this->data = NULL;
+	}
+#endif
+
+	if (!this->data) {
+		std::cout << "ERROR: failed to map shared memory " << name << std::endl;
+		this->close();
+		return false;
+	}
+	this->size = size;
+	return true;
+}
+
+void sharedMapping::close() {
+#ifdef _WIN32
+	if (this->data) {
+		UnmapViewOfFile(this->data);
+	}
+	if (this->handle) {
+		CloseHandle(this->handle);
+	}
+	this->handle = NULL;
+#else
+	if (this->data) {
+		munmap(this->data, this->size);
+	}
+	if (this->handle >= 0) {
+		::close(this->handle);
+	}
+	if (this->owner) {
+		shm_unlink(this->name); //mapped readers keep their view
+	}
+	this->handle = -1;
+	this->owner = false;
+#endif
+	this->data = NULL;
+	this->size = 0;
+}
+
+void* sharedMapping::get() {
+	return this->data;
+}
+
+frameExport::frameExport() {
+	this->header = NULL;
+}
+
+bool frameExport::open(const char* name, bool replace) {
+	this->close();
+	if (!this->mapping.create(name, sizeof(exportHeader), replace)) {
+		return false;
+	}
+
+	this->header = static_cast<exportHeader*>(this->mapping.get());
+	this->header->version = EXPORT_VERSION;
+	this->header->width = SCREEN_WIDTH;
+	this->header->height = SCREEN_HEIGHT;
+	this->header->slots = EXPORT_SLOTS;
+	this->header->slotSize = sizeof(exportSlot);
+	this->header->published.store(0, std::memory_order_relaxed);
+
+	/* readers check the magic last */
+	std::atomic_thread_fence(std::memory_order_release);
+	this->header->magic = EXPORT_MAGIC;
+	return true;
+}
+
+void frameExport::close() {
+	this->mapping.close();
+	this->header = NULL;
+}
+
+bool frameExport::isOpen() {
+	return this->header != NULL;
+}
+
+void frameExport::publish(uint64_t frame, uint8_t buttons, const uint8_t* rgb) {
+	if (!this->header) {
+		return;
+	}
+
+	uint64_t published = this->header->published.load(std::memory_order_relaxed);
+	exportSlot& slot = this->header->slot[published % EXPORT_SLOTS];
+	uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.frame = frame;
+	slot.buttons = buttons;
+	memcpy(slot.rgb, rgb, EXPORT_PIXELS);
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	this->header->published.store(published + 1, std::memory_order_release);
+}
+
+frameReader::frameReader() {
+	this->header = NULL;
+}
+
+bool frameReader::open(const char* name) {
+	this->close();
+	if (!this->mapping.open(name, sizeof(exportHeader))) {
+		return false;
+	}
+
+	this->header = static_cast<const exportHeader*>(this->mapping.get());
+	if (this->header->magic != EXPORT_MAGIC || this->header->version != EXPORT_VERSION || this->header->slotSize != sizeof(exportSlot)) {
+		std::cout << "ERROR: " << name << " is not a version " << EXPORT_VERSION << " frame export" << std::endl;
+		this->close();
+		return false;
+	}
+	return true;
+}
+
+void frameReader::close() {
+	this->mapping.close();
+	this->header = NULL;
+}
+
+uint64_t frameReader::getPublished() {
+	return this->header ? this->header->published.load(std::memory_order_acquire) : 0;
+}
+
+bool frameReader::read(uint64_t& frame, uint8_t& buttons, uint8_t* rgb) {
+	if (!this->header) {
+		return false;
+	}
+
+	/* a few tries, each one only fails if the writer lapped the whole ring meanwhile */
+	for (int attempt = 0; attempt < EXPORT_SLOTS; attempt++) {
+		uint64_t published = this->header->published.load(std::memory_order_acquire);
+		if (published == 0) {
+			return false;
+		}
+
+		const exportSlot& slot = this->header->slot[(published - 1) % EXPORT_SLOTS];
+		uint32_t before = slot.sequence.load(std::memory_order_acquire);
+		if (before & 1) {
+			continue;
+		}
+
+		frame = slot.frame;
+		buttons = slot.buttons;
+		memcpy(rgb, slot.rgb, EXPORT_PIXELS);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) == before) {
+			return true;
+		}
+	}
+	return false;
+}
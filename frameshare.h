@@ -0,0 +1,101 @@
+#ifndef __FRAMESHARE_H__
+#define __FRAMESHARE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#include "ppu.h"
+
+#define EXPORT_MAGIC 0x58464247 //"GBFX"
+#define EXPORT_VERSION 1
+#define EXPORT_SLOTS 4
+#define EXPORT_PIXELS (FRAMEBUFFER_SIZE * 3) //RGB as displayed
+#define EXPORT_NAME "/gbemu-frames"
+
+/*
+layout of the shared object, fixed so readers in other languages can map it
+
+a frame is written into slot (published % EXPORT_SLOTS). Readers take the
+slot of the newest frame, read its sequence, copy or use what they need
+and read the sequence again: it has to be even and unchanged, otherwise
+the slot was overwritten and the reader tries the newest one again. The
+writer never waits, a reader that is too slow only loses frames
+*/
+struct exportSlot {
+	std::atomic<uint32_t> sequence; //odd while the slot is written
+	uint32_t reserved;
+	uint64_t frame;
+	uint8_t buttons; //BUTTON_* bits held during the frame
+	uint8_t padding[47];
+	uint8_t rgb[EXPORT_PIXELS];
+};
+
+struct exportHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t slots;
+	uint32_t slotSize;
+	std::atomic<uint64_t> published; //frames written so far
+	uint8_t padding[32];
+	exportSlot slot[EXPORT_SLOTS];
+};
+
+/* named shared memory, POSIX shm or a Windows file mapping */
+class sharedMapping {
+	private:
+#ifdef _WIN32
+		void* handle;
+#else
+		int handle;
+		char name[64];
+		bool owner; //unlinks the name on close
+#endif
+		void* data;
+		size_t size;
+
+	public:
+		sharedMapping();
+		~sharedMapping();
+		sharedMapping(const sharedMapping&) = delete;
+		sharedMapping& operator=(const sharedMapping&) = delete;
+
+		bool create(const char* name, size_t size, bool replace = false); //fails if the name exists unless replace
+		bool open(const char* name, size_t size);
+		void close();
+		void* get();
+};
+
+/* emulator side, publishes every finished frame */
+class frameExport {
+	private:
+		sharedMapping mapping;
+		exportHeader* header;
+
+	public:
+		frameExport();
+		bool open(const char* name = EXPORT_NAME, bool replace = false); //replace only a stale mapping from a crashed run
+		void close();
+		bool isOpen();
+
+		void publish(uint64_t frame, uint8_t buttons, const uint8_t* rgb); //never blocks
+};
+
+/* consumer side */
+class frameReader {
+	private:
+		sharedMapping mapping;
+		const exportHeader* header;
+
+	public:
+		frameReader();
+		bool open(const char* name = EXPORT_NAME);
+		void close();
+
+		uint64_t getPublished(); //0 until the first frame
+		bool read(uint64_t& frame, uint8_t& buttons, uint8_t* rgb); //newest frame, false if none or the writer kept lapping us
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include "gameboy.h"
+#include "profiler.h"
+#include "probe.h"
+#include "utils.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+gameboy::gameboy() {
+	this->memory = new uint8_t[MEMORY_SIZE];
+	this->ownsMemory = true;
+	this->init();
+}
+
+gameboy::gameboy(uint8_t* memory) {
+	this->memory = memory;
+	this->ownsMemory = false;
+	this->init();
+}
+
+void gameboy::init() {
+	memset(this->memory, 0, MEMORY_SIZE);
+
+	this->cpu = new gbcpu(this->memory);
+	this->view = new cpuView(*this->cpu);
+	this->audio = new audioRing(AUDIO_BUFFER_FRAMES);
+	this->sound = new apu(this->memory, this->audio);
+	this->serial = new serialPort(this->memory);
+	this->video = new ppu(this->memory);
+	this->frame = 0;
+	this->profiler = NULL;
+
+	this->io.attach(JOYP, JOYP, &this->pad);
+	this->io.attach(SB, SC, this->serial);
+	this->io.attach(APU_FIRST, APU_LAST, this->sound);
+	this->io.attach(PPU_FIRST, PPU_LAST, this->video);
+	this->cpu->setIO(&this->io);
+}
+
+gameboy::~gameboy() {
+	delete this->video;
+	delete this->serial;
+	delete this->sound;
+	delete this->audio;
+	delete this->view;
+	delete this->cpu;
+	if (this->ownsMemory) {
+		delete[] this->memory;
+	}
+}
+
+bool gameboy::loadROM(const char* filename) {
+	std::ifstream inp(filename, std::ios::binary);
+	if (!inp) {
+		std::cout << "ERROR: failed to open ROM " << filename << std::endl;
+		return false;
+	}
+
+	inp.read(reinterpret_cast<char*>(this->memory), ROM_SIZE);
+	return inp.gcount() > 0;
+}
+
+bool gameboy::loadROM(const uint8_t* data, size_t size) {
+	if (!data || size == 0) {
+		std::cout << "ERROR: empty ROM" << std::endl;
+		return false;
+	}
+
+	memcpy(this->memory, data, (size < ROM_SIZE) ? size : ROM_SIZE);
+	return true;
+}
+
+uint64_t gameboy::runFrame() {
+	uint64_t start = this->view->getTotalCycles();
+	scopedProbe phase("cpu");
+	this->runCPU(start + CYCLES_PER_FRAME);
+	phase.end();
+	return this->endFrame(start);
+}
+
+bool gameboy::runCPU(uint64_t end) {
+	uint64_t now = this->view->getTotalCycles();
+
+	/* the serial port decides how far the CPU may run, a linked one may wait for its peer here */
+	while (now < end) {
+		uint64_t stop = this->serial->nextEvent(now);
+		if (stop > end) {
+			stop = end;
+		}
+		if (this->profiler) {
+			if (now >= this->profiler->getNextSample()) {
+				this->profiler->sample(this->view->getPC(), now);
+			}
+			if (stop > this->profiler->getNextSample()) {
+				stop = this->profiler->getNextSample();
+			}
+		}
+
+		uint64_t ran = this->cpu->run(stop - now);
+		now += ran;
+		this->serial->update(now);
+		if (this->cpu->stopped()) {
+			return false; //breakpoint or watchpoint, possibly on the last cycle of the window
+		}
+	}
+	return true;
+}
+
+uint64_t gameboy::endFrame(uint64_t start) {
+	uint64_t now = this->view->getTotalCycles();
+
+	/* video and audio are finished once per frame, register writes in between catch them up */
+	scopedProbe phase("ppu");
+	this->video->runTo(now);
+	phase.next("apu");
+	this->sound->endFrame(now);
+	phase.end();
+	if (this->profiler) {
+		this->profiler->endFrame(this->view->getPC(), now);
+	}
+	this->frame++;
+	return now - start;
+}
+
+uint64_t gameboy::getFrame() {
+	return this->frame;
+}
+
+uint64_t gameboy::getCycles() {
+	return this->view->getTotalCycles();
+}
+
+void gameboy::setProfiler(guestProfiler* profiler) {
+	this->profiler = profiler;
+	this->cpu->setProfiler(profiler);
+}
+
+void gameboy::setCodeDataLog(codeDataLog* cdl) {
+	this->cpu->setCodeDataLog(cdl);
+}
+
+void gameboy::setAudioOutput(bool enabled) {
+	this->sound->setOutput(enabled ? this->audio : NULL);
+}
+
+void gameboy::setRender(bool enabled) {
+	this->video->setRender(enabled);
+}
+
+void gameboy::saveState(gameboyState& state) {
+	memcpy(state.memory, this->memory, MEMORY_SIZE);
+	this->cpu->saveState(state.cpu);
+	this->sound->saveState(state.sound);
+	this->serial->saveState(state.serial);
+	this->video->saveState(state.video);
+	state.frame = this->frame;
+}
+
+void gameboy::loadState(const gameboyState& state) {
+	memcpy(this->memory, state.memory, MEMORY_SIZE);
+	this->cpu->loadState(state.cpu);
+	this->sound->loadState(state.sound);
+	this->serial->loadState(state.serial);
+	this->video->loadState(state.video);
+	this->frame = state.frame;
+}
+
+uint64_t gameboy::stateHash() {
+	cpuState state;
+	this->cpu->saveState(state);
+
+	/* field by field, padding and the decode pointers differ between machines */
+	uint16_t registers[6] = { state.AF.full, state.BC.full, state.DE.full, state.HL.full, state.SP, state.PC };
+	uint64_t hash = hashBytes(this->memory, MEMORY_SIZE);
+	hash = hashBytes(registers, sizeof(registers), hash);
+	hash = hashBytes(&state.totalCycles, sizeof(state.totalCycles), hash);
+	return hashBytes(&state.cycle, sizeof(state.cycle), hash);
+}
+
+gbcpu& gameboy::getCPU() {
+	return *this->cpu;
+}
+
+uint8_t* gameboy::getMemory() {
+	return this->memory;
+}
+
+audioRing& gameboy::getAudio() {
+	return *this->audio;
+}
+
+joypad& gameboy::getJoypad() {
+	return this->pad;
+}
+
+serialPort& gameboy::getSerial() {
+	return *this->serial;
+}
+
+const uint8_t* gameboy::getFramebuffer() {
+	return this->video->getFramebuffer();
+}
+
+void gameboy::setFramebuffer(uint8_t* framebuffer) {
+	this->video->setTarget(framebuffer);
+}
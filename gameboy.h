@@ -0,0 +1,88 @@
+#ifndef __GAMEBOY_H__
+#define __GAMEBOY_H__
+
+#include <cstdint>
+#include <cstddef>
+
+#include "cpu.h"
+#include "io.h"
+#include "apu.h"
+#include "audio.h"
+#include "joypad.h"
+#include "serial.h"
+#include "ppu.h"
+
+#define MEMORY_SIZE 0x10000
+#define ROM_SIZE 0x8000 //unbanked cartridge area
+#define CYCLES_PER_LINE 114 //machine cycles
+#define LINES_PER_FRAME 154
+#define CYCLES_PER_FRAME (CYCLES_PER_LINE * LINES_PER_FRAME)
+#define AUDIO_BUFFER_FRAMES 8192 //about 170ms at 48kHz
+
+class guestProfiler;
+class codeDataLog;
+
+/* whole machine between two frames, about 65KB */
+struct gameboyState {
+	uint8_t memory[MEMORY_SIZE];
+	cpuState cpu;
+	apuState sound;
+	serialState serial;
+	ppuState video;
+	uint64_t frame;
+};
+
+/* CPU, memory and hardware registers of one emulated console, usable without a window */
+class gameboy {
+	private:
+		uint8_t* memory;
+		bool ownsMemory;
+		gbcpu* cpu;
+		cpuView* view;
+		ioBus io;
+		joypad pad;
+		serialPort* serial;
+		ppu* video;
+		audioRing* audio;
+		apu* sound;
+		guestProfiler* profiler; //NULL when off
+		uint64_t frame;
+
+		void init();
+
+	public:
+		gameboy();
+		gameboy(uint8_t* memory); //MEMORY_SIZE bytes owned by the caller, e.g. one slice of a batch
+		~gameboy();
+		gameboy(const gameboy&) = delete;
+		gameboy& operator=(const gameboy&) = delete;
+
+		bool loadROM(const char* filename);
+		bool loadROM(const uint8_t* data, size_t size);
+		uint64_t runFrame(); //returns machine cycles run, fewer if a breakpoint hit
+
+		/* runFrame() in pieces, for consoles that have to take turns */
+		bool runCPU(uint64_t end); //up to end cycles since power on, false when a breakpoint or watchpoint hit first
+		uint64_t endFrame(uint64_t start); //catches video and audio up, returns the cycles since start
+		uint64_t getFrame();
+		uint64_t getCycles(); //machine cycles since power on
+		void setAudioOutput(bool enabled); //false drops the audio of the following frames
+		void setRender(bool enabled); //false skips drawing the following frames, for re-simulation
+		void setProfiler(guestProfiler* profiler); //samples where the guest spends its cycles, NULL to stop
+		void setCodeDataLog(codeDataLog* cdl); //marks the bytes run, read and written, NULL to stop
+
+		/* between frames only, a state loads into any gameboy built the same way */
+		void saveState(gameboyState& state);
+		void loadState(const gameboyState& state);
+		uint64_t stateHash(); //memory and registers, equal on every machine that ran the same inputs
+
+		gbcpu& getCPU();
+		uint8_t* getMemory();
+		audioRing& getAudio();
+		joypad& getJoypad();
+		serialPort& getSerial();
+		const uint8_t* getFramebuffer(); //SCREEN_HEIGHT rows of SCREEN_WIDTH shades, complete after runFrame()
+		void setFramebuffer(uint8_t* framebuffer); //draw straight into the caller's FRAMEBUFFER_SIZE bytes, NULL to stop
+};
+
+#endif
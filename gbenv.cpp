@@ -0,0 +1,184 @@
+#include "gbenv.h"
+#include "gameboy.h"
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstring>
+
+struct gbBatch {
+	uint32_t count;
+	uint32_t threads;
+	uint8_t* memory; //count * MEMORY_SIZE
+	uint8_t* framebuffers; //count * FRAMEBUFFER_SIZE
+	gameboy** consoles;
+	uint8_t* rom;
+	size_t romSize;
+
+	/* workers for slices 1 to threads - 1, they live as long as the batch and sleep between steps */
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake; //a step was posted or the batch is going away
+	std::condition_variable done; //the last worker finished its slice
+	uint64_t step; //posted steps, workers run each one once
+	uint32_t busy; //workers still on the current step
+	bool stopping;
+	const uint8_t* inputs; //of the current step
+	uint32_t frames;
+};
+
+static void startConsole(gbBatch* batch, uint32_t index) {
+	gameboy* gb = new gameboy(&batch->memory[static_cast<size_t>(index) * MEMORY_SIZE]);
+	gb->loadROM(batch->rom, batch->romSize);
+	gb->setFramebuffer(&batch->framebuffers[static_cast<size_t>(index) * FRAMEBUFFER_SIZE]);
+	gb->setAudioOutput(false);
+	batch->consoles[index] = gb;
+}
+
+static void stepRange(gbBatch* batch, const uint8_t* inputs, uint32_t frames, uint32_t first, uint32_t last) {
+	for (uint32_t i = first; i < last; i++) {
+		gameboy* gb = batch->consoles[i];
+		gb->getJoypad().setButtons(inputs ? inputs[i] : 0);
+		for (uint32_t f = 0; f < frames; f++) {
+			gb->runFrame();
+		}
+	}
+}
+
+/* contiguous slices keep each thread on its own part of the memory blocks */
+static void sliceOf(gbBatch* batch, uint32_t slice, uint32_t& first, uint32_t& last) {
+	uint32_t per = (batch->count + batch->threads - 1) / batch->threads;
+	first = (slice * per < batch->count) ? slice * per : batch->count;
+	last = (first + per < batch->count) ? first + per : batch->count;
+}
+
+static void workerLoop(gbBatch* batch, uint32_t slice) {
+	uint32_t first, last;
+	sliceOf(batch, slice, first, last);
+	uint64_t seen = 0;
+
+	std::unique_lock<std::mutex> lock(batch->lock);
+	while (true) {
+		batch->wake.wait(lock, [&]() { return batch->stopping || batch->step != seen; });
+		if (batch->stopping) {
+			return;
+		}
+		seen = batch->step;
+
+		lock.unlock();
+		stepRange(batch, batch->inputs, batch->frames, first, last);
+		lock.lock();
+
+		if (--batch->busy == 0) {
+			batch->done.notify_one();
+		}
+	}
+}
+
+gbBatch* gbBatchCreate(uint32_t count, const uint8_t* rom, size_t romSize, uint32_t threads) {
+	if (count == 0 || !rom || romSize == 0) {
+		std::cout << "ERROR: a batch needs at least one console and a ROM" << std::endl;
+		return NULL;
+	}
+
+	gbBatch* batch = new gbBatch;
+	batch->count = count;
+	batch->threads = (threads == 0) ? 1 : ((threads < count) ? threads : count);
+	batch->memory = new uint8_t[static_cast<size_t>(count) * MEMORY_SIZE];
+	batch->framebuffers = new uint8_t[static_cast<size_t>(count) * FRAMEBUFFER_SIZE];
+	memset(batch->framebuffers, 0, static_cast<size_t>(count) * FRAMEBUFFER_SIZE);
+	batch->rom = new uint8_t[romSize];
+	memcpy(batch->rom, rom, romSize);
+	batch->romSize = romSize;
+
+	batch->consoles = new gameboy*[count];
+	for (uint32_t i = 0; i < count; i++) {
+		startConsole(batch, i);
+	}
+
+	batch->step = 0;
+	batch->busy = 0;
+	batch->stopping = false;
+	batch->inputs = NULL;
+	batch->frames = 0;
+	for (uint32_t t = 1; t < batch->threads; t++) {
+		batch->workers.push_back(std::thread(workerLoop, batch, t));
+	}
+	return batch;
+}
+
+void gbBatchDestroy(gbBatch* batch) {
+	if (!batch) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(batch->lock);
+		batch->stopping = true;
+	}
+	batch->wake.notify_all();
+	for (std::thread& worker : batch->workers) {
+		worker.join();
+	}
+
+	for (uint32_t i = 0; i < batch->count; i++) {
+		delete batch->consoles[i];
+	}
+	delete[] batch->consoles;
+	delete[] batch->rom;
+	delete[] batch->framebuffers;
+	delete[] batch->memory;
+	delete batch;
+}
+
+uint32_t gbBatchCount(const gbBatch* batch) {
+	return batch->count;
+}
+
+void gbBatchReset(gbBatch* batch, uint32_t index) {
+	if (index >= batch->count) {
+		std::cout << "ERROR: console " << index << " is not in the batch" << std::endl;
+		return;
+	}
+
+	delete batch->consoles[index];
+	startConsole(batch, index);
+	memset(&batch->framebuffers[static_cast<size_t>(index) * FRAMEBUFFER_SIZE], 0, FRAMEBUFFER_SIZE);
+}
+
+void gbBatchStep(gbBatch* batch, const uint8_t* inputs, uint32_t frames) {
+	uint32_t first, last;
+	sliceOf(batch, 0, first, last);
+	if (batch->workers.empty()) {
+		stepRange(batch, inputs, frames, first, last);
+		return;
+	}
+
+	/* the workers take their slices, this thread does the first one */
+	{
+		std::lock_guard<std::mutex> lock(batch->lock);
+		batch->inputs = inputs;
+		batch->frames = frames;
+		batch->busy = static_cast<uint32_t>(batch->workers.size());
+		batch->step++;
+	}
+	batch->wake.notify_all();
+	stepRange(batch, inputs, frames, first, last);
+
+	std::unique_lock<std::mutex> lock(batch->lock);
+	batch->done.wait(lock, [&]() { return batch->busy == 0; });
+}
+
+const uint8_t* gbBatchFramebuffers(const gbBatch* batch) {
+	return batch->framebuffers;
+}
+
+gbView gbBatchMemoryView(const gbBatch* batch, uint16_t address) {
+	gbView view;
+	view.base = &batch->memory[address];
+	view.stride = MEMORY_SIZE;
+	view.count = batch->count;
+	return view;
+}
@@ -0,0 +1,55 @@
+#ifndef __GBENV_H__
+#define __GBENV_H__
+
+/*
+C API for stepping many consoles at once, e.g. from a training loop
+
+every console runs the same ROM. Framebuffers and memory of the whole
+batch each live in one contiguous block, so nothing is allocated or
+copied per console while stepping
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(_WIN32)
+#define GBENV_API __declspec(dllexport)
+#else
+#define GBENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct gbBatch gbBatch;
+
+/* the same byte in every console, console i is at base + i * stride */
+typedef struct gbView {
+	const uint8_t* base;
+	size_t stride;
+	uint32_t count;
+} gbView;
+
+/* threads 0 or 1 steps on the calling thread, returns NULL on failure */
+GBENV_API gbBatch* gbBatchCreate(uint32_t count, const uint8_t* rom, size_t romSize, uint32_t threads);
+GBENV_API void gbBatchDestroy(gbBatch* batch);
+GBENV_API uint32_t gbBatchCount(const gbBatch* batch);
+
+/* power cycles one console, e.g. at the end of an episode */
+GBENV_API void gbBatchReset(gbBatch* batch, uint32_t index);
+
+/* inputs holds one byte of BUTTON_* bits per console, held for all frames */
+GBENV_API void gbBatchStep(gbBatch* batch, const uint8_t* inputs, uint32_t frames);
+
+/* count x 144 x 160 shades from 0 (white) to 3 (black), valid until the next step */
+GBENV_API const uint8_t* gbBatchFramebuffers(const gbBatch* batch);
+
+/* RAM readouts such as a score or a lives counter */
+GBENV_API gbView gbBatchMemoryView(const gbBatch* batch, uint16_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+#include "golden.h"
+#include "movie.h"
+#include "screen.h"
+#include "utils.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+
+std::string goldenTest::resolve(const std::string& path) {
+	std::filesystem::path p(path);
+	if (p.is_absolute()) {
+		return path;
+	}
+	return (std::filesystem::path(this->filename).parent_path() / p).string();
+}
+
+bool goldenTest::load(const char* filename) {
+	std::ifstream in(filename);
+	if (!in) {
+		std::cout << "ERROR: failed to open golden file " << filename << std::endl;
+		return false;
+	}
+
+	this->filename = filename;
+	this->movieFile.clear();
+	this->romFile.clear();
+	this->frames.clear();
+
+	std::string line;
+	int number = 0;
+	while (std::getline(in, line)) {
+		number++;
+		std::istringstream words(line);
+		std::string first;
+		std::string second;
+		if (!(words >> first) || first[0] == '#') {
+			continue;
+		}
+		words >> second;
+
+		if (first == "movie") {
+			this->movieFile = second;
+		}
+		else if (first == "rom") {
+			this->romFile = second;
+		}
+		else if (first.find_first_not_of("0123456789") == std::string::npos && !second.empty()) {
+			goldenFrame frame;
+			frame.frame = std::strtoull(first.c_str(), NULL, 10);
+			frame.expected = (second == "-") ? GOLDEN_UNSET : std::strtoull(second.c_str(), NULL, 16);
+			frame.actual = GOLDEN_UNSET;
+			this->frames.push_back(frame);
+		}
+		else {
+			std::cout << "ERROR: " << filename << ":" << number << ": expected movie, rom or a frame and its hash" << std::endl;
+			return false;
+		}
+	}
+
+	if (this->movieFile.empty()) {
+		std::cout << "ERROR: " << filename << " names no movie" << std::endl;
+		return false;
+	}
+
+	/* played in order, so each frame carries on from the last one */
+	std::sort(this->frames.begin(), this->frames.end(), [](const goldenFrame& a, const goldenFrame& b) {
+		return a.frame < b.frame;
+	});
+	return true;
+}
+
+bool goldenTest::save() {
+	std::ofstream out(this->filename);
+	if (!out) {
+		std::cout << "ERROR: failed to write golden file " << this->filename << std::endl;
+		return false;
+	}
+
+	out << "movie " << this->movieFile << "\n";
+	if (!this->romFile.empty()) {
+		out << "rom " << this->romFile << "\n";
+	}
+	char hash[17];
+	for (goldenFrame& frame : this->frames) {
+		frame.expected = frame.actual;
+		snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)frame.actual);
+		out << frame.frame << " " << ((frame.actual == GOLDEN_UNSET) ? "-" : hash) << "\n";
+	}
+	return static_cast<bool>(out);
+}
+
+uint32_t goldenTest::run(const char* pngDir) {
+	uint32_t mismatches = 0;
+	for (goldenFrame& frame : this->frames) {
+		frame.actual = GOLDEN_UNSET;
+	}
+
+	movieReader reader;
+	if (!reader.open(this->resolve(this->movieFile).c_str())) {
+		return static_cast<uint32_t>(this->frames.size());
+	}
+
+	if (!this->romFile.empty()) {
+		gameboy rom;
+		if (!rom.loadROM(this->resolve(this->romFile).c_str())) {
+			return static_cast<uint32_t>(this->frames.size());
+		}
+		if (hashBytes(rom.getMemory(), ROM_SIZE) != reader.getRomHash()) {
+			std::cout << "ERROR: " << this->movieFile << " was not recorded with " << this->romFile << std::endl;
+			return static_cast<uint32_t>(this->frames.size());
+		}
+	}
+
+	gameboy gb;
+	gb.setAudioOutput(false);
+	uint64_t position = UINT64_MAX; //frames run so far, nothing is loaded yet
+	screen* display = NULL;
+
+	for (goldenFrame& frame : this->frames) {
+		if (frame.frame >= reader.getFrames()) {
+			std::cout << "ERROR: " << this->movieFile << " ends before frame " << frame.frame << std::endl;
+			mismatches++;
+			continue;
+		}
+
+		/* seek when playing on from here would replay more than a seek does */
+		if (position == UINT64_MAX || frame.frame - position > reader.getInterval()) {
+			reader.seek(gb, frame.frame);
+			position = frame.frame;
+		}
+		while (position <= frame.frame) {
+			gb.getJoypad().setButtons(reader.getInput(position));
+			gb.runFrame();
+			position++;
+		}
+
+		frame.actual = frameHash(gb.getFramebuffer());
+		if (frame.actual == frame.expected) {
+			continue;
+		}
+
+		/* only a mismatch pays for a full image */
+		mismatches++;
+		if (frame.expected != GOLDEN_UNSET && pngDir) {
+			if (!display) {
+				display = new screen;
+			}
+			shadeScreen(display, gb.getFramebuffer());
+			std::string name = std::filesystem::path(this->filename).stem().string() + "_" + std::to_string(frame.frame) + ".png";
+			savePNG((std::filesystem::path(pngDir) / name).string().c_str(), display);
+		}
+	}
+
+	delete display;
+	return mismatches;
+}
+
+const std::string& goldenTest::getFilename() {
+	return this->filename;
+}
+
+size_t goldenTest::getFrames() {
+	return this->frames.size();
+}
+
+const goldenFrame& goldenTest::getFrame(size_t i) {
+	return this->frames[i];
+}
@@ -0,0 +1,47 @@
+#ifndef __GOLDEN_H__
+#define __GOLDEN_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define GOLDEN_UNSET 0 //hash of a frame that has not been blessed yet
+
+struct goldenFrame {
+	uint64_t frame; //checked once this frame has been run, counting from 0
+	uint64_t expected;
+	uint64_t actual;
+};
+
+/*
+frame hashes a movie has to reproduce, kept in a text file
+
+	# comment
+	movie zelda.gbm
+	rom zelda.gb
+	120 8c1f0a3b5d7e9f21
+	600 -
+
+paths are relative to the file. The movie carries the machine, the rom
+line only checks it was recorded with that ROM. A "-" hash is filled in
+by save() after a run, as are the others when the output is blessed
+*/
+class goldenTest {
+	private:
+		std::string filename;
+		std::string movieFile;
+		std::string romFile;
+		std::vector<goldenFrame> frames;
+
+		std::string resolve(const std::string& path);
+
+	public:
+		bool load(const char* filename);
+		bool save(); //writes the actual hashes as the expected ones
+		uint32_t run(const char* pngDir); //mismatching frames, each saved as a PNG in pngDir
+		const std::string& getFilename();
+		size_t getFrames();
+		const goldenFrame& getFrame(size_t i);
+};
+
+#endif
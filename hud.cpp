@@ -0,0 +1,203 @@
+#include "hud.h"
+#include "shader.h"
+#include "shadersrc.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const char glyphChars[] = " 0123456789.%:-ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+#define GLYPHS (sizeof(glyphChars) - 1)
+
+/* 5x7, one byte per row with the leftmost pixel in bit 4 */
+static const uint8_t glyphRows[GLYPHS][7] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //space
+	{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, //0
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },
+	{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, //9
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, //.
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, //%
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, //:
+	{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, //-
+	{ 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 }, //A
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },
+	{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },
+	{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },
+	{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },
+	{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },
+	{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },
+	{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },
+	{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },
+	{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },
+	{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },
+	{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },
+	{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },
+	{ 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, //Z
+};
+
+static void nearestTexture(GLuint texture) {
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+hudOverlay::hudOverlay() {
+	this->program = 0;
+	this->VAO = 0;
+	this->font = 0;
+	this->text = 0;
+	this->graph = 0;
+	this->rectLocation = -1;
+	this->headLocation = -1;
+	this->targetLocation = -1;
+	this->shown = 0;
+}
+
+bool hudOverlay::init(double speed) {
+	this->program = loadShaderProgram("hud", hudVertexShader, hudFragmentShader, shaderCacheDir().c_str());
+	if (!this->program) {
+		return false;
+	}
+
+	glGenVertexArrays(1, &this->VAO);
+
+	/* every glyph once, white on black */
+	uint8_t* pixels = new uint8_t[GLYPHS * GLYPH_WIDTH * GLYPH_HEIGHT];
+	memset(pixels, 0, GLYPHS * GLYPH_WIDTH * GLYPH_HEIGHT);
+	for (size_t g = 0; g < GLYPHS; g++) {
+		for (int y = 0; y < 7; y++) {
+			for (int x = 0; x < 5; x++) {
+				if (glyphRows[g][y] & (0x10 >> x)) {
+					pixels[y * GLYPHS * GLYPH_WIDTH + g * GLYPH_WIDTH + x] = 0xFF;
+				}
+			}
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glGenTextures(1, &this->font);
+	nearestTexture(this->font);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GLYPHS * GLYPH_WIDTH, GLYPH_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, pixels);
+	delete[] pixels;
+
+	uint8_t blank[HUD_COLUMNS * HUD_ROWS] = {};
+	glGenTextures(1, &this->text);
+	nearestTexture(this->text);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, HUD_COLUMNS, HUD_ROWS, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, blank);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	float empty[FRAME_HISTORY] = {};
+	glGenTextures(1, &this->graph);
+	nearestTexture(this->graph);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, FRAME_HISTORY, 1, 0, GL_RED, GL_FLOAT, empty);
+
+	/* the emulator quad keeps texture unit 0 */
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glUseProgram(this->program);
+	glUniform1i(glGetUniformLocation(this->program, "font"), 1);
+	glUniform1i(glGetUniformLocation(this->program, "text"), 2);
+	glUniform1i(glGetUniformLocation(this->program, "graph"), 3);
+	glUniform2f(glGetUniformLocation(this->program, "size"), HUD_COLUMNS * GLYPH_WIDTH, HUD_ROWS * GLYPH_HEIGHT + HUD_GRAPH_HEIGHT);
+	glUniform1i(glGetUniformLocation(this->program, "textHeight"), HUD_ROWS * GLYPH_HEIGHT);
+	this->rectLocation = glGetUniformLocation(this->program, "rect");
+	this->headLocation = glGetUniformLocation(this->program, "head");
+	this->targetLocation = glGetUniformLocation(this->program, "target");
+	glUniform1f(this->targetLocation, static_cast<float>(1000.0 / (GB_FRAME_RATE * speed)));
+	return true;
+}
+
+void hudOverlay::update(frameStats& stats) {
+	if (!this->program) {
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, this->graph);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, FRAME_HISTORY, 1, GL_RED, GL_FLOAT, stats.getHistory());
+
+	if (stats.getVersion() != this->shown) {
+		this->shown = stats.getVersion();
+
+		/* one HUD_COLUMNS line per row, snprintf leaves room for the terminator */
+		char lines[HUD_ROWS][HUD_COLUMNS + 1];
+		snprintf(lines[0], sizeof(lines[0]), "FPS %5.1f SPEED %3.0f%%", stats.getFPS(), stats.getSpeed() * 100.0);
+		snprintf(lines[1], sizeof(lines[1]), "MS P50 %4.1f P95 %4.1f", stats.getPercentile(0), stats.getPercentile(1));
+		snprintf(lines[2], sizeof(lines[2]), "   P99 %4.1f MAX %4.1f", stats.getPercentile(2), stats.getPercentile(3));
+
+		uint8_t glyphs[HUD_ROWS * HUD_COLUMNS] = {};
+		for (int row = 0; row < HUD_ROWS; row++) {
+			for (int column = 0; column < HUD_COLUMNS && lines[row][column]; column++) {
+				const char* found = strchr(glyphChars, lines[row][column]);
+				glyphs[row * HUD_COLUMNS + column] = found ? static_cast<uint8_t>(found - glyphChars) : 0;
+			}
+		}
+
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, this->text);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, HUD_COLUMNS, HUD_ROWS, GL_RED_INTEGER, GL_UNSIGNED_BYTE, glyphs);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	glUseProgram(this->program);
+	glUniform1i(this->headLocation, static_cast<GLint>(stats.getHead()));
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void hudOverlay::draw(int width, int height) {
+	if (!this->program || width <= 0 || height <= 0) {
+		return;
+	}
+
+	/* HUD pixels to normalized device coordinates, a HUD_SCALE pixel margin from the corner */
+	float w = 2.0f * HUD_SCALE * HUD_COLUMNS * GLYPH_WIDTH / width;
+	float h = 2.0f * HUD_SCALE * (HUD_ROWS * GLYPH_HEIGHT + HUD_GRAPH_HEIGHT) / height;
+	float left = -1.0f + 2.0f * HUD_SCALE / width;
+	float top = 1.0f - 2.0f * HUD_SCALE / height;
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, this->font);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, this->text);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, this->graph);
+	glActiveTexture(GL_TEXTURE0);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glUseProgram(this->program);
+	glUniform4f(this->rectLocation, left, top, left + w, top - h);
+	glBindVertexArray(this->VAO);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glDisable(GL_BLEND);
+}
+
+void hudOverlay::destroy() {
+	if (!this->program) {
+		return;
+	}
+	GLuint textures[3] = { this->font, this->text, this->graph };
+	glDeleteTextures(3, textures);
+	glDeleteVertexArrays(1, &this->VAO);
+	glDeleteProgram(this->program);
+	this->program = 0;
+}
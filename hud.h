@@ -0,0 +1,47 @@
+#ifndef __HUD_H__
+#define __HUD_H__
+
+#include <cstdint>
+#include <glad/glad.h>
+
+#include "pacing.h"
+
+#define HUD_COLUMNS 20 //text cells, each GLYPH_WIDTH x GLYPH_HEIGHT HUD pixels
+#define HUD_ROWS 3
+#define HUD_GRAPH_HEIGHT 32 //HUD pixels, the graph is one pixel per frame wide
+#define HUD_SCALE 2 //window pixels per HUD pixel
+#define GLYPH_WIDTH 6 //5x7 glyphs with a blank column and row
+#define GLYPH_HEIGHT 8
+
+static_assert(HUD_COLUMNS * GLYPH_WIDTH == FRAME_HISTORY, "the graph spans the text");
+
+/*
+performance overlay, drawn by its own shader pass over the emulator quad
+
+the GPU does all the drawing: the text is a HUD_COLUMNS x HUD_ROWS texture
+of glyph numbers looked up in a font texture made once at startup, and
+the graph reads the frame time ring as a one row float texture. The CPU
+only writes the 60 glyph numbers when the stats change and the ring every
+frame
+*/
+class hudOverlay {
+	private:
+		GLuint program;
+		GLuint VAO; //empty, the vertex shader makes the quad
+		GLuint font;
+		GLuint text;
+		GLuint graph;
+		GLint rectLocation;
+		GLint headLocation;
+		GLint targetLocation;
+		uint64_t shown; //stats version on screen
+
+	public:
+		hudOverlay();
+		bool init(double speed); //needs the GL context, speed is the target multiple of the real frame rate
+		void update(frameStats& stats);
+		void draw(int width, int height); //framebuffer size, draws in the top left corner
+		void destroy();
+};
+
+#endif
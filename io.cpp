@@ -0,0 +1,30 @@
+#include "io.h"
+
+#include <cstddef>
+
+ioBus::ioBus() {
+	for (int i = 0; i < IO_PORTS; i++) {
+		this->ports[i] = NULL;
+	}
+}
+
+void ioBus::attach(uint16_t first, uint16_t last, ioDevice* device) {
+	for (uint16_t address = first; address <= last; address++) {
+		this->ports[address - IO_FIRST] = device;
+	}
+}
+
+uint8_t ioBus::read(uint16_t address, uint8_t val, uint64_t cycle) {
+	ioDevice* device = this->ports[address - IO_FIRST];
+	if (device) {
+		return device->ioRead(address, val, cycle);
+	}
+	return val;
+}
+
+void ioBus::write(uint16_t address, uint8_t val, uint64_t cycle) {
+	ioDevice* device = this->ports[address - IO_FIRST];
+	if (device) {
+		device->ioWrite(address, val, cycle);
+	}
+}
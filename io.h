@@ -0,0 +1,34 @@
+#ifndef __IO_H__
+#define __IO_H__
+
+#include <cstdint>
+
+#define IO_FIRST 0xFF00
+#define IO_PORTS 0x80 //0xFF00 - 0xFF7F
+#define IF_REGISTER 0xFF0F //interrupt requests, devices set their bit in memory
+
+/* hardware register block, e.g. the APU or the joypad */
+class ioDevice {
+	public:
+		virtual ~ioDevice() {}
+
+		/* val is the byte last written to memory, the result is what the CPU reads */
+		virtual uint8_t ioRead(uint16_t address, uint8_t val, uint64_t cycle) = 0;
+
+		/* called after val has been stored to memory, cycle is gbcpu machine cycles */
+		virtual void ioWrite(uint16_t address, uint8_t val, uint64_t cycle) = 0;
+};
+
+/* routes CPU accesses in 0xFF00-0xFF7F to the device attached to each port */
+class ioBus {
+	private:
+		ioDevice* ports[IO_PORTS];
+
+	public:
+		ioBus();
+		void attach(uint16_t first, uint16_t last, ioDevice* device);
+		uint8_t read(uint16_t address, uint8_t val, uint64_t cycle);
+		void write(uint16_t address, uint8_t val, uint64_t cycle);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "joypad.h"
+
+joypad::joypad() {
+	this->buttons = 0;
+	this->poller = NULL;
+	this->lastPoll = UINT64_MAX;
+}
+
+void joypad::press(uint8_t button) {
+	this->buttons.fetch_or(static_cast<uint8_t>(1 << button), std::memory_order_relaxed);
+}
+
+void joypad::release(uint8_t button) {
+	this->buttons.fetch_and(static_cast<uint8_t>(~(1 << button)), std::memory_order_relaxed);
+}
+
+void joypad::setButtons(uint8_t state) {
+	this->buttons.store(state, std::memory_order_relaxed);
+}
+
+uint8_t joypad::getButtons() {
+	return this->buttons.load(std::memory_order_relaxed);
+}
+
+void joypad::setPoller(inputPoller* poller) {
+	this->poller = poller;
+	this->lastPoll = UINT64_MAX; //the first read polls
+}
+
+uint8_t joypad::ioRead(uint16_t, uint8_t val, uint64_t cycle) {
+	/* games read JOYP many times in a row, the host is asked again only now and then */
+	if (this->poller && (cycle < this->lastPoll || cycle >= this->lastPoll + JOYPAD_POLL_INTERVAL)) {
+		this->lastPoll = cycle;
+		this->poller->poll();
+	}
+
+	uint8_t state = this->buttons.load(std::memory_order_relaxed);
+	uint8_t pressed = 0;
+
+	/* bit 4 low selects the d-pad, bit 5 low the buttons, lines read 0 while pressed */
+	if (!(val & 0x10)) {
+		pressed |= state & 0x0F;
+	}
+	if (!(val & 0x20)) {
+		pressed |= state >> 4;
+	}
+	return 0xC0 | (val & 0x30) | (~pressed & 0x0F);
+}
+
+void joypad::ioWrite(uint16_t, uint8_t, uint64_t) {
+}
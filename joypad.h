@@ -0,0 +1,58 @@
+#ifndef __JOYPAD_H__
+#define __JOYPAD_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#include "io.h"
+
+#define JOYP 0xFF00
+
+/* bits of the button state, 1 while held */
+#define BUTTON_RIGHT 0
+#define BUTTON_LEFT 1
+#define BUTTON_UP 2
+#define BUTTON_DOWN 3
+#define BUTTON_A 4
+#define BUTTON_B 5
+#define BUTTON_SELECT 6
+#define BUTTON_START 7
+
+#define JOYPAD_POLL_INTERVAL 1140 //machine cycles between host input polls from JOYP reads, ten lines
+
+/* host input that can be read again mid-frame, e.g. the window's event queue */
+class inputPoller {
+	public:
+		virtual ~inputPoller() {}
+		virtual void poll() = 0; //may press and release buttons on the joypad
+};
+
+/*
+JOYP register
+
+the buttons are latched when the guest reads 0xFF00, not once per frame,
+so a press lands in the very next poll. Any thread may change the state.
+A window's key callback only runs when its events are polled though, so
+an inputPoller lets JOYP reads poll them in the middle of a frame
+*/
+class joypad : public ioDevice {
+	private:
+		std::atomic<uint8_t> buttons;
+		inputPoller* poller; //NULL when the state only changes from outside
+		uint64_t lastPoll;
+
+	public:
+		joypad();
+
+		void press(uint8_t button);
+		void release(uint8_t button);
+		void setButtons(uint8_t state); //whole state at once, e.g. from a movie or the network
+		uint8_t getButtons();
+		void setPoller(inputPoller* poller); //NULL to stop, not for runs whose input has to stay fixed for a frame
+
+		uint8_t ioRead(uint16_t address, uint8_t val, uint64_t cycle); //polls at most every JOYPAD_POLL_INTERVAL cycles
+		void ioWrite(uint16_t address, uint8_t val, uint64_t cycle); //no-op, only the select bits are writable and ioRead() masks the rest
+};
+
+#endif
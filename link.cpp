@@ -0,0 +1,65 @@
+#include "link.h"
+
+#include <thread>
+
+static void runSide(gameboy* gb, uint32_t frames) {
+	for (uint32_t f = 0; f < frames; f++) {
+		gb->runFrame();
+	}
+	gb->getSerial().finish(gb->getCycles());
+}
+
+linkCable::linkCable(gameboy& a, gameboy& b) {
+	this->console[0] = &a;
+	this->console[1] = &b;
+	this->link = new serialLink;
+
+	for (int i = 0; i < 2; i++) {
+		this->link->time[i] = 0;
+		this->link->finished[i] = false;
+		this->console[i]->getSerial().connect(this->link, static_cast<uint8_t>(i), this->console[i]->getCycles());
+	}
+}
+
+linkCable::~linkCable() {
+	this->console[0]->getSerial().disconnect();
+	this->console[1]->getSerial().disconnect();
+	delete this->link;
+}
+
+void linkCable::runFrames(uint32_t frames) {
+	/* both sides are idle here, nothing else touches the link */
+	for (int i = 0; i < 2; i++) {
+		this->link->finished[i] = false;
+	}
+
+	std::thread other(runSide, this->console[1], frames);
+	runSide(this->console[0], frames);
+	other.join();
+}
+
+void linkCable::stepFrame() {
+	uint64_t start[2];
+	for (int i = 0; i < 2; i++) {
+		this->link->finished[i] = false;
+		start[i] = this->console[i]->getCycles();
+		this->console[i]->getSerial().update(start[i]); //publishes the time again, a loaded state may have moved it back
+	}
+
+	/* neither side gets far enough ahead to wait, and every byte is answered before its transfer completes */
+	uint64_t run = 0;
+	while (run < CYCLES_PER_FRAME) {
+		run = (run + LINK_SLICE < CYCLES_PER_FRAME) ? run + LINK_SLICE : CYCLES_PER_FRAME;
+		for (int i = 0; i < 2; i++) {
+			while (!this->console[i]->runCPU(start[i] + run)) {}
+		}
+	}
+
+	/* the first side answers what the second clocked in the last turn, so the queues are empty between frames */
+	this->console[0]->getSerial().update(start[0] + run);
+	this->console[1]->getSerial().update(start[1] + run);
+
+	for (int i = 0; i < 2; i++) {
+		this->console[i]->endFrame(start[i]);
+	}
+}
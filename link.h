@@ -0,0 +1,35 @@
+#ifndef __LINK_H__
+#define __LINK_H__
+
+#include <cstdint>
+
+#include "gameboy.h"
+#include "serial.h"
+
+#define LINK_SLICE (SERIAL_LOOKAHEAD / 2) //cycles each console runs per turn in stepFrame()
+
+/*
+serial cable between two consoles in the same process
+
+runFrames() runs both on their own threads, they only wait for each
+other when one gets SERIAL_LOOKAHEAD cycles ahead or a transfer needs
+the other side's byte. Which byte a late side sends then depends on the
+thread timing. stepFrame() takes turns on the calling thread instead, so
+the result only depends on the two machine states, as rollback needs
+*/
+class linkCable {
+	private:
+		gameboy* console[2];
+		serialLink* link;
+
+	public:
+		linkCable(gameboy& a, gameboy& b);
+		~linkCable();
+		linkCable(const linkCable&) = delete;
+		linkCable& operator=(const linkCable&) = delete;
+
+		void runFrames(uint32_t frames); //the second console runs on a new thread, the first on this one
+		void stepFrame(); //one frame of both on this thread, breakpoints do not stop it
+};
+
+#endif
@@ -0,0 +1,370 @@
+#include "lockstep.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+uint8_t laneKind(uint8_t opcode) {
+	/* same decoding as gbcpu::tick(), these are the one cycle instructions */
+	if (opcode == 0x00) {
+		return LANE_NOP;
+	}
+	if (opcode >= 0x40 && opcode < 0x80 && (opcode & 0x07) != 0x6 && (opcode < 0x70 || opcode >= 0x78)) {
+		return LANE_LD_R_R;
+	}
+	if (opcode >= 0x80 && opcode < 0xC0) {
+		return LANE_ALU;
+	}
+	return LANE_SCALAR;
+}
+
+/* register r of every lane, zero extended to 16 bits */
+static void extract(const registerPair* pair, bool high, uint16_t* out) {
+#ifdef __AVX2__
+	__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pair));
+	x = high ? _mm256_srli_epi16(x, 8) : _mm256_and_si256(x, _mm256_set1_epi16(0x00FF));
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), x);
+#else
+	for (int i = 0; i < LOCKSTEP_LANES; i++) {
+		out[i] = high ? (pair[i].full >> 8) : (pair[i].full & 0x00FF);
+	}
+#endif
+}
+
+/* writes val into the high or low half of the enabled lanes */
+static void merge(registerPair* pair, bool high, const uint16_t* val, const uint16_t* mask) {
+#ifdef __AVX2__
+	__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pair));
+	__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(val));
+	__m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask));
+	__m256i y = high ? _mm256_or_si256(_mm256_and_si256(x, _mm256_set1_epi16(0x00FF)), _mm256_slli_epi16(v, 8))
+		: _mm256_or_si256(_mm256_and_si256(x, _mm256_set1_epi16(static_cast<short>(0xFF00))), v);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(pair), _mm256_blendv_epi8(x, y, m));
+#else
+	for (int i = 0; i < LOCKSTEP_LANES; i++) {
+		uint16_t y = high ? static_cast<uint16_t>((pair[i].full & 0x00FF) | (val[i] << 8)) : static_cast<uint16_t>((pair[i].full & 0xFF00) | val[i]);
+		pair[i].full = static_cast<uint16_t>((pair[i].full & ~mask[i]) | (y & mask[i]));
+	}
+#endif
+}
+
+/*
+gbcpu::ALU() on every lane, including its quirks: ADC and SBC use the new
+carry for the half carry and the result, CP leaves A alone and clears Z
+*/
+static void aluLanes(uint8_t operation, registerPair* AF, const uint16_t* val, const uint16_t* mask) {
+	uint16_t a[LOCKSTEP_LANES];
+	uint16_t h[LOCKSTEP_LANES];
+	uint16_t c[LOCKSTEP_LANES];
+	uint16_t result[LOCKSTEP_LANES];
+
+	for (int i = 0; i < LOCKSTEP_LANES; i++) {
+		a[i] = AF[i].full >> 8;
+		h[i] = (AF[i].full >> H_FLAG) & 1;
+		c[i] = (AF[i].full >> C_FLAG) & 1;
+	}
+
+	/* the operation is the same in every lane, so each loop is branch-free */
+	switch (operation) {
+	case 0: //ADD
+		for (int i = 0; i < LOCKSTEP_LANES; i++) {
+			h[i] = static_cast<uint16_t>(((a[i] & 0xF) + (val[i] & 0xF)) >> 4);
+			c[i] = static_cast<uint16_t>((a[i] + val[i]) >> 8);
+			a[i] = static_cast<uint16_t>((a[i] + val[i]) & 0xFF);
+		}
+		break;
+	case 1: //ADC
+		for (int i = 0; i < LOCKSTEP_LANES; i++) {
+			c[i] = static_cast<uint16_t>((a[i] + val[i] + c[i]) >> 8);
+			h[i] = static_cast<uint16_t>(((a[i] & 0xF) + (val[i] & 0xF) + c[i]) >> 4);
+			a[i] = static_cast<uint16_t>((a[i] + val[i] + c[i]) & 0xFF);
+		}
+		break;
+	case 2: //SUB
+		for (int i = 0; i < LOCKSTEP_LANES; i++) {
+			c[i] = a[i] < val[i];
+			h[i] = (a[i] & 0xF) < (val[i] & 0xF);
+			a[i] = static_cast<uint16_t>((a[i] - val[i]) & 0xFF);
+		}
+		break;
+	case 3: //SBC
+		for (int i = 0; i < LOCKSTEP_LANES; i++) {
+			c[i] = a[i] < val[i] + c[i];
+			h[i] = (a[i] & 0xF) < (val[i] & 0xF) + c[i];
+			a[i] = static_cast<uint16_t>((a[i] - val[i] - c[i]) & 0xFF);
+		}
+		break;
+	case 4: //AND
+		for (int i = 0; i < LOCKSTEP_LANES; i++) {
+			a[i] &= val[i];
+			h[i] = 1;
+		}
+		break;
+	case 5: //XOR
+		for (int i = 0; i < LOCKSTEP_LANES; i++) {
+			a[i] ^= val[i];
+		}
+		break;
+	case 6: //OR
+		for (int i = 0; i < LOCKSTEP_LANES; i++) {
+			a[i] |= val[i];
+		}
+		break;
+	case 7: //CP
+		break;
+	}
+
+	uint16_t subtract = (operation == 2 || operation == 3 || operation == 7) ? 1 : 0;
+	uint16_t zeroable = (operation != 7) ? 1 : 0;
+	for (int i = 0; i < LOCKSTEP_LANES; i++) {
+		uint16_t z = static_cast<uint16_t>(zeroable & (a[i] == 0));
+		uint16_t flags = static_cast<uint16_t>((AF[i].full & 0x0F) | (z << Z_FLAG) | (subtract << S_FLAG) | (h[i] << H_FLAG) | (c[i] << C_FLAG));
+		result[i] = static_cast<uint16_t>((a[i] << 8) | flags);
+	}
+	for (int i = 0; i < LOCKSTEP_LANES; i++) {
+		AF[i].full = static_cast<uint16_t>((AF[i].full & ~mask[i]) | (result[i] & mask[i]));
+	}
+}
+
+lockstep::lockstep(gbcpu** cpus, uint8_t** memory, uint32_t count) {
+	if (count > LOCKSTEP_LANES) {
+		std::cout << "ERROR: lockstep runs at most " << LOCKSTEP_LANES << " lanes, not " << count << std::endl;
+		count = LOCKSTEP_LANES;
+	}
+
+	this->count = count;
+	for (uint32_t i = 0; i < LOCKSTEP_LANES; i++) {
+		this->lanes[i] = (i < count) ? cpus[i] : NULL;
+		this->memory[i] = (i < count) ? memory[i] : NULL;
+	}
+
+	/* unused lanes are never enabled, they only need defined values */
+	memset(this->AF, 0, sizeof(this->AF));
+	memset(this->BC, 0, sizeof(this->BC));
+	memset(this->DE, 0, sizeof(this->DE));
+	memset(this->HL, 0, sizeof(this->HL));
+	memset(this->SP, 0, sizeof(this->SP));
+	memset(this->PC, 0, sizeof(this->PC));
+	memset(this->opcode, 0, sizeof(this->opcode));
+	memset(this->cycle, 0, sizeof(this->cycle));
+	memset(this->immediate, 0, sizeof(this->immediate));
+	memset(this->immediate16, 0, sizeof(this->immediate16));
+	memset(this->totalCycles, 0, sizeof(this->totalCycles));
+	this->resetStats();
+}
+
+void lockstep::gather() {
+	for (uint32_t i = 0; i < this->count; i++) {
+		const gbcpu* cpu = this->lanes[i];
+		this->AF[i] = cpu->AF;
+		this->BC[i] = cpu->BC;
+		this->DE[i] = cpu->DE;
+		this->HL[i] = cpu->HL;
+		this->SP[i] = cpu->SP;
+		this->PC[i] = cpu->PC;
+		this->opcode[i] = cpu->opcode;
+		this->cycle[i] = cpu->cycle;
+		this->immediate[i] = cpu->immediate;
+		this->immediate16[i] = cpu->immediate16;
+		this->totalCycles[i] = cpu->totalCycles;
+	}
+}
+
+void lockstep::scatter() {
+	for (uint32_t i = 0; i < this->count; i++) {
+		gbcpu* cpu = this->lanes[i];
+		cpu->AF = this->AF[i];
+		cpu->BC = this->BC[i];
+		cpu->DE = this->DE[i];
+		cpu->HL = this->HL[i];
+		cpu->SP = this->SP[i];
+		cpu->PC = this->PC[i];
+		cpu->opcode = this->opcode[i];
+		cpu->nibble[0] = this->opcode[i] & 0x0F;
+		cpu->nibble[1] = (this->opcode[i] >> 4) & 0x0F;
+		cpu->cycle = this->cycle[i];
+		cpu->immediate = this->immediate[i];
+		cpu->immediate16 = this->immediate16[i];
+		cpu->totalCycles = this->totalCycles[i];
+	}
+}
+
+registerPair* lockstep::pairOf(uint8_t r) {
+	switch (r >> 1) {
+	case 0:
+		return this->BC;
+	case 1:
+		return this->DE;
+	case 2:
+		return this->HL;
+	}
+	return this->AF;
+}
+
+/* finishes the lane's instruction on its own gbcpu, or stops at target */
+void lockstep::scalarStep(uint32_t lane, uint64_t target) {
+	gbcpu* cpu = this->lanes[lane];
+
+	cpu->AF = this->AF[lane];
+	cpu->BC = this->BC[lane];
+	cpu->DE = this->DE[lane];
+	cpu->HL = this->HL[lane];
+	cpu->SP = this->SP[lane];
+	cpu->PC = this->PC[lane];
+	cpu->opcode = this->opcode[lane];
+	cpu->nibble[0] = this->opcode[lane] & 0x0F;
+	cpu->nibble[1] = (this->opcode[lane] >> 4) & 0x0F;
+	cpu->cycle = this->cycle[lane];
+	cpu->immediate = this->immediate[lane];
+	cpu->immediate16 = this->immediate16[lane];
+	cpu->totalCycles = this->totalCycles[lane];
+
+	do {
+		cpu->tick();
+	} while (cpu->cycle != NEW_CYCLE && cpu->totalCycles < target);
+
+	this->AF[lane] = cpu->AF;
+	this->BC[lane] = cpu->BC;
+	this->DE[lane] = cpu->DE;
+	this->HL[lane] = cpu->HL;
+	this->SP[lane] = cpu->SP;
+	this->PC[lane] = cpu->PC;
+	this->opcode[lane] = cpu->opcode;
+	this->cycle[lane] = cpu->cycle;
+	this->immediate[lane] = cpu->immediate;
+	this->immediate16[lane] = cpu->immediate16;
+	this->totalCycles[lane] = cpu->totalCycles;
+}
+
+/* one tick of op on every enabled lane, then the fetch gbcpu::tick() does in the same cycle */
+void lockstep::vectorStep(uint8_t op, const uint16_t* mask) {
+	uint16_t val[LOCKSTEP_LANES];
+	uint8_t src = op & 0x07;
+
+	switch (laneKind(op)) {
+	case LANE_LD_R_R: {
+		uint8_t dest = (op >> 3) & 0x07;
+		extract(this->pairOf(src), (src & 1) == 0 || src == 7, val);
+		merge(this->pairOf(dest), (dest & 1) == 0 || dest == 7, val, mask);
+		break;
+	}
+	case LANE_ALU:
+		if (src == 0x6) {
+			/* (HL) is not read here, gbcpu uses whatever immediate holds */
+			for (int i = 0; i < LOCKSTEP_LANES; i++) {
+				val[i] = this->immediate[i];
+			}
+		}
+		else {
+			extract(this->pairOf(src), (src & 1) == 0 || src == 7, val);
+			for (int i = 0; i < LOCKSTEP_LANES; i++) {
+				this->immediate[i] = mask[i] ? static_cast<uint8_t>(val[i]) : this->immediate[i];
+			}
+		}
+		aluLanes((op >> 3) & 0x07, this->AF, val, mask);
+		break;
+	}
+
+	/* every lane has its own memory, so the fetch is a gather */
+	for (uint32_t i = 0; i < this->count; i++) {
+		if (mask[i]) {
+			this->totalCycles[i]++;
+			this->opcode[i] = this->memory[i][this->PC[i]];
+			this->PC[i]++;
+			this->cycle[i] = NEW_CYCLE;
+		}
+	}
+}
+
+void lockstep::run(uint64_t cycles) {
+	uint64_t target[LOCKSTEP_LANES];
+	bool pending[LOCKSTEP_LANES];
+
+	this->gather();
+	for (uint32_t i = 0; i < this->count; i++) {
+		target[i] = this->totalCycles[i] + cycles;
+	}
+
+	/* every round runs one instruction on each lane that still has cycles left */
+	while (true) {
+		uint32_t left = 0;
+		for (uint32_t i = 0; i < this->count; i++) {
+			pending[i] = this->totalCycles[i] < target[i];
+			left += pending[i];
+		}
+		if (left == 0) {
+			break;
+		}
+
+		for (uint32_t i = 0; i < this->count; i++) {
+			if (!pending[i]) {
+				continue;
+			}
+			pending[i] = false;
+
+			if (this->cycle[i] == NEW_CYCLE && laneKind(this->opcode[i]) != LANE_SCALAR) {
+				uint16_t mask[LOCKSTEP_LANES] = { 0 };
+				uint32_t enabled = 1;
+				mask[i] = 0xFFFF;
+				for (uint32_t j = i + 1; j < this->count; j++) {
+					if (pending[j] && this->cycle[j] == NEW_CYCLE && this->opcode[j] == this->opcode[i]) {
+						mask[j] = 0xFFFF;
+						pending[j] = false;
+						enabled++;
+					}
+				}
+
+				if (enabled > 1) {
+					this->vectorStep(this->opcode[i], mask);
+					this->vectorSteps++;
+					this->vectorLanes += enabled;
+					continue;
+				}
+			}
+
+			this->scalarStep(i, target[i]);
+			this->scalarInstructions++;
+		}
+	}
+
+	this->scatter();
+}
+
+double lockstep::getUtilisation() {
+	if (this->vectorSteps == 0) {
+		return 0;
+	}
+	return static_cast<double>(this->vectorLanes) / (static_cast<double>(this->vectorSteps) * LOCKSTEP_LANES);
+}
+
+double lockstep::getVectorShare() {
+	uint64_t total = this->vectorLanes + this->scalarInstructions;
+	if (total == 0) {
+		return 0;
+	}
+	return static_cast<double>(this->vectorLanes) / total;
+}
+
+uint64_t lockstep::getVectorSteps() {
+	return this->vectorSteps;
+}
+
+uint64_t lockstep::getScalarInstructions() {
+	return this->scalarInstructions;
+}
+
+void lockstep::resetStats() {
+	this->vectorSteps = 0;
+	this->vectorLanes = 0;
+	this->scalarInstructions = 0;
+}
+
+void lockstep::report() {
+	printf("lockstep %u lanes: %llu vector steps at %.1f%% lane utilisation, %llu scalar instructions, %.1f%% of instructions vectorised\n",
+		this->count, (unsigned long long)this->vectorSteps, 100.0 * this->getUtilisation(),
+		(unsigned long long)this->scalarInstructions, 100.0 * this->getVectorShare());
+}
@@ -0,0 +1,74 @@
+#ifndef __LOCKSTEP_H__
+#define __LOCKSTEP_H__
+
+#include <cstdint>
+
+#include "cpu.h"
+
+#define LOCKSTEP_LANES 16 //16 bit registers, 16 lanes fill one 256 bit vector
+
+/* how a lane executes an opcode that is at the start of its instruction */
+#define LANE_SCALAR 0
+#define LANE_NOP 1
+#define LANE_LD_R_R 2
+#define LANE_ALU 3
+
+/*
+experimental engine that runs up to LOCKSTEP_LANES CPUs with the same
+program side by side
+
+registers live here in structure-of-arrays form while run() executes.
+Lanes about to execute the same single-cycle opcode (NOP, LD r,r and the
+8 bit ALU) are executed together, with AVX2 when the build enables it and
+branch-free lane loops otherwise. Every other opcode, and lanes that are
+alone on their opcode, fall back to the lane's own gbcpu, so the result
+matches calling run() on every gbcpu exactly. The vector path does not
+see tracing, breakpoints or the opcode profiler
+*/
+class lockstep {
+	private:
+		gbcpu* lanes[LOCKSTEP_LANES];
+		uint8_t* memory[LOCKSTEP_LANES];
+		uint32_t count;
+
+		/* structure of arrays, lane i of every register is at index i */
+		registerPair AF[LOCKSTEP_LANES];
+		registerPair BC[LOCKSTEP_LANES];
+		registerPair DE[LOCKSTEP_LANES];
+		registerPair HL[LOCKSTEP_LANES];
+		uint16_t SP[LOCKSTEP_LANES];
+		uint16_t PC[LOCKSTEP_LANES];
+		uint8_t opcode[LOCKSTEP_LANES];
+		uint8_t cycle[LOCKSTEP_LANES];
+		uint8_t immediate[LOCKSTEP_LANES];
+		registerPair immediate16[LOCKSTEP_LANES];
+		uint64_t totalCycles[LOCKSTEP_LANES];
+
+		/* utilisation */
+		uint64_t vectorSteps;
+		uint64_t vectorLanes; //lanes enabled summed over vector steps
+		uint64_t scalarInstructions;
+
+		void gather();
+		void scatter();
+		void scalarStep(uint32_t lane, uint64_t target);
+		void vectorStep(uint8_t op, const uint16_t* mask);
+		registerPair* pairOf(uint8_t r); //B, C, D, E, H, L, -, A like the opcode encoding
+
+	public:
+		/* memory[i] is the memory cpus[i] was created with */
+		lockstep(gbcpu** cpus, uint8_t** memory, uint32_t count);
+
+		void run(uint64_t cycles); //every lane, like gbcpu::run() without breakpoints
+
+		double getUtilisation(); //enabled lanes per vector step out of LOCKSTEP_LANES
+		double getVectorShare(); //instructions that took the vector path
+		uint64_t getVectorSteps();
+		uint64_t getScalarInstructions();
+		void resetStats();
+		void report();
+};
+
+uint8_t laneKind(uint8_t opcode);
+
+#endif
@@ -9,37 +9,214 @@
 #include <GLFW/glfw3.h>
 
 #include "shader.h"
+#include "shadersrc.h"
 #include "cpu.h"
+#include "gameboy.h"
+#include "pacing.h"
+#include "runahead.h"
+#include "frameshare.h"
+#include "recorder.h"
+#include "movie.h"
+#include "screen.h"
+#include "profiler.h"
+#include "cdl.h"
+#include "probe.h"
+#include "hud.h"
 
 #define WIDTH 160
 #define HEIGHT 144
 
-struct Pixel {
-	uint8_t r;
-	uint8_t g;
-	uint8_t b;
-}pixel;
-
-union screen { //monochrome 8 bit depth
-	Pixel square[HEIGHT][WIDTH];
-	Pixel flat[WIDTH * HEIGHT];
-};
-
-//Pixel colors[4] = { {15, 56, 15}, {48, 98, 48}, {139, 172, 15}, {155, 188, 15} };
-//Pixel colors[4] = { {0,19,26}, {31,89,74}, {108,166,108}, {216,247,215} };
-Pixel colors[4] = { {0,0,0}, {85,85,85}, {170,170,170}, {255,255,255} };
+/* indexed by BUTTON_* */
+const int buttonKeys[8] = { GLFW_KEY_RIGHT, GLFW_KEY_LEFT, GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_Z, GLFW_KEY_X, GLFW_KEY_BACKSPACE, GLFW_KEY_ENTER };
 
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
 	}
+
+	if (action == GLFW_REPEAT) {
+		return;
+	}
+
+	int button = 0;
+	while (button < 8 && buttonKeys[button] != key) {
+		button++;
+	}
+	if (button == 8) {
+		return;
+	}
+
+	/* goes straight to the register, the guest sees it at its next JOYP read */
+	joypad* pad = static_cast<joypad*>(glfwGetWindowUserPointer(window));
+	if (action == GLFW_PRESS) {
+		pad->press(button);
+	}
+	else {
+		pad->release(button);
+	}
 }
 
+/* GLFW only runs the key callback from glfwPollEvents, JOYP reads call it mid-frame through this */
+class windowPoller : public inputPoller {
+	public:
+		void poll() {
+			glfwPollEvents();
+		}
+};
+
+/* the window lost what was drawn, unchanged frames must not skip drawing */
+static bool damaged = true;
+
 static void sizeCallback(GLFWwindow* window, int width, int height) {
 	glViewport(0, 0, width, height);
+	damaged = true;
+}
+
+static void refreshCallback(GLFWwindow* window) {
+	damaged = true;
 }
 
-int main(void) {
+/* GBemu [rom.gb] [--pace vsync|audio|timer|fast] [--speed n] [--runahead n] [--export name] [--export-replace] [--record name] [--movie out.gbm] [--profile out.folded] [--cdl out.cdl] [--probes out.json] [--slow ms] [--hud] */
+int main(int argc, char** argv) {
+	auto launched = std::chrono::steady_clock::now(); //for the time to the first frame
+	const char* romFile = NULL;
+	uint8_t pace = PACE_VSYNC;
+	double speed = 1.0;
+	uint32_t aheadFrames = 0;
+	const char* exportName = NULL;
+	bool exportReplace = false;
+	std::string recordName;
+	const char* movieFile = NULL;
+	const char* profileFile = NULL;
+	const char* cdlFile = NULL;
+	const char* probeFile = NULL;
+	double slowFrame = 0.0; //ms, 0 for one and a half frame periods
+	bool showHud = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--pace" && i + 1 < argc) {
+			std::string mode = argv[++i];
+			if (mode == "vsync") {
+				pace = PACE_VSYNC;
+			}
+			else if (mode == "audio") {
+				pace = PACE_AUDIO;
+			}
+			else if (mode == "timer") {
+				pace = PACE_TIMER;
+			}
+			else if (mode == "fast") {
+				pace = PACE_UNTHROTTLED;
+			}
+			else {
+				std::cout << "ERROR: unknown pacing mode " << mode << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--speed" && i + 1 < argc) {
+			speed = std::atof(argv[++i]);
+		}
+		else if (arg == "--runahead" && i + 1 < argc) {
+			aheadFrames = std::atoi(argv[++i]);
+		}
+		else if (arg == "--export" && i + 1 < argc) {
+			exportName = argv[++i];
+		}
+		else if (arg == "--export-replace") {
+			exportReplace = true;
+		}
+		else if (arg == "--record" && i + 1 < argc) {
+			recordName = argv[++i];
+		}
+		else if (arg == "--movie" && i + 1 < argc) {
+			movieFile = argv[++i];
+		}
+		else if (arg == "--profile" && i + 1 < argc) {
+			profileFile = argv[++i];
+		}
+		else if (arg == "--cdl" && i + 1 < argc) {
+			cdlFile = argv[++i];
+		}
+		else if (arg == "--probes" && i + 1 < argc) {
+			probeFile = argv[++i];
+		}
+		else if (arg == "--slow" && i + 1 < argc) {
+			slowFrame = std::atof(argv[++i]);
+		}
+		else if (arg == "--hud") {
+			showHud = true;
+		}
+		else {
+			romFile = argv[i];
+		}
+	}
+
+	gameboy gb;
+	if (romFile && !gb.loadROM(romFile)) {
+		return 1;
+	}
+	runAhead ahead(gb, aheadFrames);
+
+	/* guest profile, labels from rom.sym when there is one. Run-ahead frames would be sampled too */
+	guestProfiler profiler;
+	if (profileFile && aheadFrames > 0) {
+		std::cout << "ERROR: --profile can't be used with --runahead" << std::endl;
+		return 1;
+	}
+	if (profileFile) {
+		if (romFile) {
+			std::string symbols = romFile;
+			symbols = symbols.substr(0, symbols.find_last_of('.')) + ".sym";
+			if (std::ifstream(symbols)) {
+				profiler.loadSymbols(symbols.c_str());
+			}
+		}
+		gb.setProfiler(&profiler);
+	}
+
+	/* code/data log, adds to the one from earlier sessions. F2 pauses and resumes it */
+	codeDataLog cdl;
+	bool logging = false;
+	bool toggleHeld = false;
+	if (cdlFile) {
+		if (std::ifstream(cdlFile)) {
+			cdl.load(cdlFile);
+		}
+		gb.setCodeDataLog(&cdl);
+		logging = true;
+	}
+
+	/* inputs and keyframes, see movie.h. Keyframes would catch the run-ahead frames */
+	movieWriter movie;
+	if (movieFile && aheadFrames > 0) {
+		std::cout << "ERROR: --movie can't be used with --runahead" << std::endl;
+		return 1;
+	}
+	if (movieFile && !movie.create(movieFile, gb)) {
+		return 1;
+	}
+
+	/* finished frames for other processes, see frameshare.h */
+	frameExport exporter;
+	if (exportName && !exporter.open(exportName, exportReplace)) {
+		return 1;
+	}
+
+	/* name.y4m and name.wav, written on a background thread */
+	recorder capture;
+	if (!recordName.empty() && !capture.open((recordName + ".y4m").c_str(), (recordName + ".wav").c_str(), APU_SAMPLE_RATE)) {
+		return 1;
+	}
+
+	/* APU output goes through the resampler into a shallow device buffer */
+	audioRing deviceRing(DEVICE_BUFFER_FRAMES);
+	audioDevice device(&deviceRing, APU_SAMPLE_RATE);
+	framePacer pacer(pace, speed, &deviceRing);
+	resampler audioResampler;
+	int16_t* apuSamples = new int16_t[AUDIO_BUFFER_FRAMES * AUDIO_CHANNELS];
+	int16_t* deviceSamples = new int16_t[(AUDIO_BUFFER_FRAMES * 2 + 2) * AUDIO_CHANNELS];
+
 	glfwInit();
 
 	/* create window */
@@ -50,23 +227,46 @@ int main(void) {
 		return 1;
 	}
 
+	glfwSetWindowUserPointer(window, &gb.getJoypad());
 	glfwSetKeyCallback(window, keyCallback);
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GLFW_TRUE);
 	glfwSetFramebufferSizeCallback(window, sizeCallback);
+	glfwSetWindowRefreshCallback(window, refreshCallback);
+
+	/* presses that arrive while a frame is emulated reach its later JOYP reads, movies and run-ahead need the input fixed per frame */
+	windowPoller poller;
+	if (!movieFile && aheadFrames == 0) {
+		gb.getJoypad().setPoller(&poller);
+	}
 
 	glfwMakeContextCurrent(window);
 	gladLoadGL();
-	glfwSwapInterval(1);
+	glfwSwapInterval(pacer.useVsync() ? 1 : 0);
 
-	/* create shaders */
-	GLuint vShader = createShaderFromFile(GL_VERTEX_SHADER, "Shaders/shader.vert");
-	GLuint fShader = createShaderFromFile(GL_FRAGMENT_SHADER, "Shaders/shader.frag");
+	/* the rate control starts from the monitor's rate and measures the exact one as it goes */
+	const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+	if (videoMode) {
+		pacer.setRefreshRate(videoMode->refreshRate);
+	}
 
-	const GLuint shaderList[] = { vShader, fShader };
-	GLuint shaderProgram = createShaderProgram(shaderList, 2);
+	/* create shaders, from the binary cache when this driver has built them before */
+	auto shadersStart = std::chrono::steady_clock::now();
+	bool shadersCached = false;
+	GLuint shaderProgram = loadShaderProgram("screen", screenVertexShader, screenFragmentShader, shaderCacheDir().c_str(), &shadersCached);
+	double shaderTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shadersStart).count();
+	if (!shaderProgram) {
+		glfwTerminate();
+		return 1;
+	}
+	bool firstFrame = true;
 
-	glDeleteShader(vShader);
-	glDeleteShader(fShader);
+	/* performance overlay, F1 shows and hides it */
+	hudOverlay hud;
+	frameStats stats;
+	bool hudHeld = false;
+	if (!hud.init(speed)) {
+		std::cout << "ERROR: no performance overlay" << std::endl;
+	}
 
 	/* define texture dimensions and VBO/VAO */
 	float vertices[] = {
@@ -109,6 +309,10 @@ int main(void) {
 		}
 	}
 
+	/* allocated once, frames only replace the lines that changed */
+	glTexImage2D(GL_TEXTURE_2D, 0, 3, WIDTH, HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, display->flat);
+	frameDiff diff;
+
 	/* opcode tester */
 	for (uint16_t opcode = 0; opcode <= 255; opcode++) {
 		uint8_t nibble[2];
@@ -128,22 +332,168 @@ int main(void) {
 		}
 	}
 
+	if (pace == PACE_AUDIO) {
+		device.start();
+	}
+
+	/* host timing, F3 dumps the probes to probeFile and a slow frame dumps the second before it */
+	std::string probeName = probeFile ? probeFile : "";
+	probeName = probeName.substr(0, probeName.find_last_of('.'));
+	uint64_t slowLimit = static_cast<uint64_t>(((slowFrame > 0.0) ? slowFrame : 1500.0 / (GB_FRAME_RATE * speed)) * 1e6);
+	uint64_t lastSlowDump = 0;
+	bool dumpHeld = false;
+	if (probeFile) {
+		probeEnable(true);
+		probeThreadName("main");
+	}
+
 	/* main loop */
 	while (!glfwWindowShouldClose(window)) {
+		uint64_t frameStart = probesOn ? probeNow() : 0;
+		scopedProbe frameProbe("frame");
+		scopedProbe phase("emulate");
+		if (movieFile) {
+			movie.record(gb, gb.getJoypad().getButtons());
+		}
+		ahead.runFrame();
+
+		phase.next("audio");
+		uint32_t frames = gb.getAudio().read(apuSamples, AUDIO_BUFFER_FRAMES);
+		if (pace == PACE_AUDIO) {
+			uint32_t produced = audioResampler.process(apuSamples, frames, pacer.rateAdjust(), deviceSamples);
+			deviceRing.write(deviceSamples, produced);
+		}
+
+		phase.next("pace");
+		pacer.endFrame();
+
+		phase.next("present");
+		const uint8_t* shades = gb.getFramebuffer();
+		uint32_t ranges = diff.update(shades);
+		for (uint32_t r = 0; r < ranges; r++) {
+			shadeLines(display, shades, diff.getRange(r).first, diff.getRange(r).count);
+		}
+		exporter.publish(gb.getFrame(), gb.getJoypad().getButtons(), reinterpret_cast<const uint8_t*>(display->flat));
+		if (capture.isOpen()) {
+			capture.capture(gb.getFrame(), shades, apuSamples, frames);
+		}
 
 		/* update texture */
-		glTexImage2D(GL_TEXTURE_2D, 0, 3, WIDTH, HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, display->flat);
+		phase.next("upload");
+		for (uint32_t r = 0; r < ranges; r++) {
+			const lineRange& range = diff.getRange(r);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, range.first, WIDTH, range.count, GL_RGB, GL_UNSIGNED_BYTE, display->square[range.first]);
+		}
+
+		/*
+		an unchanged frame needs no drawing, unless vsync paces the loop: then
+		the swap has to happen and the back buffer holds nothing useful after it
+		*/
+		bool idle = ranges == 0 && !damaged && !showHud && !pacer.useVsync();
+		damaged = false;
 
 		/* draw triangles */
-		glUseProgram(shaderProgram);
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, indices);
+		phase.next("draw");
+		if (!idle) {
+			glUseProgram(shaderProgram);
+			glBindVertexArray(VAO);
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, indices);
+		}
+
+		stats.endFrame(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(),
+			gb.getFrame(), gb.getCycles());
+		bool hudKey = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+		if (hudKey && !hudHeld) {
+			showHud = !showHud;
+			damaged = true; //a hidden HUD has to be drawn over
+		}
+		hudHeld = hudKey;
+		if (showHud) {
+			int width, height;
+			glfwGetFramebufferSize(window, &width, &height);
+			hud.update(stats);
+			hud.draw(width, height);
+		}
+
+		if (cdlFile) {
+			bool held = glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS;
+			if (held && !toggleHeld) {
+				logging = !logging;
+				gb.setCodeDataLog(logging ? &cdl : NULL);
+				std::cout << "code/data log " << (logging ? "resumed" : "paused") << std::endl;
+			}
+			toggleHeld = held;
+		}
+
+		if (probeFile) {
+			bool held = glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS;
+			if (held && !dumpHeld && probeDump(probeFile)) {
+				std::cout << "probes written to " << probeFile << std::endl;
+			}
+			dumpHeld = held;
+		}
 
 		/* this code should go last */
+		phase.next("poll");
 		glfwPollEvents();
-		glfwSwapBuffers(window);
+		phase.next("swap");
+		if (!idle) {
+			glfwSwapBuffers(window);
+		}
+		if (firstFrame) {
+			firstFrame = false;
+			std::cout << "first frame after " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launched).count()
+				<< "ms, screen shader " << (shadersCached ? "from cache " : "compiled ") << "in " << shaderTime << "ms" << std::endl;
+		}
+		phase.end();
+		frameProbe.end();
+
+		/* at most one dump a second, the dump itself makes the next frame slow */
+		uint64_t frameTime = probesOn ? probeNow() - frameStart : 0;
+		if (frameTime > slowLimit && frameStart > lastSlowDump + 1000000000) {
+			std::string name = probeName + "_slow" + std::to_string(gb.getFrame()) + ".json";
+			uint64_t since = (frameStart > 1000000000) ? frameStart - 1000000000 : 0;
+			if (probeDump(name.c_str(), since)) {
+				std::cout << "slow frame (" << frameTime / 1e6 << "ms), probes written to " << name << std::endl;
+			}
+			lastSlowDump = probeNow();
+		}
+	}
+
+	device.stop();
+	if (pace == PACE_AUDIO) {
+		std::cout << "audio underruns: " << device.getUnderruns() << " frames" << std::endl;
+	}
+
+	if (capture.isOpen()) {
+		std::cout << "recorded " << capture.getRecorded() << " frames, dropped " << capture.getDropped() << std::endl;
+		capture.close();
+	}
+
+	if (movieFile) {
+		std::cout << "movie: " << movie.getFrames() << " frames" << std::endl;
+		movie.close();
+	}
+
+	if (profileFile) {
+		gb.setProfiler(NULL);
+		profiler.report(20);
+		profiler.writeFolded(profileFile);
+	}
+
+	if (cdlFile) {
+		gb.setCodeDataLog(NULL);
+		std::cout << "code/data log: " << cdl.count(CDL_CODE, 0, ROM_SIZE) << " ROM bytes run, " << cdl.count(CDL_DATA, 0, ROM_SIZE) << " read" << std::endl;
+		cdl.save(cdlFile);
+	}
+
+	if (ahead.getFrames() > 0) {
+		ahead.report();
 	}
 
+	delete[] apuSamples;
+	delete[] deviceSamples;
+	hud.destroy();
 	delete display;
 	return 0;
 }
\ No newline at end of file
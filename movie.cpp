@@ -0,0 +1,400 @@
+#include "movie.h"
+#include "utils.h"
+
+#include <iostream>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static uint64_t padded(uint64_t size) {
+	return (size + 7) & ~static_cast<uint64_t>(7);
+}
+
+movieWriter::movieWriter() {
+	this->file = NULL;
+	this->interval = MOVIE_KEYFRAME_INTERVAL;
+	this->frames = 0;
+	this->offset = 0;
+	this->scratch = NULL;
+}
+
+movieWriter::~movieWriter() {
+	this->close();
+}
+
+void movieWriter::writeChunk(uint32_t type, uint64_t frame, const void* data, uint32_t size) {
+	static const uint8_t zeros[8] = { 0 };
+	movieChunk chunk = { type, size, frame };
+
+	fwrite(&chunk, sizeof(chunk), 1, this->file);
+	fwrite(data, 1, size, this->file);
+	fwrite(zeros, 1, padded(size) - size, this->file);
+	this->offset += sizeof(chunk) + padded(size);
+}
+
+void movieWriter::flushInputs() {
+	if (this->pending.empty()) {
+		return;
+	}
+
+	this->writeChunk(CHUNK_INPUT, this->frames - this->pending.size(), this->pending.data(), static_cast<uint32_t>(this->pending.size()));
+	this->pending.clear();
+	fflush(this->file); //a reader following the file sees whole chunks
+}
+
+bool movieWriter::create(const char* filename, gameboy& gb, uint32_t interval) {
+	this->close();
+
+	this->file = fopen(filename, "wb");
+	if (!this->file) {
+		std::cout << "ERROR: failed to create movie " << filename << std::endl;
+		return false;
+	}
+
+	movieHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MOVIE_MAGIC;
+	header.version = MOVIE_VERSION;
+	header.interval = (interval == 0) ? MOVIE_KEYFRAME_INTERVAL : interval;
+	header.stateSize = sizeof(gameboyState);
+	header.romHash = hashBytes(gb.getMemory(), ROM_SIZE);
+	fwrite(&header, sizeof(header), 1, this->file);
+
+	this->interval = header.interval;
+	this->frames = 0;
+	this->offset = sizeof(header);
+	this->scratch = new gameboyState;
+	return true;
+}
+
+bool movieWriter::append(const char* filename, gameboy& gb) {
+	this->close();
+
+	movieReader reader;
+	if (!reader.open(filename)) {
+		return false;
+	}
+
+	/* carry on from the last recorded frame */
+	this->frames = reader.getFrames();
+	reader.seek(gb, this->frames);
+	this->interval = reader.getInterval();
+	this->offset = reader.getEnd();
+	for (size_t i = 0; i < reader.getKeyframes(); i++) {
+		this->index.push_back(reader.getKeyframe(i));
+	}
+	reader.close();
+
+	/* the index and any half written chunk go, they are rewritten by close() */
+	std::error_code error;
+	std::filesystem::resize_file(filename, this->offset, error);
+	this->file = error ? NULL : fopen(filename, "r+b");
+	if (!this->file) {
+		std::cout << "ERROR: failed to reopen movie " << filename << std::endl;
+		this->index.clear();
+		return false;
+	}
+	fseek(this->file, 0, SEEK_END);
+	this->scratch = new gameboyState;
+	return true;
+}
+
+void movieWriter::record(gameboy& gb, uint8_t buttons) {
+	if (!this->file) {
+		return;
+	}
+
+	/* a movie that was cut off right after a keyframe already has this one */
+	if (this->frames % this->interval == 0 && (this->index.empty() || this->index.back().frame != this->frames)) {
+		this->flushInputs();
+		gb.saveState(*this->scratch);
+		this->index.push_back({ this->frames, this->offset });
+		this->writeChunk(CHUNK_KEYFRAME, this->frames, this->scratch, sizeof(gameboyState));
+	}
+
+	this->pending.push_back(buttons);
+	this->frames++;
+	gb.getJoypad().setButtons(buttons);
+
+	if (this->pending.size() >= MOVIE_FLUSH_FRAMES) {
+		this->flushInputs();
+	}
+}
+
+void movieWriter::close() {
+	if (this->file) {
+		this->flushInputs();
+
+		movieTrailer trailer;
+		trailer.indexOffset = this->offset;
+		trailer.frames = this->frames;
+		trailer.entries = static_cast<uint32_t>(this->index.size());
+		trailer.magic = MOVIE_INDEX_MAGIC;
+		this->writeChunk(CHUNK_INDEX, 0, this->index.data(), static_cast<uint32_t>(this->index.size() * sizeof(movieIndexEntry)));
+		fwrite(&trailer, sizeof(trailer), 1, this->file);
+		fclose(this->file);
+		this->file = NULL;
+	}
+
+	delete this->scratch;
+	this->scratch = NULL;
+	this->index.clear();
+	this->pending.clear();
+}
+
+uint64_t movieWriter::getFrames() {
+	return this->frames;
+}
+
+movieReader::movieReader() {
+#ifdef _WIN32
+	this->file = NULL;
+	this->mapping = NULL;
+#else
+	this->fd = -1;
+#endif
+	this->data = NULL;
+	this->size = 0;
+	this->header = NULL;
+	this->frames = 0;
+	this->end = 0;
+}
+
+movieReader::~movieReader() {
+	this->close();
+}
+
+bool movieReader::map(const char* filename) {
+#ifdef _WIN32
+	this->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (this->file == INVALID_HANDLE_VALUE) {
+		this->file = NULL;
+		return false;
+	}
+	LARGE_INTEGER length;
+	GetFileSizeEx(this->file, &length);
+	this->size = static_cast<size_t>(length.QuadPart);
+	this->mapping = (this->size > 0) ? CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	if (this->mapping) {
+		this->data = static_cast<const uint8_t*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	this->fd = ::open(filename, O_RDONLY);
+	if (this->fd < 0) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(this->fd, &info) == 0 && info.st_size > 0) {
+		this->size = static_cast<size_t>(info.st_size);
+		void* view = mmap(NULL, this->size, PROT_READ, MAP_SHARED, this->fd, 0);
+		this->data = (view == MAP_FAILED) ? NULL : static_cast<const uint8_t*>(view);
+	}
+#endif
+	return this->data != NULL;
+}
+
+bool movieReader::open(const char* filename) {
+	this->close();
+
+	if (!this->map(filename)) {
+		std::cout << "ERROR: failed to map movie " << filename << std::endl;
+		this->close();
+		return false;
+	}
+
+	this->header = reinterpret_cast<const movieHeader*>(this->data);
+	if (this->size < sizeof(movieHeader) || this->header->magic != MOVIE_MAGIC || this->header->version != MOVIE_VERSION) {
+		std::cout << "ERROR: " << filename << " is not a version " << MOVIE_VERSION << " movie" << std::endl;
+		this->close();
+		return false;
+	}
+	if (this->header->stateSize != sizeof(gameboyState)) {
+		std::cout << "ERROR: " << filename << " was recorded by a different build" << std::endl;
+		this->close();
+		return false;
+	}
+
+	/* an unfinished recording has no index yet */
+	if (!this->readIndex()) {
+		this->scanChunks();
+	}
+	if (this->keyframes.empty() || this->keyframes[0].frame != 0) {
+		std::cout << "ERROR: " << filename << " has no keyframe at frame 0" << std::endl;
+		this->close();
+		return false;
+	}
+	return true;
+}
+
+void movieReader::close() {
+#ifdef _WIN32
+	if (this->data) {
+		UnmapViewOfFile(this->data);
+	}
+	if (this->mapping) {
+		CloseHandle(this->mapping);
+	}
+	if (this->file) {
+		CloseHandle(this->file);
+	}
+	this->file = NULL;
+	this->mapping = NULL;
+#else
+	if (this->data) {
+		munmap(const_cast<uint8_t*>(this->data), this->size);
+	}
+	if (this->fd >= 0) {
+		::close(this->fd);
+	}
+	this->fd = -1;
+#endif
+	this->data = NULL;
+	this->size = 0;
+	this->header = NULL;
+	this->keyframes.clear();
+	this->frames = 0;
+	this->end = 0;
+}
+
+bool movieReader::readIndex() {
+	if (this->size < sizeof(movieHeader) + sizeof(movieChunk) + sizeof(movieTrailer)) {
+		return false;
+	}
+
+	const movieTrailer* trailer = reinterpret_cast<const movieTrailer*>(this->data + this->size - sizeof(movieTrailer));
+	uint64_t indexSize = static_cast<uint64_t>(trailer->entries) * sizeof(movieIndexEntry);
+	if (trailer->magic != MOVIE_INDEX_MAGIC || trailer->indexOffset + sizeof(movieChunk) + indexSize + sizeof(movieTrailer) != this->size) {
+		return false;
+	}
+
+	const movieChunk* chunk = reinterpret_cast<const movieChunk*>(this->data + trailer->indexOffset);
+	if (chunk->type != CHUNK_INDEX || chunk->size != indexSize) {
+		return false;
+	}
+
+	const movieIndexEntry* entries = reinterpret_cast<const movieIndexEntry*>(chunk + 1);
+	this->keyframes.assign(entries, entries + trailer->entries);
+	this->frames = trailer->frames;
+	this->end = static_cast<size_t>(trailer->indexOffset);
+	return true;
+}
+
+void movieReader::scanChunks() {
+	size_t pos = sizeof(movieHeader);
+	this->keyframes.clear();
+	this->frames = 0;
+
+	while (pos + sizeof(movieChunk) <= this->size) {
+		const movieChunk* chunk = reinterpret_cast<const movieChunk*>(this->data + pos);
+		size_t span = sizeof(movieChunk) + static_cast<size_t>(padded(chunk->size));
+		if (pos + span > this->size || chunk->type == CHUNK_INDEX) {
+			break; //still being written, or the start of a damaged index
+		}
+
+		if (chunk->type == CHUNK_KEYFRAME) {
+			this->keyframes.push_back({ chunk->frame, pos });
+		}
+		else if (chunk->type == CHUNK_INPUT && chunk->frame + chunk->size > this->frames) {
+			this->frames = chunk->frame + chunk->size;
+		}
+		pos += span;
+	}
+	this->end = pos;
+}
+
+size_t movieReader::keyframeBefore(uint64_t frame) {
+	size_t low = 0;
+	size_t high = this->keyframes.size();
+	while (high - low > 1) {
+		size_t mid = (low + high) / 2;
+		if (this->keyframes[mid].frame <= frame) {
+			low = mid;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return static_cast<size_t>(this->keyframes[low].offset);
+}
+
+uint64_t movieReader::getFrames() {
+	return this->frames;
+}
+
+uint32_t movieReader::getInterval() {
+	return this->header ? this->header->interval : 0;
+}
+
+uint64_t movieReader::getRomHash() {
+	return this->header ? this->header->romHash : 0;
+}
+
+size_t movieReader::getKeyframes() {
+	return this->keyframes.size();
+}
+
+movieIndexEntry movieReader::getKeyframe(size_t i) {
+	return this->keyframes[i];
+}
+
+size_t movieReader::getEnd() {
+	return this->end;
+}
+
+uint8_t movieReader::getInput(uint64_t frame) {
+	if (!this->data || frame >= this->frames) {
+		return 0;
+	}
+
+	/* inputs after a keyframe are in the chunks that follow it */
+	size_t pos = this->keyframeBefore(frame);
+	while (pos + sizeof(movieChunk) <= this->end) {
+		const movieChunk* chunk = reinterpret_cast<const movieChunk*>(this->data + pos);
+		if (chunk->type == CHUNK_INPUT && frame >= chunk->frame && frame < chunk->frame + chunk->size) {
+			return reinterpret_cast<const uint8_t*>(chunk + 1)[frame - chunk->frame];
+		}
+		pos += sizeof(movieChunk) + static_cast<size_t>(padded(chunk->size));
+	}
+	return 0;
+}
+
+uint64_t movieReader::seek(gameboy& gb, uint64_t frame) {
+	if (!this->data) {
+		return 0;
+	}
+	if (frame > this->frames) {
+		std::cout << "ERROR: the movie ends at frame " << this->frames << std::endl;
+		frame = this->frames;
+	}
+
+	/* the keyframe is used straight from the mapping */
+	size_t pos = this->keyframeBefore(frame);
+	const movieChunk* key = reinterpret_cast<const movieChunk*>(this->data + pos);
+	gb.loadState(*reinterpret_cast<const gameboyState*>(key + 1));
+
+	uint64_t now = key->frame;
+	pos += sizeof(movieChunk) + static_cast<size_t>(padded(key->size));
+	while (now < frame && pos + sizeof(movieChunk) <= this->end) {
+		const movieChunk* chunk = reinterpret_cast<const movieChunk*>(this->data + pos);
+		if (chunk->type == CHUNK_INPUT) {
+			const uint8_t* buttons = reinterpret_cast<const uint8_t*>(chunk + 1);
+			for (uint32_t i = 0; i < chunk->size && now < frame; i++) {
+				if (chunk->frame + i == now) {
+					gb.getJoypad().setButtons(buttons[i]);
+					gb.runFrame();
+					now++;
+				}
+			}
+		}
+		pos += sizeof(movieChunk) + static_cast<size_t>(padded(chunk->size));
+	}
+	return now - key->frame;
+}
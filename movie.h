@@ -0,0 +1,127 @@
+#ifndef __MOVIE_H__
+#define __MOVIE_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+
+#include "gameboy.h"
+
+#define MOVIE_MAGIC 0x564D4247 //"GBMV"
+#define MOVIE_INDEX_MAGIC 0x494D4247 //"GBMI"
+#define MOVIE_VERSION 1
+#define MOVIE_KEYFRAME_INTERVAL 600 //frames, a seek replays at most this many
+#define MOVIE_FLUSH_FRAMES 60 //inputs reach the file at least once a second
+
+#define CHUNK_KEYFRAME 1 //gameboyState before the chunk's frame
+#define CHUNK_INPUT 2 //one BUTTON_* byte per frame from the chunk's frame on
+#define CHUNK_INDEX 3 //movieIndexEntry per keyframe, only written by close()
+
+/*
+file layout, little endian and 8 byte aligned so it can be used mapped
+
+	movieHeader
+	chunks: movieChunk followed by size bytes, padded to 8
+	CHUNK_INDEX chunk and movieTrailer, once the recording is closed
+
+keyframes hold the whole machine including memory, so playing a movie
+needs no ROM. They are only valid for builds with the same stateSize.
+Recording only ever appends: a reader can follow a movie that is still
+being recorded, or one that was never closed, by walking the chunks
+instead of reading the index
+*/
+struct movieHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t interval; //frames between keyframes
+	uint32_t stateSize; //sizeof(gameboyState) of the recording build
+	uint64_t romHash; //hashBytes() of the cartridge area when recording started
+	uint8_t reserved[40];
+};
+
+struct movieChunk {
+	uint32_t type;
+	uint32_t size; //payload bytes, not counting the padding
+	uint64_t frame;
+};
+
+struct movieIndexEntry {
+	uint64_t frame;
+	uint64_t offset; //of the keyframe's movieChunk
+};
+
+struct movieTrailer {
+	uint64_t indexOffset; //of the CHUNK_INDEX chunk
+	uint64_t frames;
+	uint32_t entries;
+	uint32_t magic;
+};
+
+class movieWriter {
+	private:
+		FILE* file;
+		uint32_t interval;
+		uint64_t frames; //inputs recorded
+		uint64_t offset; //end of the file
+		std::vector<movieIndexEntry> index;
+		std::vector<uint8_t> pending; //inputs not written yet
+		gameboyState* scratch;
+
+		void writeChunk(uint32_t type, uint64_t frame, const void* data, uint32_t size);
+		void flushInputs();
+
+	public:
+		movieWriter();
+		~movieWriter();
+		movieWriter(const movieWriter&) = delete;
+		movieWriter& operator=(const movieWriter&) = delete;
+
+		bool create(const char* filename, gameboy& gb, uint32_t interval = MOVIE_KEYFRAME_INTERVAL); //gb is at frame 0 of the movie
+		bool append(const char* filename, gameboy& gb); //drops the index and puts gb at the end of the movie
+		void record(gameboy& gb, uint8_t buttons); //before every frame, sets the joypad too
+		void close(); //writes the index
+		uint64_t getFrames();
+};
+
+/* plays or seeks a movie through a read-only mapping of the file */
+class movieReader {
+	private:
+#ifdef _WIN32
+		void* file;
+		void* mapping;
+#else
+		int fd;
+#endif
+		const uint8_t* data;
+		size_t size;
+		const movieHeader* header;
+		std::vector<movieIndexEntry> keyframes;
+		uint64_t frames;
+		size_t end; //end of the last complete chunk before any index
+
+		bool map(const char* filename);
+		bool readIndex();
+		void scanChunks();
+		size_t keyframeBefore(uint64_t frame); //offset of the newest keyframe at or before frame
+
+	public:
+		movieReader();
+		~movieReader();
+		movieReader(const movieReader&) = delete;
+		movieReader& operator=(const movieReader&) = delete;
+
+		bool open(const char* filename);
+		void close();
+
+		uint64_t getFrames();
+		uint32_t getInterval();
+		uint64_t getRomHash(); //hashBytes() of the ROM area at frame 0
+		size_t getKeyframes();
+		movieIndexEntry getKeyframe(size_t i);
+		size_t getEnd(); //where an appending writer carries on
+		uint8_t getInput(uint64_t frame);
+		uint64_t seek(gameboy& gb, uint64_t frame); //gb is then before frame, returns the frames replayed to get there
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "net.h"
+
+#include <iostream>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define INVALID_HANDLE INVALID_SOCKET
+#define closeSocket closesocket
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define INVALID_HANDLE -1
+#define closeSocket ::close
+#endif
+
+udpSocket::udpSocket() {
+	this->handle = INVALID_HANDLE;
+	this->valid = false;
+	this->peerAddress = 0;
+	this->peerPort = 0;
+}
+
+udpSocket::~udpSocket() {
+	this->close();
+}
+
+bool udpSocket::open(uint16_t port) {
+#ifdef _WIN32
+	static bool started = false;
+	if (!started) {
+		WSADATA data;
+		if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+			std::cout << "ERROR: failed to start winsock" << std::endl;
+			return false;
+		}
+		started = true;
+	}
+#endif
+
+	this->close();
+	this->handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (this->handle == INVALID_HANDLE) {
+		std::cout << "ERROR: failed to create socket" << std::endl;
+		return false;
+	}
+
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(port);
+	if (bind(this->handle, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+		std::cout << "ERROR: failed to bind UDP port " << port << std::endl;
+		closeSocket(this->handle);
+		this->handle = INVALID_HANDLE;
+		return false;
+	}
+
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	ioctlsocket(this->handle, FIONBIO, &nonBlocking);
+#else
+	fcntl(this->handle, F_SETFL, fcntl(this->handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+	this->valid = true;
+	return true;
+}
+
+bool udpSocket::setPeer(const char* host, uint16_t port) {
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo* result = NULL;
+	if (getaddrinfo(host, NULL, &hints, &result) != 0 || !result) {
+		std::cout << "ERROR: failed to resolve " << host << std::endl;
+		return false;
+	}
+
+	this->peerAddress = reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr.s_addr;
+	this->peerPort = htons(port);
+	freeaddrinfo(result);
+	return true;
+}
+
+void udpSocket::close() {
+	if (this->valid) {
+		closeSocket(this->handle);
+		this->handle = INVALID_HANDLE;
+		this->valid = false;
+	}
+}
+
+bool udpSocket::send(const uint8_t* data, uint32_t length) {
+	if (!this->valid || this->peerPort == 0) {
+		return false;
+	}
+
+	sockaddr_in peer;
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	peer.sin_addr.s_addr = this->peerAddress;
+	peer.sin_port = this->peerPort;
+
+	return sendto(this->handle, reinterpret_cast<const char*>(data), length, 0, reinterpret_cast<sockaddr*>(&peer), sizeof(peer)) == static_cast<int>(length);
+}
+
+int32_t udpSocket::receive(uint8_t* data, uint32_t length) {
+	while (this->valid) {
+		sockaddr_in from;
+		socklen_t fromLength = sizeof(from);
+		int got = recvfrom(this->handle, reinterpret_cast<char*>(data), length, 0, reinterpret_cast<sockaddr*>(&from), &fromLength);
+		if (got < 0) {
+			return -1; //nothing waiting, or an ICMP error for an earlier send
+		}
+
+		if (from.sin_addr.s_addr == this->peerAddress && from.sin_port == this->peerPort) {
+			return got;
+		}
+	}
+	return -1;
+}
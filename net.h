@@ -0,0 +1,32 @@
+#ifndef __NET_H__
+#define __NET_H__
+
+#include <cstdint>
+
+/* non-blocking IPv4 UDP socket talking to a single peer */
+class udpSocket {
+	private:
+#ifdef _WIN32
+		uintptr_t handle; //SOCKET
+#else
+		int handle;
+#endif
+		bool valid;
+		uint32_t peerAddress; //network byte order
+		uint16_t peerPort;
+
+	public:
+		udpSocket();
+		~udpSocket();
+		udpSocket(const udpSocket&) = delete;
+		udpSocket& operator=(const udpSocket&) = delete;
+
+		bool open(uint16_t port); //listens on every interface, 0 picks a free port
+		bool setPeer(const char* host, uint16_t port);
+		void close();
+
+		bool send(const uint8_t* data, uint32_t length);
+		int32_t receive(uint8_t* data, uint32_t length); //-1 when nothing is waiting, only accepts the peer
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "netplay.h"
+
+#define SNAPSHOTS (NETPLAY_MAX_ROLLBACK + 1)
+
+static void put32(uint8_t* out, uint32_t val) {
+	out[0] = static_cast<uint8_t>(val);
+	out[1] = static_cast<uint8_t>(val >> 8);
+	out[2] = static_cast<uint8_t>(val >> 16);
+	out[3] = static_cast<uint8_t>(val >> 24);
+}
+
+static uint32_t get32(const uint8_t* in) {
+	return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+rollbackSession::rollbackSession(gameboy& player0, gameboy& player1, uint8_t player) {
+	this->console[0] = &player0;
+	this->console[1] = &player1;
+	this->cable = new linkCable(player0, player1);
+	this->player = player & 1;
+
+	this->frame = 0;
+	this->confirmed = 0;
+	this->acked = 0;
+	this->rollbackFrom = 0;
+
+	for (int i = 0; i < NETPLAY_HISTORY; i++) {
+		this->localInput[i] = 0;
+		this->remoteInput[i] = 0;
+		this->predicted[i] = 0;
+	}
+	this->snapshots = new netplayState[SNAPSHOTS];
+
+	this->loss = 0;
+	this->random = 0x12345678 + player;
+
+	this->rollbacks = 0;
+	this->resimulated = 0;
+	this->stalls = 0;
+}
+
+rollbackSession::~rollbackSession() {
+	delete[] this->snapshots;
+	delete this->cable;
+}
+
+bool rollbackSession::connect(uint16_t localPort, const char* host, uint16_t remotePort) {
+	return this->socket.open(localPort) && this->socket.setPeer(host, remotePort);
+}
+
+void rollbackSession::setLoss(double fraction) {
+	this->loss = fraction;
+}
+
+void rollbackSession::simulate(uint32_t f) {
+	netplayState& snapshot = this->snapshots[f % SNAPSHOTS];
+	this->console[0]->saveState(snapshot.console[0]);
+	this->console[1]->saveState(snapshot.console[1]);
+
+	/* repeating the last input is right most of the time, buttons are held for many frames */
+	uint8_t remote;
+	if (f < this->confirmed) {
+		remote = this->remoteInput[f % NETPLAY_HISTORY];
+	}
+	else {
+		remote = (this->confirmed > 0) ? this->remoteInput[(this->confirmed - 1) % NETPLAY_HISTORY] : 0;
+	}
+	this->predicted[f % NETPLAY_HISTORY] = remote;
+
+	this->console[this->player]->getJoypad().setButtons(this->localInput[f % NETPLAY_HISTORY]);
+	this->console[this->player ^ 1]->getJoypad().setButtons(remote);
+	this->cable->stepFrame();
+}
+
+void rollbackSession::receive() {
+	uint8_t packet[NETPLAY_PACKET_SIZE];
+	int32_t length;
+
+	while ((length = this->socket.receive(packet, sizeof(packet))) >= 13) {
+		if (get32(packet) != NETPLAY_MAGIC) {
+			continue;
+		}
+
+		/* inputs for frames first to first + count - 1 */
+		uint32_t first = get32(&packet[4]);
+		uint32_t ack = get32(&packet[8]);
+		uint8_t count = packet[12];
+		if (count > NETPLAY_INPUTS || length < 13 + count) {
+			continue;
+		}
+
+		if (ack > this->acked && ack <= this->frame) {
+			this->acked = ack;
+		}
+
+		/* anything past a gap waits for a later packet that resends it */
+		if (first > this->confirmed || first + count <= this->confirmed) {
+			continue;
+		}
+
+		for (uint32_t f = this->confirmed; f < first + count; f++) {
+			uint8_t input = packet[13 + f - first];
+			this->remoteInput[f % NETPLAY_HISTORY] = input;
+			if (f < this->frame && input != this->predicted[f % NETPLAY_HISTORY] && f < this->rollbackFrom) {
+				this->rollbackFrom = f;
+			}
+		}
+		this->confirmed = first + count;
+	}
+}
+
+void rollbackSession::send() {
+	uint32_t count = this->frame - this->acked;
+	if (count > NETPLAY_INPUTS) {
+		count = NETPLAY_INPUTS;
+	}
+	uint32_t first = this->frame - count;
+
+	uint8_t packet[NETPLAY_PACKET_SIZE];
+	put32(packet, NETPLAY_MAGIC);
+	put32(&packet[4], first);
+	put32(&packet[8], this->confirmed);
+	packet[12] = static_cast<uint8_t>(count);
+	for (uint32_t i = 0; i < count; i++) {
+		packet[13 + i] = this->localInput[(first + i) % NETPLAY_HISTORY];
+	}
+
+	if (this->loss > 0) {
+		this->random = this->random * 1664525 + 1013904223;
+		if ((this->random >> 8) < this->loss * (1 << 24)) {
+			return;
+		}
+	}
+	this->socket.send(packet, 13 + count);
+}
+
+void rollbackSession::repair() {
+	if (this->rollbackFrom >= this->frame) {
+		return;
+	}
+
+	this->rollbacks++;
+	this->resimulated += this->frame - this->rollbackFrom;
+
+	this->console[0]->loadState(this->snapshots[this->rollbackFrom % SNAPSHOTS].console[0]);
+	this->console[1]->loadState(this->snapshots[this->rollbackFrom % SNAPSHOTS].console[1]);
+
+	/* the mispredicted frames were already heard and seen, the next step() draws the corrected one */
+	for (int i = 0; i < 2; i++) {
+		this->console[i]->setAudioOutput(false);
+		this->console[i]->setRender(false);
+	}
+	for (uint32_t f = this->rollbackFrom; f < this->frame; f++) {
+		this->simulate(f);
+	}
+	for (int i = 0; i < 2; i++) {
+		this->console[i]->setAudioOutput(true);
+		this->console[i]->setRender(true);
+	}
+
+	this->rollbackFrom = this->frame;
+}
+
+void rollbackSession::poll() {
+	this->receive();
+	this->repair();
+	this->send();
+}
+
+bool rollbackSession::step(uint8_t input) {
+	this->receive();
+	this->repair();
+
+	if (this->frame >= this->confirmed + NETPLAY_MAX_ROLLBACK) {
+		this->stalls++;
+		this->send(); //the peer may be waiting on our acknowledgement
+		return false;
+	}
+
+	this->localInput[this->frame % NETPLAY_HISTORY] = input;
+	this->simulate(this->frame);
+	this->frame++;
+	this->rollbackFrom = this->frame;
+
+	this->send();
+	return true;
+}
+
+uint32_t rollbackSession::getFrame() {
+	return this->frame;
+}
+
+uint32_t rollbackSession::getConfirmed() {
+	return this->confirmed;
+}
+
+uint32_t rollbackSession::getAcked() {
+	return this->acked;
+}
+
+bool rollbackSession::isSynced() {
+	return this->confirmed >= this->frame && this->rollbackFrom >= this->frame;
+}
+
+uint64_t rollbackSession::getRollbacks() {
+	return this->rollbacks;
+}
+
+uint64_t rollbackSession::getResimulated() {
+	return this->resimulated;
+}
+
+uint64_t rollbackSession::getStalls() {
+	return this->stalls;
+}
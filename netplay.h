@@ -0,0 +1,83 @@
+#ifndef __NETPLAY_H__
+#define __NETPLAY_H__
+
+#include <cstdint>
+
+#include "gameboy.h"
+#include "link.h"
+#include "net.h"
+
+#define NETPLAY_MAGIC 0x4E524247 //"GBRN"
+#define NETPLAY_MAX_ROLLBACK 8 //frames simulated past the last confirmed remote input before stalling
+#define NETPLAY_INPUTS 16 //newest unacknowledged inputs resent in every packet, covers lost packets
+#define NETPLAY_HISTORY 32 //input ring, more than NETPLAY_INPUTS + NETPLAY_MAX_ROLLBACK
+#define NETPLAY_PACKET_SIZE (13 + NETPLAY_INPUTS)
+
+/* both consoles at the start of one frame */
+struct netplayState {
+	gameboyState console[2];
+};
+
+/*
+rollback netplay for two linked consoles
+
+both peers simulate both consoles. Each frame the local player's input
+is sent and the remote player's input is predicted to repeat the last
+one received. When a received input differs from the prediction the
+consoles go back to the snapshot of that frame and the frames since are
+simulated again, silently, with the corrected input. The consoles take
+turns on one thread and swap serial bytes through a linkCable, so a
+resimulated transfer comes out the same every time
+*/
+class rollbackSession {
+	private:
+		gameboy* console[2]; //indexed by player
+		linkCable* cable;
+		uint8_t player; //0 or 1, the local one
+		udpSocket socket;
+
+		uint32_t frame; //next frame to simulate
+		uint32_t confirmed; //remote inputs are known for every frame before this
+		uint32_t acked; //the peer has our inputs for every frame before this
+		uint32_t rollbackFrom; //earliest mispredicted frame, frame when there is none
+
+		uint8_t localInput[NETPLAY_HISTORY];
+		uint8_t remoteInput[NETPLAY_HISTORY];
+		uint8_t predicted[NETPLAY_HISTORY]; //remote input each simulated frame used
+		netplayState* snapshots; //NETPLAY_MAX_ROLLBACK + 1, state at the start of frame % count
+
+		/* testing aid, drops outgoing packets */
+		double loss;
+		uint32_t random;
+
+		uint64_t rollbacks;
+		uint64_t resimulated;
+		uint64_t stalls;
+
+		void simulate(uint32_t f);
+		void repair(); //rolls back to rollbackFrom and simulates up to frame again
+		void receive();
+		void send();
+
+	public:
+		rollbackSession(gameboy& player0, gameboy& player1, uint8_t player);
+		~rollbackSession();
+		rollbackSession(const rollbackSession&) = delete;
+		rollbackSession& operator=(const rollbackSession&) = delete;
+
+		bool connect(uint16_t localPort, const char* host, uint16_t remotePort);
+		void setLoss(double fraction);
+
+		bool step(uint8_t input); //false when stalled waiting for the peer, call again with the same input
+		void poll(); //exchanges packets and repairs mispredictions without advancing
+
+		uint32_t getFrame();
+		uint32_t getConfirmed();
+		uint32_t getAcked();
+		bool isSynced(); //every simulated frame used confirmed input
+		uint64_t getRollbacks();
+		uint64_t getResimulated();
+		uint64_t getStalls();
+};
+
+#endif
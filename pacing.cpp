@@ -0,0 +1,264 @@
+#include "pacing.h"
+#include "gameboy.h"
+
+#include <algorithm>
+
+resampler::resampler() {
+	this->position = 0;
+	for (int c = 0; c < AUDIO_CHANNELS; c++) {
+		this->last[c] = 0;
+	}
+}
+
+uint32_t resampler::process(const int16_t* in, uint32_t count, double ratio, int16_t* out) {
+	double step = 1.0 / ratio;
+	uint32_t produced = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		const int16_t* next = &in[i * AUDIO_CHANNELS];
+
+		while (this->position < 1.0) {
+			for (int c = 0; c < AUDIO_CHANNELS; c++) {
+				out[produced * AUDIO_CHANNELS + c] = static_cast<int16_t>(this->last[c] + (next[c] - this->last[c]) * this->position);
+			}
+			produced++;
+			this->position += step;
+		}
+
+		this->position -= 1.0;
+		for (int c = 0; c < AUDIO_CHANNELS; c++) {
+			this->last[c] = next[c];
+		}
+	}
+
+	return produced;
+}
+
+audioDevice::audioDevice(audioRing* ring, uint32_t sampleRate) {
+	this->ring = ring;
+	this->sampleRate = sampleRate;
+	this->running = false;
+	this->underruns = 0;
+}
+
+audioDevice::~audioDevice() {
+	this->stop();
+}
+
+void audioDevice::start() {
+	if (!this->running) {
+		this->running = true;
+		this->consumer = std::thread(&audioDevice::consumerLoop, this);
+	}
+}
+
+void audioDevice::stop() {
+	if (this->running) {
+		this->running = false;
+		this->consumer.join();
+	}
+}
+
+uint64_t audioDevice::getUnderruns() {
+	return this->underruns;
+}
+
+void audioDevice::consumerLoop() {
+	const uint32_t period = this->sampleRate / 200; //5ms, like a small hardware buffer
+	int16_t* samples = new int16_t[period * AUDIO_CHANNELS];
+	auto next = std::chrono::steady_clock::now();
+
+	while (this->running) {
+		next += std::chrono::microseconds(5000);
+		std::this_thread::sleep_until(next);
+
+		uint32_t got = this->ring->read(samples, period);
+		if (got < period) {
+			this->underruns += period - got;
+		}
+	}
+
+	delete[] samples;
+}
+
+framePacer::framePacer(uint8_t mode, double speed, audioRing* device) {
+	this->mode = mode;
+	this->speed = (speed > 0) ? speed : 1.0;
+	this->device = device;
+	this->deadline = std::chrono::steady_clock::now();
+	this->refreshRate = DEFAULT_REFRESH_RATE;
+	this->lastFrame = this->deadline;
+	this->measuring = false;
+}
+
+bool framePacer::useVsync() {
+	return this->mode == PACE_VSYNC || this->mode == PACE_AUDIO;
+}
+
+void framePacer::setRefreshRate(double hz) {
+	if (hz > 0) {
+		this->refreshRate = hz;
+	}
+}
+
+double framePacer::getRefreshRate() {
+	return this->refreshRate;
+}
+
+double framePacer::rateAdjust() {
+	if (this->mode != PACE_AUDIO || !this->device) {
+		return 1.0;
+	}
+
+	/*
+	a 60Hz monitor runs the emulator about 0.5% fast, which the nominal ratio
+	takes back. The fill only corrects the drift that is left, slightly more
+	audio when the buffer runs low and slightly less when it fills up. It is
+	read just before a frame's audio is written, so aiming for a quarter
+	keeps the fill below the backstop even right after the write
+	*/
+	double nominal = GB_FRAME_RATE / this->refreshRate;
+	nominal = std::min(std::max(nominal, 1.0 - DRC_MAX_NOMINAL), 1.0 + DRC_MAX_NOMINAL);
+
+	double target = this->device->getCapacity() / 4.0;
+	double delta = (target - this->device->available()) / target;
+	if (delta > 1.0) {
+		delta = 1.0;
+	}
+	else if (delta < -1.0) {
+		delta = -1.0;
+	}
+	return nominal * (1.0 + DRC_MAX_DELTA * delta);
+}
+
+void framePacer::endFrame() {
+	using namespace std::chrono;
+
+	switch (this->mode) {
+	case PACE_AUDIO: {
+		/* vsync spaces the calls one refresh apart, hitches like a dragged window are left out */
+		auto now = steady_clock::now();
+		double period = duration<double>(now - this->lastFrame).count();
+		if (this->measuring && period > 0.5 / this->refreshRate && period < 2.0 / this->refreshRate) {
+			this->refreshRate += (1.0 / period - this->refreshRate) * REFRESH_SMOOTHING;
+		}
+		this->lastFrame = now;
+		this->measuring = true;
+
+		/* backstop for a refresh rate that is still far off, should not trigger once it is known */
+		while (this->device && this->device->available() > this->device->getCapacity() * 3 / 4) {
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		break;
+	}
+	case PACE_TIMER: {
+		auto period = duration_cast<steady_clock::duration>(duration<double>(1.0 / (GB_FRAME_RATE * this->speed)));
+		auto now = steady_clock::now();
+
+		this->deadline += period;
+		if (now > this->deadline + 4 * period) {
+			this->deadline = now; //fell far behind, e.g. a debugger pause, do not try to catch up
+		}
+
+		/* sleep is only accurate to about a millisecond, spin for the rest */
+		if (this->deadline - now > milliseconds(2)) {
+			std::this_thread::sleep_until(this->deadline - milliseconds(1));
+		}
+		while (steady_clock::now() < this->deadline) {
+			std::this_thread::yield();
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+frameStats::frameStats() {
+	for (uint32_t i = 0; i < FRAME_HISTORY; i++) {
+		this->history[i] = 0.0f;
+	}
+	this->head = 0;
+	this->count = 0;
+	this->lastTime = 0;
+	this->periodTime = 0;
+	this->periodFrame = 0;
+	this->periodCycles = 0;
+	this->started = false;
+	this->fps = 0.0;
+	this->speed = 0.0;
+	for (int i = 0; i < 4; i++) {
+		this->percentiles[i] = 0.0f;
+	}
+	this->version = 0;
+}
+
+void frameStats::endFrame(uint64_t now, uint64_t frame, uint64_t cycles) {
+	if (!this->started) {
+		this->lastTime = now;
+		this->periodTime = now;
+		this->periodFrame = frame;
+		this->periodCycles = cycles;
+		this->started = true;
+		return;
+	}
+
+	float ms = static_cast<float>(now - this->lastTime) / 1e6f;
+	this->lastTime = now;
+	if (this->count < FRAME_HISTORY) {
+		this->history[(this->head + this->count) % FRAME_HISTORY] = ms;
+		this->count++;
+	}
+	else {
+		this->history[this->head] = ms;
+		this->head = (this->head + 1) % FRAME_HISTORY;
+	}
+
+	uint64_t elapsed = now - this->periodTime;
+	if (elapsed < FRAME_STATS_PERIOD) {
+		return;
+	}
+
+	double seconds = elapsed / 1e9;
+	this->fps = (frame - this->periodFrame) / seconds;
+	this->speed = (cycles - this->periodCycles) / seconds / (GB_FRAME_RATE * CYCLES_PER_FRAME);
+	this->periodTime = now;
+	this->periodFrame = frame;
+	this->periodCycles = cycles;
+
+	float sorted[FRAME_HISTORY];
+	for (uint32_t i = 0; i < this->count; i++) {
+		sorted[i] = this->history[(this->head + i) % FRAME_HISTORY];
+	}
+	std::sort(sorted, sorted + this->count);
+	const double ranks[3] = { 0.50, 0.95, 0.99 };
+	for (int i = 0; i < 3; i++) {
+		this->percentiles[i] = sorted[static_cast<uint32_t>(ranks[i] * (this->count - 1) + 0.5)];
+	}
+	this->percentiles[3] = sorted[this->count - 1];
+	this->version++;
+}
+
+double frameStats::getFPS() {
+	return this->fps;
+}
+
+double frameStats::getSpeed() {
+	return this->speed;
+}
+
+float frameStats::getPercentile(uint32_t which) {
+	return (which < 4) ? this->percentiles[which] : 0.0f;
+}
+
+uint64_t frameStats::getVersion() {
+	return this->version;
+}
+
+const float* frameStats::getHistory() {
+	return this->history;
+}
+
+uint32_t frameStats::getHead() {
+	return this->head;
+}
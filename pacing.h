@@ -0,0 +1,115 @@
+#ifndef __PACING_H__
+#define __PACING_H__
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "audio.h"
+
+#define PACE_VSYNC 0 //buffer swaps wait for the monitor, as before
+#define PACE_AUDIO 1 //vsync plus rate control that keeps the audio buffer from running dry or over
+#define PACE_TIMER 2 //high resolution timer at a multiple of the real frame rate
+#define PACE_UNTHROTTLED 3
+
+#define GB_FRAME_RATE 59.7275 //4194304 / 70224
+#define DRC_MAX_DELTA 0.005 //largest resampling ratio change for drift, inaudible as pitch
+#define DRC_MAX_NOMINAL 0.02 //refresh rates this close to GB_FRAME_RATE are matched by the ratio, faster ones lean on the backstop
+#define DEFAULT_REFRESH_RATE 60.0 //until the monitor's rate is known
+#define REFRESH_SMOOTHING 0.01 //weight of each measured frame in the refresh rate estimate
+#define DEVICE_BUFFER_FRAMES 2048 //about 43ms at 48kHz, rate control aims for a quarter before each frame's audio goes in
+#define FRAME_HISTORY 120 //host frame times kept, two seconds at 60Hz
+#define FRAME_STATS_PERIOD 500000000 //nanoseconds between refreshes of the averages
+
+/* stereo linear interpolation, only ever asked for ratios very close to the nominal one */
+class resampler {
+	private:
+		double position; //between last and the next input frame
+		int16_t last[AUDIO_CHANNELS];
+
+	public:
+		resampler();
+
+		/* ratio is output frames per input frame, out needs room for count * ratio + 2 frames */
+		uint32_t process(const int16_t* in, uint32_t count, double ratio, int16_t* out);
+};
+
+/*
+stand-in for a sound card: a thread that consumes the device ring at a
+fixed rate by the host clock, counting underruns. A real backend reads
+the same ring from its callback instead
+*/
+class audioDevice {
+	private:
+		audioRing* ring;
+		uint32_t sampleRate;
+		std::thread consumer;
+		std::atomic<bool> running;
+		std::atomic<uint64_t> underruns; //frames played as silence
+
+		void consumerLoop();
+
+	public:
+		audioDevice(audioRing* ring, uint32_t sampleRate);
+		~audioDevice();
+		void start();
+		void stop();
+		uint64_t getUnderruns();
+};
+
+class framePacer {
+	private:
+		uint8_t mode;
+		double speed; //PACE_TIMER multiplier of the real frame rate
+		audioRing* device; //NULL when there is no audio output
+		std::chrono::steady_clock::time_point deadline;
+		double refreshRate; //host frames per second, PACE_AUDIO runs one emulated frame each
+		std::chrono::steady_clock::time_point lastFrame;
+		bool measuring;
+
+	public:
+		framePacer(uint8_t mode, double speed, audioRing* device);
+		bool useVsync();
+		void setRefreshRate(double hz); //the monitor's nominal rate, PACE_AUDIO refines it from the frame times
+		double getRefreshRate();
+		double rateAdjust(); //resampling ratio for the refresh rate, corrected by the device buffer fill
+		void endFrame(); //waits as long as the mode requires
+};
+
+/*
+host frame times and emulation rate for the HUD
+
+the averages and percentiles are only worked out every FRAME_STATS_PERIOD
+so they stay readable, getVersion() tells when they changed
+*/
+class frameStats {
+	private:
+		float history[FRAME_HISTORY]; //milliseconds, a ring
+		uint32_t head; //oldest entry
+		uint32_t count;
+
+		uint64_t lastTime; //of the previous endFrame(), nanoseconds
+		uint64_t periodTime; //start of the current period
+		uint64_t periodFrame; //emulated frame and cycle counts at its start
+		uint64_t periodCycles;
+		bool started;
+
+		double fps;
+		double speed;
+		float percentiles[4]; //50th, 95th, 99th and the slowest
+		uint64_t version;
+
+	public:
+		frameStats();
+		void endFrame(uint64_t now, uint64_t frame, uint64_t cycles); //once per host frame with the emulator's counters
+
+		double getFPS(); //emulated frames per second
+		double getSpeed(); //emulated cycles against real hardware, 1 is full speed
+		float getPercentile(uint32_t which); //0 to 3 for p50, p95, p99 and max, milliseconds
+		uint64_t getVersion(); //changes when the values above do
+		const float* getHistory(); //FRAME_HISTORY times starting at getHead(), 0 where there was no frame yet
+		uint32_t getHead();
+};
+
+#endif
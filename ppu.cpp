@@ -0,0 +1,282 @@
+#include "ppu.h"
+
+#include <cstring>
+
+#define LCDC 0xFF40
+#define STAT 0xFF41
+#define SCY 0xFF42
+#define SCX 0xFF43
+#define LY 0xFF44
+#define LYC 0xFF45
+#define DMA 0xFF46
+#define BGP 0xFF47
+#define OBP0 0xFF48
+#define OBP1 0xFF49
+#define WY 0xFF4A
+#define WX 0xFF4B
+
+#define OAM 0xFE00
+#define SPRITES_PER_LINE 10
+
+ppu::ppu(uint8_t* memory) {
+	this->memory = memory;
+	this->internal = new uint8_t[FRAMEBUFFER_SIZE];
+	memset(this->internal, 0, FRAMEBUFFER_SIZE);
+	this->target = this->internal;
+	this->render = true;
+
+	memset(&this->state, 0, sizeof(this->state));
+	this->state.nextLine = PPU_RENDER_OFFSET;
+	this->state.lcdc = memory[LCDC];
+	this->state.scy = memory[SCY];
+	this->state.scx = memory[SCX];
+	this->state.bgp = memory[BGP];
+	this->state.obp[0] = memory[OBP0];
+	this->state.obp[1] = memory[OBP1];
+	this->state.wy = memory[WY];
+	this->state.wx = memory[WX];
+}
+
+ppu::~ppu() {
+	delete[] this->internal;
+}
+
+void ppu::setTarget(uint8_t* framebuffer) {
+	this->target = framebuffer ? framebuffer : this->internal;
+}
+
+void ppu::setRender(bool enabled) {
+	this->render = enabled;
+}
+
+const uint8_t* ppu::getFramebuffer() {
+	return this->target;
+}
+
+void ppu::saveState(ppuState& state) {
+	state = this->state;
+}
+
+void ppu::loadState(const ppuState& state) {
+	this->state = state;
+}
+
+void ppu::runTo(uint64_t cycle) {
+	while (this->state.nextLine <= cycle) {
+		uint8_t line = static_cast<uint8_t>((this->state.nextLine / PPU_LINE_CYCLES) % PPU_LINES);
+
+		if (line == 0) {
+			this->state.windowLine = 0;
+		}
+
+		if (line < SCREEN_HEIGHT) {
+			if (this->render) {
+				this->drawLine(line);
+			}
+			else {
+				this->skipLine(line);
+			}
+		}
+		else if (line == SCREEN_HEIGHT && (this->state.lcdc & 0x80)) {
+			this->memory[IF_REGISTER] |= VBLANK_INTERRUPT;
+		}
+
+		this->state.nextLine += PPU_LINE_CYCLES;
+	}
+}
+
+void ppu::drawLine(uint8_t line) {
+	uint8_t* out = &this->target[line * SCREEN_WIDTH];
+	uint8_t bgIndex[SCREEN_WIDTH]; //colour numbers before the palette, sprites need them for priority
+	uint8_t lcdc = this->state.lcdc;
+
+	if (!(lcdc & 0x80) || !(lcdc & 0x01)) {
+		memset(out, 0, SCREEN_WIDTH);
+		memset(bgIndex, 0, SCREEN_WIDTH);
+		if ((lcdc & 0x80) && (lcdc & 0x02)) {
+			this->drawSprites(line, out, bgIndex);
+		}
+		return;
+	}
+
+	bool window = (lcdc & 0x20) && line >= this->state.wy && this->state.wx <= 166;
+	int windowStart = window ? this->state.wx - 7 : SCREEN_WIDTH;
+
+	/* one tile row fetch per 8 pixels, the background wraps around its 256x256 map */
+	uint16_t map = (lcdc & 0x08) ? 0x9C00 : 0x9800;
+	uint8_t y = static_cast<uint8_t>(this->state.scy + line);
+	uint8_t low = 0;
+	uint8_t high = 0;
+
+	for (int x = 0; x < SCREEN_WIDTH; x++) {
+		uint8_t px;
+		if (x == windowStart || (x == 0 && windowStart < 0)) {
+			map = (lcdc & 0x40) ? 0x9C00 : 0x9800;
+			y = this->state.windowLine;
+		}
+		if (x >= windowStart) {
+			px = static_cast<uint8_t>(x - windowStart);
+		}
+		else {
+			px = static_cast<uint8_t>(x + this->state.scx);
+		}
+
+		if (x == 0 || (px & 7) == 0 || x == windowStart) {
+			uint8_t tile = this->memory[map + (y / 8) * 32 + px / 8];
+			uint16_t address = (lcdc & 0x10) ? 0x8000 + tile * 16 : 0x9000 + static_cast<int8_t>(tile) * 16;
+			low = this->memory[address + (y & 7) * 2];
+			high = this->memory[address + (y & 7) * 2 + 1];
+		}
+
+		uint8_t bit = 7 - (px & 7);
+		uint8_t index = static_cast<uint8_t>((((high >> bit) & 1) << 1) | ((low >> bit) & 1));
+		bgIndex[x] = index;
+		out[x] = (this->state.bgp >> (index * 2)) & 3;
+	}
+
+	if (windowStart < SCREEN_WIDTH) {
+		this->state.windowLine++;
+	}
+
+	if (lcdc & 0x02) {
+		this->drawSprites(line, out, bgIndex);
+	}
+}
+
+/* what drawLine() changes besides pixels */
+void ppu::skipLine(uint8_t line) {
+	uint8_t lcdc = this->state.lcdc;
+	if ((lcdc & 0x80) && (lcdc & 0x01) && (lcdc & 0x20) && line >= this->state.wy && this->state.wx <= 166) {
+		this->state.windowLine++;
+	}
+}
+
+void ppu::drawSprites(uint8_t line, uint8_t* out, const uint8_t* bgIndex) {
+	uint8_t height = (this->state.lcdc & 0x04) ? 16 : 8;
+	uint8_t selected[SPRITES_PER_LINE];
+	int count = 0;
+
+	/* the first ten in OAM order that cover the line */
+	for (int i = 0; i < 40 && count < SPRITES_PER_LINE; i++) {
+		int top = this->memory[OAM + i * 4] - 16;
+		if (line >= top && line < top + height) {
+			selected[count++] = static_cast<uint8_t>(i);
+		}
+	}
+
+	/* lower X wins, then lower OAM index */
+	for (int i = 1; i < count; i++) {
+		uint8_t s = selected[i];
+		int j = i - 1;
+		while (j >= 0 && this->memory[OAM + selected[j] * 4 + 1] > this->memory[OAM + s * 4 + 1]) {
+			selected[j + 1] = selected[j];
+			j--;
+		}
+		selected[j + 1] = s;
+	}
+
+	bool claimed[SCREEN_WIDTH] = { false };
+	for (int i = 0; i < count; i++) {
+		const uint8_t* sprite = &this->memory[OAM + selected[i] * 4];
+		int top = sprite[0] - 16;
+		int left = sprite[1] - 8;
+		uint8_t tile = sprite[2];
+		uint8_t flags = sprite[3];
+
+		int row = line - top;
+		if (flags & 0x40) {
+			row = height - 1 - row;
+		}
+		if (height == 16) {
+			tile &= 0xFE;
+		}
+
+		uint16_t address = 0x8000 + tile * 16 + row * 2;
+		uint8_t low = this->memory[address];
+		uint8_t high = this->memory[address + 1];
+		uint8_t palette = this->state.obp[(flags >> 4) & 1];
+
+		for (int p = 0; p < 8; p++) {
+			int x = left + p;
+			if (x < 0 || x >= SCREEN_WIDTH || claimed[x]) {
+				continue;
+			}
+
+			uint8_t bit = (flags & 0x20) ? p : 7 - p;
+			uint8_t index = static_cast<uint8_t>((((high >> bit) & 1) << 1) | ((low >> bit) & 1));
+			if (index == 0) {
+				continue; //transparent, a lower priority sprite may still show here
+			}
+
+			claimed[x] = true;
+			if (!(flags & 0x80) || bgIndex[x] == 0) {
+				out[x] = (palette >> (index * 2)) & 3;
+			}
+		}
+	}
+}
+
+uint8_t ppu::ioRead(uint16_t address, uint8_t val, uint64_t cycle) {
+	if (address != LY && address != STAT) {
+		return val;
+	}
+
+	uint8_t line = 0;
+	uint8_t mode = 0;
+	if (this->state.lcdc & 0x80) {
+		uint32_t position = static_cast<uint32_t>(cycle % (PPU_LINE_CYCLES * PPU_LINES));
+		uint32_t dot = position % PPU_LINE_CYCLES;
+		line = static_cast<uint8_t>(position / PPU_LINE_CYCLES);
+
+		if (line >= SCREEN_HEIGHT) {
+			mode = 1;
+		}
+		else if (dot < PPU_RENDER_OFFSET) {
+			mode = 2;
+		}
+		else if (dot < PPU_RENDER_OFFSET + 43) {
+			mode = 3;
+		}
+	}
+
+	if (address == LY) {
+		return line;
+	}
+
+	uint8_t coincidence = (line == this->memory[LYC]) ? 0x04 : 0x00;
+	return 0x80 | (val & 0x78) | coincidence | mode;
+}
+
+void ppu::ioWrite(uint16_t address, uint8_t val, uint64_t cycle) {
+	this->runTo(cycle); //lines due so far use the old value
+
+	switch (address) {
+	case LCDC:
+		this->state.lcdc = val;
+		break;
+	case SCY:
+		this->state.scy = val;
+		break;
+	case SCX:
+		this->state.scx = val;
+		break;
+	case DMA:
+		memcpy(&this->memory[OAM], &this->memory[(val << 8) & 0xFF00], 160); //instant instead of 160 cycles
+		break;
+	case BGP:
+		this->state.bgp = val;
+		break;
+	case OBP0:
+		this->state.obp[0] = val;
+		break;
+	case OBP1:
+		this->state.obp[1] = val;
+		break;
+	case WY:
+		this->state.wy = val;
+		break;
+	case WX:
+		this->state.wx = val;
+		break;
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef __PPU_H__
+#define __PPU_H__
+
+#include <cstdint>
+
+#include "io.h"
+
+#define SCREEN_WIDTH 160
+#define SCREEN_HEIGHT 144
+#define FRAMEBUFFER_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT)
+
+#define PPU_FIRST 0xFF40
+#define PPU_LAST 0xFF4B
+#define PPU_LINE_CYCLES 114 //machine cycles per scanline
+#define PPU_LINES 154 //including vertical blank
+#define PPU_RENDER_OFFSET 20 //a line is drawn once its OAM scan is over
+#define VBLANK_INTERRUPT 0x01
+
+/* registers the renderer latched, the ones in memory may already hold a newer write */
+struct ppuState {
+	uint64_t nextLine; //cycle the next scanline is drawn at
+	uint8_t windowLine; //window rows drawn this frame
+	uint8_t lcdc;
+	uint8_t scy;
+	uint8_t scx;
+	uint8_t bgp;
+	uint8_t obp[2];
+	uint8_t wy;
+	uint8_t wx;
+};
+
+/*
+background, window and sprites drawn a scanline at a time
+
+like the APU the PPU catches up when one of its registers is written
+and at the end of every frame, so VRAM changes in the middle of a frame
+show up at the next catch-up instead of on the exact scanline. Pixels are
+shades 0 (white) to 3 (black) after the palettes
+*/
+class ppu : public ioDevice {
+	private:
+		uint8_t* memory;
+		uint8_t* target; //FRAMEBUFFER_SIZE shades, internal or supplied
+		uint8_t* internal;
+		ppuState state;
+		bool render; //false only keeps the timing, interrupts and window row count
+
+		void drawLine(uint8_t line);
+		void skipLine(uint8_t line);
+		void drawSprites(uint8_t line, uint8_t* out, const uint8_t* bgIndex);
+
+	public:
+		ppu(uint8_t* memory);
+		~ppu();
+		ppu(const ppu&) = delete;
+		ppu& operator=(const ppu&) = delete;
+
+		void runTo(uint64_t cycle); //draws every scanline due by cycle
+		void setTarget(uint8_t* framebuffer); //NULL goes back to the internal buffer
+		void setRender(bool enabled); //false leaves the framebuffer alone, for frames nobody sees
+		const uint8_t* getFramebuffer();
+
+		void saveState(ppuState& state);
+		void loadState(const ppuState& state);
+
+		uint8_t ioRead(uint16_t address, uint8_t val, uint64_t cycle);
+		void ioWrite(uint16_t address, uint8_t val, uint64_t cycle);
+};
+
+#endif
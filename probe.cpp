@@ -0,0 +1,118 @@
+#include "probe.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+std::atomic<bool> probesOn(false);
+
+static std::mutex bufferLock;
+static std::vector<std::unique_ptr<probeBuffer>> buffers; //kept after their thread ends so a dump still sees them
+
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+probeBuffer::probeBuffer(uint32_t tid) {
+	this->written = 0;
+	this->tid = tid;
+	snprintf(this->name, sizeof(this->name), "thread %u", tid);
+}
+
+void probeBuffer::setName(const char* name) {
+	std::lock_guard<std::mutex> lock(bufferLock); //a dump may be reading it
+	snprintf(this->name, sizeof(this->name), "%s", name);
+}
+
+void probeEnable(bool enabled) {
+	probesOn.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t probeNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+probeBuffer* probeThread() {
+	thread_local probeBuffer* buffer = NULL;
+	if (!buffer) {
+		std::lock_guard<std::mutex> lock(bufferLock);
+		buffers.emplace_back(new probeBuffer(static_cast<uint32_t>(buffers.size() + 1)));
+		buffer = buffers.back().get();
+	}
+	return buffer;
+}
+
+void probeThreadName(const char* name) {
+	probeThread()->setName(name);
+}
+
+/* JSON strings, probe names are literals but thread names come from outside */
+static void writeEscaped(std::ofstream& out, const char* s) {
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			out << '\\';
+		}
+		if (static_cast<unsigned char>(*s) >= 0x20) {
+			out << *s;
+		}
+	}
+}
+
+bool probeDump(const char* filename, uint64_t since) {
+	std::ofstream out(filename);
+	if (!out) {
+		std::cout << "ERROR: failed to create " << filename << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(bufferLock);
+	std::vector<probeEvent> copy(PROBE_EVENTS);
+	bool first = true;
+	char number[64];
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (const auto& buffer : buffers) {
+		out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"";
+		writeEscaped(out, buffer->name);
+		out << "\"}}";
+		first = false;
+
+		/*
+		copy, then drop the oldest entries in case the owner lapped the copy. While
+		written is after, event after may be going into the slot of after - PROBE_EVENTS.
+		The fence pairs with the one in record(): a copied store from event n means
+		the load of after below sees at least n
+		*/
+		uint64_t end = buffer->written.load(std::memory_order_acquire);
+		uint64_t begin = (end > PROBE_EVENTS) ? end - PROBE_EVENTS : 0;
+		for (uint64_t i = begin; i < end; i++) {
+			const probeSlot& slot = buffer->events[i & (PROBE_EVENTS - 1)];
+			probeEvent& event = copy[i - begin];
+			event.name = slot.name.load(std::memory_order_relaxed);
+			event.start = slot.start.load(std::memory_order_relaxed);
+			event.duration = slot.duration.load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = buffer->written.load(std::memory_order_relaxed);
+		uint64_t valid = (after >= PROBE_EVENTS) ? after - PROBE_EVENTS + 1 : 0;
+
+		for (uint64_t i = (valid > begin) ? valid : begin; i < end; i++) {
+			const probeEvent& event = copy[i - begin];
+			if (event.start < since) {
+				continue;
+			}
+
+			/* microseconds with nanosecond fractions */
+			snprintf(number, sizeof(number), "\"ts\":%llu.%03u,\"dur\":%llu.%03u", (unsigned long long)(event.start / 1000),
+				(unsigned int)(event.start % 1000), (unsigned long long)(event.duration / 1000), (unsigned int)(event.duration % 1000));
+			out << ",\n{\"name\":\"";
+			writeEscaped(out, event.name);
+			out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid << "," << number << "}";
+		}
+	}
+	out << "\n]}\n";
+	return static_cast<bool>(out);
+}
@@ -0,0 +1,97 @@
+#ifndef __PROBE_H__
+#define __PROBE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#define PROBE_EVENTS 16384 //per thread, power of 2, the oldest are overwritten
+#define PROBE_NAME 32 //thread name length, with the terminator
+
+struct probeEvent {
+	const char* name; //string literal, never copied
+	uint64_t start; //nanoseconds since the probes were first used
+	uint64_t duration;
+};
+
+/* a probeEvent in its ring, relaxed atomics because a dump may copy it while it is rewritten */
+struct probeSlot {
+	std::atomic<const char*> name;
+	std::atomic<uint64_t> start;
+	std::atomic<uint64_t> duration;
+};
+
+/*
+host side timing, dumped as Chrome trace-event JSON (chrome://tracing, Perfetto)
+
+every thread that records gets its own ring, registered under a lock the
+first time and written without one after that. A dump copies the rings
+while they are being written and drops whatever was overwritten during
+the copy. Disabled probes cost one relaxed load
+*/
+class probeBuffer {
+	friend bool probeDump(const char* filename, uint64_t since);
+
+	private:
+		probeSlot events[PROBE_EVENTS];
+		std::atomic<uint64_t> written;
+		uint32_t tid;
+		char name[PROBE_NAME];
+
+	public:
+		probeBuffer(uint32_t tid);
+		void record(const char* name, uint64_t start, uint64_t duration) {
+			uint64_t i = this->written.load(std::memory_order_relaxed);
+			probeSlot& slot = this->events[i & (PROBE_EVENTS - 1)];
+
+			/* a dump that sees any of the stores below also sees written at i, see probeDump() */
+			std::atomic_thread_fence(std::memory_order_release);
+			slot.name.store(name, std::memory_order_relaxed);
+			slot.start.store(start, std::memory_order_relaxed);
+			slot.duration.store(duration, std::memory_order_relaxed);
+			this->written.store(i + 1, std::memory_order_release);
+		}
+		void setName(const char* name);
+};
+
+extern std::atomic<bool> probesOn;
+
+void probeEnable(bool enabled);
+uint64_t probeNow(); //nanoseconds, on the clock events are stamped with
+probeBuffer* probeThread(); //the calling thread's ring
+void probeThreadName(const char* name); //shown instead of the thread number
+bool probeDump(const char* filename, uint64_t since = 0); //events that started at or after since
+
+class scopedProbe {
+	private:
+		const char* name; //NULL when probes were off at the start
+		uint64_t start;
+
+	public:
+		scopedProbe(const char* name) {
+			this->name = probesOn.load(std::memory_order_relaxed) ? name : NULL;
+			this->start = this->name ? probeNow() : 0;
+		}
+		~scopedProbe() {
+			this->end();
+		}
+		void end() {
+			if (this->name) {
+				probeThread()->record(this->name, this->start, probeNow() - this->start);
+				this->name = NULL;
+			}
+		}
+		void next(const char* name) { //ends this phase and starts the one after it
+			this->end();
+			this->name = probesOn.load(std::memory_order_relaxed) ? name : NULL;
+			this->start = this->name ? probeNow() : 0;
+		}
+		scopedProbe(const scopedProbe&) = delete;
+		scopedProbe& operator=(const scopedProbe&) = delete;
+};
+
+#define PROBE_JOIN(a, b) a##b
+#define PROBE_VAR(line) PROBE_JOIN(probe, line)
+#define PROBE(name) scopedProbe PROBE_VAR(__LINE__)(name) //times the rest of the enclosing scope
+
+#endif
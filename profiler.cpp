@@ -0,0 +1,215 @@
+#include "profiler.h"
+#include "gameboy.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+uint32_t guestLocation(uint16_t address) {
+	/* without a mapper the upper half of the cartridge is ROMX bank 1, everything else is bank 0 */
+	uint32_t bank = (address >= 0x4000 && address < 0x8000) ? 1 : 0;
+	return (bank << 16) | address;
+}
+
+guestProfiler::guestProfiler(uint64_t interval) {
+	this->interval = (interval == 0) ? 1 : interval;
+	this->nextSample = 0;
+	this->lastTime = 0;
+	this->started = false;
+	this->jitter = 0x9E3779B9;
+	this->depth = 0;
+	this->lastCall = false;
+	this->lastPC = 0;
+	this->lastSP = 0;
+	this->frames = 0;
+	this->samples = 0;
+}
+
+bool guestProfiler::loadSymbols(const char* filename) {
+	std::ifstream in(filename);
+	if (!in) {
+		std::cout << "ERROR: failed to open symbol file " << filename << std::endl;
+		return false;
+	}
+
+	/* "BB:AAAA Name" per line, ';' starts a comment */
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t comment = line.find(';');
+		if (comment != std::string::npos) {
+			line.resize(comment);
+		}
+
+		std::istringstream words(line);
+		std::string location;
+		guestSymbol symbol;
+		if (!(words >> location >> symbol.name) || location.size() < 6 || location[location.size() - 5] != ':') {
+			continue;
+		}
+		if (symbol.name.find('.') != std::string::npos) {
+			continue; //local labels belong to the function they are in
+		}
+
+		uint32_t bank = static_cast<uint32_t>(std::strtoul(location.substr(0, location.size() - 5).c_str(), NULL, 16));
+		uint32_t address = static_cast<uint32_t>(std::strtoul(location.substr(location.size() - 4).c_str(), NULL, 16));
+		symbol.location = (bank << 16) | address;
+		this->symbols.push_back(symbol);
+	}
+
+	std::sort(this->symbols.begin(), this->symbols.end(), [](const guestSymbol& a, const guestSymbol& b) {
+		return a.location < b.location;
+	});
+	return true;
+}
+
+size_t guestProfiler::getSymbols() {
+	return this->symbols.size();
+}
+
+uint32_t guestProfiler::functionOf(uint32_t location) {
+	auto after = std::upper_bound(this->symbols.begin(), this->symbols.end(), location, [](uint32_t l, const guestSymbol& s) {
+		return l < s.location;
+	});
+	if (after != this->symbols.begin() && ((after - 1)->location >> 16) == (location >> 16)) {
+		return (after - 1)->location;
+	}
+	return location & 0xFFFFFF00;
+}
+
+std::string guestProfiler::nameOf(uint32_t function) {
+	auto found = std::lower_bound(this->symbols.begin(), this->symbols.end(), function, [](const guestSymbol& s, uint32_t l) {
+		return s.location < l;
+	});
+	if (found != this->symbols.end() && found->location == function) {
+		return found->name;
+	}
+
+	char name[16];
+	snprintf(name, sizeof(name), "$%02X:%04X", function >> 16, function & 0xFFFF);
+	return name;
+}
+
+void guestProfiler::onFetch(uint16_t PC, uint16_t SP, uint8_t opcode) {
+	/* the instruction before this one was a call that was taken */
+	if (this->lastCall && SP == static_cast<uint16_t>(this->lastSP - 2) && this->depth < PROFILE_MAX_DEPTH) {
+		this->stack[this->depth].caller = this->functionOf(guestLocation(this->lastPC));
+		this->stack[this->depth].function = this->functionOf(guestLocation(PC));
+		this->stack[this->depth].SP = SP;
+		this->depth++;
+	}
+
+	/* returned from, one way or another */
+	while (this->depth > 0 && SP > this->stack[this->depth - 1].SP) {
+		this->depth--;
+	}
+
+	this->lastCall = isCallOpcode(opcode);
+	this->lastPC = PC;
+	this->lastSP = SP;
+}
+
+void guestProfiler::restored() {
+	this->depth = 0;
+	this->lastCall = false;
+}
+
+uint64_t guestProfiler::getNextSample() {
+	return this->nextSample;
+}
+
+void guestProfiler::sample(uint16_t PC, uint64_t now) {
+	/* a sample stands for the cycles since the one before, the first one for none */
+	uint64_t cycles = this->started ? now - this->lastTime : 0;
+	this->lastTime = now;
+	this->started = true;
+
+	/* between half and one and a half intervals away */
+	this->jitter ^= this->jitter << 13;
+	this->jitter ^= this->jitter >> 17;
+	this->jitter ^= this->jitter << 5;
+	this->nextSample = now + this->interval / 2 + this->jitter % this->interval + 1;
+
+	/* PC is past the opcode once it has been fetched */
+	uint32_t leaf = this->functionOf(guestLocation(static_cast<uint16_t>(PC - 1)));
+	this->key.clear();
+	if (this->depth > 0) {
+		this->key.push_back(this->stack[0].caller);
+	}
+	for (uint32_t i = 0; i < this->depth; i++) {
+		this->key.push_back(this->stack[i].function);
+	}
+	if (this->key.empty() || this->key.back() != leaf) {
+		this->key.push_back(leaf);
+	}
+	this->stacks[this->key]++;
+
+	this->frameCycles[leaf] += cycles;
+	this->samples++;
+}
+
+void guestProfiler::endFrame(uint16_t PC, uint64_t now) {
+	/* the cycles after the last sample go to where the frame ended, so every frame adds up to its length */
+	if (this->started) {
+		this->frameCycles[this->functionOf(guestLocation(static_cast<uint16_t>(PC - 1)))] += now - this->lastTime;
+		this->lastTime = now;
+	}
+
+	for (const auto& entry : this->frameCycles) {
+		functionBudget& total = this->budget[entry.first];
+		total.cycles += entry.second;
+		if (entry.second > total.worst) {
+			total.worst = entry.second;
+		}
+	}
+	this->frameCycles.clear();
+	this->frames++;
+}
+
+uint32_t guestProfiler::getDepth() {
+	return this->depth;
+}
+
+uint64_t guestProfiler::getSamples() {
+	return this->samples;
+}
+
+uint64_t guestProfiler::getFrames() {
+	return this->frames;
+}
+
+bool guestProfiler::writeFolded(const char* filename) {
+	std::ofstream out(filename);
+	if (!out) {
+		std::cout << "ERROR: failed to create " << filename << std::endl;
+		return false;
+	}
+
+	for (const auto& entry : this->stacks) {
+		for (size_t i = 0; i < entry.first.size(); i++) {
+			out << (i > 0 ? ";" : "") << this->nameOf(entry.first[i]);
+		}
+		out << " " << entry.second << "\n";
+	}
+	return static_cast<bool>(out);
+}
+
+void guestProfiler::report(unsigned int top) {
+	std::vector<std::pair<uint32_t, functionBudget>> sorted(this->budget.begin(), this->budget.end());
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<uint32_t, functionBudget>& a, const std::pair<uint32_t, functionBudget>& b) {
+		return a.second.cycles > b.second.cycles;
+	});
+
+	uint64_t frames = (this->frames == 0) ? 1 : this->frames;
+	printf("%llu samples over %llu frames, budget %d cycles a frame\n", (unsigned long long)this->samples,
+		(unsigned long long)this->frames, CYCLES_PER_FRAME);
+	printf("%-32s %12s %8s %12s %8s\n", "function", "cycles/frame", "%budget", "worst frame", "%budget");
+	for (size_t i = 0; i < sorted.size() && i < top; i++) {
+		double average = static_cast<double>(sorted[i].second.cycles) / frames;
+		printf("%-32s %12.0f %7.1f%% %12llu %7.1f%%\n", this->nameOf(sorted[i].first).c_str(), average,
+			100.0 * average / CYCLES_PER_FRAME, (unsigned long long)sorted[i].second.worst,
+			100.0 * sorted[i].second.worst / CYCLES_PER_FRAME);
+	}
+}
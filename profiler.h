@@ -0,0 +1,93 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#define PROFILE_INTERVAL 1000 //machine cycles between samples on average, about 17 a frame
+#define PROFILE_MAX_DEPTH 64 //deeper calls are not tracked
+
+/* a bank and an address, as RGBDS writes them: bank << 16 | address */
+uint32_t guestLocation(uint16_t address);
+
+struct guestSymbol {
+	uint32_t location;
+	std::string name;
+};
+
+struct callFrame {
+	uint32_t caller; //function the call was made from
+	uint32_t function; //location of the callee
+	uint16_t SP; //right after the return address was pushed
+};
+
+struct functionBudget {
+	uint64_t cycles; //over all frames
+	uint64_t worst; //most in a single frame
+};
+
+/*
+samples where the guest spends its cycles
+
+gameboy::runFrame() stops the CPU at every sample point and hands over
+the PC, so sampling costs a few extra run() calls a frame. Call stacks
+come from a shadow stack fed by gbcpu on every opcode fetch: a CALL or
+RST that moved SP down by 2 pushes a frame, and any frame whose return
+address lies below SP has been returned from, whether by RET, RETI, a
+conditional return or code that fixes up SP by hand.
+
+samples are attributed to functions, the nearest global label in a
+.sym file at or below the address, or the 256 byte page without one
+*/
+class guestProfiler {
+	private:
+		uint64_t interval;
+		uint64_t nextSample;
+		uint64_t lastTime; //of the previous sample or frame end
+		bool started;
+		uint32_t jitter; //xorshift state, keeps samples from locking onto the frame rate
+
+		std::vector<guestSymbol> symbols; //global labels, sorted by location
+
+		/* shadow stack */
+		callFrame stack[PROFILE_MAX_DEPTH];
+		uint32_t depth;
+		bool lastCall; //the previous instruction was a CALL or RST
+		uint16_t lastPC;
+		uint16_t lastSP;
+
+		std::map<std::vector<uint32_t>, uint64_t> stacks; //functions from the root to the sampled one, and its samples
+		std::vector<uint32_t> key; //reused for every sample
+
+		std::unordered_map<uint32_t, uint64_t> frameCycles; //per function, this frame
+		std::unordered_map<uint32_t, functionBudget> budget;
+		uint64_t frames;
+		uint64_t samples;
+
+		uint32_t functionOf(uint32_t location);
+		std::string nameOf(uint32_t function);
+
+	public:
+		guestProfiler(uint64_t interval = PROFILE_INTERVAL);
+
+		bool loadSymbols(const char* filename); //RGBDS .sym
+		size_t getSymbols();
+
+		/* fed by gbcpu and gameboy */
+		void onFetch(uint16_t PC, uint16_t SP, uint8_t opcode);
+		uint64_t getNextSample();
+		void sample(uint16_t PC, uint64_t now);
+		void endFrame(uint16_t PC, uint64_t now);
+		void restored(); //SP and PC jumped with a loaded state, the shadow stack is no longer theirs
+
+		uint32_t getDepth();
+		uint64_t getSamples();
+		uint64_t getFrames();
+		bool writeFolded(const char* filename); //flame graph input, one "root;...;leaf count" line per stack
+		void report(unsigned int top); //busiest functions against the CYCLES_PER_FRAME budget
+};
+
+#endif
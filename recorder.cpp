@@ -0,0 +1,195 @@
+#include "recorder.h"
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+
+#define CHROMA_SIZE ((SCREEN_WIDTH / 2) * (SCREEN_HEIGHT / 2))
+
+/* same greys main.cpp shows, shade 0 is white */
+static const uint8_t shadeLuma[4] = { 255, 170, 85, 0 };
+
+bufferQueue::bufferQueue() {
+	this->head = 0;
+	this->tail = 0;
+}
+
+bool bufferQueue::push(recordBuffer* buffer) {
+	uint64_t h = this->head.load(std::memory_order_relaxed);
+	if (h - this->tail.load(std::memory_order_acquire) >= RECORD_POOL_SIZE) {
+		return false;
+	}
+	this->entries[h % RECORD_POOL_SIZE] = buffer;
+	this->head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+bool bufferQueue::pop(recordBuffer*& buffer) {
+	uint64_t t = this->tail.load(std::memory_order_relaxed);
+	if (t == this->head.load(std::memory_order_acquire)) {
+		return false;
+	}
+	buffer = this->entries[t % RECORD_POOL_SIZE];
+	this->tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+recorder::recorder() {
+	this->pool = NULL;
+	this->running = false;
+	this->video = NULL;
+	this->hasAudio = false;
+	this->yuv = NULL;
+	this->recorded = 0;
+	this->dropped = 0;
+}
+
+recorder::~recorder() {
+	this->close();
+}
+
+bool recorder::open(const char* videoFile, const char* wavFile, uint32_t sampleRate) {
+	this->close();
+
+	if (videoFile) {
+		this->video = fopen(videoFile, "wb");
+		if (!this->video) {
+			std::cout << "ERROR: failed to open video file " << videoFile << std::endl;
+			return false;
+		}
+		fprintf(this->video, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", SCREEN_WIDTH, SCREEN_HEIGHT,
+			RECORD_RATE_NUM, RECORD_RATE_DEN);
+	}
+	if (wavFile) {
+		if (!this->audio.open(wavFile, sampleRate)) {
+			this->close();
+			return false;
+		}
+		this->hasAudio = true;
+	}
+
+	/* everything is allocated up front, buffers only move between the two queues */
+	this->pool = new recordBuffer[RECORD_POOL_SIZE];
+	this->yuv = new uint8_t[FRAMEBUFFER_SIZE + 2 * CHROMA_SIZE];
+	memset(this->yuv + FRAMEBUFFER_SIZE, 128, 2 * CHROMA_SIZE); //grey has no chroma
+	for (int i = 0; i < RECORD_POOL_SIZE; i++) {
+		this->spare.push(&this->pool[i]);
+	}
+
+	this->recorded = 0;
+	this->dropped = 0;
+	this->running = true;
+	this->writer = std::thread(&recorder::writerLoop, this);
+	return true;
+}
+
+void recorder::close() {
+	if (this->writer.joinable()) {
+		this->running = false;
+		this->writer.join();
+	}
+
+	if (this->video) {
+		fclose(this->video);
+		this->video = NULL;
+	}
+	if (this->hasAudio) {
+		this->audio.close();
+		this->hasAudio = false;
+	}
+
+	/* drain both queues so a later open() starts from an empty pool */
+	recordBuffer* buffer;
+	while (this->spare.pop(buffer)) {
+	}
+	while (this->filled.pop(buffer)) {
+	}
+	delete[] this->pool;
+	delete[] this->yuv;
+	this->pool = NULL;
+	this->yuv = NULL;
+}
+
+bool recorder::isOpen() {
+	return this->pool != NULL;
+}
+
+recordBuffer* recorder::acquire(bool wait) {
+	recordBuffer* buffer;
+	if (!this->pool) {
+		return NULL;
+	}
+	while (!this->spare.pop(buffer)) {
+		if (!wait) {
+			this->dropped++;
+			return NULL;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	buffer->frame = 0;
+	buffer->sampleCount = 0;
+	return buffer;
+}
+
+void recorder::submit(recordBuffer* buffer) {
+	if (buffer) {
+		this->filled.push(buffer); //never full, there are only RECORD_POOL_SIZE buffers
+		this->recorded++;
+	}
+}
+
+bool recorder::capture(uint64_t frame, const uint8_t* pixels, const int16_t* samples, uint32_t count) {
+	recordBuffer* buffer = this->acquire();
+	if (!buffer) {
+		return false;
+	}
+
+	if (count > RECORD_AUDIO_FRAMES) {
+		count = RECORD_AUDIO_FRAMES;
+	}
+	buffer->frame = frame;
+	memcpy(buffer->pixels, pixels, FRAMEBUFFER_SIZE);
+	memcpy(buffer->samples, samples, count * AUDIO_CHANNELS * sizeof(int16_t));
+	buffer->sampleCount = count;
+	this->submit(buffer);
+	return true;
+}
+
+void recorder::writerLoop() {
+	while (true) {
+		/* read before draining, every submit before close() is then seen below */
+		bool stopping = !this->running;
+
+		recordBuffer* buffer;
+		while (this->filled.pop(buffer)) {
+			this->writeFrame(buffer);
+			this->spare.push(buffer);
+		}
+
+		if (stopping) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void recorder::writeFrame(const recordBuffer* buffer) {
+	if (this->video) {
+		for (int i = 0; i < FRAMEBUFFER_SIZE; i++) {
+			this->yuv[i] = shadeLuma[buffer->pixels[i] & 3];
+		}
+		fputs("FRAME\n", this->video);
+		fwrite(this->yuv, FRAMEBUFFER_SIZE + 2 * CHROMA_SIZE, 1, this->video);
+	}
+	if (this->hasAudio) {
+		this->audio.write(buffer->samples, buffer->sampleCount);
+	}
+}
+
+uint64_t recorder::getRecorded() {
+	return this->recorded;
+}
+
+uint64_t recorder::getDropped() {
+	return this->dropped;
+}
@@ -0,0 +1,86 @@
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+
+#include "ppu.h"
+#include "audio.h"
+
+#define RECORD_POOL_SIZE 16 //frames in flight, a quarter second of slack for the disk
+#define RECORD_AUDIO_FRAMES 2048 //per video frame, about 800 are produced at 48kHz
+#define RECORD_RATE_NUM 4194304 //Y4M frame rate, clock over T-cycles per frame
+#define RECORD_RATE_DEN 70224
+
+/* one emulated frame on its way to disk */
+struct recordBuffer {
+	uint64_t frame;
+	uint8_t pixels[FRAMEBUFFER_SIZE]; //shades, a PPU can draw straight into this
+	int16_t samples[RECORD_AUDIO_FRAMES * AUDIO_CHANNELS];
+	uint32_t sampleCount;
+};
+
+/* single producer, single consumer queue of buffer pointers */
+class bufferQueue {
+	private:
+		recordBuffer* entries[RECORD_POOL_SIZE];
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+
+	public:
+		bufferQueue();
+		bool push(recordBuffer* buffer); //false when full
+		bool pop(recordBuffer*& buffer); //false when empty
+};
+
+/*
+records frames to Y4M and audio to WAV on a background thread
+
+the emulator takes a pooled buffer, fills it (or lets the PPU draw into
+it) and hands the pointer over. The writer converts to YUV, writes and
+returns the buffer to the pool. Nothing is allocated per frame and the
+emulator never waits: when the disk falls so far behind that the pool is
+empty, frames are dropped and counted instead. Offline tools running
+faster than real time can wait for a buffer instead
+*/
+class recorder {
+	private:
+		recordBuffer* pool;
+		bufferQueue spare; //writer to emulator
+		bufferQueue filled; //emulator to writer
+
+		std::thread writer;
+		std::atomic<bool> running;
+
+		FILE* video;
+		wavWriter audio;
+		bool hasAudio;
+		uint8_t* yuv; //writer thread only
+
+		uint64_t recorded;
+		uint64_t dropped;
+
+		void writerLoop();
+		void writeFrame(const recordBuffer* buffer);
+
+	public:
+		recorder();
+		~recorder();
+		recorder(const recorder&) = delete;
+		recorder& operator=(const recorder&) = delete;
+
+		bool open(const char* videoFile, const char* wavFile, uint32_t sampleRate); //either file may be NULL
+		void close(); //writes everything still queued
+		bool isOpen();
+
+		recordBuffer* acquire(bool wait = false); //NULL while every buffer is queued, the frame is then dropped
+		void submit(recordBuffer* buffer);
+		bool capture(uint64_t frame, const uint8_t* pixels, const int16_t* samples, uint32_t count); //acquire, copy and submit
+
+		uint64_t getRecorded();
+		uint64_t getDropped();
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "romtest.h"
+
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+static const uint8_t fibonacci[6] = { 3, 5, 8, 13, 21, 34 };
+static const uint8_t mooneyeFail[6] = { 0x42, 0x42, 0x42, 0x42, 0x42, 0x42 };
+
+const char* romTestStatusName(uint8_t status) {
+	switch (status) {
+	case ROMTEST_PASSED:
+		return "passed";
+	case ROMTEST_FAILED:
+		return "failed";
+	case ROMTEST_TIMEOUT:
+		return "timeout";
+	case ROMTEST_STUCK:
+		return "stuck";
+	}
+	return "error";
+}
+
+/*
+a frame boundary on the same PC twice is not enough, a wait loop whose
+length divides CYCLES_PER_FRAME lands on the same instruction every frame
+*/
+bool romTestStuck(const cpuState& cpu) {
+	return cpu.cycle == NEW_CYCLE && opcodeFamily(cpu.opcode) == FAMILY_OTHER;
+}
+
+/* ROMTEST_TIMEOUT while there is no verdict yet */
+static uint8_t verdict(const std::string& output, const uint8_t* memory, const cpuState& cpu) {
+	if (output.find("Passed") != std::string::npos) {
+		return ROMTEST_PASSED;
+	}
+	if (output.find("Failed") != std::string::npos) {
+		return ROMTEST_FAILED;
+	}
+
+	if (memory[ROMTEST_SIGNATURE] == 0xDE && memory[ROMTEST_SIGNATURE + 1] == 0xB0 && memory[ROMTEST_SIGNATURE + 2] == 0x61 &&
+		memory[ROMTEST_RESULT] != 0x80) {
+		return (memory[ROMTEST_RESULT] == 0) ? ROMTEST_PASSED : ROMTEST_FAILED;
+	}
+
+	uint8_t registers[6] = { cpu.BC.half[1], cpu.BC.half[0], cpu.DE.half[1], cpu.DE.half[0], cpu.HL.half[1], cpu.HL.half[0] };
+	if (memcmp(registers, fibonacci, 6) == 0 || output.find(reinterpret_cast<const char*>(fibonacci), 0, 6) != std::string::npos) {
+		return ROMTEST_PASSED;
+	}
+	if (memcmp(registers, mooneyeFail, 6) == 0 || output.find(reinterpret_cast<const char*>(mooneyeFail), 0, 6) != std::string::npos) {
+		return ROMTEST_FAILED;
+	}
+	return ROMTEST_TIMEOUT;
+}
+
+romTestRunner::romTestRunner(unsigned int threads, uint64_t maxFrames) {
+	this->threads = (threads == 0) ? 1 : threads;
+	this->maxFrames = maxFrames;
+}
+
+romTestResult romTestRunner::runROM(const std::string& rom) {
+	romTestResult result;
+	result.rom = rom;
+	result.status = ROMTEST_ERROR;
+	result.frames = 0;
+	result.seconds = 0;
+	result.PC = 0;
+	result.opcode = 0;
+
+	gameboy gb;
+	if (!gb.loadROM(rom.c_str())) {
+		return result;
+	}
+	gb.setAudioOutput(false);
+	gb.getSerial().setCapture(&result.output);
+
+	auto start = std::chrono::steady_clock::now();
+	uint8_t* memory = gb.getMemory();
+	cpuState cpu;
+	uint64_t tail = 0;
+	result.status = ROMTEST_TIMEOUT;
+
+	while (result.frames < this->maxFrames) {
+		gb.runFrame();
+		result.frames++;
+		gb.getCPU().saveState(cpu);
+
+		if (result.status != ROMTEST_TIMEOUT) {
+			if (++tail == ROMTEST_TAIL_FRAMES) {
+				break;
+			}
+			continue;
+		}
+
+		result.status = verdict(result.output, memory, cpu);
+
+		if (result.status == ROMTEST_TIMEOUT && romTestStuck(cpu)) {
+			result.status = ROMTEST_STUCK;
+			result.PC = static_cast<uint16_t>(cpu.PC - 1);
+			result.opcode = cpu.opcode;
+			break;
+		}
+	}
+	gb.getSerial().setCapture(NULL);
+
+	if (result.output.empty() && memory[ROMTEST_SIGNATURE] == 0xDE) {
+		const char* text = reinterpret_cast<const char*>(&memory[ROMTEST_TEXT]);
+		result.output.assign(text, strnlen(text, MEMORY_SIZE - ROMTEST_TEXT));
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+void romTestRunner::runROMs(const std::vector<std::string>* roms, std::atomic<size_t>* next, std::vector<romTestResult>* results) {
+	for (size_t i = (*next)++; i < roms->size(); i = (*next)++) {
+		(*results)[i] = this->runROM((*roms)[i]);
+	}
+}
+
+std::vector<romTestResult> romTestRunner::run(const std::vector<std::string>& roms) {
+	std::vector<romTestResult> results(roms.size());
+	std::vector<std::thread> workers;
+	std::atomic<size_t> next(0);
+
+	/* ROMs are handed out one at a time, a slow one does not hold up the others */
+	for (unsigned int i = 0; i < this->threads && i < roms.size(); i++) {
+		workers.push_back(std::thread(&romTestRunner::runROMs, this, &roms, &next, &results));
+	}
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	return results;
+}
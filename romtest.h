@@ -0,0 +1,60 @@
+#ifndef __ROMTEST_H__
+#define __ROMTEST_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include "gameboy.h"
+
+#define ROMTEST_PASSED 0
+#define ROMTEST_FAILED 1
+#define ROMTEST_TIMEOUT 2 //no verdict within the frame limit
+#define ROMTEST_STUCK 3 //the CPU stopped on an opcode it does not implement
+#define ROMTEST_ERROR 4 //the ROM could not be loaded
+
+#define ROMTEST_FRAMES 7200 //two emulated minutes, the slowest suites need about one
+#define ROMTEST_TAIL_FRAMES 10 //kept running after a verdict, for the text that follows "Failed"
+
+/* blargg's ROMs also report through cartridge RAM */
+#define ROMTEST_RESULT 0xA000 //0x80 while running, then 0 for passed
+#define ROMTEST_SIGNATURE 0xA001 //DE B0 61 once the result is valid
+#define ROMTEST_TEXT 0xA004 //zero terminated, same text as the serial output
+
+struct romTestResult {
+	std::string rom;
+	uint8_t status; //ROMTEST_*
+	uint64_t frames;
+	double seconds;
+	uint16_t PC; //where a stuck CPU stopped
+	uint8_t opcode;
+	std::string output; //serial text, or the cartridge RAM text when nothing was sent
+};
+
+const char* romTestStatusName(uint8_t status);
+bool romTestStuck(const cpuState& cpu); //waiting to start an opcode gbcpu does not implement, it never will
+
+/*
+runs test ROMs to their verdict, several at a time
+
+a ROM passes or fails when its serial output says "Passed" or "Failed",
+when blargg's result in cartridge RAM is valid, or when it leaves the
+Fibonacci numbers 3 5 8 13 21 34 (passed) or six 0x42 (failed) in B-L
+or on the serial port, as mooneye's ROMs do. The verdict is checked
+after every frame and the ROM is stopped a few frames later
+*/
+class romTestRunner {
+	private:
+		unsigned int threads;
+		uint64_t maxFrames;
+
+		void runROMs(const std::vector<std::string>* roms, std::atomic<size_t>* next, std::vector<romTestResult>* results);
+
+	public:
+		romTestRunner(unsigned int threads, uint64_t maxFrames = ROMTEST_FRAMES);
+		romTestResult runROM(const std::string& rom);
+		std::vector<romTestResult> run(const std::vector<std::string>& roms); //results in the order of roms
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "runahead.h"
+
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+
+#define FRAME_BUDGET_US (1e6 / 59.7275)
+
+static uint64_t nanosSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+runAhead::runAhead(gameboy& gb, uint32_t frames) {
+	this->gb = &gb;
+	this->saved = new gameboyState;
+	this->pending = false;
+	this->frames = 0;
+	this->setFrames(frames);
+
+	this->count = 0;
+	this->saveTime = 0;
+	this->loadTime = 0;
+	this->realTime = 0;
+	this->aheadTime = 0;
+}
+
+runAhead::~runAhead() {
+	delete this->saved;
+}
+
+void runAhead::setFrames(uint32_t frames) {
+	if (frames > RUNAHEAD_MAX_FRAMES) {
+		std::cout << "ERROR: run-ahead is limited to " << RUNAHEAD_MAX_FRAMES << " frames" << std::endl;
+		frames = RUNAHEAD_MAX_FRAMES;
+	}
+	this->frames = frames;
+}
+
+uint32_t runAhead::getFrames() {
+	return this->frames;
+}
+
+void runAhead::runFrame() {
+	auto start = std::chrono::steady_clock::now();
+	if (this->pending) {
+		this->gb->loadState(*this->saved);
+		this->pending = false;
+		this->loadTime += nanosSince(start);
+		start = std::chrono::steady_clock::now();
+	}
+
+	/* only the last frame run is shown */
+	this->gb->setRender(this->frames == 0);
+	this->gb->runFrame();
+	this->gb->setRender(true);
+	this->realTime += nanosSince(start);
+	this->count++;
+
+	if (this->frames == 0) {
+		return;
+	}
+
+	start = std::chrono::steady_clock::now();
+	this->gb->saveState(*this->saved);
+	this->pending = true;
+	this->saveTime += nanosSince(start);
+
+	start = std::chrono::steady_clock::now();
+	this->gb->setAudioOutput(false);
+	for (uint32_t i = 0; i < this->frames; i++) {
+		this->gb->setRender(i + 1 == this->frames);
+		this->gb->runFrame();
+	}
+	this->gb->setAudioOutput(true);
+	this->aheadTime += nanosSince(start);
+}
+
+double runAhead::getSaveMicros() {
+	return this->count ? this->saveTime / 1000.0 / this->count : 0;
+}
+
+double runAhead::getLoadMicros() {
+	return this->count ? this->loadTime / 1000.0 / this->count : 0;
+}
+
+double runAhead::getRealMicros() {
+	return this->count ? this->realTime / 1000.0 / this->count : 0;
+}
+
+double runAhead::getAheadMicros() {
+	return this->count ? this->aheadTime / 1000.0 / this->count : 0;
+}
+
+void runAhead::report() {
+	double overhead = this->getSaveMicros() + this->getLoadMicros() + this->getAheadMicros();
+	double total = overhead + this->getRealMicros();
+
+	printf("run-ahead %u frames: save %.1fus, load %.1fus, frames ahead %.1fus, real frame %.1fus\n", this->frames,
+		this->getSaveMicros(), this->getLoadMicros(), this->getAheadMicros(), this->getRealMicros());
+	printf("run-ahead overhead %.2f%% of the frame budget, %.2f%% used in total\n", 100.0 * overhead / FRAME_BUDGET_US,
+		100.0 * total / FRAME_BUDGET_US);
+}
@@ -0,0 +1,50 @@
+#ifndef __RUNAHEAD_H__
+#define __RUNAHEAD_H__
+
+#include <cstdint>
+
+#include "gameboy.h"
+
+#define RUNAHEAD_MAX_FRAMES 8
+
+/*
+hides the game's own input lag
+
+every host frame runs one real frame with sound, saves the state, runs
+frames more with the latest input and no sound and leaves the machine
+showing that last one for presentation. The next call loads the saved
+state back first, so the frames run ahead never count
+*/
+class runAhead {
+	private:
+		gameboy* gb;
+		gameboyState* saved;
+		uint32_t frames;
+		bool pending; //saved must be loaded before the next real frame
+
+		/* nanoseconds summed over count host frames */
+		uint64_t count;
+		uint64_t saveTime;
+		uint64_t loadTime;
+		uint64_t realTime;
+		uint64_t aheadTime;
+
+	public:
+		runAhead(gameboy& gb, uint32_t frames);
+		~runAhead();
+		runAhead(const runAhead&) = delete;
+		runAhead& operator=(const runAhead&) = delete;
+
+		void setFrames(uint32_t frames); //0 turns run-ahead off
+		uint32_t getFrames();
+		void runFrame();
+
+		/* averages per host frame in microseconds */
+		double getSaveMicros();
+		double getLoadMicros();
+		double getRealMicros(); //the one frame that counts
+		double getAheadMicros(); //all frames run ahead together
+		void report(); //overhead as a share of the 16.74ms frame budget
+};
+
+#endif
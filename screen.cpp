@@ -0,0 +1,159 @@
+#include "screen.h"
+#include "utils.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+//Pixel colors[4] = { {15, 56, 15}, {48, 98, 48}, {139, 172, 15}, {155, 188, 15} };
+//Pixel colors[4] = { {0,19,26}, {31,89,74}, {108,166,108}, {216,247,215} };
+Pixel colors[4] = { {0,0,0}, {85,85,85}, {170,170,170}, {255,255,255} };
+
+void shadeScreen(screen* display, const uint8_t* shades) {
+	shadeLines(display, shades, 0, SCREEN_HEIGHT);
+}
+
+void shadeLines(screen* display, const uint8_t* shades, uint32_t first, uint32_t count) {
+	for (uint32_t i = first * SCREEN_WIDTH; i < (first + count) * SCREEN_WIDTH; i++) {
+		display->flat[i] = colors[3 - (shades[i] & 3)];
+	}
+}
+
+uint64_t frameHash(const uint8_t* shades) {
+	return hashFast(shades, FRAMEBUFFER_SIZE);
+}
+
+frameDiff::frameDiff() {
+	this->valid = false;
+	this->rangeCount = 0;
+}
+
+void frameDiff::invalidate() {
+	this->valid = false;
+}
+
+uint32_t frameDiff::update(const uint8_t* shades) {
+	this->rangeCount = 0;
+	for (uint32_t line = 0; line < SCREEN_HEIGHT; line++) {
+		const uint8_t* row = &shades[line * SCREEN_WIDTH];
+		uint8_t* old = &this->last[line * SCREEN_WIDTH];
+		if (this->valid && memcmp(row, old, SCREEN_WIDTH) == 0) {
+			continue;
+		}
+		memcpy(old, row, SCREEN_WIDTH);
+
+		/* joins the range the line before started */
+		if (this->rangeCount > 0) {
+			lineRange& previous = this->ranges[this->rangeCount - 1];
+			if (previous.first + previous.count == line) {
+				previous.count++;
+				continue;
+			}
+		}
+		this->ranges[this->rangeCount].first = line;
+		this->ranges[this->rangeCount].count = 1;
+		this->rangeCount++;
+	}
+
+	this->valid = true;
+	return this->rangeCount;
+}
+
+const lineRange& frameDiff::getRange(uint32_t i) {
+	return this->ranges[i];
+}
+
+struct crcTable {
+	uint32_t entries[256];
+
+	crcTable() {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			}
+			this->entries[n] = c;
+		}
+	}
+};
+
+static uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0) {
+	static const crcTable table; //built once, safely, by the first thread to get here
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++) {
+		crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void putBig32(std::vector<uint8_t>& out, uint32_t n) {
+	out.push_back(static_cast<uint8_t>(n >> 24));
+	out.push_back(static_cast<uint8_t>(n >> 16));
+	out.push_back(static_cast<uint8_t>(n >> 8));
+	out.push_back(static_cast<uint8_t>(n));
+}
+
+static void writeChunk(FILE* f, const char* type, const std::vector<uint8_t>& data) {
+	std::vector<uint8_t> chunk;
+	putBig32(chunk, static_cast<uint32_t>(data.size()));
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBig32(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+	fwrite(chunk.data(), 1, chunk.size(), f);
+}
+
+bool savePNG(const char* filename, const screen* display) {
+	FILE* f = fopen(filename, "wb");
+	if (!f) {
+		std::cout << "ERROR: failed to create " << filename << std::endl;
+		return false;
+	}
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	fwrite(signature, 1, sizeof(signature), f);
+
+	std::vector<uint8_t> header;
+	putBig32(header, SCREEN_WIDTH);
+	putBig32(header, SCREEN_HEIGHT);
+	header.push_back(8); //bits per channel
+	header.push_back(2); //RGB
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	writeChunk(f, "IHDR", header);
+
+	/* rows with filter type 0 */
+	std::vector<uint8_t> raw;
+	for (int y = 0; y < SCREEN_HEIGHT; y++) {
+		raw.push_back(0);
+		const uint8_t* row = reinterpret_cast<const uint8_t*>(display->square[y]);
+		raw.insert(raw.end(), row, row + SCREEN_WIDTH * 3);
+	}
+
+	/* zlib stream of stored deflate blocks, a frame only happens on a failure so size does not matter */
+	std::vector<uint8_t> data = { 0x78, 0x01 };
+	for (size_t pos = 0; pos < raw.size(); pos += 65535) {
+		size_t length = (raw.size() - pos < 65535) ? raw.size() - pos : 65535;
+		data.push_back((pos + length == raw.size()) ? 1 : 0);
+		data.push_back(static_cast<uint8_t>(length));
+		data.push_back(static_cast<uint8_t>(length >> 8));
+		data.push_back(static_cast<uint8_t>(~length));
+		data.push_back(static_cast<uint8_t>(~length >> 8));
+		data.insert(data.end(), raw.begin() + pos, raw.begin() + pos + length);
+	}
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for (uint8_t byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBig32(data, (b << 16) | a);
+	writeChunk(f, "IDAT", data);
+	writeChunk(f, "IEND", std::vector<uint8_t>());
+
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
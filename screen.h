@@ -0,0 +1,52 @@
+#ifndef __SCREEN_H__
+#define __SCREEN_H__
+
+#include <cstdint>
+
+#include "ppu.h"
+
+struct Pixel {
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+};
+
+union screen { //monochrome 8 bit depth
+	Pixel square[SCREEN_HEIGHT][SCREEN_WIDTH];
+	Pixel flat[SCREEN_WIDTH * SCREEN_HEIGHT];
+};
+
+/* indexed darkest first, shades run the other way */
+extern Pixel colors[4];
+
+void shadeScreen(screen* display, const uint8_t* shades); //FRAMEBUFFER_SIZE PPU shades to colors
+void shadeLines(screen* display, const uint8_t* shades, uint32_t first, uint32_t count); //only those lines
+bool savePNG(const char* filename, const screen* display); //uncompressed, needs no zlib
+uint64_t frameHash(const uint8_t* shades); //hashFast() of the shades, the same on every build
+
+struct lineRange {
+	uint32_t first;
+	uint32_t count;
+};
+
+/*
+scanlines that changed since the previous frame, so a front end only
+shades and uploads those and can skip a frame that did not change at all,
+as in menus, pauses and text boxes. Keeps its own copy of the last frame,
+so it works whichever buffer the PPU drew into
+*/
+class frameDiff {
+	private:
+		uint8_t last[FRAMEBUFFER_SIZE];
+		bool valid; //false until the first frame, and after invalidate()
+		lineRange ranges[SCREEN_HEIGHT / 2 + 1]; //changed lines never touch, so at most every other one starts a range
+		uint32_t rangeCount;
+
+	public:
+		frameDiff();
+		void invalidate(); //the next update() reports the whole screen
+		uint32_t update(const uint8_t* shades); //changed line ranges, 0 for an identical frame
+		const lineRange& getRange(uint32_t i);
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "serial.h"
+
+#include <thread>
+
+linkQueue::linkQueue() {
+	this->head = 0;
+	this->tail = 0;
+}
+
+void linkQueue::push(const linkMessage& message) {
+	uint64_t h = this->head.load(std::memory_order_relaxed);
+	while (h - this->tail.load(std::memory_order_acquire) >= LINK_QUEUE_SIZE) {
+		std::this_thread::yield();
+	}
+	this->messages[h & (LINK_QUEUE_SIZE - 1)] = message;
+	this->head.store(h + 1, std::memory_order_release);
+}
+
+bool linkQueue::peek(linkMessage& message) {
+	uint64_t t = this->tail.load(std::memory_order_relaxed);
+	if (t == this->head.load(std::memory_order_acquire)) {
+		return false;
+	}
+	message = this->messages[t & (LINK_QUEUE_SIZE - 1)];
+	return true;
+}
+
+void linkQueue::pop() {
+	this->tail.store(this->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+serialPort::serialPort(uint8_t* memory) {
+	this->memory = memory;
+	this->link = NULL;
+	this->side = 0;
+	this->epoch = 0;
+	this->state.done = SERIAL_NEVER;
+	this->state.incoming = 0xFF;
+	this->state.waiting = false;
+	this->capture = NULL;
+}
+
+void serialPort::connect(serialLink* link, uint8_t side, uint64_t now) {
+	this->link = link;
+	this->side = side & 1;
+	this->epoch = now;
+}
+
+void serialPort::disconnect() {
+	this->link = NULL;
+	if (this->state.waiting) {
+		this->state.incoming = 0xFF; //the cable was pulled mid-transfer
+		this->state.waiting = false;
+	}
+}
+
+uint64_t serialPort::nextEvent(uint64_t now) {
+	uint64_t next = now + SERIAL_WINDOW;
+	if (this->state.done < next) {
+		next = this->state.done;
+	}
+
+	/* a transfer the peer clocked ahead of us starts exactly on time */
+	linkMessage message;
+	if (this->link && this->link->inbox[this->side].peek(message) && message.cycle + this->epoch > now && message.cycle + this->epoch < next) {
+		next = message.cycle + this->epoch;
+	}
+
+	if (this->link && !this->link->finished[this->side ^ 1].load(std::memory_order_acquire)) {
+		uint64_t limit = this->link->time[this->side ^ 1].load(std::memory_order_acquire) + SERIAL_LOOKAHEAD + this->epoch;
+		if (limit < next) {
+			next = limit;
+		}
+	}
+	return next;
+}
+
+/*
+a transfer clocked while this side was ahead is seen up to SERIAL_LOOKAHEAD
+cycles late and sends SB as it is by then, it still completes on time
+*/
+void serialPort::receive(uint64_t now) {
+	linkMessage message;
+	while (this->link->inbox[this->side].peek(message)) {
+		if (message.type == LINK_START && message.cycle + this->epoch > now) {
+			break;
+		}
+		this->link->inbox[this->side].pop();
+
+		if (message.type == LINK_START) {
+			linkMessage reply = { message.cycle, LINK_REPLY, this->memory[SB] };
+			this->link->inbox[this->side ^ 1].push(reply);
+
+			/* the external clock shifts SB whether or not this side armed SC */
+			this->state.done = message.cycle + this->epoch + SERIAL_TRANSFER_CYCLES;
+			this->state.incoming = message.data;
+			this->state.waiting = false;
+		}
+		else {
+			this->state.incoming = message.data;
+			this->state.waiting = false;
+		}
+	}
+}
+
+void serialPort::update(uint64_t now) {
+	if (this->link) {
+		this->link->time[this->side].store(now - this->epoch, std::memory_order_release);
+
+		while (true) {
+			this->receive(now);
+
+			bool peerDone = this->link->finished[this->side ^ 1].load(std::memory_order_acquire);
+			if (peerDone && this->state.waiting) {
+				this->state.incoming = 0xFF;
+				this->state.waiting = false;
+			}
+
+			bool blocked = (this->state.waiting && now >= this->state.done) ||
+				(!peerDone && now - this->epoch >= this->link->time[this->side ^ 1].load(std::memory_order_acquire) + SERIAL_LOOKAHEAD);
+			if (!blocked) {
+				break;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	if (now >= this->state.done) {
+		this->memory[SB] = this->state.incoming;
+		if (this->memory[SC] & 0x80) {
+			this->memory[SC] &= 0x7F;
+			this->memory[IF_REGISTER] |= SERIAL_INTERRUPT;
+		}
+		this->state.done = SERIAL_NEVER;
+	}
+}
+
+void serialPort::finish(uint64_t now) {
+	if (!this->link) {
+		return;
+	}
+
+	/* transfers clocked after our end are answered right away */
+	this->link->time[this->side].store(now - this->epoch, std::memory_order_release);
+	this->link->finished[this->side].store(true, std::memory_order_release);
+	while (!this->link->finished[this->side ^ 1].load(std::memory_order_acquire)) {
+		this->receive(SERIAL_NEVER);
+		std::this_thread::yield();
+	}
+	this->receive(SERIAL_NEVER);
+}
+
+void serialPort::setCapture(std::string* text) {
+	this->capture = text;
+}
+
+void serialPort::saveState(serialState& state) {
+	state = this->state;
+}
+
+void serialPort::loadState(const serialState& state) {
+	this->state = state;
+}
+
+uint8_t serialPort::ioRead(uint16_t address, uint8_t val, uint64_t) {
+	return (address == SC) ? (val | 0x7E) : val;
+}
+
+void serialPort::ioWrite(uint16_t address, uint8_t val, uint64_t cycle) {
+	/* only the internal clock starts a transfer, an external one waits for the peer */
+	if (address != SC || (val & 0x81) != 0x81 || this->state.done != SERIAL_NEVER) {
+		return;
+	}
+
+	this->state.done = cycle + SERIAL_TRANSFER_CYCLES;
+	if (this->capture) {
+		this->capture->push_back(static_cast<char>(this->memory[SB]));
+	}
+	if (this->link) {
+		linkMessage start = { cycle - this->epoch, LINK_START, this->memory[SB] };
+		this->link->inbox[this->side ^ 1].push(start);
+		this->state.waiting = true;
+	}
+	else {
+		this->state.incoming = 0xFF;
+		this->state.waiting = false;
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+
+#include <cstdint>
+#include <atomic>
+#include <string>
+
+#include "io.h"
+
+#define SB 0xFF01
+#define SC 0xFF02
+#define SERIAL_INTERRUPT 0x08
+
+#define SERIAL_TRANSFER_CYCLES 1024 //8 bits at 8192Hz, in machine cycles
+#define SERIAL_WINDOW 1024 //longest run between two serial updates, keeps completions exact
+#define SERIAL_LOOKAHEAD 512 //how far a linked console may run past its peer, below a transfer time
+#define SERIAL_NEVER UINT64_MAX
+
+#define LINK_QUEUE_SIZE 64 //power of 2
+#define LINK_START 0 //the sender clocks a transfer with its byte
+#define LINK_REPLY 1 //the receiver's byte for that transfer
+
+struct linkMessage {
+	uint64_t cycle; //since the sender was connected
+	uint8_t type;
+	uint8_t data;
+};
+
+/* single producer, single consumer queue of messages to one side of the cable */
+class linkQueue {
+	private:
+		linkMessage messages[LINK_QUEUE_SIZE];
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+
+	public:
+		linkQueue();
+		void push(const linkMessage& message); //spins while full
+		bool peek(linkMessage& message); //oldest message, false when empty
+		void pop();
+};
+
+/*
+what two linked serial ports share
+
+each side publishes its cycle count after every run of at most
+SERIAL_WINDOW cycles and never runs more than SERIAL_LOOKAHEAD cycles
+past the other, so the consoles only wait for each other when one gets
+ahead or a transfer needs the other side's byte
+*/
+struct serialLink {
+	linkQueue inbox[2];
+	alignas(64) std::atomic<uint64_t> time[2]; //cycles run since each side was connected
+	alignas(64) std::atomic<bool> finished[2]; //the side only answers transfers until its peer finishes too
+};
+
+/* transfer in progress, part of the saved machine state */
+struct serialState {
+	uint64_t done; //cycle the transfer completes at, SERIAL_NEVER when idle
+	uint8_t incoming; //byte shifted in by then
+	bool waiting; //incoming has not arrived from the peer yet
+};
+
+/*
+SB/SC
+
+a transfer with the internal clock completes SERIAL_TRANSFER_CYCLES after
+it starts. Without a cable 0xFF is shifted in, with one the bytes are
+swapped with the linked console. The interrupt is only flagged in IF,
+the CPU does not take interrupts yet
+*/
+class serialPort : public ioDevice {
+	private:
+		uint8_t* memory;
+		serialLink* link; //NULL without a cable
+		uint8_t side;
+		uint64_t epoch; //cycle count when the cable was connected
+		serialState state;
+		std::string* capture; //every byte this side sends, NULL when off
+
+		void receive(uint64_t now);
+
+	public:
+		serialPort(uint8_t* memory);
+
+		void connect(serialLink* link, uint8_t side, uint64_t now);
+		void disconnect();
+
+		uint64_t nextEvent(uint64_t now); //cycle the next run has to stop at
+		void update(uint64_t now); //completes transfers and talks to the peer, may wait for it
+		void finish(uint64_t now); //answers the peer until it is done too
+		void setCapture(std::string* text); //test ROMs print through the serial port
+
+		void saveState(serialState& state);
+		void loadState(const serialState& state);
+
+		uint8_t ioRead(uint16_t address, uint8_t val, uint64_t cycle);
+		void ioWrite(uint16_t address, uint8_t val, uint64_t cycle);
+};
+
+#endif
@@ -1,37 +1,64 @@
 #include "shader.h"
+#include "utils.h"
 
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <vector>
+#include <filesystem>
+#include <cstdlib>
 #include <glad/glad.h>
 
-GLuint createShaderFromFile(const GLenum shaderType, const char* filename) {
-	GLuint shader = glCreateShader(shaderType);
-	std::string fileText;
-
-	std::ifstream inp;
-	inp.open(filename);
-	if (!inp) {
-		std::cout << "ERROR: failed to open shader file " << filename << std::endl;
-		return 0;
+/* glad leaves the binary entry points NULL on a 3.3 context without the extension */
+static bool programBinaries() {
+#ifdef GL_VERSION_4_1
+	if (GLAD_GL_VERSION_4_1) {
+		return true;
 	}
-
-	std::string temp = "";
-	while (!inp.eof()) {
-		std::getline(inp, temp);
-		fileText.append(temp + "\n");
+#endif
+#ifdef GL_ARB_get_program_binary
+	if (GLAD_GL_ARB_get_program_binary) {
+		return true;
 	}
+#endif
+	return false;
+}
 
-	inp.close();
+std::string shaderCacheDir() {
+	std::filesystem::path base;
+#ifdef _WIN32
+	const char* local = std::getenv("LOCALAPPDATA");
+	if (local && *local) {
+		base = local;
+	}
+#else
+	const char* xdg = std::getenv("XDG_CACHE_HOME");
+	const char* home = std::getenv("HOME");
+	if (xdg && *xdg) {
+		base = xdg;
+	}
+	else if (home && *home) {
+		base = std::filesystem::path(home) / ".cache";
+	}
+#endif
+	if (base.empty()) {
+		std::error_code error;
+		base = std::filesystem::temp_directory_path(error);
+	}
+	return (base / "GBemu" / "shaders").string();
+}
 
-	const char* s = fileText.c_str();
-	glShaderSource(shader, 1, &s, NULL);
+GLuint createShaderFromSource(const GLenum shaderType, const char* source) {
+	GLuint shader = glCreateShader(shaderType);
+	glShaderSource(shader, 1, &source, NULL);
 	glCompileShader(shader);
 
 	int success;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 	if (!success) {
-		std::cout << "ERROR: failed to compile shader from " << filename << std::endl;
+		char log[512] = {};
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		std::cout << "ERROR: failed to compile " << ((shaderType == GL_VERTEX_SHADER) ? "vertex" : "fragment") << " shader: " << log << std::endl;
 	}
 
 	return shader;
@@ -44,6 +71,10 @@ GLuint createShaderProgram(const GLuint* shaderArray, const unsigned int num) {
 		glAttachShader(shaderProgram, shaderArray[i]);
 	}
 
+	/* lets loadShaderProgram() read the binary back */
+	if (programBinaries()) {
+		glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(shaderProgram);
 
 	int success;
@@ -54,3 +85,105 @@ GLuint createShaderProgram(const GLuint* shaderArray, const unsigned int num) {
 
 	return shaderProgram;
 }
+
+static uint64_t cacheKey(const char* vertex, const char* fragment) {
+	std::string key;
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const GLubyte* value = glGetString(name);
+		key += value ? reinterpret_cast<const char*>(value) : "";
+		key += '\n';
+	}
+	key += vertex;
+	key += '\n';
+	key += fragment;
+	return hashFast(key.data(), key.size());
+}
+
+/* false on any mismatch, the caller compiles instead */
+static bool loadBinary(GLuint program, const std::string& filename, uint64_t key) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
+		return false;
+	}
+
+	shaderCacheHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != SHADER_CACHE_MAGIC || header.key != key) {
+		return false;
+	}
+	std::vector<char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (binary.empty()) {
+		return false;
+	}
+
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+	int success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	return success != 0;
+}
+
+static void saveBinary(GLuint program, const std::string& filename, uint64_t key) {
+	int size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0) {
+		return;
+	}
+
+	shaderCacheHeader header;
+	header.magic = SHADER_CACHE_MAGIC;
+	header.key = key;
+	std::vector<char> binary(size);
+	glGetProgramBinary(program, size, NULL, &header.format, binary.data());
+
+	/* a cache that cannot be written only costs the next start its time */
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), error);
+	std::ofstream out(filename, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(binary.data(), binary.size());
+}
+
+GLuint loadShaderProgram(const char* name, const char* vertex, const char* fragment, const char* cacheDir, bool* cached) {
+	if (cached) {
+		*cached = false;
+	}
+
+	/* drivers without binary formats just compile every time */
+	int formats = 0;
+	if (cacheDir && programBinaries()) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	bool useCache = formats > 0;
+
+	uint64_t key = 0;
+	std::string filename;
+	if (useCache) {
+		key = cacheKey(vertex, fragment);
+		filename = (std::filesystem::path(cacheDir) / (std::string(name) + ".bin")).string();
+
+		GLuint program = glCreateProgram();
+		if (loadBinary(program, filename, key)) {
+			if (cached) {
+				*cached = true;
+			}
+			return program;
+		}
+		glDeleteProgram(program);
+	}
+
+	GLuint shaders[2] = { createShaderFromSource(GL_VERTEX_SHADER, vertex), createShaderFromSource(GL_FRAGMENT_SHADER, fragment) };
+	GLuint program = createShaderProgram(shaders, 2);
+	glDeleteShader(shaders[0]);
+	glDeleteShader(shaders[1]);
+
+	int success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	if (useCache) {
+		saveBinary(program, filename, key);
+	}
+	return program;
+}
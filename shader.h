@@ -1,9 +1,28 @@
 #ifndef __SHADER_H__
 #define __SHADER_H__
 
+#include <cstdint>
+#include <cstddef>
+#include <string>
 #include <glad/glad.h>
 
-GLuint createShaderFromFile(const GLenum shaderType, const char* filename);
+#define SHADER_CACHE_MAGIC 0x43534247 //"GBSC"
+
+/*
+program binaries are only valid for the driver that made them, so each
+program's one cache file is keyed by a hash of the vendor, renderer and
+version strings together with the sources. A driver update or an edited
+shader misses the cache, compiles again and overwrites the file
+*/
+struct shaderCacheHeader {
+	uint32_t magic;
+	uint32_t format; //from glGetProgramBinary
+	uint64_t key;
+};
+
+GLuint createShaderFromSource(const GLenum shaderType, const char* source);
 GLuint createShaderProgram(const GLuint* shaderArray, const unsigned int num);
+std::string shaderCacheDir(); //per user: LOCALAPPDATA, XDG_CACHE_HOME or ~/.cache, then the temporary directory
+GLuint loadShaderProgram(const char* name, const char* vertex, const char* fragment, const char* cacheDir, bool* cached = NULL); //0 on failure, cacheDir NULL to always compile
 
-#endif
\ No newline at end of file
+#endif
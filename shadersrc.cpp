@@ -0,0 +1,80 @@
+#include "shadersrc.h"
+
+/* the emulator screen, one textured quad */
+const char* const screenVertexShader = R"glsl(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+
+out vec2 TexCoord;
+
+void main()
+{
+    gl_Position = vec4(aPos, 1.0);
+    TexCoord = aTexCoord;
+})glsl";
+
+const char* const screenFragmentShader = R"glsl(#version 330 core
+out vec4 FragColor;
+in vec3 vertexColor;
+in vec2 TexCoord;
+
+uniform sampler2D tex;
+
+void main()
+{
+   FragColor = texture(tex, TexCoord);
+})glsl";
+
+/* the performance overlay, see hud.h */
+const char* const hudVertexShader = R"glsl(#version 330 core
+uniform vec4 rect; //left, top, right, bottom in normalized device coordinates
+uniform vec2 size; //in HUD pixels
+
+out vec2 hudPos; //HUD pixels from the top left
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1); //triangle strip over the four corners
+    gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);
+    hudPos = corner * size;
+})glsl";
+
+const char* const hudFragmentShader = R"glsl(#version 330 core
+out vec4 FragColor;
+in vec2 hudPos;
+
+uniform sampler2D font; //glyphs side by side, 6x8 each
+uniform usampler2D text; //glyph number per cell
+uniform sampler2D graph; //frame times in ms, a ring
+uniform int head; //oldest frame time in the ring
+uniform int textHeight; //HUD pixels above the graph
+uniform vec2 size;
+uniform float target; //ms of one emulated frame
+
+void main()
+{
+   ivec2 p = ivec2(hudPos);
+   vec4 background = vec4(0.0, 0.0, 0.0, 0.6);
+
+   if (p.y < textHeight) {
+      uint glyph = texelFetch(text, p / ivec2(6, 8), 0).r;
+      float on = texelFetch(font, ivec2(int(glyph) * 6 + p.x % 6, p.y % 8), 0).r;
+      FragColor = mix(background, vec4(1.0), on);
+      return;
+   }
+
+   /* one column per frame, oldest on the left, the top is two frame periods */
+   int width = int(size.x);
+   float ms = texelFetch(graph, ivec2((head + p.x) % width, 0), 0).r;
+   float height = size.y - float(textHeight);
+   float y = (size.y - hudPos.y) / height * 2.0 * target; //ms at this pixel
+   if (abs(y - target) < target / height) {
+      FragColor = vec4(0.5, 0.5, 0.5, 0.8); //the target line
+   }
+   else if (y < ms) {
+      FragColor = (ms > target * 1.2) ? vec4(1.0, 0.3, 0.2, 0.9) : vec4(0.3, 0.9, 0.3, 0.9);
+   }
+   else {
+      FragColor = background;
+   }
+})glsl";
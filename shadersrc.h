@@ -0,0 +1,10 @@
+#ifndef __SHADERSRC_H__
+#define __SHADERSRC_H__
+
+/* GLSL sources compiled into the executable, so it starts from any working directory */
+extern const char* const screenVertexShader;
+extern const char* const screenFragmentShader;
+extern const char* const hudVertexShader;
+extern const char* const hudFragmentShader;
+
+#endif
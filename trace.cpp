@@ -0,0 +1,320 @@
+#include "trace.h"
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+
+size_t traceCompressBound(uint32_t count) {
+	size_t size = static_cast<size_t>(count) * sizeof(traceRecord);
+	return size + size / 128 + 1;
+}
+
+size_t traceCompress(const traceRecord* records, uint32_t count, uint8_t* out) {
+	const uint8_t* raw = reinterpret_cast<const uint8_t*>(records);
+	size_t size = static_cast<size_t>(count) * sizeof(traceRecord);
+	size_t outPos = 0;
+	size_t literalStart = 0;
+	size_t literalLength = 0;
+
+	/* byte i XORed with the same byte of the previous record */
+	auto delta = [&](size_t i) -> uint8_t {
+		return (i < sizeof(traceRecord)) ? raw[i] : (raw[i] ^ raw[i - sizeof(traceRecord)]);
+	};
+
+	auto flushLiterals = [&]() {
+		while (literalLength > 0) {
+			size_t n = (literalLength > 128) ? 128 : literalLength;
+			out[outPos++] = static_cast<uint8_t>(n - 1);
+			for (size_t j = 0; j < n; j++) {
+				out[outPos++] = delta(literalStart + j);
+			}
+			literalStart += n;
+			literalLength -= n;
+		}
+	};
+
+	size_t i = 0;
+	while (i < size) {
+		if (delta(i) != 0) {
+			if (literalLength == 0) {
+				literalStart = i;
+			}
+			literalLength++;
+			i++;
+			continue;
+		}
+
+		size_t run = 0;
+		while (i + run < size && run < 128 && delta(i + run) == 0) {
+			run++;
+		}
+
+		/* short zero runs are cheaper as literals */
+		if (run < 2 && i + run < size) {
+			if (literalLength == 0) {
+				literalStart = i;
+			}
+			literalLength += run;
+			i += run;
+			continue;
+		}
+
+		flushLiterals();
+		out[outPos++] = static_cast<uint8_t>(0x80 | (run - 1));
+		i += run;
+	}
+	flushLiterals();
+
+	return outPos;
+}
+
+bool traceDecompress(const uint8_t* in, size_t size, traceRecord* records, uint32_t count) {
+	uint8_t* raw = reinterpret_cast<uint8_t*>(records);
+	size_t rawSize = static_cast<size_t>(count) * sizeof(traceRecord);
+	size_t inPos = 0;
+	size_t outPos = 0;
+
+	while (inPos < size) {
+		uint8_t control = in[inPos++];
+		size_t n = (control & 0x7F) + 1;
+		if (outPos + n > rawSize) {
+			return false;
+		}
+
+		if (control & 0x80) {
+			memset(&raw[outPos], 0, n);
+		}
+		else {
+			if (inPos + n > size) {
+				return false;
+			}
+			memcpy(&raw[outPos], &in[inPos], n);
+			inPos += n;
+		}
+		outPos += n;
+	}
+
+	if (outPos != rawSize) {
+		return false;
+	}
+
+	/* undo the delta against the previous record */
+	for (size_t i = sizeof(traceRecord); i < rawSize; i++) {
+		raw[i] ^= raw[i - sizeof(traceRecord)];
+	}
+	return true;
+}
+
+traceRing::traceRing(uint32_t id) {
+	this->records = new traceRecord[TRACE_RING_SIZE];
+	this->id = id;
+	this->head = 0;
+	this->tail = 0;
+}
+
+traceRing::~traceRing() {
+	delete[] this->records;
+}
+
+void traceRing::push(const traceRecord& record) {
+	uint64_t h = this->head.load(std::memory_order_relaxed);
+
+	/* only waits when the writer thread has fallen a whole ring behind */
+	while (h - this->tail.load(std::memory_order_acquire) >= TRACE_RING_SIZE) {
+		std::this_thread::yield();
+	}
+
+	this->records[h & (TRACE_RING_SIZE - 1)] = record;
+	this->head.store(h + 1, std::memory_order_release);
+}
+
+bool traceRing::pop(traceRecord& record) {
+	uint64_t t = this->tail.load(std::memory_order_relaxed);
+	if (t == this->head.load(std::memory_order_acquire)) {
+		return false;
+	}
+	record = this->records[t & (TRACE_RING_SIZE - 1)];
+	this->tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+traceRecorder::traceRecorder() {
+	this->file = NULL;
+	this->running = false;
+	this->chunkBuffer = new traceRecord[TRACE_CHUNK];
+	this->compressBuffer = new uint8_t[traceCompressBound(TRACE_CHUNK)];
+	this->bytesWritten = 0;
+	this->recordsWritten = 0;
+}
+
+traceRecorder::~traceRecorder() {
+	this->close();
+
+	for (traceRing* ring : this->rings) {
+		delete ring;
+	}
+	delete[] this->chunkBuffer;
+	delete[] this->compressBuffer;
+}
+
+bool traceRecorder::open(const char* filename) {
+	this->close();
+
+	this->file = fopen(filename, "wb");
+	if (!this->file) {
+		std::cout << "ERROR: failed to open trace file " << filename << std::endl;
+		return false;
+	}
+
+	uint32_t header[3] = { TRACE_MAGIC, TRACE_VERSION, sizeof(traceRecord) };
+	fwrite(header, sizeof(header), 1, this->file);
+	this->bytesWritten = sizeof(header);
+	this->recordsWritten = 0;
+
+	this->running = true;
+	this->writer = std::thread(&traceRecorder::writerLoop, this);
+	return true;
+}
+
+void traceRecorder::close() {
+	/* producers must have stopped pushing before this is called */
+	if (!this->file) {
+		return;
+	}
+
+	this->running = false;
+	this->writer.join();
+
+	fclose(this->file);
+	this->file = NULL;
+}
+
+traceRing* traceRecorder::openRing() {
+	std::lock_guard<std::mutex> lock(this->ringLock);
+	traceRing* ring = new traceRing(static_cast<uint32_t>(this->rings.size()));
+	this->rings.push_back(ring);
+	return ring;
+}
+
+uint64_t traceRecorder::getBytesWritten() {
+	return this->bytesWritten;
+}
+
+uint64_t traceRecorder::getRecordsWritten() {
+	return this->recordsWritten;
+}
+
+bool traceRecorder::drain(traceRing* ring) {
+	traceRecord* chunk = this->chunkBuffer;
+
+	uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+	uint64_t available = ring->head.load(std::memory_order_acquire) - tail;
+	if (available == 0) {
+		return false;
+	}
+
+	uint32_t count = (available > TRACE_CHUNK) ? TRACE_CHUNK : static_cast<uint32_t>(available);
+	for (uint32_t i = 0; i < count; i++) {
+		chunk[i] = ring->records[(tail + i) & (TRACE_RING_SIZE - 1)];
+	}
+	ring->tail.store(tail + count, std::memory_order_release);
+
+	uint32_t size = static_cast<uint32_t>(traceCompress(chunk, count, this->compressBuffer));
+	uint32_t header[3] = { ring->id, count, size };
+	fwrite(header, sizeof(header), 1, this->file);
+	fwrite(this->compressBuffer, 1, size, this->file);
+
+	this->bytesWritten += sizeof(header) + size;
+	this->recordsWritten += count;
+	return true;
+}
+
+void traceRecorder::writerLoop() {
+	while (true) {
+		bool stopping = !this->running;
+		bool busy = false;
+
+		{
+			std::lock_guard<std::mutex> lock(this->ringLock);
+			for (traceRing* ring : this->rings) {
+				while (this->drain(ring)) {
+					busy = true;
+				}
+			}
+		}
+
+		if (stopping) {
+			break; //everything pushed before close() has been written
+		}
+		if (!busy) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+traceReader::traceReader() {
+	this->file = NULL;
+	this->chunkRing = 0;
+	this->chunkCount = 0;
+	this->chunkPos = 0;
+}
+
+traceReader::~traceReader() {
+	if (this->file) {
+		fclose(this->file);
+	}
+}
+
+bool traceReader::open(const char* filename) {
+	this->file = fopen(filename, "rb");
+	if (!this->file) {
+		std::cout << "ERROR: failed to open trace file " << filename << std::endl;
+		return false;
+	}
+
+	uint32_t header[3];
+	if (fread(header, sizeof(header), 1, this->file) != 1 || header[0] != TRACE_MAGIC ||
+		header[1] != TRACE_VERSION || header[2] != sizeof(traceRecord)) {
+		std::cout << "ERROR: " << filename << " is not a compatible trace file" << std::endl;
+		fclose(this->file);
+		this->file = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+bool traceReader::nextChunk() {
+	uint32_t header[3];
+	if (!this->file || fread(header, sizeof(header), 1, this->file) != 1) {
+		return false;
+	}
+	if (header[1] == 0 || header[1] > TRACE_CHUNK) {
+		std::cout << "ERROR: corrupt trace chunk" << std::endl;
+		return false;
+	}
+
+	this->payload.resize(header[2]);
+	if (header[2] > 0 && fread(this->payload.data(), 1, header[2], this->file) != header[2]) {
+		return false;
+	}
+	if (!traceDecompress(this->payload.data(), header[2], this->chunk, header[1])) {
+		std::cout << "ERROR: corrupt trace chunk" << std::endl;
+		return false;
+	}
+
+	this->chunkRing = header[0];
+	this->chunkCount = header[1];
+	this->chunkPos = 0;
+	return true;
+}
+
+bool traceReader::next(traceRecord& record, uint32_t& ring) {
+	if (this->chunkPos == this->chunkCount && !this->nextChunk()) {
+		return false;
+	}
+
+	record = this->chunk[this->chunkPos++];
+	ring = this->chunkRing;
+	return true;
+}
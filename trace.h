@@ -0,0 +1,112 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+#define TRACE_EXEC 0 //instruction fetch, registers are valid
+#define TRACE_READ 1 //bus read, only address and data are valid
+#define TRACE_WRITE 2 //bus write
+
+#define TRACE_MAGIC 0x52544247 //"GBTR"
+#define TRACE_VERSION 1
+#define TRACE_RING_SIZE 65536 //records per ring, power of 2
+#define TRACE_CHUNK 4096 //records compressed together by the writer
+
+struct traceRecord {
+	uint8_t type;
+	uint8_t opcode;
+	uint16_t PC;
+	uint16_t AF;
+	uint16_t BC;
+	uint16_t DE;
+	uint16_t HL;
+	uint16_t SP;
+	uint16_t address;
+	uint8_t data;
+	uint8_t pad[7];
+	uint64_t cycle; //machine cycles since power on
+};
+
+static_assert(sizeof(traceRecord) == 32, "trace records must stay fixed size");
+
+/*
+file layout:
+header: magic, version, record size (uint32 each)
+chunks: ring id, record count, compressed size (uint32 each), then the payload
+
+each payload is the chunk's records XORed with the record before them and
+packed with a zero run length code, so unchanged registers cost almost nothing
+*/
+
+size_t traceCompress(const traceRecord* records, uint32_t count, uint8_t* out);
+bool traceDecompress(const uint8_t* in, size_t size, traceRecord* records, uint32_t count);
+size_t traceCompressBound(uint32_t count);
+
+/* single producer, single consumer ring owned by one emulation thread */
+class traceRing {
+	friend class traceRecorder;
+
+	private:
+		traceRecord* records;
+		uint32_t id;
+
+		alignas(64) std::atomic<uint64_t> head; //written by the producer
+		alignas(64) std::atomic<uint64_t> tail; //written by the writer thread
+
+	public:
+		traceRing(uint32_t id);
+		~traceRing();
+		void push(const traceRecord& record);
+		bool pop(traceRecord& record); //consumer side when no recorder owns the ring, false when empty
+};
+
+class traceRecorder {
+	private:
+		FILE* file;
+		std::vector<traceRing*> rings;
+		std::mutex ringLock;
+		std::thread writer;
+		std::atomic<bool> running;
+
+		traceRecord* chunkBuffer; //TRACE_CHUNK records, only touched by this recorder's writer thread
+		uint8_t* compressBuffer;
+		uint64_t bytesWritten;
+		uint64_t recordsWritten;
+
+		bool drain(traceRing* ring);
+		void writerLoop();
+
+	public:
+		traceRecorder();
+		~traceRecorder();
+		bool open(const char* filename);
+		void close();
+		traceRing* openRing(); //call once from each thread that runs a CPU
+		uint64_t getBytesWritten();
+		uint64_t getRecordsWritten();
+};
+
+class traceReader {
+	private:
+		FILE* file;
+		std::vector<uint8_t> payload;
+		traceRecord chunk[TRACE_CHUNK];
+		uint32_t chunkRing;
+		uint32_t chunkCount;
+		uint32_t chunkPos;
+
+		bool nextChunk();
+
+	public:
+		traceReader();
+		~traceReader();
+		bool open(const char* filename);
+		bool next(traceRecord& record, uint32_t& ring);
+};
+
+#endif
@@ -1,5 +1,13 @@
 #include "utils.h"
 
+#include <cstring>
+
+#define XXH_PRIME1 11400714785074694791ULL
+#define XXH_PRIME2 14029467366897019727ULL
+#define XXH_PRIME3 1609587929392839161ULL
+#define XXH_PRIME4 9650029242287828579ULL
+#define XXH_PRIME5 2870177450012600261ULL
+
 uint8_t getBit(uint64_t n, uint8_t i) {
 	return static_cast<uint8_t>((n >> i) & 0x1);
 }
@@ -13,4 +21,82 @@ uint64_t setBit(uint64_t n, uint8_t i, uint8_t state) {
 	}
 
 	return n;
-}
\ No newline at end of file
+}
+
+uint64_t hashBytes(const void* data, size_t length, uint64_t hash) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static inline uint64_t rotateLeft(uint64_t n, int bits) {
+	return (n << bits) | (n >> (64 - bits));
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+	uint64_t n;
+	memcpy(&n, p, sizeof(n)); //little endian hosts only, like the file formats
+	return n;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+	acc += input * XXH_PRIME2;
+	acc = rotateLeft(acc, 31);
+	return acc * XXH_PRIME1;
+}
+
+static inline uint64_t xxhMerge(uint64_t acc, uint64_t lane) {
+	acc ^= xxhRound(0, lane);
+	return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+uint64_t hashFast(const void* data, size_t length, uint64_t seed) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* end = p + length;
+	uint64_t hash;
+
+	if (length >= 32) {
+		/* the lanes do not depend on each other, so their multiplies overlap */
+		uint64_t lane[4] = { seed + XXH_PRIME1 + XXH_PRIME2, seed + XXH_PRIME2, seed, seed - XXH_PRIME1 };
+		for (; p + 32 <= end; p += 32) {
+			lane[0] = xxhRound(lane[0], read64(p));
+			lane[1] = xxhRound(lane[1], read64(p + 8));
+			lane[2] = xxhRound(lane[2], read64(p + 16));
+			lane[3] = xxhRound(lane[3], read64(p + 24));
+		}
+		hash = rotateLeft(lane[0], 1) + rotateLeft(lane[1], 7) + rotateLeft(lane[2], 12) + rotateLeft(lane[3], 18);
+		for (int i = 0; i < 4; i++) {
+			hash = xxhMerge(hash, lane[i]);
+		}
+	}
+	else {
+		hash = seed + XXH_PRIME5;
+	}
+	hash += length;
+
+	for (; p + 8 <= end; p += 8) {
+		hash ^= xxhRound(0, read64(p));
+		hash = rotateLeft(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+	}
+	if (p + 4 <= end) {
+		uint32_t word;
+		memcpy(&word, p, sizeof(word));
+		hash ^= word * XXH_PRIME1;
+		hash = rotateLeft(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		hash ^= *p * XXH_PRIME5;
+		hash = rotateLeft(hash, 11) * XXH_PRIME1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
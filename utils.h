@@ -2,9 +2,24 @@
 #define __UTILS_H__
 
 #include <cstdint>
+#include <cstddef>
+
+/* keeps rarely taken paths (tracing, debugging) out of gbcpu::tick() */
+#if defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
 
 uint8_t getBit(uint64_t n, uint8_t i);
 
 uint64_t setBit(uint64_t n, uint8_t i, uint8_t state);
 
+/* 64 bit FNV-1a, chain calls by passing the previous result */
+#define HASH_SEED 14695981039346656037ULL
+uint64_t hashBytes(const void* data, size_t length, uint64_t hash = HASH_SEED);
+
+/* XXH64, four independent lanes of 8 bytes, for hashing whole frames quickly */
+uint64_t hashFast(const void* data, size_t length, uint64_t seed = 0);
+
 #endif
\ No newline at end of file